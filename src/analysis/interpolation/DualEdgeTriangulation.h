@@ -106,6 +106,12 @@ class ANALYSIS_EXPORT DualEdgeTriangulation: public Triangulation
     /**Saves the triangulation as a (line) shapefile
     @return true in case of success*/
     virtual bool saveAsShapefile( const QString& fileName ) const;
+    /**Returns the number of the half edge, from which the search for the triangle of the next point starts. It is the edge of the last found triangle*/
+    //! @note added in 2.4
+    int walkStartEdge() const { return mEdgeInside; }
+    /**Sets the half edge, from which the search for the triangle of the next point starts. This lets e.g. a raster start a row from the triangle of the previous row instead of the last cell*/
+    //! @note added in 2.4
+    void setWalkStartEdge( int edge );
 
   protected:
     /**X-coordinate of the upper right corner of the bounding box*/
@@ -122,8 +128,8 @@ class ANALYSIS_EXPORT DualEdgeTriangulation: public Triangulation
     QVector<Point3D*> mPointVector;
     /**Default value for the number of storable HalfEdges at the beginning*/
     const static unsigned int mDefaultStorageForHalfEdges = 300006;
-    /**Stores pointers to the HalfEdges*/
-    QVector<HalfEdge*> mHalfEdge;
+    /**Stores the HalfEdges. They are kept by value in one block of memory, edges refer to each other by their index*/
+    QVector<HalfEdge> mHalfEdge;
     /**Association to an interpolator object*/
     TriangleInterpolator* mTriangleInterpolator;
     /**Member to store the behaviour in case of crossing forced segments*/
@@ -226,9 +232,17 @@ inline Point3D* DualEdgeTriangulation::getPoint( unsigned int i ) const
   return mPointVector.at( i );
 }
 
+inline void DualEdgeTriangulation::setWalkStartEdge( int edge )
+{
+  if ( edge >= 0 && edge < mHalfEdge.count() && mHalfEdge[edge].getPoint() != -1 )
+  {
+    mEdgeInside = edge;
+  }
+}
+
 inline bool DualEdgeTriangulation::halfEdgeBBoxTest( int edge, double xlowleft, double ylowleft, double xupright, double yupright ) const
 {
-  return (( getPoint( mHalfEdge[edge]->getPoint() )->getX() >= xlowleft && getPoint( mHalfEdge[edge]->getPoint() )->getX() <= xupright && getPoint( mHalfEdge[edge]->getPoint() )->getY() >= ylowleft && getPoint( mHalfEdge[edge]->getPoint() )->getY() <= yupright ) || ( getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getX() >= xlowleft && getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getX() <= xupright && getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getY() >= ylowleft && getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getY() <= yupright ) );
+  return (( getPoint( mHalfEdge[edge].getPoint() )->getX() >= xlowleft && getPoint( mHalfEdge[edge].getPoint() )->getX() <= xupright && getPoint( mHalfEdge[edge].getPoint() )->getY() >= ylowleft && getPoint( mHalfEdge[edge].getPoint() )->getY() <= yupright ) || ( getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getX() >= xlowleft && getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getX() <= xupright && getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getY() >= ylowleft && getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getY() <= yupright ) );
 }
 
 #endif
@@ -17,6 +17,8 @@
 #ifndef HALFEDGE_H
 #define HALFEDGE_H
 
+#include <QtGlobal>
+
 class ANALYSIS_EXPORT HalfEdge
 {
   protected:
@@ -123,4 +125,7 @@ inline void HalfEdge::setForced( bool f )
   mForced = f;
 }
 
+//the half edges are stored by value, this lets QVector move them with memcpy
+Q_DECLARE_TYPEINFO( HalfEdge, Q_MOVABLE_TYPE );
+
 #endif
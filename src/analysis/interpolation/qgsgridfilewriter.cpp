@@ -17,19 +17,75 @@
 
 #include "qgsgridfilewriter.h"
 #include "qgsinterpolator.h"
+#include "qgslogger.h"
 #include "qgsvectorlayer.h"
+#include "gdal.h"
+#include "cpl_string.h"
 #include <QFile>
 #include <QFileInfo>
 #include <QProgressDialog>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#define NO_DATA -9999
+
+//number of rows interpolated by a thread in one task
+#define ROWS_PER_TASK 4
+
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
+#define TO8F(x) (x).toUtf8().constData()
+#else
+#define TO8F(x) QFile::encodeName( x ).constData()
+#endif
+
+//! consecutive rows of the grid
+struct GfwRows
+{
+  int firstRow;
+  int rowCount;
+};
+
+//! interpolates the values of rows, nodata if the interpolator fails
+struct GfwInterpolateRows
+{
+  typedef QVector<double> result_type;
+
+  GfwInterpolateRows( QgsInterpolator* interpolator, const QgsRectangle& extent, int nCols, double cellSizeX, double cellSizeY )
+      : mInterpolator( interpolator ), mExtent( extent ), mNumColumns( nCols ), mCellSizeX( cellSizeX ), mCellSizeY( cellSizeY )
+  {}
+
+  QVector<double> operator()( const GfwRows& rows ) const
+  {
+    QVector<double> values( rows.rowCount * mNumColumns );
+    double* value = values.data();
+    double interpolatedValue;
+    for ( int i = rows.firstRow; i < rows.firstRow + rows.rowCount; ++i )
+    {
+      double currentYValue = mExtent.yMaximum() - mCellSizeY / 2.0 - i * mCellSizeY; //calculate value in the center of the cell
+      for ( int j = 0; j < mNumColumns; ++j )
+      {
+        double currentXValue = mExtent.xMinimum() + mCellSizeX / 2.0 + j * mCellSizeX;
+        *value++ = mInterpolator->interpolatePoint( currentXValue, currentYValue, interpolatedValue ) == 0 ? interpolatedValue : NO_DATA;
+      }
+    }
+    return values;
+  }
+
+  QgsInterpolator* mInterpolator;
+  QgsRectangle mExtent;
+  int mNumColumns;
+  double mCellSizeX;
+  double mCellSizeY;
+};
 
 QgsGridFileWriter::QgsGridFileWriter( QgsInterpolator* i, QString outputPath, QgsRectangle extent, int nCols, int nRows , double cellSizeX, double cellSizeY )
     : mInterpolator( i ), mOutputFilePath( outputPath ), mInterpolationExtent( extent ), mNumColumns( nCols ), mNumRows( nRows )
-    , mCellSizeX( cellSizeX ), mCellSizeY( cellSizeY )
+    , mCellSizeX( cellSizeX ), mCellSizeY( cellSizeY ), mMaxThreads( 0 )
 {
 
 }
 
-QgsGridFileWriter::QgsGridFileWriter(): mInterpolator( 0 )
+QgsGridFileWriter::QgsGridFileWriter(): mInterpolator( 0 ), mMaxThreads( 0 )
 {
 
 }
@@ -41,26 +97,52 @@ QgsGridFileWriter::~QgsGridFileWriter()
 
 int QgsGridFileWriter::writeFile( bool showProgressDialog )
 {
-  QFile outputFile( mOutputFilePath );
-
-  if ( !outputFile.open( QFile::WriteOnly ) )
-  {
-    return 1;
-  }
-
   if ( !mInterpolator )
   {
-    outputFile.remove();
     return 2;
   }
 
-  QTextStream outStream( &outputFile );
-  outStream.setRealNumberPrecision( 8 );
-  writeHeader( outStream );
+  QString crs;
+  if ( !mInterpolator->layerData().isEmpty() && mInterpolator->layerData().first().vectorLayer )
+  {
+    crs = mInterpolator->layerData().first().vectorLayer->crs().toWkt();
+  }
 
-  double currentYValue = mInterpolationExtent.yMaximum() - mCellSizeY / 2.0; //calculate value in the center of the cell
-  double currentXValue;
-  double interpolatedValue;
+  //open the output, either an ascii grid or a GDAL dataset
+  QFile outputFile( mOutputFilePath );
+  QTextStream outStream;
+  GDALDriverH outputDriver = 0;
+  GDALDatasetH outputDataset = 0;
+  GDALRasterBandH outputBand = 0;
+  if ( mOutputFormat.isEmpty() )
+  {
+    if ( !outputFile.open( QFile::WriteOnly ) )
+    {
+      return 1;
+    }
+    outStream.setDevice( &outputFile );
+    outStream.setRealNumberPrecision( 8 );
+    writeHeader( outStream );
+  }
+  else
+  {
+    GDALAllRegister();
+    outputDriver = GDALGetDriverByName( mOutputFormat.toLocal8Bit().data() );
+    if ( !outputDriver || !CSLFetchBoolean( GDALGetMetadata( outputDriver, NULL ), GDAL_DCAP_CREATE, false ) )
+    {
+      return 1;
+    }
+    outputDataset = GDALCreate( outputDriver, TO8F( mOutputFilePath ), mNumColumns, mNumRows, 1, GDT_Float32, NULL );
+    if ( !outputDataset )
+    {
+      return 1;
+    }
+    double geoTransform[6] = { mInterpolationExtent.xMinimum(), mCellSizeX, 0, mInterpolationExtent.yMaximum(), 0, -mCellSizeY };
+    GDALSetGeoTransform( outputDataset, geoTransform );
+    GDALSetProjection( outputDataset, crs.toLocal8Bit().data() );
+    outputBand = GDALGetRasterBand( outputDataset, 1 );
+    GDALSetRasterNoDataValue( outputBand, NO_DATA );
+  }
 
   QProgressDialog* progressDialog = 0;
   if ( showProgressDialog )
@@ -69,40 +151,106 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
     progressDialog->setWindowModality( Qt::WindowModal );
   }
 
-  for ( int i = 0; i < mNumRows; ++i )
+  //the first value is interpolated on this thread, it lets the interpolator cache its base data
+  int threads = mMaxThreads > 0 ? mMaxThreads : QThreadPool::globalInstance()->maxThreadCount();
+  if ( !mInterpolator->supportsParallelInterpolation() )
+  {
+    threads = 1;
+  }
+  else if ( threads > 1 )
+  {
+    double interpolatedValue;
+    mInterpolator->interpolatePoint( mInterpolationExtent.xMinimum() + mCellSizeX / 2.0, mInterpolationExtent.yMaximum() - mCellSizeY / 2.0, interpolatedValue );
+  }
+
+  //the rows are interpolated in batches of one task per thread and written in order
+  GfwInterpolateRows interpolateRows( mInterpolator, mInterpolationExtent, mNumColumns, mCellSizeX, mCellSizeY );
+  bool canceled = false;
+  int row = 0;
+  while ( row < mNumRows && !canceled )
   {
-    currentXValue = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
-    for ( int j = 0; j < mNumColumns; ++j )
+    QList<GfwRows> tasks;
+    for ( int i = 0; i < threads && row < mNumRows; ++i )
+    {
+      GfwRows rows;
+      rows.firstRow = row;
+      rows.rowCount = qMin( ROWS_PER_TASK, mNumRows - row );
+      tasks << rows;
+      row += rows.rowCount;
+    }
+
+    QList< QVector<double> > results;
+    if ( tasks.size() > 1 )
+    {
+      results = QtConcurrent::blockingMapped( tasks, interpolateRows );
+    }
+    else
     {
-      if ( mInterpolator->interpolatePoint( currentXValue, currentYValue, interpolatedValue ) == 0 )
+      results << interpolateRows( tasks.first() );
+    }
+
+    for ( int i = 0; i < tasks.size(); ++i )
+    {
+      const QVector<double>& values = results.at( i );
+      if ( outputDataset )
       {
-        outStream << interpolatedValue << " ";
+        if ( GDALRasterIO( outputBand, GF_Write, 0, tasks.at( i ).firstRow, mNumColumns, tasks.at( i ).rowCount,
+                           const_cast<double*>( values.constData() ), mNumColumns, tasks.at( i ).rowCount, GDT_Float64, 0, 0 ) != CE_None )
+        {
+          QgsDebugMsg( "Raster IO Error" );
+        }
+        continue;
       }
-      else
+
+      for ( int j = 0; j < values.size(); ++j )
       {
-        outStream << "-9999 ";
+        if ( values.at( j ) == NO_DATA )
+        {
+          outStream << "-9999 ";
+        }
+        else
+        {
+          outStream << values.at( j ) << " ";
+        }
+        if (( j + 1 ) % mNumColumns == 0 )
+        {
+          outStream << endl;
+        }
       }
-      currentXValue += mCellSizeX;
     }
-    outStream << endl;
-    currentYValue -= mCellSizeY;
 
     if ( showProgressDialog )
     {
       if ( progressDialog->wasCanceled() )
       {
-        outputFile.remove();
-        return 3;
+        canceled = true;
       }
-      progressDialog->setValue( i );
+      progressDialog->setValue( row );
     }
   }
 
+  delete progressDialog;
+
+  if ( outputDataset )
+  {
+    GDALClose( outputDataset );
+    if ( canceled )
+    {
+      GDALDeleteDataset( outputDriver, TO8F( mOutputFilePath ) );
+      return 3;
+    }
+    return 0;
+  }
+
+  outStream.flush();
+  outputFile.close();
+  if ( canceled )
+  {
+    outputFile.remove();
+    return 3;
+  }
+
   // create prj file
-  QgsInterpolator::LayerData ld;
-  ld = mInterpolator->layerData().first();
-  QgsVectorLayer* vl = ld.vectorLayer;
-  QString crs = vl->crs().toWkt();
   QFileInfo fi( mOutputFilePath );
   QString fileName = fi.absolutePath() + "/" + fi.completeBaseName() + ".prj";
   QFile prjFile( fileName );
@@ -115,7 +263,6 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
   prjStream << endl;
   prjFile.close();
 
-  delete progressDialog;
   return 0;
 }
 
@@ -24,14 +24,26 @@
 
 class QgsInterpolator;
 
-/**A class that does interpolation to a grid and writes the results to an ascii grid*/
-//todo: extend such that writing to other file types is possible
+/**A class that does interpolation to a grid and writes the results to an ascii grid
+  or to a raster format supported by GDAL. If the interpolator supports it, several
+  rows are interpolated at the same time*/
 class ANALYSIS_EXPORT QgsGridFileWriter
 {
   public:
     QgsGridFileWriter( QgsInterpolator* i, QString outputPath, QgsRectangle extent, int nCols, int nRows, double cellSizeX, double cellSizeY );
     ~QgsGridFileWriter();
 
+    /**Sets the GDAL driver used for the output file, e.g. "GTiff". The driver needs
+      to support the creation of files. An empty name (the default) writes an ascii grid
+      @note added in 2.4 */
+    void setOutputFormat( const QString& driverName ) { mOutputFormat = driverName; }
+    QString outputFormat() const { return mOutputFormat; }
+
+    /**Number of threads interpolating rows, 0 to use the size of the global thread pool
+      @note added in 2.4 */
+    void setMaxThreads( int threads ) { mMaxThreads = threads; }
+    int maxThreads() const { return mMaxThreads; }
+
     /**Writes the grid file.
      @param showProgressDialog shows a dialog with the possibility to cancel
     @return 0 in case of success*/
@@ -51,6 +63,9 @@ class ANALYSIS_EXPORT QgsGridFileWriter
 
     double mCellSizeX;
     double mCellSizeY;
+
+    QString mOutputFormat;
+    int mMaxThreads;
 };
 
 #endif
@@ -16,15 +16,25 @@
  ***************************************************************************/
 
 #include "qgsidwinterpolator.h"
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <utility>
+#include <vector>
+
+//average number of points in a cell of the grid index
+#define POINTS_PER_CELL 2.0
 
 QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData ): QgsInterpolator( layerData ), mDistanceCoefficient( 2.0 )
+    , mMaxNeighbours( 0 ), mSearchRadius( 0.0 ), mIndexBuilt( false ), mIndexXMin( 0.0 ), mIndexYMin( 0.0 ), mIndexCellSize( 1.0 )
+    , mIndexColumns( 0 ), mIndexRows( 0 )
 {
 
 }
 
 QgsIDWInterpolator::QgsIDWInterpolator(): QgsInterpolator( QList<LayerData>() ), mDistanceCoefficient( 2.0 )
+    , mMaxNeighbours( 0 ), mSearchRadius( 0.0 ), mIndexBuilt( false ), mIndexXMin( 0.0 ), mIndexYMin( 0.0 ), mIndexCellSize( 1.0 )
+    , mIndexColumns( 0 ), mIndexRows( 0 )
 {
 
 }
@@ -47,19 +57,47 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
   double sumCounter = 0;
   double sumDenominator = 0;
 
-  QVector<vertexData>::iterator vertex_it = mCachedBaseData.begin();
+  if ( mMaxNeighbours <= 0 && mSearchRadius <= 0 )
+  {
+    QVector<vertexData>::const_iterator vertex_it = mCachedBaseData.constBegin();
 
-  for ( ; vertex_it != mCachedBaseData.end(); ++vertex_it )
+    for ( ; vertex_it != mCachedBaseData.constEnd(); ++vertex_it )
+    {
+      distance = sqrt(( vertex_it->x - x ) * ( vertex_it->x - x ) + ( vertex_it->y - y ) * ( vertex_it->y - y ) );
+      if (( distance - 0 ) < std::numeric_limits<double>::min() )
+      {
+        result = vertex_it->z;
+        return 0;
+      }
+      currentWeight = 1 / ( pow( distance, mDistanceCoefficient ) );
+      sumCounter += ( currentWeight * vertex_it->z );
+      sumDenominator += currentWeight;
+    }
+  }
+  else
   {
-    distance = sqrt(( vertex_it->x - x ) * ( vertex_it->x - x ) + ( vertex_it->y - y ) * ( vertex_it->y - y ) );
-    if (( distance - 0 ) < std::numeric_limits<double>::min() )
+    if ( !mIndexBuilt )
+    {
+      buildIndex();
+    }
+
+    QVector<int> points;
+    nearestPoints( x, y, points );
+
+    QVector<int>::const_iterator point_it = points.constBegin();
+    for ( ; point_it != points.constEnd(); ++point_it )
     {
-      result = vertex_it->z;
-      return 0;
+      const vertexData& vertex = mCachedBaseData.at( *point_it );
+      distance = sqrt(( vertex.x - x ) * ( vertex.x - x ) + ( vertex.y - y ) * ( vertex.y - y ) );
+      if (( distance - 0 ) < std::numeric_limits<double>::min() )
+      {
+        result = vertex.z;
+        return 0;
+      }
+      currentWeight = 1 / ( pow( distance, mDistanceCoefficient ) );
+      sumCounter += ( currentWeight * vertex.z );
+      sumDenominator += currentWeight;
     }
-    currentWeight = 1 / ( pow( distance, mDistanceCoefficient ) );
-    sumCounter += ( currentWeight * vertex_it->z );
-    sumDenominator += currentWeight;
   }
 
   if ( sumDenominator == 0.0 )
@@ -70,3 +108,154 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
   result = sumCounter / sumDenominator;
   return 0;
 }
+
+void QgsIDWInterpolator::buildIndex()
+{
+  mIndexBuilt = true;
+  mIndexCellStart.clear();
+  mIndexPoints.clear();
+  mIndexColumns = 0;
+  mIndexRows = 0;
+
+  int nPoints = mCachedBaseData.size();
+  if ( nPoints < 1 )
+  {
+    return;
+  }
+
+  double xMin = mCachedBaseData.at( 0 ).x;
+  double xMax = xMin;
+  double yMin = mCachedBaseData.at( 0 ).y;
+  double yMax = yMin;
+  for ( int i = 1; i < nPoints; ++i )
+  {
+    const vertexData& v = mCachedBaseData.at( i );
+    xMin = qMin( xMin, v.x );
+    xMax = qMax( xMax, v.x );
+    yMin = qMin( yMin, v.y );
+    yMax = qMax( yMax, v.y );
+  }
+
+  //square cells with a few points each. The lower limit keeps the number of cells
+  //in the order of the number of points for points on a line
+  double width = xMax - xMin;
+  double height = yMax - yMin;
+  double cellSize = qMax( sqrt( width * height * POINTS_PER_CELL / nPoints ), qMax( width, height ) * POINTS_PER_CELL / nPoints );
+  if ( cellSize <= 0 )
+  {
+    cellSize = 1.0;
+  }
+
+  mIndexXMin = xMin;
+  mIndexYMin = yMin;
+  mIndexCellSize = cellSize;
+  mIndexColumns = ( int )( width / cellSize ) + 1;
+  mIndexRows = ( int )( height / cellSize ) + 1;
+
+  //count the points per cell, then place the point indices at the cell offsets
+  QVector<int> pointCells( nPoints );
+  mIndexCellStart.fill( 0, mIndexColumns * mIndexRows + 1 );
+  for ( int i = 0; i < nPoints; ++i )
+  {
+    const vertexData& v = mCachedBaseData.at( i );
+    int column = qMin(( int )(( v.x - xMin ) / cellSize ), mIndexColumns - 1 );
+    int row = qMin(( int )(( v.y - yMin ) / cellSize ), mIndexRows - 1 );
+    pointCells[i] = row * mIndexColumns + column;
+    ++mIndexCellStart[pointCells[i] + 1];
+  }
+  for ( int i = 1; i < mIndexCellStart.size(); ++i )
+  {
+    mIndexCellStart[i] += mIndexCellStart[i - 1];
+  }
+
+  QVector<int> cellFill = mIndexCellStart;
+  mIndexPoints.resize( nPoints );
+  for ( int i = 0; i < nPoints; ++i )
+  {
+    mIndexPoints[cellFill[pointCells[i]]++] = i;
+  }
+}
+
+void QgsIDWInterpolator::nearestPoints( double x, double y, QVector<int>& points ) const
+{
+  points.clear();
+  if ( mIndexColumns < 1 || mIndexRows < 1 )
+  {
+    return;
+  }
+
+  //the cells are visited in rings around the cell of the point. All points outside of
+  //ring r are at least r cell sizes away, which ends the search once enough points are found
+  int centerColumn = ( int ) floor(( x - mIndexXMin ) / mIndexCellSize );
+  int centerRow = ( int ) floor(( y - mIndexYMin ) / mIndexCellSize );
+  int firstRing = qMax( qMax( -centerColumn, centerColumn - mIndexColumns + 1 ), qMax( -centerRow, centerRow - mIndexRows + 1 ) );
+  firstRing = qMax( firstRing, 0 );
+  int lastRing = qMax( qMax( centerColumn, mIndexColumns - 1 - centerColumn ), qMax( centerRow, mIndexRows - 1 - centerRow ) );
+
+  double radius2 = mSearchRadius * mSearchRadius;
+
+  //max heap of the squared distances of the nearest points
+  std::vector< std::pair<double, int> > candidates;
+
+  for ( int ring = firstRing; ring <= lastRing; ++ring )
+  {
+    double ringDistance = ( ring - 1 ) * mIndexCellSize;
+    if ( mSearchRadius > 0 && ringDistance > mSearchRadius )
+    {
+      break;
+    }
+    if ( mMaxNeighbours > 0 && ( int ) candidates.size() == mMaxNeighbours && ringDistance > 0 && candidates.front().first <= ringDistance * ringDistance )
+    {
+      break;
+    }
+
+    int rowMin = qMax( centerRow - ring, 0 );
+    int rowMax = qMin( centerRow + ring, mIndexRows - 1 );
+    for ( int row = rowMin; row <= rowMax; ++row )
+    {
+      //the rows on the border of the ring are complete, the others only have the first and the last cell
+      bool fullRow = ( row == centerRow - ring || row == centerRow + ring );
+      int columnStep = fullRow || ring == 0 ? 1 : 2 * ring;
+      int columnMin = fullRow ? qMax( centerColumn - ring, 0 ) : centerColumn - ring;
+      int columnMax = fullRow ? qMin( centerColumn + ring, mIndexColumns - 1 ) : centerColumn + ring;
+      for ( int column = columnMin; column <= columnMax; column += columnStep )
+      {
+        if ( column < 0 || column >= mIndexColumns )
+        {
+          continue;
+        }
+
+        int cell = row * mIndexColumns + column;
+        for ( int i = mIndexCellStart.at( cell ); i < mIndexCellStart.at( cell + 1 ); ++i )
+        {
+          int pointIndex = mIndexPoints.at( i );
+          const vertexData& v = mCachedBaseData.at( pointIndex );
+          double distance2 = ( v.x - x ) * ( v.x - x ) + ( v.y - y ) * ( v.y - y );
+          if ( mSearchRadius > 0 && distance2 > radius2 )
+          {
+            continue;
+          }
+
+          if ( mMaxNeighbours <= 0 || ( int ) candidates.size() < mMaxNeighbours )
+          {
+            candidates.push_back( std::make_pair( distance2, pointIndex ) );
+            std::push_heap( candidates.begin(), candidates.end() );
+          }
+          else if ( distance2 < candidates.front().first )
+          {
+            std::pop_heap( candidates.begin(), candidates.end() );
+            candidates.back() = std::make_pair( distance2, pointIndex );
+            std::push_heap( candidates.begin(), candidates.end() );
+          }
+        }
+      }
+    }
+  }
+
+  std::sort_heap( candidates.begin(), candidates.end() );
+  points.reserve( candidates.size() );
+  for ( unsigned int i = 0; i < candidates.size(); ++i )
+  {
+    points.append( candidates[i].second );
+  }
+}
@@ -20,6 +20,10 @@
 
 #include "qgsinterpolator.h"
 
+/**Inverse distance weighting interpolator. By default every base point contributes
+  to every interpolated value. If a maximum number of neighbours or a search radius
+  is set, only the nearest points are used, which are looked up in a regular grid
+  index built together with the cached base data.*/
 class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
 {
   public:
@@ -33,16 +37,51 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
        @return 0 in case of success*/
     int interpolatePoint( double x, double y, double& result );
 
+    /**The index is only read by interpolatePoint once the base data is cached
+      @note added in 2.4 */
+    bool supportsParallelInterpolation() const { return true; }
+
     void setDistanceCoefficient( double p ) {mDistanceCoefficient = p;}
 
+    /**Maximum number of nearest points used for a value, 0 to use all points
+      @note added in 2.4 */
+    void setMaxNeighbours( int n ) { mMaxNeighbours = n; }
+    int maxNeighbours() const { return mMaxNeighbours; }
+
+    /**Only points closer than the radius are used for a value, 0 for no limit.
+      Cells without points in the radius are not interpolated.
+      @note added in 2.4 */
+    void setSearchRadius( double radius ) { mSearchRadius = radius; }
+    double searchRadius() const { return mSearchRadius; }
+
   private:
 
     QgsIDWInterpolator(); //forbidden
 
+    /**Sorts the cached points into the cells of the grid index*/
+    void buildIndex();
+
+    /**Collects the indices of the points used for the value at x, y from the
+      cells around the point, nearest points first*/
+    void nearestPoints( double x, double y, QVector<int>& points ) const;
+
     /**The parameter that sets how the values are weighted with distance.
        Smaller values mean sharper peaks at the data points. The default is a
        value of 2*/
     double mDistanceCoefficient;
+
+    int mMaxNeighbours;
+    double mSearchRadius;
+
+    //grid index of the cached points: the points of cell i are mIndexPoints[mIndexCellStart[i]] to mIndexPoints[mIndexCellStart[i+1] - 1]
+    bool mIndexBuilt;
+    double mIndexXMin;
+    double mIndexYMin;
+    double mIndexCellSize;
+    int mIndexColumns;
+    int mIndexRows;
+    QVector<int> mIndexCellStart;
+    QVector<int> mIndexPoints;
 };
 
 #endif
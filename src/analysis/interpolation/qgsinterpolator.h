@@ -64,6 +64,11 @@ class ANALYSIS_EXPORT QgsInterpolator
        @return 0 in case of success*/
     virtual int interpolatePoint( double x, double y, double& result ) = 0;
 
+    /**Returns true if interpolatePoint may be called from several threads at the same
+      time once it has been called for a first point
+      @note added in 2.4 */
+    virtual bool supportsParallelInterpolation() const { return false; }
+
     const QList<LayerData>& layerData() const { return mLayerData; }
 
   protected:
@@ -23,17 +23,48 @@
 #include "Point3D.h"
 #include "qgsfeature.h"
 #include "qgsgeometry.h"
+#include "qgsmessagelog.h"
 #include "qgsvectorlayer.h"
 #include <QProgressDialog>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+//! distance of a point along a Hilbert curve through a 65536 x 65536 grid
+static quint32 hilbertIndex( quint32 x, quint32 y )
+{
+  const quint32 n = 65536;
+  quint32 d = 0;
+  for ( quint32 s = n / 2; s > 0; s /= 2 )
+  {
+    quint32 rx = ( x & s ) > 0;
+    quint32 ry = ( y & s ) > 0;
+    d += s * s * (( 3 * rx ) ^ ry );
+    //rotate the quadrant
+    if ( ry == 0 )
+    {
+      if ( rx == 1 )
+      {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      qSwap( x, y );
+    }
+  }
+  return d;
+}
 
 QgsTINInterpolator::QgsTINInterpolator( const QList<LayerData>& inputData, TIN_INTERPOLATION interpolation, bool showProgressDialog )
     : QgsInterpolator( inputData )
     , mTriangulation( 0 )
+    , mDualEdgeTriangulation( 0 )
     , mTriangleInterpolator( 0 )
     , mIsInitialized( false )
     , mShowProgressDialog( showProgressDialog )
     , mExportTriangulationToFile( false )
     , mInterpolation( interpolation )
+    , mLastY( 0 )
+    , mRowStartEdge( -1 )
 {
 }
 
@@ -55,8 +86,23 @@ int QgsTINInterpolator::interpolatePoint( double x, double y, double& result )
     return 1;
   }
 
+  //a new row starts its search at the first triangle of the previous row instead of the end of the previous row
+  bool newRow = ( y != mLastY || mRowStartEdge < 0 );
+  if ( newRow && mRowStartEdge >= 0 )
+  {
+    mDualEdgeTriangulation->setWalkStartEdge( mRowStartEdge );
+  }
+
   Point3D r;
-  if ( !mTriangleInterpolator->calcPoint( x, y, &r ) )
+  bool ok = mTriangleInterpolator->calcPoint( x, y, &r );
+
+  if ( newRow )
+  {
+    mLastY = y;
+    mRowStartEdge = mDualEdgeTriangulation->walkStartEdge();
+  }
+
+  if ( !ok )
   {
     return 2;
   }
@@ -67,6 +113,7 @@ int QgsTINInterpolator::interpolatePoint( double x, double y, double& result )
 void QgsTINInterpolator::initialize()
 {
   DualEdgeTriangulation* theDualEdgeTriangulation = new DualEdgeTriangulation( 100000, 0 );
+  mDualEdgeTriangulation = theDualEdgeTriangulation;
   if ( mInterpolation == CloughTocher )
   {
     NormVecDecorator* dec = new NormVecDecorator();
@@ -130,6 +177,7 @@ void QgsTINInterpolator::initialize()
       }
     }
   }
+  insertBufferedPoints();
 
   delete theProgressDialog;
 
@@ -220,11 +268,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
       {
         z = attributeValue;
       }
-      Point3D* thePoint = new Point3D( x, y, z );
-      if ( mTriangulation->addPoint( thePoint ) == -100 )
-      {
-        return -1;
-      }
+      mPointBuffer.append( new Point3D( x, y, z ) );
       break;
     }
     case QGis::WKBMultiPoint25D:
@@ -241,10 +285,11 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
         {
           currentWkbPtr >> z;
         }
-        else
+        if ( !zCoord || !hasZValue )
         {
           z = attributeValue;
         }
+        mPointBuffer.append( new Point3D( x, y, z ) );
       }
       break;
     }
@@ -272,8 +317,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
         if ( type == POINTS )
         {
-          //todo: handle error code -100
-          mTriangulation->addPoint( new Point3D( x, y, z ) );
+          mPointBuffer.append( new Point3D( x, y, z ) );
         }
         else
         {
@@ -283,6 +327,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
       if ( type != POINTS )
       {
+        insertBufferedPoints();
         mTriangulation->addLine( line, type == BREAK_LINES );
       }
       break;
@@ -315,8 +360,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
           if ( type == POINTS )
           {
-            //todo: handle error code -100
-            mTriangulation->addPoint( new Point3D( x, y, z ) );
+            mPointBuffer.append( new Point3D( x, y, z ) );
           }
           else
           {
@@ -325,6 +369,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
         }
         if ( type != POINTS )
         {
+          insertBufferedPoints();
           mTriangulation->addLine( line, type == BREAK_LINES );
         }
       }
@@ -358,8 +403,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
           }
           if ( type == POINTS )
           {
-            //todo: handle error code -100
-            mTriangulation->addPoint( new Point3D( x, y, z ) );
+            mPointBuffer.append( new Point3D( x, y, z ) );
           }
           else
           {
@@ -369,6 +413,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
         if ( type != POINTS )
         {
+          insertBufferedPoints();
           mTriangulation->addLine( line, type == BREAK_LINES );
         }
       }
@@ -407,8 +452,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
             }
             if ( type == POINTS )
             {
-              //todo: handle error code -100
-              mTriangulation->addPoint( new Point3D( x, y, z ) );
+              mPointBuffer.append( new Point3D( x, y, z ) );
             }
             else
             {
@@ -417,6 +461,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
           }
           if ( type != POINTS )
           {
+            insertBufferedPoints();
             mTriangulation->addLine( line, type == BREAK_LINES );
           }
         }
@@ -431,3 +476,53 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
   return 0;
 }
 
+
+int QgsTINInterpolator::insertBufferedPoints()
+{
+  if ( mPointBuffer.isEmpty() )
+  {
+    return 0;
+  }
+
+  double xMin = mPointBuffer.at( 0 )->getX();
+  double xMax = xMin;
+  double yMin = mPointBuffer.at( 0 )->getY();
+  double yMax = yMin;
+  for ( int i = 1; i < mPointBuffer.size(); ++i )
+  {
+    xMin = qMin( xMin, mPointBuffer.at( i )->getX() );
+    xMax = qMax( xMax, mPointBuffer.at( i )->getX() );
+    yMin = qMin( yMin, mPointBuffer.at( i )->getY() );
+    yMax = qMax( yMax, mPointBuffer.at( i )->getY() );
+  }
+  double scale = 65535.0 / qMax( qMax( xMax - xMin, yMax - yMin ), 1e-300 );
+
+  //consecutive points on the curve are close to each other, so the search for the
+  //triangle of a new point starts next to it
+  std::vector< std::pair<quint32, int> > order;
+  order.reserve( mPointBuffer.size() );
+  for ( int i = 0; i < mPointBuffer.size(); ++i )
+  {
+    quint32 x = ( quint32 )(( mPointBuffer.at( i )->getX() - xMin ) * scale );
+    quint32 y = ( quint32 )(( mPointBuffer.at( i )->getY() - yMin ) * scale );
+    order.push_back( std::make_pair( hilbertIndex( x, y ), i ) );
+  }
+  std::sort( order.begin(), order.end() );
+
+  int nRejected = 0;
+  for ( unsigned int i = 0; i < order.size(); ++i )
+  {
+    //the triangulation takes ownership of the point, also if it is not inserted
+    if ( mTriangulation->addPoint( mPointBuffer.at( order[i].second ) ) == -100 )
+    {
+      ++nRejected;
+    }
+  }
+  mPointBuffer.clear();
+
+  if ( nRejected > 0 )
+  {
+    QgsMessageLog::logMessage( QObject::tr( "%n point(s) could not be inserted into the triangulation because of numerical problems", 0, nRejected ), QObject::tr( "Interpolation" ) );
+  }
+  return nRejected;
+}
@@ -21,11 +21,17 @@
 #include "qgsinterpolator.h"
 #include <QString>
 
+class DualEdgeTriangulation;
+class Point3D;
 class Triangulation;
 class TriangleInterpolator;
 class QgsFeature;
 
-/**Interpolation in a triangular irregular network*/
+/**Interpolation in a triangular irregular network. The input points are inserted into
+  the triangulation in the order of a Hilbert curve, which keeps the searches for the
+  triangles of new points short. Values on a raster row are located starting from the
+  triangle of the previous cell, the first cell of a row from the triangle of the first
+  cell of the previous row*/
 class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
 {
   public:
@@ -50,6 +56,8 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
 
   private:
     Triangulation* mTriangulation;
+    /**The triangulation decorated by mTriangulation (or mTriangulation itself)*/
+    DualEdgeTriangulation* mDualEdgeTriangulation;
     TriangleInterpolator* mTriangleInterpolator;
     bool mIsInitialized;
     bool mShowProgressDialog;
@@ -59,6 +67,12 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
     QString mTriangulationFilePath;
     /**Type of interpolation*/
     TIN_INTERPOLATION mInterpolation;
+    /**Points read from the input, which are not yet inserted into the triangulation*/
+    QVector<Point3D*> mPointBuffer;
+    /**y-coordinate of the last interpolated point*/
+    double mLastY;
+    /**Edge of the triangle of the first point with y-coordinate mLastY*/
+    int mRowStartEdge;
 
     /**Create dual edge triangulation*/
     void initialize();
@@ -67,8 +81,12 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
       @param zCoord true if the z coordinate is the interpolation attribute
       @param attr interpolation attribute index (if zCoord is false)
       @param type point/structure line, break line
-      @return 0 in case of success, -1 if the feature could not be inserted because of numerical problems*/
+      @return 0 in case of success, -1 if the feature could not be inserted because of numerical problems.
+      Points are buffered, the points rejected by the triangulation are reported by insertBufferedPoints()*/
     int insertData( QgsFeature* f, bool zCoord, int attr, InputType type );
+    /**Inserts the buffered points sorted along a Hilbert curve into the triangulation
+      @return the number of points which could not be inserted because of numerical problems*/
+    int insertBufferedPoints();
 };
 
 #endif
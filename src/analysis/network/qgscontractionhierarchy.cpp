@@ -0,0 +1,590 @@
+/***************************************************************************
+  qgscontractionhierarchy.cpp
+  --------------------------------------
+  Date                 : May 2014
+  Copyright            : (C) 2014 by QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+// C++ standard includes
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// QT includes
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+
+//QGIS-includes
+#include "qgsgraph.h"
+#include "qgscontractionhierarchy.h"
+
+#define INFINITE_COST std::numeric_limits<double>::infinity()
+
+//! identifies hierarchy files, followed by the format version
+static const quint32 HIERARCHY_FILE_MAGIC = 0x51474348;
+static const quint32 HIERARCHY_FILE_VERSION = 1;
+
+//! the witness searches stop after this number of vertices, a missed witness only adds a needless shortcut
+static const int WITNESS_SETTLED_LIMIT = 500;
+
+//! weights of the terms of the contraction priority
+static const int PRIORITY_EDGE_DIFFERENCE = 2;
+static const int PRIORITY_DELETED_NEIGHBOURS = 1;
+static const int PRIORITY_LEVEL = 1;
+
+typedef std::pair<double, int> ChQueueEntry;
+typedef std::priority_queue< ChQueueEntry, std::vector<ChQueueEntry>, std::greater<ChQueueEntry> > ChQueue;
+
+/** dijkstra search which checks whether a path between two neighbours of a vertex avoiding it is as short as the path through it */
+class ChWitnessSearch
+{
+  public:
+    explicit ChWitnessSearch( int vertexCount ) : mCost( vertexCount, INFINITE_COST ) {}
+
+    /** searches from a vertex up to a maximum cost, ignoring the vertex to be contracted and the contracted vertices */
+    void run( int startVertex, int ignoredVertex, double maxCost, const QVector< QVector<int> >& outArcs,
+              const QVector<int>& arcTo, const QVector<double>& arcCost, const QVector<bool>& contracted )
+    {
+      foreach ( int vertex, mTouched )
+      {
+        mCost[vertex] = INFINITE_COST;
+      }
+      mTouched.clear();
+
+      ChQueue queue;
+      mCost[startVertex] = 0.0;
+      mTouched << startVertex;
+      queue.push( ChQueueEntry( 0.0, startVertex ) );
+      int settled = 0;
+      while ( !queue.empty() )
+      {
+        ChQueueEntry entry = queue.top();
+        queue.pop();
+        if ( entry.first > mCost[entry.second] )
+          continue;
+        if ( entry.first > maxCost || ++settled > WITNESS_SETTLED_LIMIT )
+          break;
+
+        foreach ( int arc, outArcs[entry.second] )
+        {
+          int target = arcTo[arc];
+          if ( target == ignoredVertex || contracted[target] )
+            continue;
+          double cost = entry.first + arcCost[arc];
+          if ( cost < mCost[target] )
+          {
+            if ( mCost[target] == INFINITE_COST )
+              mTouched << target;
+            mCost[target] = cost;
+            queue.push( ChQueueEntry( cost, target ) );
+          }
+        }
+      }
+    }
+
+    double cost( int vertex ) const { return mCost[vertex]; }
+
+  private:
+    QVector<double> mCost;
+    QVector<int> mTouched;
+};
+
+/** contracts the vertices of a graph in the order of their priority. The priority of a vertex grows with
+ * the number of shortcuts needed minus its remaining arcs, with its contracted neighbours and with its level */
+class ChContraction
+{
+  public:
+    ChContraction( QVector<QgsContractionHierarchy::Arc>& arcs, const QgsGraph* graph, int criterionNum )
+        : mArcs( arcs )
+        , mOutArcs( graph->vertexCount() )
+        , mInArcs( graph->vertexCount() )
+        , mContracted( graph->vertexCount(), false )
+        , mDeletedNeighbours( graph->vertexCount(), 0 )
+        , mLevel( graph->vertexCount(), 0 )
+        , mWitness( graph->vertexCount() )
+        , mShortcutCount( 0 )
+    {
+      for ( int i = 0; i < graph->arcCount(); ++i )
+      {
+        const QgsGraphArc& sourceArc = graph->arc( i );
+        if ( sourceArc.outVertex() == sourceArc.inVertex() )
+          continue;
+
+        QgsContractionHierarchy::Arc arc;
+        arc.from = sourceArc.outVertex();
+        arc.to = sourceArc.inVertex();
+        arc.cost = sourceArc.property( criterionNum ).toDouble();
+        arc.sourceArc = i;
+        arc.first = -1;
+        arc.second = -1;
+        addArc( arc );
+      }
+    }
+
+    /** contracts all vertices, returns the arcs to more important vertices and from more important vertices of each vertex */
+    void run( QVector< QVector<int> >& upArcs, QVector< QVector<int> >& downArcs )
+    {
+      int nVertices = mOutArcs.size();
+      upArcs = QVector< QVector<int> >( nVertices );
+      downArcs = QVector< QVector<int> >( nVertices );
+
+      ChQueue queue;
+      for ( int vertex = 0; vertex < nVertices; ++vertex )
+      {
+        queue.push( ChQueueEntry( simulate( vertex ), vertex ) );
+      }
+
+      while ( !queue.empty() )
+      {
+        int vertex = queue.top().second;
+        queue.pop();
+        if ( mContracted[vertex] )
+          continue;
+
+        // the priority may have increased since the vertex was queued
+        int priority = simulate( vertex );
+        if ( !queue.empty() && priority > queue.top().first )
+        {
+          queue.push( ChQueueEntry( priority, vertex ) );
+          continue;
+        }
+
+        // the arcs to the remaining vertices lead to more important vertices
+        foreach ( int arc, mOutArcs[vertex] )
+        {
+          if ( !mContracted[mArcs[arc].to] )
+            upArcs[vertex] << arc;
+        }
+        foreach ( int arc, mInArcs[vertex] )
+        {
+          if ( !mContracted[mArcs[arc].from] )
+            downArcs[vertex] << arc;
+        }
+        mContracted[vertex] = true;
+
+        foreach ( const QgsContractionHierarchy::Arc& shortcut, mShortcuts )
+        {
+          addArc( shortcut );
+        }
+        mShortcutCount += mShortcuts.size();
+
+        // drop the arcs of the contracted vertex from its neighbours
+        QList<int> neighbours = mInNeighbours.keys() + mOutNeighbours.keys();
+        foreach ( int neighbour, neighbours )
+        {
+          ++mDeletedNeighbours[neighbour];
+          mLevel[neighbour] = qMax( mLevel[neighbour], mLevel[vertex] + 1 );
+          removeContractedArcs( neighbour );
+        }
+        mOutArcs[vertex].clear();
+        mInArcs[vertex].clear();
+      }
+    }
+
+    int shortcutCount() const { return mShortcutCount; }
+
+  private:
+    void addArc( const QgsContractionHierarchy::Arc& arc )
+    {
+      mOutArcs[arc.from] << mArcs.size();
+      mInArcs[arc.to] << mArcs.size();
+      mArcs << arc;
+      mArcTo << arc.to;
+      mArcCost << arc.cost;
+    }
+
+    void removeContractedArcs( int vertex )
+    {
+      QVector<int> remaining;
+      foreach ( int arc, mOutArcs[vertex] )
+      {
+        if ( !mContracted[mArcs[arc].to] )
+          remaining << arc;
+      }
+      mOutArcs[vertex] = remaining;
+      remaining.clear();
+      foreach ( int arc, mInArcs[vertex] )
+      {
+        if ( !mContracted[mArcs[arc].from] )
+          remaining << arc;
+      }
+      mInArcs[vertex] = remaining;
+    }
+
+    /** finds the remaining neighbours of a vertex and the shortcuts its contraction needs, returns its priority */
+    int simulate( int vertex )
+    {
+      mInNeighbours.clear();
+      mOutNeighbours.clear();
+      mShortcuts.clear();
+
+      // the cheapest arc from and to each neighbour
+      foreach ( int arc, mInArcs[vertex] )
+      {
+        int from = mArcs[arc].from;
+        if ( mContracted[from] )
+          continue;
+        QHash<int, int>::iterator it = mInNeighbours.find( from );
+        if ( it == mInNeighbours.end() )
+          mInNeighbours.insert( from, arc );
+        else if ( mArcs[arc].cost < mArcs[it.value()].cost )
+          it.value() = arc;
+      }
+      double maxOutCost = 0.0;
+      foreach ( int arc, mOutArcs[vertex] )
+      {
+        int to = mArcs[arc].to;
+        if ( mContracted[to] )
+          continue;
+        maxOutCost = qMax( maxOutCost, mArcs[arc].cost );
+        QHash<int, int>::iterator it = mOutNeighbours.find( to );
+        if ( it == mOutNeighbours.end() )
+          mOutNeighbours.insert( to, arc );
+        else if ( mArcs[arc].cost < mArcs[it.value()].cost )
+          it.value() = arc;
+      }
+
+      // a shortcut is needed unless there is a path avoiding the vertex which is not longer
+      QHash<int, int>::const_iterator inIt = mInNeighbours.constBegin();
+      for ( ; inIt != mInNeighbours.constEnd(); ++inIt )
+      {
+        double inCost = mArcs[inIt.value()].cost;
+        mWitness.run( inIt.key(), vertex, inCost + maxOutCost, mOutArcs, mArcTo, mArcCost, mContracted );
+        QHash<int, int>::const_iterator outIt = mOutNeighbours.constBegin();
+        for ( ; outIt != mOutNeighbours.constEnd(); ++outIt )
+        {
+          double viaCost = inCost + mArcs[outIt.value()].cost;
+          if ( outIt.key() == inIt.key() || mWitness.cost( outIt.key() ) <= viaCost )
+            continue;
+
+          QgsContractionHierarchy::Arc shortcut;
+          shortcut.from = inIt.key();
+          shortcut.to = outIt.key();
+          shortcut.cost = viaCost;
+          shortcut.sourceArc = -1;
+          shortcut.first = inIt.value();
+          shortcut.second = outIt.value();
+          mShortcuts << shortcut;
+        }
+      }
+      return PRIORITY_EDGE_DIFFERENCE * ( mShortcuts.size() - mInNeighbours.size() - mOutNeighbours.size() )
+             + PRIORITY_DELETED_NEIGHBOURS * mDeletedNeighbours[vertex] + PRIORITY_LEVEL * mLevel[vertex];
+    }
+
+    QVector<QgsContractionHierarchy::Arc>& mArcs;
+    //! arcs between the vertices which are not contracted yet
+    QVector< QVector<int> > mOutArcs;
+    QVector< QVector<int> > mInArcs;
+    //! arc ends and costs in plain arrays for the witness searches
+    QVector<int> mArcTo;
+    QVector<double> mArcCost;
+    QVector<bool> mContracted;
+    QVector<int> mDeletedNeighbours;
+    //! number of contracted vertices below each vertex, keeps the hierarchy flat
+    QVector<int> mLevel;
+    ChWitnessSearch mWitness;
+    int mShortcutCount;
+
+    //! result of the last simulated contraction
+    QHash<int, int> mInNeighbours;
+    QHash<int, int> mOutNeighbours;
+    QVector<QgsContractionHierarchy::Arc> mShortcuts;
+};
+
+QgsContractionHierarchy::QgsContractionHierarchy()
+    : mShortcutCount( 0 )
+{
+  mUp.offsets.fill( 0, 1 );
+  mDown.offsets.fill( 0, 1 );
+}
+
+QgsContractionHierarchy::QgsContractionHierarchy( const QgsGraph* graph, int criterionNum )
+{
+  ChContraction contraction( mArcs, graph, criterionNum );
+  QVector< QVector<int> > upArcs;
+  QVector< QVector<int> > downArcs;
+  contraction.run( upArcs, downArcs );
+  mUp = adjacency( upArcs );
+  mDown = adjacency( downArcs );
+  mShortcutCount = contraction.shortcutCount();
+}
+
+QgsContractionHierarchy::Adjacency QgsContractionHierarchy::adjacency( const QVector< QVector<int> >& vertexArcs ) const
+{
+  Adjacency result;
+  result.offsets.reserve( vertexArcs.size() + 1 );
+  result.offsets << 0;
+  foreach ( const QVector<int>& arcs, vertexArcs )
+  {
+    result.arcs += arcs;
+    result.offsets << result.arcs.size();
+  }
+  return result;
+}
+
+int QgsContractionHierarchy::vertexCount() const
+{
+  return mUp.offsets.size() - 1;
+}
+
+int QgsContractionHierarchy::shortcutCount() const
+{
+  return mShortcutCount;
+}
+
+double QgsContractionHierarchy::distance( int startVertexIdx, int endVertexIdx ) const
+{
+  return shortestPath( startVertexIdx, endVertexIdx );
+}
+
+double QgsContractionHierarchy::shortestPath( int startVertexIdx, int endVertexIdx, QVector<int>* resultArcs ) const
+{
+  return shortestPath( QVector<int>() << startVertexIdx, QVector<double>() << 0.0,
+                       QVector<int>() << endVertexIdx, QVector<double>() << 0.0, resultArcs );
+}
+
+//! cost of a vertex in a search and the arc it was reached by, -1 for the vertices the search starts at
+struct ChLabel
+{
+  ChLabel() : cost( INFINITE_COST ), arc( -1 ) {}
+  ChLabel( double c, int a ) : cost( c ), arc( a ) {}
+  double cost;
+  int arc;
+};
+
+double QgsContractionHierarchy::shortestPath( const QVector<int>& startVertices, const QVector<double>& startCosts,
+    const QVector<int>& endVertices, const QVector<double>& endCosts,
+    QVector<int>* resultArcs, int* resultStart ) const
+{
+  if ( resultArcs )
+    resultArcs->clear();
+  if ( resultStart )
+    *resultStart = -1;
+
+  // the searches visit few vertices, so their labels are hashed instead of kept for all vertices
+  QHash<int, ChLabel> labels[2];
+  ChQueue queues[2];
+  const QVector<int>* vertices[2] = { &startVertices, &endVertices };
+  const QVector<double>* costs[2] = { &startCosts, &endCosts };
+  const Adjacency* adjacency[2] = { &mUp, &mDown };
+  for ( int d = 0; d < 2; ++d )
+  {
+    for ( int i = 0; i < vertices[d]->size() && i < costs[d]->size(); ++i )
+    {
+      int vertex = vertices[d]->at( i );
+      double cost = costs[d]->at( i );
+      if ( vertex < 0 || vertex >= vertexCount() || cost >= labels[d].value( vertex ).cost )
+        continue;
+      labels[d].insert( vertex, ChLabel( cost, -1 ) );
+      queues[d].push( ChQueueEntry( cost, vertex ) );
+    }
+  }
+
+  // both searches go up to the most important vertices, each one stops once its
+  // smallest cost exceeds the best path found
+  double best = INFINITE_COST;
+  int meetingVertex = -1;
+  while ( !queues[0].empty() || !queues[1].empty() )
+  {
+    int d = queues[1].empty() || ( !queues[0].empty() && queues[0].top().first <= queues[1].top().first ) ? 0 : 1;
+    ChQueueEntry entry = queues[d].top();
+    queues[d].pop();
+    int vertex = entry.second;
+    if ( entry.first > labels[d][vertex].cost )
+      continue;
+    if ( entry.first >= best )
+    {
+      queues[d] = ChQueue();
+      continue;
+    }
+
+    QHash<int, ChLabel>::const_iterator other = labels[1 - d].constFind( vertex );
+    if ( other != labels[1 - d].constEnd() && entry.first + other->cost < best )
+    {
+      best = entry.first + other->cost;
+      meetingVertex = vertex;
+    }
+
+    const Adjacency& arcs = *adjacency[d];
+    for ( int i = arcs.offsets[vertex]; i < arcs.offsets[vertex + 1]; ++i )
+    {
+      const Arc& arc = mArcs[arcs.arcs[i]];
+      int target = d == 0 ? arc.to : arc.from;
+      double cost = entry.first + arc.cost;
+      QHash<int, ChLabel>::iterator it = labels[d].find( target );
+      if ( it == labels[d].end() )
+      {
+        labels[d].insert( target, ChLabel( cost, arcs.arcs[i] ) );
+        queues[d].push( ChQueueEntry( cost, target ) );
+      }
+      else if ( cost < it->cost )
+      {
+        *it = ChLabel( cost, arcs.arcs[i] );
+        queues[d].push( ChQueueEntry( cost, target ) );
+      }
+    }
+  }
+
+  if ( meetingVertex < 0 )
+    return INFINITE_COST;
+
+  // the hierarchy arcs from the start to the meeting vertex and from there to the end
+  QVector<int> pathArcs;
+  int vertex = meetingVertex;
+  for ( int arc = labels[0][vertex].arc; arc != -1; arc = labels[0][vertex].arc )
+  {
+    pathArcs.prepend( arc );
+    vertex = mArcs[arc].from;
+  }
+  if ( resultStart )
+  {
+    double startCost = labels[0][vertex].cost;
+    for ( int i = 0; i < startVertices.size() && i < startCosts.size(); ++i )
+    {
+      if ( startVertices[i] == vertex && startCosts[i] == startCost )
+      {
+        *resultStart = i;
+        break;
+      }
+    }
+  }
+  if ( resultArcs )
+  {
+    vertex = meetingVertex;
+    for ( int arc = labels[1][vertex].arc; arc != -1; arc = labels[1][vertex].arc )
+    {
+      pathArcs.append( arc );
+      vertex = mArcs[arc].to;
+    }
+    foreach ( int arc, pathArcs )
+    {
+      unpackArc( arc, *resultArcs );
+    }
+  }
+  return best;
+}
+
+void QgsContractionHierarchy::unpackArc( int arc, QVector<int>& resultArcs ) const
+{
+  QVector<int> stack;
+  stack << arc;
+  while ( !stack.isEmpty() )
+  {
+    const Arc& current = mArcs[stack.last()];
+    stack.pop_back();
+    if ( current.sourceArc >= 0 )
+    {
+      resultArcs << current.sourceArc;
+    }
+    else
+    {
+      stack << current.second << current.first;
+    }
+  }
+}
+
+bool QgsContractionHierarchy::writeToFile( const QString& fileName ) const
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+    return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_7 );
+  stream << HIERARCHY_FILE_MAGIC << HIERARCHY_FILE_VERSION;
+
+  stream << ( qint32 ) mArcs.size() << ( qint32 ) mShortcutCount;
+  foreach ( const Arc& arc, mArcs )
+  {
+    stream << ( qint32 ) arc.from << ( qint32 ) arc.to << arc.cost
+    << ( qint32 ) arc.sourceArc << ( qint32 ) arc.first << ( qint32 ) arc.second;
+  }
+  stream << mUp.offsets << mUp.arcs << mDown.offsets << mDown.arcs;
+
+  return stream.status() == QDataStream::Ok && file.error() == QFile::NoError;
+}
+
+bool QgsContractionHierarchy::readFromFile( const QString& fileName )
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::ReadOnly ) )
+    return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_7 );
+  quint32 magic, version;
+  stream >> magic >> version;
+  if ( magic != HIERARCHY_FILE_MAGIC || version != HIERARCHY_FILE_VERSION )
+    return false;
+
+  qint32 arcCount, shortcutCount;
+  stream >> arcCount >> shortcutCount;
+  if ( stream.status() != QDataStream::Ok || arcCount < 0 || shortcutCount < 0 || shortcutCount > arcCount )
+    return false;
+
+  QVector<Arc> arcs;
+  arcs.reserve( arcCount );
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    qint32 from, to, sourceArc, first, second;
+    Arc arc;
+    stream >> from >> to >> arc.cost >> sourceArc >> first >> second;
+    arc.from = from;
+    arc.to = to;
+    arc.sourceArc = sourceArc;
+    arc.first = first;
+    arc.second = second;
+    // arcs of the graph have a source arc, shortcuts (-1) refer to arcs added before them
+    if ( sourceArc < -1 || ( sourceArc == -1 && ( first < 0 || first >= i || second < 0 || second >= i ) ) )
+      return false;
+    arcs << arc;
+  }
+
+  Adjacency up, down;
+  stream >> up.offsets >> up.arcs >> down.offsets >> down.arcs;
+  if ( stream.status() != QDataStream::Ok || up.offsets.isEmpty() || up.offsets.size() != down.offsets.size()
+       || up.offsets.last() != up.arcs.size() || down.offsets.last() != down.arcs.size() )
+    return false;
+
+  int nVertices = up.offsets.size() - 1;
+  foreach ( const Arc& arc, arcs )
+  {
+    if ( arc.from < 0 || arc.from >= nVertices || arc.to < 0 || arc.to >= nVertices )
+      return false;
+  }
+  const Adjacency* adjacencies[2] = { &up, &down };
+  for ( int d = 0; d < 2; ++d )
+  {
+    // the arcs of vertex v are arcs[offsets[v]] .. arcs[offsets[v + 1] - 1]
+    const QVector<int>& offsets = adjacencies[d]->offsets;
+    if ( offsets[0] != 0 )
+      return false;
+    for ( int v = 0; v < nVertices; ++v )
+    {
+      if ( offsets[v] > offsets[v + 1] )
+        return false;
+    }
+
+    foreach ( int arc, adjacencies[d]->arcs )
+    {
+      if ( arc < 0 || arc >= arcCount )
+        return false;
+    }
+  }
+
+  mArcs = arcs;
+  mUp = up;
+  mDown = down;
+  mShortcutCount = shortcutCount;
+  return true;
+}
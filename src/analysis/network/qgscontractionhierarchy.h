@@ -0,0 +1,137 @@
+/***************************************************************************
+  qgscontractionhierarchy.h
+  --------------------------------------
+  Date                 : May 2014
+  Copyright            : (C) 2014 by QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSCONTRACTIONHIERARCHYH
+#define QGSCONTRACTIONHIERARCHYH
+
+// QT4 includes
+#include <QString>
+#include <QVector>
+
+class QgsGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsContractionHierarchy
+ * \brief Contraction hierarchy of a QgsGraph for fast repeated shortest path queries on one cost criterion.
+ *
+ * The preprocessing contracts the vertices one by one, starting with the least important
+ * ones, and adds shortcut arcs which keep the costs between the remaining vertices. A query
+ * searches from both ends only towards more important vertices, so it visits a few hundred
+ * vertices instead of the whole graph. Preprocessing takes longer than a single dijkstra
+ * search, the hierarchy pays off for many queries on the same graph and can be written to
+ * a file. Vertex and arc indices are the ones of the source graph, arc costs have to be non-negative.
+ *
+ * All query methods are const and may be called from several threads at the same time.
+ * \note added in 2.4
+ */
+class ANALYSIS_EXPORT QgsContractionHierarchy
+{
+  public:
+    QgsContractionHierarchy();
+
+    /**
+     * Builds the contraction hierarchy of a graph
+     * @param graph the source graph
+     * @param criterionNum index of arc property used as cost
+     */
+    QgsContractionHierarchy( const QgsGraph* graph, int criterionNum );
+
+    /**
+     * return vertex count
+     */
+    int vertexCount() const;
+
+    /**
+     * return the number of shortcut arcs added by the preprocessing
+     */
+    int shortcutCount() const;
+
+    /**
+     * cost of the shortest path between two vertices, infinity if the end vertex is not reachable
+     */
+    double distance( int startVertexIdx, int endVertexIdx ) const;
+
+    /**
+     * solve shortest path problem between two vertices
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param resultArcs if not null, receives the indices of the source graph arcs from the start to the end vertex
+     * @return cost of the path, infinity if the end vertex is not reachable
+     */
+    double shortestPath( int startVertexIdx, int endVertexIdx, QVector<int>* resultArcs = 0 ) const;
+
+    /**
+     * solve shortest path problem between two sets of vertices. Each start vertex has a cost to
+     * reach it and each end vertex a cost to leave it, e.g. for points on arcs.
+     * @param startVertices indices of start vertices
+     * @param startCosts initial cost of each start vertex
+     * @param endVertices indices of end vertices
+     * @param endCosts final cost of each end vertex
+     * @param resultArcs if not null, receives the indices of the source graph arcs of the path
+     * @param resultStart if not null, receives the index in startVertices of the vertex the path starts at, -1 if there is no path
+     * @return cost of the path including the start and end costs, infinity if no end vertex is reachable
+     */
+    double shortestPath( const QVector<int>& startVertices, const QVector<double>& startCosts,
+                         const QVector<int>& endVertices, const QVector<double>& endCosts,
+                         QVector<int>* resultArcs = 0, int* resultStart = 0 ) const;
+
+    /**
+     * write the hierarchy to a binary file, so it can be loaded without preprocessing the graph again
+     * @return false if the file could not be written
+     */
+    bool writeToFile( const QString& fileName ) const;
+
+    /**
+     * replace the hierarchy by a hierarchy written with writeToFile
+     * @return false if the file could not be read or is not a hierarchy file
+     */
+    bool readFromFile( const QString& fileName );
+
+  private:
+    //! arc of the hierarchy, either an arc of the source graph or a shortcut of two arcs of the hierarchy
+    struct Arc
+    {
+      int from;
+      int to;
+      double cost;
+      //! index of the source graph arc, -1 for shortcuts
+      int sourceArc;
+      //! the arcs which make up a shortcut
+      int first;
+      int second;
+    };
+
+    //! arcs of each vertex. The arcs of vertex v are arcs[offsets[v]] to arcs[offsets[v + 1] - 1]
+    struct Adjacency
+    {
+      QVector<int> offsets;
+      QVector<int> arcs;
+    };
+
+    Adjacency adjacency( const QVector< QVector<int> >& vertexArcs ) const;
+    //! appends the source graph arcs of a hierarchy arc
+    void unpackArc( int arc, QVector<int>& resultArcs ) const;
+
+    QVector<Arc> mArcs;
+    //! arcs to more important vertices, for the search from the start
+    Adjacency mUp;
+    //! arcs from more important vertices, for the search from the end
+    Adjacency mDown;
+    int mShortcutCount;
+
+    friend class ChContraction;
+};
+
+#endif //QGSCONTRACTIONHIERARCHYH
@@ -16,6 +16,13 @@
 
 #include "qgsgraph.h"
 
+#include <QDataStream>
+#include <QFile>
+
+//! identifies graph files, followed by the format version
+static const quint32 GRAPH_FILE_MAGIC = 0x51475247;
+static const quint32 GRAPH_FILE_VERSION = 1;
+
 QgsGraph::QgsGraph()
 {
 }
@@ -82,6 +89,82 @@ int QgsGraph::findVertex( const QgsPoint& pt ) const
   return -1;
 }
 
+bool QgsGraph::writeToFile( const QString& fileName ) const
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+    return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_7 );
+  stream << GRAPH_FILE_MAGIC << GRAPH_FILE_VERSION;
+
+  stream << ( qint32 ) mGraphVertexes.size();
+  QVector<QgsGraphVertex>::const_iterator vertexIt;
+  for ( vertexIt = mGraphVertexes.constBegin(); vertexIt != mGraphVertexes.constEnd(); ++vertexIt )
+  {
+    stream << vertexIt->mCoordinate.x() << vertexIt->mCoordinate.y();
+  }
+
+  // the arc lists of the vertices are rebuilt by addArc
+  stream << ( qint32 ) mGraphArc.size();
+  QVector<QgsGraphArc>::const_iterator arcIt;
+  for ( arcIt = mGraphArc.constBegin(); arcIt != mGraphArc.constEnd(); ++arcIt )
+  {
+    stream << ( qint32 ) arcIt->mOut << ( qint32 ) arcIt->mIn << arcIt->mProperties;
+  }
+
+  return stream.status() == QDataStream::Ok && file.error() == QFile::NoError;
+}
+
+bool QgsGraph::readFromFile( const QString& fileName )
+{
+  QFile file( fileName );
+  if ( !file.open( QIODevice::ReadOnly ) )
+    return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_7 );
+  quint32 magic, version;
+  stream >> magic >> version;
+  if ( magic != GRAPH_FILE_MAGIC || version != GRAPH_FILE_VERSION )
+    return false;
+
+  QgsGraph graph;
+  qint32 vertexCount;
+  stream >> vertexCount;
+  if ( stream.status() != QDataStream::Ok || vertexCount < 0 )
+    return false;
+
+  graph.mGraphVertexes.reserve( vertexCount );
+  for ( int i = 0; i < vertexCount; ++i )
+  {
+    double x, y;
+    stream >> x >> y;
+    graph.addVertex( QgsPoint( x, y ) );
+  }
+
+  qint32 arcCount;
+  stream >> arcCount;
+  if ( stream.status() != QDataStream::Ok || arcCount < 0 )
+    return false;
+
+  graph.mGraphArc.reserve( arcCount );
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    qint32 out, in;
+    QVector< QVariant > properties;
+    stream >> out >> in >> properties;
+    if ( stream.status() != QDataStream::Ok || out < 0 || out >= vertexCount || in < 0 || in >= vertexCount )
+      return false;
+    graph.addArc( out, in, properties );
+  }
+
+  mGraphVertexes = graph.mGraphVertexes;
+  mGraphArc = graph.mGraphArc;
+  return true;
+}
+
 QgsGraphArc::QgsGraphArc()
 {
 
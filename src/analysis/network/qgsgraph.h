@@ -172,6 +172,20 @@ class ANALYSIS_EXPORT QgsGraph
      */
     int findVertex( const QgsPoint& pt ) const;
 
+    /**
+     * write the graph to a binary file, so it can be loaded without building it again
+     * @return false if the file could not be written
+     * @note added in 2.4
+     */
+    bool writeToFile( const QString& fileName ) const;
+
+    /**
+     * replace the graph by a graph written with writeToFile
+     * @return false if the file could not be read or is not a graph file
+     * @note added in 2.4
+     */
+    bool readFromFile( const QString& fileName );
+
   private:
     QVector<QgsGraphVertex> mGraphVertexes;
 
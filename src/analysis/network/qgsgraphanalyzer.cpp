@@ -62,12 +62,16 @@ void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int
     int curVertex = it.value();
     not_begin.erase( it );
 
+    // the vertex was reached with a lower cost after this entry was inserted
+    if ( curCost > ( *result )[ curVertex ] )
+      continue;
+
     // edge index list
-    QgsGraphArcIdList l = source->vertex( curVertex ).outArc();
-    QgsGraphArcIdList::iterator arcIt;
-    for ( arcIt = l.begin(); arcIt != l.end(); ++arcIt )
+    const QgsGraphArcIdList& l = source->vertex( curVertex ).outArc();
+    QgsGraphArcIdList::const_iterator arcIt;
+    for ( arcIt = l.constBegin(); arcIt != l.constEnd(); ++arcIt )
     {
-      const QgsGraphArc arc = source->arc( *arcIt );
+      const QgsGraphArc& arc = source->arc( *arcIt );
       double cost = arc.property( criterionNum ).toDouble() + curCost;
 
       if ( cost < ( *result )[ arc.inVertex()] )
@@ -23,80 +23,142 @@
 #include <qgspoint.h>
 #include <qgsgeometry.h>
 #include <qgsdistancearea.h>
+#include <qgsspatialindex.h>
 
 // QT includes
+#include <QMultiHash>
+#include <QMultiMap>
 #include <QString>
 #include <QtAlgorithms>
 
 //standard includes
-#include <limits>
-#include <algorithm>
+#include <cmath>
+#include <cstring>
 
-class QgsPointCompare
+typedef QPair< qint64, qint64 > VertexKey;
+
+/** merges the points within the topology tolerance into one vertex. The vertices are
+ * hashed by cells of the size of the tolerance, so only the neighbouring cells are searched.
+ * Without tolerance they are hashed by their coordinates */
+class VertexSnapper
 {
   public:
-    QgsPointCompare( double tolerance ) :
-        mTolerance( tolerance )
+    VertexSnapper( QgsGraphBuilderInterface *builder ) :
+        mBuilder( builder ), mTolerance( builder->topologyTolerance() )
     {  }
 
-    bool operator()( const QgsPoint& p1, const QgsPoint& p2 ) const
+    //! index of the vertex next to the point. A new vertex is added if there is none within the tolerance
+    int vertex( const QgsPoint& pt )
     {
+      int idx = -1;
       if ( mTolerance <= 0 )
-        return p1.x() == p2.x() ? p1.y() < p2.y() : p1.x() < p2.x();
+      {
+        VertexKey key = exactKey( pt );
+        QMultiHash< VertexKey, int >::const_iterator it = mVertices.constFind( key );
+        for ( ; it != mVertices.constEnd() && it.key() == key; ++it )
+        {
+          if ( mPoints[ it.value()] == pt )
+            return it.value();
+        }
+        idx = addVertex( pt );
+        mVertices.insert( key, idx );
+        return idx;
+      }
+
+      qint64 cx = ( qint64 ) floor( pt.x() / mTolerance );
+      qint64 cy = ( qint64 ) floor( pt.y() / mTolerance );
+      double minDist = mTolerance * mTolerance;
+      for ( qint64 x = cx - 1; x <= cx + 1; ++x )
+      {
+        for ( qint64 y = cy - 1; y <= cy + 1; ++y )
+        {
+          VertexKey key( x, y );
+          QMultiHash< VertexKey, int >::const_iterator it = mVertices.constFind( key );
+          for ( ; it != mVertices.constEnd() && it.key() == key; ++it )
+          {
+            double dist = mPoints[ it.value()].sqrDist( pt );
+            if ( dist <= minDist && ( idx == -1 || dist < minDist || it.value() < idx ) )
+            {
+              minDist = dist;
+              idx = it.value();
+            }
+          }
+        }
+      }
+      if ( idx == -1 )
+      {
+        idx = addVertex( pt );
+        mVertices.insert( VertexKey( cx, cy ), idx );
+      }
+      return idx;
+    }
 
-      double tx1 = ceil( p1.x() / mTolerance );
-      double tx2 = ceil( p2.x() / mTolerance );
-      if ( tx1 == tx2 )
-        return ceil( p1.y() / mTolerance ) < ceil( p2.y() / mTolerance );
-      return tx1 < tx2;
+    const QgsPoint& point( int idx ) const
+    {
+      return mPoints[ idx ];
     }
 
   private:
+    int addVertex( const QgsPoint& pt )
+    {
+      mBuilder->addVertex( mPoints.size(), pt );
+      mPoints.push_back( pt );
+      return mPoints.size() - 1;
+    }
+
+    static VertexKey exactKey( const QgsPoint& pt )
+    {
+      // 0.0 and -0.0 are the same point
+      double x = pt.x() == 0.0 ? 0.0 : pt.x();
+      double y = pt.y() == 0.0 ? 0.0 : pt.y();
+      qint64 kx, ky;
+      memcpy( &kx, &x, sizeof( qint64 ) );
+      memcpy( &ky, &y, sizeof( qint64 ) );
+      return VertexKey( kx, ky );
+    }
+
+    QgsGraphBuilderInterface *mBuilder;
     double mTolerance;
+    QVector< QgsPoint > mPoints;
+    QMultiHash< VertexKey, int > mVertices;
 };
 
-template <typename RandIter, typename Type, typename CompareOp > RandIter my_binary_search( RandIter begin, RandIter end, Type val, CompareOp comp )
+//! squared distance of a point to the segment from pt1 to pt2
+static double sqrDistToSegment( const QgsPoint& pt, const QgsPoint& pt1, const QgsPoint& pt2, QgsPoint& tiedPoint )
 {
-  // result if not found
-  RandIter not_found = end;
-
-  while ( true )
+  if ( pt1 == pt2 )
   {
-    RandIter avg = begin + ( end - begin ) / 2;
-    if ( begin == avg || end == avg )
-    {
-      if ( !comp( *begin, val ) && !comp( val, *begin ) )
-        return begin;
-      if ( !comp( *end, val ) && !comp( val, *end ) )
-        return end;
-
-      return not_found;
-    }
-    if ( comp( val, *avg ) )
-      end = avg;
-    else if ( comp( *avg, val ) )
-      begin = avg;
-    else
-      return avg;
+    tiedPoint = pt1;
+    return pt.sqrDist( pt1 );
   }
-
-  return not_found;
+  return pt.sqrDistToSegment( pt1.x(), pt1.y(), pt2.x(), pt2.y(), tiedPoint );
 }
 
-struct TiePointInfo
+//! adds the arcs between two vertices of a feature in the directions of the feature
+static void addArcs( QgsGraphBuilderInterface *builder, const QList< QgsArcProperter* >& properterList, const QgsFeature& feature,
+                     int directionType, int pt1idx, const QgsPoint& pt1, int pt2idx, const QgsPoint& pt2 )
 {
-  QgsPoint mTiedPoint;
-  double mLength;
-  QgsPoint mFirstPoint;
-  QgsPoint mLastPoint;
-};
+  if ( pt1idx == pt2idx )
+    return;
 
-bool TiePointInfoCompare( const TiePointInfo& a, const TiePointInfo& b )
-{
-  if ( a.mFirstPoint == b.mFirstPoint )
-    return a.mLastPoint.x() == b.mLastPoint.x() ? a.mLastPoint.y() < b.mLastPoint.y() : a.mLastPoint.x() < b.mLastPoint.x();
+  double distance = builder->distanceArea()->measureLine( pt1, pt2 );
+  QVector< QVariant > prop;
+  QList< QgsArcProperter* >::const_iterator it;
+  for ( it = properterList.begin(); it != properterList.end(); ++it )
+  {
+    prop.push_back(( *it )->property( distance, feature ) );
+  }
 
-  return a.mFirstPoint.x() == b.mFirstPoint.x() ? a.mFirstPoint.y() < b.mFirstPoint.y() : a.mFirstPoint.x() < b.mFirstPoint.x();
+  if ( directionType == 1 ||
+       directionType == 3 )
+  {
+    builder->addArc( pt1idx, pt1, pt2idx, pt2, prop );
+  }
+  if ( directionType == 2 ||
+       directionType == 3 )
+  {
+    builder->addArc( pt2idx, pt2, pt1idx, pt1, prop );
+  }
 }
 
 QgsLineVectorLayerDirector::QgsLineVectorLayerDirector( QgsVectorLayer *myLayer,
@@ -149,99 +211,7 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
 
   tiedPoint = QVector< QgsPoint >( additionalPoints.size(), QgsPoint( 0.0, 0.0 ) );
 
-  TiePointInfo tmpInfo;
-  tmpInfo.mLength = std::numeric_limits<double>::infinity();
-
-  QVector< TiePointInfo > pointLengthMap( additionalPoints.size(), tmpInfo );
-  QVector< TiePointInfo >::iterator pointLengthIt;
-
-  //Graph's points;
-  QVector< QgsPoint > points;
-
-  QgsFeatureIterator fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QgsAttributeList() ) );
-
-  // begin: tie points to the graph
   QgsAttributeList la;
-  QgsFeature feature;
-  while ( fit.nextFeature( feature ) )
-  {
-    QgsMultiPolyline mpl;
-    if ( feature.geometry()->wkbType() == QGis::WKBMultiLineString )
-      mpl = feature.geometry()->asMultiPolyline();
-    else if ( feature.geometry()->wkbType() == QGis::WKBLineString )
-      mpl.push_back( feature.geometry()->asPolyline() );
-
-    QgsMultiPolyline::iterator mplIt;
-    for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
-    {
-      QgsPoint pt1, pt2;
-      bool isFirstPoint = true;
-      QgsPolyline::iterator pointIt;
-      for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
-      {
-        pt2 = ct.transform( *pointIt );
-        points.push_back( pt2 );
-
-        if ( !isFirstPoint )
-        {
-          int i = 0;
-          for ( i = 0; i != additionalPoints.size(); ++i )
-          {
-            TiePointInfo info;
-            if ( pt1 == pt2 )
-            {
-              info.mLength = additionalPoints[ i ].sqrDist( pt1 );
-              info.mTiedPoint = pt1;
-            }
-            else
-            {
-              info.mLength = additionalPoints[ i ].sqrDistToSegment( pt1.x(), pt1.y(),
-                             pt2.x(), pt2.y(), info.mTiedPoint );
-            }
-
-            if ( pointLengthMap[ i ].mLength > info.mLength )
-            {
-              Q_UNUSED( info.mTiedPoint );
-              info.mFirstPoint = pt1;
-              info.mLastPoint = pt2;
-
-              pointLengthMap[ i ] = info;
-              tiedPoint[ i ] = info.mTiedPoint;
-            }
-          }
-        }
-        pt1 = pt2;
-        isFirstPoint = false;
-      }
-    }
-    emit buildProgress( ++step, featureCount );
-  }
-  // end: tie points to graph
-
-  // add tied point to graph
-  int i = 0;
-  for ( i = 0; i < tiedPoint.size(); ++i )
-  {
-    if ( tiedPoint[ i ] != QgsPoint( 0.0, 0.0 ) )
-    {
-      points.push_back( tiedPoint [ i ] );
-    }
-  }
-
-  QgsPointCompare pointCompare( builder->topologyTolerance() );
-
-  qSort( points.begin(), points.end(), pointCompare );
-  QVector< QgsPoint >::iterator tmp = std::unique( points.begin(), points.end() );
-  points.resize( tmp - points.begin() );
-
-  for ( i = 0;i < points.size();++i )
-    builder->addVertex( i, points[ i ] );
-
-  for ( i = 0; i < tiedPoint.size() ; ++i )
-    tiedPoint[ i ] = *( my_binary_search( points.begin(), points.end(), tiedPoint[ i ], pointCompare ) );
-
-  qSort( pointLengthMap.begin(), pointLengthMap.end(), TiePointInfoCompare );
-
   {
     // fill attribute list 'la'
     QgsAttributeList tmpAttr;
@@ -277,8 +247,17 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
     }
   } // end fill attribute list 'la'
 
-  // begin graph construction
-  fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( la ) );
+  // begin: read the layer once, keep the transformed line parts and the attributes of the features
+  QVector< QgsPoint > points;
+  // parts are the points from partStart[i] to partStart[i + 1] - 1
+  QVector< int > partStart;
+  // parts of features are the parts from featurePartStart[i] to featurePartStart[i + 1] - 1
+  QVector< int > featurePartStart;
+  QVector< QgsFeature > features;
+  QVector< int > directionTypes;
+
+  QgsFeatureIterator fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( la ) );
+  QgsFeature feature;
   while ( fit.nextFeature( feature ) )
   {
     int directionType = mDefaultDirection;
@@ -298,97 +277,137 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
       directionType = 2;
     }
 
-    // begin features segments and add arc to the Graph;
     QgsMultiPolyline mpl;
-    if ( feature.geometry()->wkbType() == QGis::WKBMultiLineString )
+    if ( feature.geometry() && feature.geometry()->wkbType() == QGis::WKBMultiLineString )
       mpl = feature.geometry()->asMultiPolyline();
-    else if ( feature.geometry()->wkbType() == QGis::WKBLineString )
+    else if ( feature.geometry() && feature.geometry()->wkbType() == QGis::WKBLineString )
       mpl.push_back( feature.geometry()->asPolyline() );
 
+    // the arc properters only need the attributes
+    QgsFeature attributes( feature.id() );
+    attributes.setAttributes( feature.attributes() );
+    featurePartStart.push_back( partStart.size() );
+    features.push_back( attributes );
+    directionTypes.push_back( directionType );
+
     QgsMultiPolyline::iterator mplIt;
     for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
     {
-      QgsPoint pt1, pt2;
-
-      bool isFirstPoint = true;
+      partStart.push_back( points.size() );
       QgsPolyline::iterator pointIt;
       for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
       {
-        pt2 = ct.transform( *pointIt );
+        points.push_back( ct.transform( *pointIt ) );
+      }
+    }
+    emit buildProgress( ++step, featureCount );
+  }
+  featurePartStart.push_back( partStart.size() );
+  partStart.push_back( points.size() );
+  // end: read the layer
+
+  // begin: tie points to the graph
+  // a segment is identified by the index of its first point
+  QMultiHash< int, int > segmentTies;
+  if ( !additionalPoints.isEmpty() )
+  {
+    QgsSpatialIndex segmentIndex;
+    for ( int part = 0; part < partStart.size() - 1; ++part )
+    {
+      for ( int i = partStart[ part ]; i < partStart[ part + 1 ] - 1; ++i )
+      {
+        QgsPolyline segment;
+        segment << points[ i ] << points[ i + 1 ];
+        QgsFeature segmentFeature( i );
+        segmentFeature.setGeometry( QgsGeometry::fromPolyline( segment ) );
+        segmentIndex.insertFeature( segmentFeature );
+      }
+    }
 
-        if ( !isFirstPoint )
+    int i = 0;
+    for ( i = 0; i < additionalPoints.size(); ++i )
+    {
+      const QgsPoint& pt = additionalPoints[ i ];
+      QList< QgsFeatureId > nearest = segmentIndex.nearestNeighbor( pt, 1 );
+      if ( nearest.isEmpty() )
+        continue;
+
+      // the segment with the nearest bounding box bounds the distance, closer segments intersect the rectangle of that distance
+      int bestSegment = ( int ) nearest.first();
+      QgsPoint bestPoint;
+      double bestDist = sqrDistToSegment( pt, points[ bestSegment ], points[ bestSegment + 1 ], bestPoint );
+      double radius = sqrt( bestDist );
+      QList< QgsFeatureId > candidates = segmentIndex.intersects( QgsRectangle( pt.x() - radius, pt.y() - radius, pt.x() + radius, pt.y() + radius ) );
+      foreach ( QgsFeatureId id, candidates )
+      {
+        int segment = ( int ) id;
+        QgsPoint tied;
+        double dist = sqrDistToSegment( pt, points[ segment ], points[ segment + 1 ], tied );
+        if ( dist < bestDist || ( dist == bestDist && segment < bestSegment ) )
         {
-          std::map< double, QgsPoint > pointsOnArc;
-          pointsOnArc[ 0.0 ] = pt1;
-          pointsOnArc[ pt1.sqrDist( pt2 )] = pt2;
+          bestDist = dist;
+          bestSegment = segment;
+          bestPoint = tied;
+        }
+      }
 
-          TiePointInfo t;
-          t.mFirstPoint = pt1;
-          t.mLastPoint  = pt2;
-          pointLengthIt = my_binary_search( pointLengthMap.begin(), pointLengthMap.end(), t, TiePointInfoCompare );
+      tiedPoint[ i ] = bestPoint;
+      segmentTies.insert( bestSegment, i );
+    }
+  }
+  // end tie points to graph
 
-          if ( pointLengthIt != pointLengthMap.end() )
+  // begin graph construction
+  VertexSnapper snapper( builder );
+  QVector< int > tiedVertex( additionalPoints.size(), -1 );
+  int featureIdx = 0;
+  for ( featureIdx = 0; featureIdx < features.size(); ++featureIdx )
+  {
+    const QgsFeature& attributes = features[ featureIdx ];
+    int directionType = directionTypes[ featureIdx ];
+
+    int part = 0;
+    for ( part = featurePartStart[ featureIdx ]; part < featurePartStart[ featureIdx + 1 ]; ++part )
+    {
+      int first = partStart[ part ];
+      int last = partStart[ part + 1 ] - 1;
+      if ( first > last )
+        continue;
+
+      int pt1idx = snapper.vertex( points[ first ] );
+      int i = 0;
+      for ( i = first; i < last; ++i )
+      {
+        // the tied points divide the segment, they are ordered by the distance from the start
+        QList< int > ties = segmentTies.values( i );
+        if ( !ties.isEmpty() )
+        {
+          QMultiMap< double, int > pointsOnArc;
+          foreach ( int tie, ties )
           {
-            QVector< TiePointInfo >::iterator it;
-            for ( it = pointLengthIt; it - pointLengthMap.begin() >= 0; --it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
-            for ( it = pointLengthIt + 1; it != pointLengthMap.end(); ++it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
+            pointsOnArc.insert( points[ i ].sqrDist( tiedPoint[ tie ] ), tie );
           }
-
-          std::map< double, QgsPoint >::iterator pointsIt;
-          QgsPoint pt1;
-          QgsPoint pt2;
-          int pt1idx = -1, pt2idx = -1;
-          bool isFirstPoint = true;
-          for ( pointsIt = pointsOnArc.begin(); pointsIt != pointsOnArc.end(); ++pointsIt )
+          foreach ( int tie, pointsOnArc.values() )
           {
-            pt2 = pointsIt->second;
-            tmp = my_binary_search( points.begin(), points.end(), pt2, pointCompare );
-            pt2 = *tmp;
-            pt2idx = tmp - points.begin();
-
-            if ( !isFirstPoint && pt1 != pt2 )
-            {
-              double distance = builder->distanceArea()->measureLine( pt1, pt2 );
-              QVector< QVariant > prop;
-              QList< QgsArcProperter* >::const_iterator it;
-              for ( it = mProperterList.begin(); it != mProperterList.end(); ++it )
-              {
-                prop.push_back(( *it )->property( distance, feature ) );
-              }
-
-              if ( directionType == 1 ||
-                   directionType == 3 )
-              {
-                builder->addArc( pt1idx, pt1, pt2idx, pt2, prop );
-              }
-              if ( directionType == 2 ||
-                   directionType == 3 )
-              {
-                builder->addArc( pt2idx, pt2, pt1idx, pt1, prop );
-              }
-            }
-            pt1idx = pt2idx;
-            pt1 = pt2;
-            isFirstPoint = false;
+            int tieIdx = snapper.vertex( tiedPoint[ tie ] );
+            tiedVertex[ tie ] = tieIdx;
+            addArcs( builder, mProperterList, attributes, directionType, pt1idx, snapper.point( pt1idx ), tieIdx, snapper.point( tieIdx ) );
+            pt1idx = tieIdx;
           }
-        } // if ( !isFirstPoint )
-        pt1 = pt2;
-        isFirstPoint = false;
-      } // for (it = pl.begin(); it != pl.end(); ++it)
+        }
+
+        int pt2idx = snapper.vertex( points[ i + 1 ] );
+        addArcs( builder, mProperterList, attributes, directionType, pt1idx, snapper.point( pt1idx ), pt2idx, snapper.point( pt2idx ) );
+        pt1idx = pt2idx;
+      }
     }
     emit buildProgress( ++step, featureCount );
-  } // while( vl->nextFeature(feature) )
-} // makeGraph( QgsGraphBuilderInterface *builder, const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoint )
+  }
 
+  int i = 0;
+  for ( i = 0; i < tiedPoint.size(); ++i )
+  {
+    if ( tiedVertex[ i ] != -1 )
+      tiedPoint[ i ] = snapper.point( tiedVertex[ i ] );
+  }
+} // makeGraph( QgsGraphBuilderInterface *builder, const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoint )
@@ -0,0 +1,518 @@
+/***************************************************************************
+  qgsroutinggraph.cpp
+  --------------------------------------
+  Date                 : May 2014
+  Copyright            : (C) 2014 by QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+// C++ standard includes
+#include <cmath>
+#include <limits>
+
+// QT includes
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+//QGIS-includes
+#include "qgsgraph.h"
+#include "qgsroutinggraph.h"
+
+#define INFINITE_COST std::numeric_limits<double>::infinity()
+
+/** binary min heap of vertices with decrease-key. The heap knows the position of
+ * every vertex, so a vertex is in the heap at most once */
+class RgHeap
+{
+  public:
+    explicit RgHeap( int vertexCount ) : mPosition( vertexCount, -1 ) {}
+
+    bool isEmpty() const { return mHeap.isEmpty(); }
+
+    double topKey() const { return mHeap.at( 0 ).key; }
+
+    //! inserts the vertex or lowers its key
+    void push( int vertex, double key )
+    {
+      int pos = mPosition.at( vertex );
+      if ( pos < 0 )
+      {
+        pos = mHeap.size();
+        mHeap.append( Entry( key, vertex ) );
+        mPosition[vertex] = pos;
+      }
+      else
+      {
+        mHeap[pos].key = key;
+      }
+      siftUp( pos );
+    }
+
+    int pop()
+    {
+      int vertex = mHeap.at( 0 ).vertex;
+      mPosition[vertex] = -1;
+      Entry last = mHeap.last();
+      mHeap.pop_back();
+      if ( !mHeap.isEmpty() )
+      {
+        mHeap[0] = last;
+        mPosition[last.vertex] = 0;
+        siftDown( 0 );
+      }
+      return vertex;
+    }
+
+  private:
+    struct Entry
+    {
+      Entry() : key( 0 ), vertex( -1 ) {}
+      Entry( double k, int v ) : key( k ), vertex( v ) {}
+      double key;
+      int vertex;
+    };
+
+    void siftUp( int pos )
+    {
+      Entry entry = mHeap.at( pos );
+      while ( pos > 0 )
+      {
+        int parent = ( pos - 1 ) / 2;
+        if ( mHeap.at( parent ).key <= entry.key )
+          break;
+        mHeap[pos] = mHeap.at( parent );
+        mPosition[mHeap.at( pos ).vertex] = pos;
+        pos = parent;
+      }
+      mHeap[pos] = entry;
+      mPosition[entry.vertex] = pos;
+    }
+
+    void siftDown( int pos )
+    {
+      Entry entry = mHeap.at( pos );
+      int size = mHeap.size();
+      while ( true )
+      {
+        int child = 2 * pos + 1;
+        if ( child >= size )
+          break;
+        if ( child + 1 < size && mHeap.at( child + 1 ).key < mHeap.at( child ).key )
+          ++child;
+        if ( entry.key <= mHeap.at( child ).key )
+          break;
+        mHeap[pos] = mHeap.at( child );
+        mPosition[mHeap.at( pos ).vertex] = pos;
+        pos = child;
+      }
+      mHeap[pos] = entry;
+      mPosition[entry.vertex] = pos;
+    }
+
+    QVector<Entry> mHeap;
+    QVector<int> mPosition;
+};
+
+//! cost row of a start vertex of a cost matrix
+struct RgCostMatrixRow
+{
+  typedef QVector<double> result_type;
+
+  RgCostMatrixRow( const QgsRoutingGraph* graph, const QVector<int>& endVertices )
+      : mGraph( graph ), mEndVertices( endVertices )
+  {}
+
+  QVector<double> operator()( const QVector<int>& startVertices ) const
+  {
+    QVector<double> costs;
+    costs.reserve( startVertices.size() * mEndVertices.size() );
+    foreach ( int startVertex, startVertices )
+    {
+      costs += mGraph->costRow( startVertex, mEndVertices );
+    }
+    return costs;
+  }
+
+  const QgsRoutingGraph* mGraph;
+  QVector<int> mEndVertices;
+};
+
+QgsRoutingGraph::QgsRoutingGraph()
+    : mCostPerDistance( 0 )
+    , mMaxThreads( 0 )
+{
+  mOut.offsets.fill( 0, 1 );
+  mIn.offsets.fill( 0, 1 );
+}
+
+QgsRoutingGraph::QgsRoutingGraph( const QgsGraph* graph, int criterionNum )
+    : mCostPerDistance( INFINITE_COST )
+    , mMaxThreads( 0 )
+{
+  int nVertices = graph->vertexCount();
+  int nArcs = graph->arcCount();
+
+  mX.resize( nVertices );
+  mY.resize( nVertices );
+  for ( int i = 0; i < nVertices; ++i )
+  {
+    QgsPoint point = graph->vertex( i ).point();
+    mX[i] = point.x();
+    mY[i] = point.y();
+  }
+
+  // the property is converted once instead of on every relaxation
+  QVector<double> costs( nArcs );
+  mOut.offsets.fill( 0, nVertices + 1 );
+  mIn.offsets.fill( 0, nVertices + 1 );
+  for ( int i = 0; i < nArcs; ++i )
+  {
+    const QgsGraphArc& arc = graph->arc( i );
+    costs[i] = arc.property( criterionNum ).toDouble();
+    ++mOut.offsets[arc.outVertex() + 1];
+    ++mIn.offsets[arc.inVertex() + 1];
+
+    double dx = mX.at( arc.inVertex() ) - mX.at( arc.outVertex() );
+    double dy = mY.at( arc.inVertex() ) - mY.at( arc.outVertex() );
+    double length = sqrt( dx * dx + dy * dy );
+    if ( length > 0 )
+    {
+      mCostPerDistance = qMin( mCostPerDistance, costs.at( i ) / length );
+    }
+  }
+  if ( mCostPerDistance == INFINITE_COST || mCostPerDistance < 0 )
+  {
+    mCostPerDistance = 0;
+  }
+
+  for ( int i = 0; i < nVertices; ++i )
+  {
+    mOut.offsets[i + 1] += mOut.offsets.at( i );
+    mIn.offsets[i + 1] += mIn.offsets.at( i );
+  }
+
+  mOut.vertices.resize( nArcs );
+  mOut.arcs.resize( nArcs );
+  mOut.costs.resize( nArcs );
+  mIn.vertices.resize( nArcs );
+  mIn.arcs.resize( nArcs );
+  mIn.costs.resize( nArcs );
+  QVector<int> outFill = mOut.offsets;
+  QVector<int> inFill = mIn.offsets;
+  for ( int i = 0; i < nArcs; ++i )
+  {
+    const QgsGraphArc& arc = graph->arc( i );
+    int pos = outFill[arc.outVertex()]++;
+    mOut.vertices[pos] = arc.inVertex();
+    mOut.arcs[pos] = i;
+    mOut.costs[pos] = costs.at( i );
+
+    pos = inFill[arc.inVertex()]++;
+    mIn.vertices[pos] = arc.outVertex();
+    mIn.arcs[pos] = i;
+    mIn.costs[pos] = costs.at( i );
+  }
+}
+
+int QgsRoutingGraph::vertexCount() const
+{
+  return mOut.offsets.size() - 1;
+}
+
+int QgsRoutingGraph::arcCount() const
+{
+  return mOut.arcs.size();
+}
+
+QgsPoint QgsRoutingGraph::vertexPoint( int idx ) const
+{
+  return QgsPoint( mX.at( idx ), mY.at( idx ) );
+}
+
+void QgsRoutingGraph::dijkstra( int startVertexIdx, QVector<double>& resultCost, QVector<int>* resultTree ) const
+{
+  int nVertices = vertexCount();
+  resultCost.fill( INFINITE_COST, nVertices );
+  if ( resultTree )
+  {
+    resultTree->fill( -1, nVertices );
+  }
+  if ( startVertexIdx < 0 || startVertexIdx >= nVertices )
+  {
+    return;
+  }
+
+  RgHeap heap( nVertices );
+  resultCost[startVertexIdx] = 0.0;
+  heap.push( startVertexIdx, 0.0 );
+
+  while ( !heap.isEmpty() )
+  {
+    int vertex = heap.pop();
+    double cost = resultCost.at( vertex );
+    for ( int i = mOut.offsets.at( vertex ); i < mOut.offsets.at( vertex + 1 ); ++i )
+    {
+      double newCost = cost + mOut.costs.at( i );
+      int target = mOut.vertices.at( i );
+      if ( newCost < resultCost.at( target ) )
+      {
+        resultCost[target] = newCost;
+        if ( resultTree )
+        {
+          ( *resultTree )[target] = mOut.arcs.at( i );
+        }
+        heap.push( target, newCost );
+      }
+    }
+  }
+}
+
+double QgsRoutingGraph::shortestPath( int startVertexIdx, int endVertexIdx, Algorithm algorithm, QVector<int>* resultArcs ) const
+{
+  if ( resultArcs )
+  {
+    resultArcs->clear();
+  }
+  if ( startVertexIdx < 0 || startVertexIdx >= vertexCount() || endVertexIdx < 0 || endVertexIdx >= vertexCount() )
+  {
+    return INFINITE_COST;
+  }
+  if ( startVertexIdx == endVertexIdx )
+  {
+    return 0.0;
+  }
+
+  switch ( algorithm )
+  {
+    case Dijkstra:
+      return dijkstraPath( startVertexIdx, endVertexIdx, false, resultArcs );
+    case AStar:
+      return dijkstraPath( startVertexIdx, endVertexIdx, true, resultArcs );
+    case Bidirectional:
+      break;
+  }
+  return bidirectionalPath( startVertexIdx, endVertexIdx, resultArcs );
+}
+
+double QgsRoutingGraph::dijkstraPath( int startVertexIdx, int endVertexIdx, bool directed, QVector<int>* resultArcs ) const
+{
+  int nVertices = vertexCount();
+  QVector<double> costs( nVertices, INFINITE_COST );
+  QVector<int> previous( nVertices, -1 );
+  QVector<int> previousArc( nVertices, -1 );
+
+  // A*: the heap is ordered by the cost plus a lower bound of the remaining cost.
+  // The bound never exceeds the cost of an arc plus the bound of its end, so each vertex is settled once
+  double endX = mX.at( endVertexIdx );
+  double endY = mY.at( endVertexIdx );
+  double factor = directed ? mCostPerDistance : 0.0;
+
+  RgHeap heap( nVertices );
+  costs[startVertexIdx] = 0.0;
+  heap.push( startVertexIdx, 0.0 );
+
+  while ( !heap.isEmpty() )
+  {
+    int vertex = heap.pop();
+    if ( vertex == endVertexIdx )
+    {
+      break;
+    }
+
+    double cost = costs.at( vertex );
+    for ( int i = mOut.offsets.at( vertex ); i < mOut.offsets.at( vertex + 1 ); ++i )
+    {
+      double newCost = cost + mOut.costs.at( i );
+      int target = mOut.vertices.at( i );
+      if ( newCost < costs.at( target ) )
+      {
+        costs[target] = newCost;
+        previous[target] = vertex;
+        previousArc[target] = mOut.arcs.at( i );
+        double estimate = 0.0;
+        if ( factor > 0 )
+        {
+          double dx = endX - mX.at( target );
+          double dy = endY - mY.at( target );
+          estimate = factor * sqrt( dx * dx + dy * dy );
+        }
+        heap.push( target, newCost + estimate );
+      }
+    }
+  }
+
+  if ( resultArcs && costs.at( endVertexIdx ) != INFINITE_COST )
+  {
+    for ( int vertex = endVertexIdx; vertex != startVertexIdx; vertex = previous.at( vertex ) )
+    {
+      resultArcs->prepend( previousArc.at( vertex ) );
+    }
+  }
+  return costs.at( endVertexIdx );
+}
+
+double QgsRoutingGraph::bidirectionalPath( int startVertexIdx, int endVertexIdx, QVector<int>* resultArcs ) const
+{
+  int nVertices = vertexCount();
+
+  // forward search on the outgoing arcs from the start, backward search on the incoming arcs from the end
+  const Adjacency* adjacency[2] = { &mOut, &mIn };
+  QVector<double> costs[2];
+  QVector<int> next[2];
+  QVector<int> nextArc[2];
+  RgHeap forwardHeap( nVertices );
+  RgHeap backwardHeap( nVertices );
+  RgHeap* heaps[2] = { &forwardHeap, &backwardHeap };
+  int startVertices[2] = { startVertexIdx, endVertexIdx };
+  for ( int d = 0; d < 2; ++d )
+  {
+    costs[d].fill( INFINITE_COST, nVertices );
+    next[d].fill( -1, nVertices );
+    nextArc[d].fill( -1, nVertices );
+    costs[d][startVertices[d]] = 0.0;
+    heaps[d]->push( startVertices[d], 0.0 );
+  }
+
+  double best = INFINITE_COST;
+  int meetingVertex = -1;
+
+  // once the sum of the smallest keys exceeds the best path found, no shorter path can exist
+  while ( !forwardHeap.isEmpty() && !backwardHeap.isEmpty() && forwardHeap.topKey() + backwardHeap.topKey() < best )
+  {
+    // expand the search with the smaller frontier
+    int d = forwardHeap.topKey() <= backwardHeap.topKey() ? 0 : 1;
+    const Adjacency& arcs = *adjacency[d];
+    int vertex = heaps[d]->pop();
+    double cost = costs[d].at( vertex );
+
+    for ( int i = arcs.offsets.at( vertex ); i < arcs.offsets.at( vertex + 1 ); ++i )
+    {
+      double newCost = cost + arcs.costs.at( i );
+      int target = arcs.vertices.at( i );
+      if ( newCost < costs[d].at( target ) )
+      {
+        costs[d][target] = newCost;
+        next[d][target] = vertex;
+        nextArc[d][target] = arcs.arcs.at( i );
+        heaps[d]->push( target, newCost );
+      }
+      double pathCost = costs[d].at( target ) + costs[1 - d].at( target );
+      if ( pathCost < best )
+      {
+        best = pathCost;
+        meetingVertex = target;
+      }
+    }
+  }
+
+  if ( resultArcs && meetingVertex >= 0 )
+  {
+    for ( int vertex = meetingVertex; vertex != startVertexIdx; vertex = next[0].at( vertex ) )
+    {
+      resultArcs->prepend( nextArc[0].at( vertex ) );
+    }
+    for ( int vertex = meetingVertex; vertex != endVertexIdx; vertex = next[1].at( vertex ) )
+    {
+      resultArcs->append( nextArc[1].at( vertex ) );
+    }
+  }
+  return best;
+}
+
+QVector<double> QgsRoutingGraph::costRow( int startVertexIdx, const QVector<int>& endVertices ) const
+{
+  int nVertices = vertexCount();
+  QVector<double> costs( nVertices, INFINITE_COST );
+  QVector<double> row( endVertices.size(), INFINITE_COST );
+  if ( startVertexIdx < 0 || startVertexIdx >= nVertices )
+  {
+    return row;
+  }
+
+  // the number of distinct end vertices, which are not yet settled
+  QVector<bool> isEnd( nVertices, false );
+  int remaining = 0;
+  foreach ( int endVertex, endVertices )
+  {
+    if ( endVertex >= 0 && endVertex < nVertices && !isEnd.at( endVertex ) )
+    {
+      isEnd[endVertex] = true;
+      ++remaining;
+    }
+  }
+
+  RgHeap heap( nVertices );
+  costs[startVertexIdx] = 0.0;
+  heap.push( startVertexIdx, 0.0 );
+
+  while ( !heap.isEmpty() && remaining > 0 )
+  {
+    int vertex = heap.pop();
+    if ( isEnd.at( vertex ) )
+    {
+      --remaining;
+    }
+
+    double cost = costs.at( vertex );
+    for ( int i = mOut.offsets.at( vertex ); i < mOut.offsets.at( vertex + 1 ); ++i )
+    {
+      double newCost = cost + mOut.costs.at( i );
+      int target = mOut.vertices.at( i );
+      if ( newCost < costs.at( target ) )
+      {
+        costs[target] = newCost;
+        heap.push( target, newCost );
+      }
+    }
+  }
+
+  for ( int i = 0; i < endVertices.size(); ++i )
+  {
+    int endVertex = endVertices.at( i );
+    if ( endVertex >= 0 && endVertex < nVertices )
+    {
+      row[i] = costs.at( endVertex );
+    }
+  }
+  return row;
+}
+
+QVector<double> QgsRoutingGraph::costMatrix( const QVector<int>& startVertices, const QVector<int>& endVertices ) const
+{
+  // one task per thread, each one searches from a part of the start vertices
+  int threads = mMaxThreads > 0 ? mMaxThreads : QThreadPool::globalInstance()->maxThreadCount();
+  threads = qBound( 1, threads, qMax( startVertices.size(), 1 ) );
+
+  QList< QVector<int> > tasks;
+  for ( int i = 0; i < threads; ++i )
+  {
+    int begin = startVertices.size() * i / threads;
+    int end = startVertices.size() * ( i + 1 ) / threads;
+    tasks << startVertices.mid( begin, end - begin );
+  }
+
+  RgCostMatrixRow costMatrixRow( this, endVertices );
+  QList< QVector<double> > rows;
+  if ( tasks.size() > 1 )
+  {
+    rows = QtConcurrent::blockingMapped( tasks, costMatrixRow );
+  }
+  else
+  {
+    rows << costMatrixRow( tasks.first() );
+  }
+
+  QVector<double> matrix;
+  matrix.reserve( startVertices.size() * endVertices.size() );
+  foreach ( const QVector<double>& row, rows )
+  {
+    matrix += row;
+  }
+  return matrix;
+}
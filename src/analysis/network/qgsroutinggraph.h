@@ -0,0 +1,136 @@
+/***************************************************************************
+  qgsroutinggraph.h
+  --------------------------------------
+  Date                 : May 2014
+  Copyright            : (C) 2014 by QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSROUTINGGRAPHH
+#define QGSROUTINGGRAPHH
+
+// QT4 includes
+#include <QVector>
+
+// QGIS includes
+#include "qgspoint.h"
+
+class QgsGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsRoutingGraph
+ * \brief Compact copy of a QgsGraph for fast shortest path queries on one cost criterion.
+ *
+ * The arcs are stored in compressed sparse row form, i.e. the arcs leaving (and entering)
+ * a vertex are consecutive entries of plain arrays and the cost of each arc is converted
+ * to a double once. The searches use a binary heap with decrease-key. Vertex and arc
+ * indices are the ones of the source graph, so results can be used with the QgsGraph.
+ * Arc costs have to be non-negative.
+ *
+ * All query methods are const and may be called from several threads at the same time.
+ * \note added in 2.4
+ */
+class ANALYSIS_EXPORT QgsRoutingGraph
+{
+  public:
+    /** Search algorithm of a point to point query */
+    enum Algorithm
+    {
+      Dijkstra,      //!< search from the start vertex until the end vertex is reached
+      Bidirectional, //!< searches from both vertices until they meet
+      AStar          //!< search directed to the end vertex by a lower bound of the remaining cost
+    };
+
+    QgsRoutingGraph();
+
+    /**
+     * Creates the routing graph for a graph
+     * @param graph the source graph
+     * @param criterionNum index of arc property used as cost
+     */
+    QgsRoutingGraph( const QgsGraph* graph, int criterionNum );
+
+    /**
+     * return vertex count
+     */
+    int vertexCount() const;
+
+    /**
+     * return arc count
+     */
+    int arcCount() const;
+
+    /**
+     * return vertex point
+     */
+    QgsPoint vertexPoint( int idx ) const;
+
+    /**
+     * solve shortest path problem for all vertices using dijkstra algorithm
+     * @param startVertexIdx index of start vertex
+     * @param resultCost cost of the path to each vertex, infinity for unreachable vertices
+     * @param resultTree array represents the shortest path tree. resultTree[ vertexIndex ] == inboundingArcIndex if vertex reacheble and resultTree[ vertexIndex ] == -1 others.
+     */
+    void dijkstra( int startVertexIdx, QVector<double>& resultCost, QVector<int>* resultTree = 0 ) const;
+
+    /**
+     * solve shortest path problem between two vertices
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param algorithm search algorithm. All algorithms return the same cost
+     * @param resultArcs if not null, receives the indices of the arcs from the start to the end vertex
+     * @return cost of the path, infinity if the end vertex is not reachable
+     */
+    double shortestPath( int startVertexIdx, int endVertexIdx, Algorithm algorithm = Bidirectional, QVector<int>* resultArcs = 0 ) const;
+
+    /**
+     * calculates the costs of the shortest paths from a list of vertices to a list of vertices.
+     * The searches of the start vertices run in parallel.
+     * @param startVertices indices of start vertices
+     * @param endVertices indices of end vertices
+     * @return the costs row by row, i.e. result[ i * endVertices.size() + j ] is the cost from startVertices[i] to endVertices[j]
+     */
+    QVector<double> costMatrix( const QVector<int>& startVertices, const QVector<int>& endVertices ) const;
+
+    /** Number of threads used by costMatrix, 0 to use the size of the global thread pool */
+    void setMaxThreads( int threads ) { mMaxThreads = threads; }
+    int maxThreads() const { return mMaxThreads; }
+
+  private:
+    //! one direction of the arcs. The arcs of vertex v are the entries offsets[v] to offsets[v + 1] - 1
+    struct Adjacency
+    {
+      QVector<int> offsets;
+      //! vertex at the other end of the arc
+      QVector<int> vertices;
+      //! index of the arc in the source graph
+      QVector<int> arcs;
+      QVector<double> costs;
+    };
+
+    double dijkstraPath( int startVertexIdx, int endVertexIdx, bool directed, QVector<int>* resultArcs ) const;
+    double bidirectionalPath( int startVertexIdx, int endVertexIdx, QVector<int>* resultArcs ) const;
+    //! costs from a vertex to a list of vertices, the search stops once all of them are reached
+    QVector<double> costRow( int startVertexIdx, const QVector<int>& endVertices ) const;
+
+    Adjacency mOut;
+    Adjacency mIn;
+    QVector<double> mX;
+    QVector<double> mY;
+
+    //! smallest ratio of cost to straight line length of an arc, the A* estimate of the remaining cost is this ratio times the distance
+    double mCostPerDistance;
+
+    int mMaxThreads;
+
+    friend struct RgCostMatrixRow;
+};
+
+#endif //QGSROUTINGGRAPHH
@@ -0,0 +1,487 @@
+/***************************************************************************
+                          qgskerneldensityestimation.cpp  -  description
+                          ------------------------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgskerneldensityestimation.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgslogger.h"
+#include "qgsvectorlayer.h"
+#include "gdal.h"
+#include "cpl_string.h"
+
+#include <QFile>
+#include <QMap>
+#include <QProgressDialog>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrentMap>
+
+#include <cmath>
+
+#define NO_DATA -9999
+
+// Default limit for the memory used by the grids
+#define DEFAULT_MAXIMUM_MEMORY ( 512 * 1024 * 1024 )
+
+// Minimum number of points accumulated by each thread
+#define MIN_POINTS_PER_THREAD 1000
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
+#define TO8F(x) (x).toUtf8().constData()
+#else
+#define TO8F(x) QFile::encodeName( x ).constData()
+#endif
+
+//! precomputed kernel values for a radius in cells
+struct KdeStamp
+{
+  int radius;
+  //! for each row of the stamp the number of cells left and right of the center within the radius
+  QVector<int> halfWidths;
+  //! (2 * radius + 1)^2 kernel values, row by row
+  QVector<double> values;
+};
+
+//! point in cell coordinates
+struct KdePoint
+{
+  int column;
+  int row;
+  int stamp;
+  double weight;
+};
+
+//! range of points accumulated into a partial grid by one thread
+struct KdeTask
+{
+  const QVector<KdePoint>* points;
+  const QVector<KdeStamp>* stamps;
+  int begin;
+  int end;
+  int bandStart;
+  int bandRows;
+  int columns;
+  float* grid;
+};
+
+static bool kdePointRowLessThan( const KdePoint& p1, const KdePoint& p2 )
+{
+  return p1.row < p2.row;
+}
+
+static KdeStamp createStamp( int radius, QgsKernelDensityEstimation::KernelShape shape, double decay )
+{
+  KdeStamp stamp;
+  stamp.radius = radius;
+
+  int size = 2 * radius + 1;
+  stamp.halfWidths.resize( size );
+  stamp.values.fill( 0.0, size * size );
+
+  for ( int dy = -radius; dy <= radius; ++dy )
+  {
+    int halfWidth = 0;
+    for ( int dx = -radius; dx <= radius; ++dx )
+    {
+      // is cell outside search bandwidth of the point?
+      if ( dx * dx + dy * dy > radius * radius )
+        continue;
+
+      double distance = sqrt(( double )( dx * dx + dy * dy ) );
+      stamp.values[( dy + radius ) * size + dx + radius] = QgsKernelDensityEstimation::kernelValue( shape, distance, radius, decay );
+      halfWidth = qMax( halfWidth, qAbs( dx ) );
+    }
+    stamp.halfWidths[dy + radius] = halfWidth;
+  }
+
+  return stamp;
+}
+
+static void accumulate( KdeTask& task )
+{
+  int bandEnd = task.bandStart + task.bandRows;
+
+  for ( int i = task.begin; i < task.end; ++i )
+  {
+    const KdePoint& point = task.points->at( i );
+    const KdeStamp& stamp = task.stamps->at( point.stamp );
+    int radius = stamp.radius;
+    int size = 2 * radius + 1;
+
+    int firstRow = qMax( point.row - radius, task.bandStart );
+    int lastRow = qMin( point.row + radius, bandEnd - 1 );
+    for ( int row = firstRow; row <= lastRow; ++row )
+    {
+      int dy = row - point.row;
+      int halfWidth = stamp.halfWidths[dy + radius];
+      int firstColumn = qMax( point.column - halfWidth, 0 );
+      int lastColumn = qMin( point.column + halfWidth, task.columns - 1 );
+
+      // stamp values indexed by grid column
+      const double* values = stamp.values.constData() + ( dy + radius ) * size + radius - point.column;
+      float* cells = task.grid + ( row - task.bandStart ) * task.columns;
+      for ( int column = firstColumn; column <= lastColumn; ++column )
+      {
+        float value = cells[column];
+        cells[column] = ( value == NO_DATA ? 0 : value ) + point.weight * values[column];
+      }
+    }
+  }
+}
+
+QgsKernelDensityEstimation::QgsKernelDensityEstimation( QgsVectorLayer* pointLayer, const QString& outputFile, const QString& outputFormat )
+    : mPointLayer( pointLayer )
+    , mOutputFile( outputFile )
+    , mOutputFormat( outputFormat )
+    , mCellSize( 0 )
+    , mColumns( 0 )
+    , mRows( 0 )
+    , mRadius( 0 )
+    , mRadiusField( -1 )
+    , mRadiusToMapUnits( 1.0 )
+    , mWeightField( -1 )
+    , mKernelShape( Quartic )
+    , mDecay( 0 )
+    , mMaximumMemory( DEFAULT_MAXIMUM_MEMORY )
+    , mMaxThreads( 0 )
+{
+  if ( mPointLayer )
+  {
+    mExtent = mPointLayer->extent();
+  }
+}
+
+QgsKernelDensityEstimation::~QgsKernelDensityEstimation()
+{
+}
+
+QgsKernelDensityEstimation::Result QgsKernelDensityEstimation::run( QProgressDialog* p )
+{
+  if ( !mPointLayer || mCellSize <= 0 || ( mRadiusField < 0 && mRadius <= 0 ) )
+  {
+    return InvalidParameters;
+  }
+
+  int columns = mColumns;
+  int rows = mRows;
+  if ( columns <= 0 || rows <= 0 )
+  {
+    columns = qMax( qRound( mExtent.width() / mCellSize ) + 1, 1 );
+    rows = qMax( qRound( mExtent.height() / mCellSize ) + 1, 1 );
+  }
+
+  //open driver
+  GDALAllRegister();
+  GDALDriverH outputDriver = GDALGetDriverByName( mOutputFormat.toLocal8Bit().data() );
+  if ( outputDriver == NULL )
+  {
+    return DriverError;
+  }
+
+  char **driverMetadata = GDALGetMetadata( outputDriver, NULL );
+  if ( !CSLFetchBoolean( driverMetadata, GDAL_DCAP_CREATE, false ) )
+  {
+    return DriverError; //driver exist, but it does not support the create operation
+  }
+
+  //open output file
+  GDALDatasetH outputDataset = GDALCreate( outputDriver, TO8F( mOutputFile ), columns, rows, 1, GDT_Float32, NULL );
+  if ( outputDataset == NULL )
+  {
+    return FileCreationError;
+  }
+
+  double geoTransform[6] = { mExtent.xMinimum(), mCellSize, 0, mExtent.yMinimum(), 0, mCellSize };
+  GDALSetGeoTransform( outputDataset, geoTransform );
+  GDALSetProjection( outputDataset, mPointLayer->crs().toWkt().toLocal8Bit().data() );
+
+  GDALRasterBandH outputRasterBand = GDALGetRasterBand( outputDataset, 1 );
+  GDALSetRasterNoDataValue( outputRasterBand, NO_DATA );
+
+  // Read the points and create the kernel stamps for their radii
+  QgsAttributeList attributes;
+  if ( mRadiusField >= 0 )
+  {
+    attributes.append( mRadiusField );
+  }
+  if ( mWeightField >= 0 )
+  {
+    attributes.append( mWeightField );
+  }
+
+  QVector<KdeStamp> stamps;
+  QMap<int, int> stampIndex;
+  QVector<KdePoint> points;
+  int maxRadius = 0;
+  bool canceled = false;
+
+  if ( p )
+  {
+    p->setMaximum( mPointLayer->featureCount() );
+  }
+
+  QgsFeatureIterator fit = mPointLayer->getFeatures( QgsFeatureRequest().setFilterRect( mExtent ).setSubsetOfAttributes( attributes ) );
+  QgsFeature feature;
+  int counter = 0;
+  while ( fit.nextFeature( feature ) )
+  {
+    ++counter;
+    if ( p && counter % 1000 == 0 )
+    {
+      p->setValue( counter );
+      if ( p->wasCanceled() )
+      {
+        canceled = true;
+        break;
+      }
+    }
+
+    QgsGeometry* geometry = feature.geometry();
+    if ( !geometry )
+    {
+      continue;
+    }
+
+    QgsMultiPoint featurePoints;
+    if ( geometry->isMultipart() )
+    {
+      featurePoints = geometry->asMultiPoint();
+    }
+    else
+    {
+      featurePoints << geometry->asPoint();
+    }
+
+    // radii smaller than a cell would give an empty kernel
+    double radius = mRadiusField >= 0 ? feature.attribute( mRadiusField ).toDouble() * mRadiusToMapUnits : mRadius;
+    int cells = qMax( cellRadius( radius, mCellSize ), 1 );
+
+    QMap<int, int>::const_iterator stampIt = stampIndex.constFind( cells );
+    if ( stampIt == stampIndex.constEnd() )
+    {
+      stampIt = stampIndex.insert( cells, stamps.size() );
+      stamps.append( createStamp( cells, mKernelShape, mDecay ) );
+      maxRadius = qMax( maxRadius, cells );
+    }
+
+    KdePoint point;
+    point.stamp = stampIt.value();
+    point.weight = mWeightField >= 0 ? feature.attribute( mWeightField ).toDouble() : 1.0;
+
+    for ( int i = 0; i < featurePoints.size(); ++i )
+    {
+      const QgsPoint& pt = featurePoints.at( i );
+      // avoiding any out of extent points
+      if ( pt.x() < mExtent.xMinimum() || pt.y() < mExtent.yMinimum() ||
+           pt.x() > mExtent.xMaximum() || pt.y() > mExtent.yMaximum() )
+      {
+        continue;
+      }
+
+      point.column = ( int ) floor(( pt.x() - mExtent.xMinimum() ) / mCellSize );
+      point.row = ( int ) floor(( pt.y() - mExtent.yMinimum() ) / mCellSize );
+      points.append( point );
+    }
+  }
+
+  QgsDebugMsg( QString( "%1 points with %2 kernel radii" ).arg( points.size() ).arg( stamps.size() ) );
+
+  // Sort the points by row so that the points of a band are found by binary search
+  // and each thread accumulates points which are close to each other
+  qSort( points.begin(), points.end(), kdePointRowLessThan );
+
+  int threads = mMaxThreads > 0 ? mMaxThreads : QThreadPool::globalInstance()->maxThreadCount();
+  threads = qBound( 1, threads, qMax( 1, points.size() / MIN_POINTS_PER_THREAD ) );
+
+  // Each thread has its own partial grid of a band of rows
+  qint64 gridCells = qMin( mMaximumMemory / ( qint64 ) sizeof( float ), ( qint64 ) 1 << 28 );
+  int bandRows = ( int ) qBound(( qint64 ) 1, gridCells / (( qint64 ) columns * threads ), ( qint64 ) rows );
+  int bands = ( rows + bandRows - 1 ) / bandRows;
+
+  QgsDebugMsg( QString( "accumulating in %1 bands of %2 rows with %3 threads" ).arg( bands ).arg( bandRows ).arg( threads ) );
+
+  if ( p )
+  {
+    p->setMaximum( bands );
+    p->setValue( 0 );
+  }
+
+  QVector<float> grids( threads * bandRows * columns );
+  for ( int bandStart = 0; bandStart < rows; bandStart += bandRows )
+  {
+    int nRows = qMin( bandRows, rows - bandStart );
+    int bandCells = nRows * columns;
+    qFill( grids.begin(), grids.begin() + threads * bandCells, ( float ) NO_DATA );
+
+    KdePoint firstPoint;
+    firstPoint.row = bandStart - maxRadius;
+    KdePoint endPoint;
+    endPoint.row = bandStart + nRows + maxRadius;
+    int begin = qLowerBound( points.constBegin(), points.constEnd(), firstPoint, kdePointRowLessThan ) - points.constBegin();
+    int end = qLowerBound( points.constBegin(), points.constEnd(), endPoint, kdePointRowLessThan ) - points.constBegin();
+
+    QList<KdeTask> tasks;
+    for ( int i = 0; i < threads; ++i )
+    {
+      KdeTask task;
+      task.points = &points;
+      task.stamps = &stamps;
+      task.begin = begin + ( qint64 )( end - begin ) * i / threads;
+      task.end = begin + ( qint64 )( end - begin ) * ( i + 1 ) / threads;
+      task.bandStart = bandStart;
+      task.bandRows = nRows;
+      task.columns = columns;
+      task.grid = grids.data() + i * bandCells;
+      tasks << task;
+    }
+
+    if ( threads > 1 )
+    {
+      QtConcurrent::map( tasks, accumulate ).waitForFinished();
+    }
+    else
+    {
+      accumulate( tasks[0] );
+    }
+
+    // reduce the partial grids into the first one
+    float* grid = grids.data();
+    for ( int i = 1; i < threads; ++i )
+    {
+      const float* partial = grids.constData() + i * bandCells;
+      for ( int cell = 0; cell < bandCells; ++cell )
+      {
+        if ( partial[cell] == NO_DATA )
+          continue;
+
+        grid[cell] = ( grid[cell] == NO_DATA ? 0 : grid[cell] ) + partial[cell];
+      }
+    }
+
+    GDALRasterIO( outputRasterBand, GF_Write, 0, bandStart, columns, nRows, grid, columns, nRows, GDT_Float32, 0, 0 );
+
+    if ( p )
+    {
+      p->setValue( bandStart / bandRows + 1 );
+    }
+  }
+
+  GDALClose( outputDataset );
+
+  return canceled ? Canceled : Success;
+}
+
+int QgsKernelDensityEstimation::cellRadius( double radius, double cellSize )
+{
+  // Calculate the buffer size in pixels
+
+  int buffer = radius / cellSize;
+  if ( radius - ( cellSize * buffer ) > 0.5 )
+  {
+    ++buffer;
+  }
+  return buffer;
+}
+
+/* The kernel functions below are taken from "Kernel Smoothing" by Wand and Jones (1995), p. 175
+ *
+ * Each kernel is multiplied by a normalizing constant "k", which normalizes the kernel area
+ * to 1 for a given bandwidth size.
+ *
+ * k is calculated by polar double integration of the kernel function
+ * between a radius of 0 to the specified bandwidth and equating the area to 1. */
+
+static double uniformKernel( double distance, int bandwidth )
+{
+  Q_UNUSED( distance );
+  // Normalizing constant
+  double k = 2. / ( M_PI * ( double )bandwidth );
+
+  // Derived from Wand and Jones (1995), p. 175
+  return k * ( 0.5 / ( double )bandwidth );
+}
+
+static double quarticKernel( double distance, int bandwidth )
+{
+  // Normalizing constant
+  double k = 16. / ( 5. * M_PI * pow(( double )bandwidth, 2 ) );
+
+  // Derived from Wand and Jones (1995), p. 175
+  return k * ( 15. / 16. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 2 );
+}
+
+static double triweightKernel( double distance, int bandwidth )
+{
+  // Normalizing constant
+  double k = 128. / ( 35. * M_PI * pow(( double )bandwidth, 2 ) );
+
+  // Derived from Wand and Jones (1995), p. 175
+  return k * ( 35. / 32. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 3 );
+}
+
+static double epanechnikovKernel( double distance, int bandwidth )
+{
+  // Normalizing constant
+  double k = 8. / ( 3. * M_PI * pow(( double )bandwidth, 2 ) );
+
+  // Derived from Wand and Jones (1995), p. 175
+  return k * ( 3. / 4. ) * ( 1. - pow( distance / ( double )bandwidth, 2 ) );
+}
+
+static double triangularKernel( double distance, int bandwidth, double decay )
+{
+  // Normalizing constant. In this case it's calculated a little different
+  // due to the inclusion of the non-standard "decay" parameter
+
+  if ( decay >= 0 )
+  {
+    double k = 3. / (( 1. + 2. * decay ) * M_PI * pow(( double )bandwidth, 2 ) );
+
+    // Derived from Wand and Jones (1995), p. 175 (with addition of decay parameter)
+    return k * ( 1. - ( 1. - decay ) * ( distance / ( double )bandwidth ) );
+  }
+  else
+  {
+    // Non-standard or mathematically valid negative decay ("coolmap")
+    return ( 1. - ( 1. - decay ) * ( distance / ( double )bandwidth ) );
+  }
+}
+
+double QgsKernelDensityEstimation::kernelValue( KernelShape shape, double distance, int bandwidth, double decay )
+{
+  switch ( shape )
+  {
+    case Triangular:
+      return triangularKernel( distance, bandwidth, decay );
+
+    case Uniform:
+      return uniformKernel( distance, bandwidth );
+
+    case Quartic:
+      return quarticKernel( distance, bandwidth );
+
+    case Triweight:
+      return triweightKernel( distance, bandwidth );
+
+    case Epanechnikov:
+      return epanechnikovKernel( distance, bandwidth );
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+/***************************************************************************
+                          qgskerneldensityestimation.h  -  description
+                          ----------------------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSKERNELDENSITYESTIMATION_H
+#define QGSKERNELDENSITYESTIMATION_H
+
+#include "qgsrectangle.h"
+
+#include <QString>
+
+class QgsVectorLayer;
+class QProgressDialog;
+
+/**Creates a heatmap raster from a point layer by kernel density estimation.
+
+  Kernel values are precomputed once per radius and added to an in memory
+  grid by several threads, each accumulating a subset of the points into its
+  own partial grid.  Grids that would exceed the memory limit are processed
+  in bands of rows.  The raster is written once per band at the end.
+  */
+class ANALYSIS_EXPORT QgsKernelDensityEstimation
+{
+  public:
+    //! Kernel shape, the order matches the heatmap plugin
+    enum KernelShape
+    {
+      Quartic,
+      Triangular,
+      Uniform,
+      Triweight,
+      Epanechnikov
+    };
+
+    enum Result
+    {
+      Success = 0,
+      InvalidParameters,
+      DriverError,
+      FileCreationError,
+      Canceled
+    };
+
+    QgsKernelDensityEstimation( QgsVectorLayer* pointLayer, const QString& outputFile, const QString& outputFormat );
+    ~QgsKernelDensityEstimation();
+
+    /**Extent of the raster, points outside it are ignored. Defaults to the layer extent*/
+    void setExtent( const QgsRectangle& extent ) { mExtent = extent; }
+    const QgsRectangle& extent() const { return mExtent; }
+
+    /**Size of the raster cells in map units*/
+    void setCellSize( double cellSize ) { mCellSize = cellSize; }
+    double cellSize() const { return mCellSize; }
+
+    /**Number of columns and rows of the raster. If not set, they are derived from extent and cell size*/
+    void setRasterSize( int columns, int rows ) { mColumns = columns; mRows = rows; }
+    int columns() const { return mColumns; }
+    int rows() const { return mRows; }
+
+    /**Fixed radius in map units*/
+    void setRadius( double radius ) { mRadius = radius; mRadiusField = -1; }
+    double radius() const { return mRadius; }
+
+    /**Take the radius of each point from an attribute, multiplied by a factor converting it to map units*/
+    void setRadiusField( int field, double toMapUnits = 1.0 ) { mRadiusField = field; mRadiusToMapUnits = toMapUnits; }
+    int radiusField() const { return mRadiusField; }
+
+    /**Take the weight of each point from an attribute, -1 for unweighted points*/
+    void setWeightField( int field ) { mWeightField = field; }
+    int weightField() const { return mWeightField; }
+
+    void setKernelShape( KernelShape shape ) { mKernelShape = shape; }
+    KernelShape kernelShape() const { return mKernelShape; }
+
+    /**Decay ratio of the triangular kernel*/
+    void setDecayRatio( double decay ) { mDecay = decay; }
+    double decayRatio() const { return mDecay; }
+
+    /**Upper limit for the memory used by the grids in bytes*/
+    void setMaximumMemory( qint64 bytes ) { mMaximumMemory = bytes; }
+    qint64 maximumMemory() const { return mMaximumMemory; }
+
+    /**Number of threads used for accumulation, 0 to use the size of the global thread pool*/
+    void setMaxThreads( int threads ) { mMaxThreads = threads; }
+    int maxThreads() const { return mMaxThreads; }
+
+    /**Starts the calculation and writes the raster.
+      @param p progress dialog that receives update and that is checked for abort. 0 if no progress bar is needed.
+      If the calculation is canceled while reading the points, the raster is written for the points read so far.
+      @return Success or an error code*/
+    Result run( QProgressDialog* p );
+
+    /**Radius in cells for a radius in map units*/
+    static int cellRadius( double radius, double cellSize );
+
+    /**Value of a kernel at a distance from the center, both in cells*/
+    static double kernelValue( KernelShape shape, double distance, int bandwidth, double decay );
+
+  private:
+    QgsKernelDensityEstimation();
+
+    QgsVectorLayer* mPointLayer;
+    QString mOutputFile;
+    QString mOutputFormat;
+
+    QgsRectangle mExtent;
+    double mCellSize;
+    int mColumns;
+    int mRows;
+    double mRadius;
+    int mRadiusField;
+    double mRadiusToMapUnits;
+    int mWeightField;
+    KernelShape mKernelShape;
+    double mDecay;
+    qint64 mMaximumMemory;
+    int mMaxThreads;
+};
+
+#endif // QGSKERNELDENSITYESTIMATION_H
@@ -25,238 +25,413 @@
 #include "qgsvectorfilewriter.h"
 #include "qgsvectordataprovider.h"
 #include "qgsdistancearea.h"
+#include "qgsvectoranalysisutils.h"
 #include <QProgressDialog>
+#include <QThreadPool>
+#include <QtConcurrentMap>
 
-bool QgsGeometryAnalyzer::simplify( QgsVectorLayer* layer,
-                                    const QString& shapefileName,
-                                    double tolerance,
-                                    bool onlySelectedFeatures,
-                                    QProgressDialog *p )
+// Number of features read before they are processed by the thread pool
+#define FEATURE_BLOCK_SIZE 1000
+
+//! two geometries united in one step of a union, second may be 0
+struct GaGeometryPair
 {
-  if ( !layer )
+  GaGeometryPair( QgsGeometry* g1, QgsGeometry* g2 ) : first( g1 ), second( g2 ) {}
+  QgsGeometry* first;
+  QgsGeometry* second;
+};
+
+static QgsGeometry* combinePair( const GaGeometryPair& pair )
+{
+  if ( !pair.second )
   {
-    return false;
+    return pair.first;
   }
 
-  QgsVectorDataProvider* dp = layer->dataProvider();
-  if ( !dp )
+  QgsGeometry* result = QgsGeosThreadContext::instance()->combine( pair.first, pair.second );
+  if ( !result )
   {
-    return false;
+    QgsDebugMsg( "union of two geometries failed" );
+    delete pair.second;
+    return pair.first;
   }
 
-  QGis::WkbType outputType = dp->geometryType();
-  const QgsCoordinateReferenceSystem crs = layer->crs();
-
-  QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), layer->pendingFields(), outputType, &crs );
-  QgsFeature currentFeature;
+  delete pair.first;
+  delete pair.second;
+  return result;
+}
 
-  //take only selection
-  if ( onlySelectedFeatures )
+/**Union of geometries, which are deleted. The geometries are sorted along a space filling
+  curve and united pairwise in a balanced tree, so that neighbours are merged first and
+  each union step involves geometries of similar size. The pairs of a level of the tree
+  are united in parallel*/
+static QgsGeometry* unionGeometries( const QList<QgsGeometry*>& geometries, bool parallel )
+{
+  QgsRectangle extent;
+  bool first = true;
+  foreach ( QgsGeometry* geometry, geometries )
   {
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selection = layer->selectedFeaturesIds();
-    if ( p )
+    if ( !geometry )
+      continue;
+
+    QgsRectangle bbox = geometry->boundingBox();
+    if ( first )
     {
-      p->setMaximum( selection.size() );
+      extent = bbox;
+      first = false;
     }
-
-    int processedFeatures = 0;
-    QgsFeatureIds::const_iterator it = selection.constBegin();
-    for ( ; it != selection.constEnd(); ++it )
+    else
     {
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
-
-      if ( p && p->wasCanceled() )
-      {
-        break;
-      }
-      if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
-      {
-        continue;
-      }
-      simplifyFeature( currentFeature, &vWriter, tolerance );
-      ++processedFeatures;
+      extent.combineExtentWith( &bbox );
     }
+  }
 
-    if ( p )
+  QList< QPair<quint32, QgsGeometry*> > sorted;
+  foreach ( QgsGeometry* geometry, geometries )
+  {
+    if ( geometry )
     {
-      p->setValue( selection.size() );
+      sorted << qMakePair( qgsMortonCode( extent, geometry->boundingBox().center() ), geometry );
     }
   }
-  //take all features
-  else
+  if ( sorted.isEmpty() )
   {
-    QgsFeatureIterator fit = layer->getFeatures();
+    return 0;
+  }
+  qSort( sorted );
 
-    int featureCount = layer->featureCount();
-    if ( p )
+  QList<QgsGeometry*> level;
+  for ( int i = 0; i < sorted.size(); ++i )
+  {
+    level << sorted.at( i ).second;
+  }
+
+  while ( level.size() > 1 )
+  {
+    QList<GaGeometryPair> pairs;
+    for ( int i = 0; i < level.size(); i += 2 )
     {
-      p->setMaximum( featureCount );
+      pairs << GaGeometryPair( level.at( i ), i + 1 < level.size() ? level.at( i + 1 ) : 0 );
     }
-    int processedFeatures = 0;
 
-    while ( fit.nextFeature( currentFeature ) )
+    if ( parallel && pairs.size() > 1 )
+    {
+      level = QtConcurrent::blockingMapped( pairs, combinePair );
+    }
+    else
     {
-      if ( p )
+      level.clear();
+      foreach ( const GaGeometryPair& pair, pairs )
       {
-        p->setValue( processedFeatures );
+        level << combinePair( pair );
       }
-      if ( p && p->wasCanceled() )
-      {
-        break;
-      }
-      simplifyFeature( currentFeature, &vWriter, tolerance );
-      ++processedFeatures;
     }
-    if ( p )
+  }
+  return level.at( 0 );
+}
+
+//! simplified copy of a feature
+struct GaSimplify
+{
+  typedef QgsFeature result_type;
+  GaSimplify( double tolerance ) : mTolerance( tolerance ) {}
+
+  QgsFeature operator()( const QgsFeature& f ) const
+  {
+    QgsFeature newFeature;
+    if ( f.geometry() )
     {
-      p->setValue( featureCount );
+      newFeature.setGeometry( QgsGeosThreadContext::instance()->simplify( f.geometry(), mTolerance ) );
+      newFeature.setAttributes( f.attributes() );
+      newFeature.setValid( true );
     }
+    return newFeature;
   }
 
-  return true;
-}
+  double mTolerance;
+};
 
-void QgsGeometryAnalyzer::simplifyFeature( QgsFeature& f, QgsVectorFileWriter* vfw, double tolerance )
+//! centroid of a feature
+struct GaCentroid
 {
-  QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* tmpGeometry = 0;
+  typedef QgsFeature result_type;
 
-  if ( !featureGeometry )
+  QgsFeature operator()( const QgsFeature& f ) const
   {
-    return;
+    QgsFeature newFeature;
+    if ( f.geometry() )
+    {
+      newFeature.setGeometry( QgsGeosThreadContext::instance()->centroid( f.geometry() ) );
+      newFeature.setAttributes( f.attributes() );
+      newFeature.setValid( true );
+    }
+    return newFeature;
   }
-  // simplify feature
-  tmpGeometry = featureGeometry->simplify( tolerance );
+};
 
-  QgsFeature newFeature;
-  newFeature.setGeometry( tmpGeometry );
-  newFeature.setAttributes( f.attributes() );
+//! buffer of a feature
+struct GaBuffer
+{
+  typedef QgsFeature result_type;
+  GaBuffer( double distance, int distanceField ) : mDistance( distance ), mDistanceField( distanceField ) {}
 
-  //add it to vector file writer
-  if ( vfw )
+  QgsFeature operator()( const QgsFeature& f ) const
   {
-    vfw->addFeature( newFeature );
+    QgsFeature newFeature;
+    if ( f.geometry() )
+    {
+      double distance = mDistanceField == -1 ? mDistance : f.attribute( mDistanceField ).toDouble();
+      newFeature.setGeometry( QgsGeosThreadContext::instance()->buffer( f.geometry(), distance, 5 ) );
+      newFeature.setAttributes( f.attributes() );
+      newFeature.setValid( true );
+    }
+    return newFeature;
   }
-}
 
-bool QgsGeometryAnalyzer::centroids( QgsVectorLayer* layer, const QString& shapefileName,
-                                     bool onlySelectedFeatures, QProgressDialog* p )
+  double mDistance;
+  int mDistanceField;
+};
+
+/**Reads the (selected) features of a layer in blocks and applies an operation to the features
+  of a block in parallel. The results are passed to the writer in the order of the features, or
+  collected if there is no writer.
+  @return false if canceled*/
+template <typename Operation>
+static bool processFeatures( QgsVectorLayer* layer, bool onlySelectedFeatures, const Operation& operation,
+                             QgsVectorFileWriter* writer, QgsFeatureList* results, QProgressDialog* p )
 {
-  if ( !layer )
+  QgsFeatureRequest request;
+  int featureCount = layer->featureCount();
+  if ( onlySelectedFeatures )
   {
-    QgsDebugMsg( "No layer passed to centroids" );
-    return false;
+    request.setFilterFids( layer->selectedFeaturesIds() );
+    featureCount = layer->selectedFeatureCount();
   }
 
-  QgsVectorDataProvider* dp = layer->dataProvider();
-  if ( !dp )
+  if ( p )
   {
-    QgsDebugMsg( "No data provider for layer passed to centroids" );
-    return false;
+    p->setMaximum( featureCount );
   }
 
-  QGis::WkbType outputType = QGis::WKBPoint;
-  const QgsCoordinateReferenceSystem crs = layer->crs();
-
-  QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), layer->pendingFields(), outputType, &crs );
+  QgsFeatureIterator fit = layer->getFeatures( request );
+  QgsFeatureList block;
   QgsFeature currentFeature;
-
-  //take only selection
-  if ( onlySelectedFeatures )
+  int processedFeatures = 0;
+  bool more = true;
+  while ( more )
   {
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selection = layer->selectedFeaturesIds();
-    if ( p )
+    more = fit.nextFeature( currentFeature );
+    if ( more )
     {
-      p->setMaximum( selection.size() );
+      block << currentFeature;
     }
 
-    int processedFeatures = 0;
-    QgsFeatureIds::const_iterator it = selection.constBegin();
-    for ( ; it != selection.constEnd(); ++it )
+    if ( block.size() < FEATURE_BLOCK_SIZE && ( more || block.isEmpty() ) )
+      continue;
+
+    QgsFeatureList blockResults = QtConcurrent::blockingMapped( block, operation );
+    for ( QgsFeatureList::iterator it = blockResults.begin(); it != blockResults.end(); ++it )
     {
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
+      if ( !it->isValid() )
+        continue;
 
-      if ( p && p->wasCanceled() )
+      if ( writer )
       {
-        break;
+        writer->addFeature( *it );
       }
-      if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
+      if ( results )
       {
-        continue;
+        results->append( *it );
       }
-      centroidFeature( currentFeature, &vWriter );
-      ++processedFeatures;
     }
 
+    processedFeatures += block.size();
+    block.clear();
+
     if ( p )
     {
-      p->setValue( selection.size() );
+      p->setValue( processedFeatures );
+      if ( p->wasCanceled() )
+      {
+        return false;
+      }
     }
   }
-  //take all features
-  else
+
+  if ( p )
   {
-    QgsFeatureIterator fit = layer->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QgsAttributeList() ) );
+    p->setValue( featureCount );
+  }
+  return true;
+}
 
-    int featureCount = layer->featureCount();
-    if ( p )
-    {
-      p->setMaximum( featureCount );
-    }
-    int processedFeatures = 0;
+//! features with the same value of the dissolve field
+struct GaGroup
+{
+  QgsAttributes attributes;
+  QList<QgsGeometry*> geometries;
+};
+
+/**Reads the (selected) features of a layer and groups copies of their geometries by the value of a field
+  @return false if canceled*/
+static bool groupFeatures( QgsVectorLayer* layer, bool onlySelectedFeatures, int uniqueIdField, bool useField,
+                           QMap<QString, GaGroup>& groups, QProgressDialog* p )
+{
+  QgsFeatureRequest request;
+  int featureCount = layer->featureCount();
+  if ( onlySelectedFeatures )
+  {
+    request.setFilterFids( layer->selectedFeaturesIds() );
+    featureCount = layer->selectedFeatureCount();
+  }
+
+  if ( p )
+  {
+    p->setMaximum( featureCount );
+  }
 
-    while ( fit.nextFeature( currentFeature ) )
+  QgsFeatureIterator fit = layer->getFeatures( request );
+  QgsFeature currentFeature;
+  int processedFeatures = 0;
+  while ( fit.nextFeature( currentFeature ) )
+  {
+    if ( p && ++processedFeatures % 1000 == 0 )
     {
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
-      if ( p && p->wasCanceled() )
+      p->setValue( processedFeatures );
+      if ( p->wasCanceled() )
       {
-        break;
+        return false;
       }
-      centroidFeature( currentFeature, &vWriter );
-      ++processedFeatures;
     }
-    if ( p )
+
+    if ( !currentFeature.geometry() )
+      continue;
+
+    QString key = useField ? currentFeature.attribute( uniqueIdField ).toString() : QString();
+    QMap<QString, GaGroup>::iterator groupIt = groups.find( key );
+    if ( groupIt == groups.end() )
     {
-      p->setValue( featureCount );
+      groupIt = groups.insert( key, GaGroup() );
+      groupIt->attributes = currentFeature.attributes();
     }
+    groupIt->geometries << new QgsGeometry( *currentFeature.geometry() );
   }
-
   return true;
 }
 
+//! union of the geometries of a group
+static QgsGeometry* dissolveGroup( const GaGroup& group )
+{
+  return unionGeometries( group.geometries, false );
+}
 
-void QgsGeometryAnalyzer::centroidFeature( QgsFeature& f, QgsVectorFileWriter* vfw )
+//! convex hull of the geometries of a group
+static QgsGeometry* convexHullGroup( const GaGroup& group )
 {
-  QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* tmpGeometry = 0;
+  QgsGeosThreadContext* context = QgsGeosThreadContext::instance();
 
-  if ( !featureGeometry )
+  // the hull of all vertices of the hulls of the geometries
+  QgsMultiPoint points;
+  foreach ( QgsGeometry* geometry, group.geometries )
   {
-    return;
+    QgsGeometry* hull = context->convexHull( geometry );
+    if ( !hull )
+      continue;
+
+    switch ( hull->type() )
+    {
+      case QGis::Point:
+        points << hull->asPoint();
+        break;
+      case QGis::Line:
+        points << hull->asPolyline();
+        break;
+      case QGis::Polygon:
+        if ( !hull->asPolygon().isEmpty() )
+          points << hull->asPolygon().at( 0 );
+        break;
+      default:
+        break;
+    }
+    delete hull;
+  }
+  qDeleteAll( group.geometries );
+
+  if ( points.isEmpty() )
+  {
+    return 0;
+  }
+
+  QgsGeometry* multiPoint = QgsGeometry::fromMultiPoint( points );
+  QgsGeometry* hull = context->convexHull( multiPoint );
+  delete multiPoint;
+  return hull;
+}
+
+/**Applies an operation to the groups, in parallel if there are several groups or
+  with a parallel union if there is only one*/
+template <typename GroupOperation>
+static QList<QgsGeometry*> processGroups( const QMap<QString, GaGroup>& groups, GroupOperation operation, bool parallelUnion )
+{
+  QList<QgsGeometry*> results;
+  if ( groups.size() == 1 && parallelUnion )
+  {
+    results << unionGeometries( groups.begin()->geometries, true );
+  }
+  else
+  {
+    results = QtConcurrent::blockingMapped( groups.values(), operation );
   }
+  return results;
+}
 
-  tmpGeometry = featureGeometry->centroid();
+bool QgsGeometryAnalyzer::simplify( QgsVectorLayer* layer,
+                                    const QString& shapefileName,
+                                    double tolerance,
+                                    bool onlySelectedFeatures,
+                                    QProgressDialog *p )
+{
+  if ( !layer )
+  {
+    return false;
+  }
+
+  QgsVectorDataProvider* dp = layer->dataProvider();
+  if ( !dp )
+  {
+    return false;
+  }
 
-  QgsFeature newFeature;
-  newFeature.setGeometry( tmpGeometry );
-  newFeature.setAttributes( f.attributes() );
+  QGis::WkbType outputType = dp->geometryType();
+  const QgsCoordinateReferenceSystem crs = layer->crs();
 
-  //add it to vector file writer
-  if ( vfw )
+  QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), layer->pendingFields(), outputType, &crs );
+  processFeatures( layer, onlySelectedFeatures, GaSimplify( tolerance ), &vWriter, 0, p );
+  return true;
+}
+
+bool QgsGeometryAnalyzer::centroids( QgsVectorLayer* layer, const QString& shapefileName,
+                                     bool onlySelectedFeatures, QProgressDialog* p )
+{
+  if ( !layer )
+  {
+    QgsDebugMsg( "No layer passed to centroids" );
+    return false;
+  }
+
+  QgsVectorDataProvider* dp = layer->dataProvider();
+  if ( !dp )
   {
-    vfw->addFeature( newFeature );
+    QgsDebugMsg( "No data provider for layer passed to centroids" );
+    return false;
   }
+
+  QGis::WkbType outputType = QGis::WKBPoint;
+  const QgsCoordinateReferenceSystem crs = layer->crs();
+
+  QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), layer->pendingFields(), outputType, &crs );
+  processFeatures( layer, onlySelectedFeatures, GaCentroid(), &vWriter, 0, p );
+  return true;
 }
 
 bool QgsGeometryAnalyzer::extent( QgsVectorLayer* layer,
@@ -412,186 +587,42 @@ bool QgsGeometryAnalyzer::convexHull( QgsVectorLayer* layer, const QString& shap
   const QgsCoordinateReferenceSystem crs = layer->crs();
 
   QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), fields, outputType, &crs );
-  QgsFeature currentFeature;
-  QgsGeometry* dissolveGeometry = 0; //dissolve geometry
-  QMultiMap<QString, QgsFeatureId> map;
 
-  if ( onlySelectedFeatures )
+  QMap<QString, GaGroup> groups;
+  if ( !groupFeatures( layer, onlySelectedFeatures, uniqueIdField, useField, groups, p ) )
   {
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selection = layer->selectedFeaturesIds();
-    QgsFeatureIds::const_iterator it = selection.constBegin();
-    for ( ; it != selection.constEnd(); ++it )
+    foreach ( const GaGroup& group, groups )
     {
-#if 0
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
-      if ( p && p->wasCanceled() )
-      {
-        // break; // it may be better to do something else here?
-        return false;
-      }
-#endif
-      if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
-      {
-        continue;
-      }
-      map.insert( currentFeature.attribute( uniqueIdField ).toString(), currentFeature.id() );
-    }
-  }
-  else
-  {
-    QgsFeatureIterator fit = layer->getFeatures();
-    while ( fit.nextFeature( currentFeature ) )
-    {
-#if 0
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
-      if ( p && p->wasCanceled() )
-      {
-        // break; // it may be better to do something else here?
-        return false;
-      }
-#endif
-      map.insert( currentFeature.attribute( uniqueIdField ).toString(), currentFeature.id() );
+      qDeleteAll( group.geometries );
     }
+    return true;
   }
 
-  QMultiMap<QString, QgsFeatureId>::const_iterator jt = map.constBegin();
-  while ( jt != map.constEnd() )
+  QList<QgsGeometry*> hulls = processGroups( groups, convexHullGroup, false );
+
+  int i = 0;
+  for ( QMap<QString, GaGroup>::const_iterator groupIt = groups.constBegin(); groupIt != groups.constEnd(); ++groupIt, ++i )
   {
-    QString currentKey = jt.key();
-    int processedFeatures = 0;
-    //take only selection
-    if ( onlySelectedFeatures )
+    QgsGeometry* hull = hulls.at( i );
+    if ( !hull )
     {
-      //use QgsVectorLayer::featureAtId
-      const QgsFeatureIds selection = layer->selectedFeaturesIds();
-      if ( p )
-      {
-        p->setMaximum( selection.size() );
-      }
-      processedFeatures = 0;
-      while ( jt != map.constEnd() && ( jt.key() == currentKey || !useField ) )
-      {
-        if ( p && p->wasCanceled() )
-        {
-          break;
-        }
-        if ( selection.contains( jt.value() ) )
-        {
-          if ( p )
-          {
-            p->setValue( processedFeatures );
-          }
-          if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( jt.value() ) ).nextFeature( currentFeature ) )
-          {
-            continue;
-          }
-          convexFeature( currentFeature, processedFeatures, &dissolveGeometry );
-          ++processedFeatures;
-        }
-        ++jt;
-      }
-      QList<double> values;
-      if ( !dissolveGeometry )
-      {
-        QgsDebugMsg( "no dissolved geometry - should not happen" );
-        return false;
-      }
-      dissolveGeometry = dissolveGeometry->convexHull();
-      values = simpleMeasure( dissolveGeometry );
-      QgsAttributes attributes( 3 );
-      attributes[0] = QVariant( currentKey );
-      attributes[1] = values[ 0 ];
-      attributes[2] = values[ 1 ];
-      QgsFeature dissolveFeature;
-      dissolveFeature.setAttributes( attributes );
-      dissolveFeature.setGeometry( dissolveGeometry );
-      vWriter.addFeature( dissolveFeature );
+      QgsDebugMsg( "no convex hull geometry - should not happen" );
+      continue;
     }
-    //take all features
-    else
-    {
-      int featureCount = layer->featureCount();
-      if ( p )
-      {
-        p->setMaximum( featureCount );
-      }
-      processedFeatures = 0;
-      while ( jt != map.constEnd() && ( jt.key() == currentKey || !useField ) )
-      {
-        if ( p )
-        {
-          p->setValue( processedFeatures );
-        }
 
-        if ( p && p->wasCanceled() )
-        {
-          break;
-        }
-        if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( jt.value() ) ).nextFeature( currentFeature ) )
-        {
-          continue;
-        }
-        convexFeature( currentFeature, processedFeatures, &dissolveGeometry );
-        ++processedFeatures;
-        ++jt;
-      }
-      QList<double> values;
-      // QgsGeometry* tmpGeometry = 0;
-      if ( !dissolveGeometry )
-      {
-        QgsDebugMsg( "no dissolved geometry - should not happen" );
-        return false;
-      }
-      dissolveGeometry = dissolveGeometry->convexHull();
-      // values = simpleMeasure( tmpGeometry );
-      values = simpleMeasure( dissolveGeometry );
-      QgsAttributes attributes;
-      attributes[0] = QVariant( currentKey );
-      attributes[1] = QVariant( values[ 0 ] );
-      attributes[2] = QVariant( values[ 1 ] );
-      QgsFeature dissolveFeature;
-      dissolveFeature.setAttributes( attributes );
-      dissolveFeature.setGeometry( dissolveGeometry );
-      vWriter.addFeature( dissolveFeature );
-    }
+    QList<double> values = simpleMeasure( hull );
+    QgsAttributes attributes( 3 );
+    attributes[0] = QVariant( useField ? groupIt.key() : groupIt->attributes.value( uniqueIdField ).toString() );
+    attributes[1] = QVariant( values.value( 0 ) );
+    attributes[2] = QVariant( values.value( 1 ) );
+    QgsFeature dissolveFeature;
+    dissolveFeature.setAttributes( attributes );
+    dissolveFeature.setGeometry( hull );
+    vWriter.addFeature( dissolveFeature );
   }
   return true;
 }
 
-
-void QgsGeometryAnalyzer::convexFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry )
-{
-  QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* tmpGeometry = 0;
-  QgsGeometry* convexGeometry = 0;
-
-  if ( !featureGeometry )
-  {
-    return;
-  }
-
-  convexGeometry = featureGeometry->convexHull();
-
-  if ( nProcessedFeatures == 0 )
-  {
-    *dissolveGeometry = convexGeometry;
-  }
-  else
-  {
-    tmpGeometry = *dissolveGeometry;
-    *dissolveGeometry = ( *dissolveGeometry )->combine( convexGeometry );
-    delete tmpGeometry;
-    delete convexGeometry;
-  }
-}
-
 bool QgsGeometryAnalyzer::dissolve( QgsVectorLayer* layer, const QString& shapefileName,
                                     bool onlySelectedFeatures, int uniqueIdField, QProgressDialog* p )
 {
@@ -618,137 +649,30 @@ bool QgsGeometryAnalyzer::dissolve( QgsVectorLayer* layer, const QString& shapef
   const QgsCoordinateReferenceSystem crs = layer->crs();
 
   QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), layer->pendingFields(), outputType, &crs );
-  QgsFeature currentFeature;
-  QMultiMap<QString, QgsFeatureId> map;
 
-  if ( onlySelectedFeatures )
+  QMap<QString, GaGroup> groups;
+  if ( !groupFeatures( layer, onlySelectedFeatures, uniqueIdField, useField, groups, p ) )
   {
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selection = layer->selectedFeaturesIds();
-    QgsFeatureIds::const_iterator it = selection.constBegin();
-    for ( ; it != selection.constEnd(); ++it )
+    foreach ( const GaGroup& group, groups )
     {
-      if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
-      {
-        continue;
-      }
-      map.insert( currentFeature.attribute( uniqueIdField ).toString(), currentFeature.id() );
-    }
-  }
-  else
-  {
-    QgsFeatureIterator fit = layer->getFeatures();
-    while ( fit.nextFeature( currentFeature ) )
-    {
-      map.insert( currentFeature.attribute( uniqueIdField ).toString(), currentFeature.id() );
+      qDeleteAll( group.geometries );
     }
+    return true;
   }
 
-  QgsGeometry *dissolveGeometry = 0; //dissolve geometry
-  QMultiMap<QString, QgsFeatureId>::const_iterator jt = map.constBegin();
-  QgsFeature outputFeature;
-  while ( jt != map.constEnd() )
-  {
-    QString currentKey = jt.key();
-    int processedFeatures = 0;
-    bool first = true;
-    //take only selection
-    if ( onlySelectedFeatures )
-    {
-      //use QgsVectorLayer::featureAtId
-      const QgsFeatureIds selection = layer->selectedFeaturesIds();
-      if ( p )
-      {
-        p->setMaximum( selection.size() );
-      }
-      while ( jt != map.constEnd() && ( jt.key() == currentKey || !useField ) )
-      {
-        if ( p && p->wasCanceled() )
-        {
-          break;
-        }
-        if ( selection.contains( jt.value() ) )
-        {
-          if ( p )
-          {
-            p->setValue( processedFeatures );
-          }
-          if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( jt.value() ) ).nextFeature( currentFeature ) )
-          {
-            continue;
-          }
-          if ( first )
-          {
-            outputFeature.setAttributes( currentFeature.attributes() );
-            first = false;
-          }
-          dissolveFeature( currentFeature, processedFeatures, &dissolveGeometry );
-          ++processedFeatures;
-        }
-        ++jt;
-      }
-    }
-    //take all features
-    else
-    {
-      int featureCount = layer->featureCount();
-      if ( p )
-      {
-        p->setMaximum( featureCount );
-      }
-      while ( jt != map.constEnd() && ( jt.key() == currentKey || !useField ) )
-      {
-        if ( p )
-        {
-          p->setValue( processedFeatures );
-        }
+  QList<QgsGeometry*> dissolved = processGroups( groups, dissolveGroup, true );
 
-        if ( p && p->wasCanceled() )
-        {
-          break;
-        }
-        if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( jt.value() ) ).nextFeature( currentFeature ) )
-        {
-          continue;
-        }
-        {
-          outputFeature.setAttributes( currentFeature.attributes() );
-          first = false;
-        }
-        dissolveFeature( currentFeature, processedFeatures, &dissolveGeometry );
-        ++processedFeatures;
-        ++jt;
-      }
-    }
-    outputFeature.setGeometry( dissolveGeometry );
+  int i = 0;
+  for ( QMap<QString, GaGroup>::const_iterator groupIt = groups.constBegin(); groupIt != groups.constEnd(); ++groupIt, ++i )
+  {
+    QgsFeature outputFeature;
+    outputFeature.setAttributes( groupIt->attributes );
+    outputFeature.setGeometry( dissolved.at( i ) );
     vWriter.addFeature( outputFeature );
   }
   return true;
 }
 
-void QgsGeometryAnalyzer::dissolveFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry )
-{
-  QgsGeometry* featureGeometry = f.geometry();
-
-  if ( !featureGeometry )
-  {
-    return;
-  }
-
-  if ( nProcessedFeatures == 0 )
-  {
-    size_t geomSize = featureGeometry->wkbSize();
-    *dissolveGeometry = new QgsGeometry();
-    unsigned char* wkb = new unsigned char[geomSize];
-    memcpy( wkb, featureGeometry->asWkb(), geomSize );
-    ( *dissolveGeometry )->fromWkb( wkb, geomSize );
-  }
-  else
-  {
-    *dissolveGeometry = ( *dissolveGeometry )->combine( featureGeometry );
-  }
-}
-
 bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefileName, double bufferDistance,
                                   bool onlySelectedFeatures, bool dissolve, int bufferDistanceField, QProgressDialog* p )
 {
@@ -771,140 +695,40 @@ bool QgsGeometryAnalyzer::buffer( QgsVectorLayer* layer, const QString& shapefil
   const QgsCoordinateReferenceSystem crs = layer->crs();
 
   QgsVectorFileWriter vWriter( shapefileName, dp->encoding(), layer->pendingFields(), outputType, &crs );
-  QgsFeature currentFeature;
-  QgsGeometry *dissolveGeometry = 0; //dissolve geometry (if dissolve enabled)
 
-  //take only selection
-  if ( onlySelectedFeatures )
+  if ( !dissolve )
   {
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selection = layer->selectedFeaturesIds();
-    if ( p )
-    {
-      p->setMaximum( selection.size() );
-    }
-
-    int processedFeatures = 0;
-    QgsFeatureIds::const_iterator it = selection.constBegin();
-    for ( ; it != selection.constEnd(); ++it )
-    {
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
-
-      if ( p && p->wasCanceled() )
-      {
-        break;
-      }
-      if ( !layer->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
-      {
-        continue;
-      }
-      bufferFeature( currentFeature, processedFeatures, &vWriter, dissolve, &dissolveGeometry, bufferDistance, bufferDistanceField );
-      ++processedFeatures;
-    }
-
-    if ( p )
-    {
-      p->setValue( selection.size() );
-    }
+    processFeatures( layer, onlySelectedFeatures, GaBuffer( bufferDistance, bufferDistanceField ), &vWriter, 0, p );
+    return true;
   }
-  //take all features
-  else
-  {
-    QgsFeatureIterator fit = layer->getFeatures();
-
-    int featureCount = layer->featureCount();
-    if ( p )
-    {
-      p->setMaximum( featureCount );
-    }
-    int processedFeatures = 0;
 
-    while ( fit.nextFeature( currentFeature ) )
-    {
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
-      if ( p && p->wasCanceled() )
-      {
-        break;
-      }
-      bufferFeature( currentFeature, processedFeatures, &vWriter, dissolve, &dissolveGeometry, bufferDistance, bufferDistanceField );
-      ++processedFeatures;
-    }
-    if ( p )
-    {
-      p->setValue( featureCount );
-    }
+  QgsFeatureList buffers;
+  if ( !processFeatures( layer, onlySelectedFeatures, GaBuffer( bufferDistance, bufferDistanceField ), 0, &buffers, p ) )
+  {
+    return true;
   }
 
-  if ( dissolve )
+  QList<QgsGeometry*> geometries;
+  for ( QgsFeatureList::iterator it = buffers.begin(); it != buffers.end(); ++it )
   {
-    QgsFeature dissolveFeature;
-    if ( !dissolveGeometry )
+    if ( it->geometry() )
     {
-      QgsDebugMsg( "no dissolved geometry - should not happen" );
-      return false;
+      geometries << new QgsGeometry( *it->geometry() );
     }
-    dissolveFeature.setGeometry( dissolveGeometry );
-    vWriter.addFeature( dissolveFeature );
   }
-  return true;
-}
+  buffers.clear();
 
-void QgsGeometryAnalyzer::bufferFeature( QgsFeature& f, int nProcessedFeatures, QgsVectorFileWriter* vfw, bool dissolve,
-    QgsGeometry** dissolveGeometry, double bufferDistance, int bufferDistanceField )
-{
-  double currentBufferDistance;
-  QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* tmpGeometry = 0;
-  QgsGeometry* bufferGeometry = 0;
-
-  if ( !featureGeometry )
-  {
-    return;
-  }
-
-  //create buffer
-  if ( bufferDistanceField == -1 )
-  {
-    currentBufferDistance = bufferDistance;
-  }
-  else
-  {
-    currentBufferDistance = f.attribute( bufferDistanceField ).toDouble();
-  }
-  bufferGeometry = featureGeometry->buffer( currentBufferDistance, 5 );
-
-  if ( dissolve )
+  QgsGeometry* dissolveGeometry = unionGeometries( geometries, true );
+  if ( !dissolveGeometry )
   {
-    if ( nProcessedFeatures == 0 )
-    {
-      *dissolveGeometry = bufferGeometry;
-    }
-    else
-    {
-      tmpGeometry = *dissolveGeometry;
-      *dissolveGeometry = ( *dissolveGeometry )->combine( bufferGeometry );
-      delete tmpGeometry;
-      delete bufferGeometry;
-    }
+    QgsDebugMsg( "no dissolved geometry - should not happen" );
+    return false;
   }
-  else //dissolve
-  {
-    QgsFeature newFeature;
-    newFeature.setGeometry( bufferGeometry );
-    newFeature.setAttributes( f.attributes() );
 
-    //add it to vector file writer
-    if ( vfw )
-    {
-      vfw->addFeature( newFeature );
-    }
-  }
+  QgsFeature dissolveFeature;
+  dissolveFeature.setGeometry( dissolveGeometry );
+  vWriter.addFeature( dissolveFeature );
+  return true;
 }
 
 bool QgsGeometryAnalyzer::eventLayer( QgsVectorLayer* lineLayer, QgsVectorLayer* eventLayer, int lineField, int eventField, QList<int>& unlocatedFeatureIds, const QString& outputLayer,
@@ -31,6 +31,10 @@ class QProgressDialog;
 
 /** \ingroup analysis
  * The QGis class provides vector geometry analysis functions
+ *
+ * Features are read in blocks, whose geometries are processed by the global thread pool
+ * and written in the order they were read. Dissolving unites the geometries pairwise
+ * in a balanced tree instead of adding them one by one to a growing geometry.
  */
 
 class ANALYSIS_EXPORT QgsGeometryAnalyzer
@@ -131,18 +135,6 @@ class ANALYSIS_EXPORT QgsGeometryAnalyzer
 
     QList<double> simpleMeasure( QgsGeometry* geometry );
     double perimeterMeasure( QgsGeometry* geometry, QgsDistanceArea& measure );
-    /**Helper function to simplify an individual feature*/
-    void simplifyFeature( QgsFeature& f, QgsVectorFileWriter* vfw, double tolerance );
-    /**Helper function to get the cetroid of an individual feature*/
-    void centroidFeature( QgsFeature& f, QgsVectorFileWriter* vfw );
-    /**Helper function to buffer an individual feature*/
-    void bufferFeature( QgsFeature& f, int nProcessedFeatures, QgsVectorFileWriter* vfw, bool dissolve, QgsGeometry** dissolveGeometry,
-                        double bufferDistance, int bufferDistanceField );
-    /**Helper function to get the convex hull of feature(s)*/
-    void convexFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry );
-    /**Helper function to dissolve feature(s)*/
-    void dissolveFeature( QgsFeature& f, int nProcessedFeatures, QgsGeometry** dissolveGeometry );
-
     //helper functions for event layer
     void addEventLayerFeature( QgsFeature& feature, QgsGeometry* geom, QgsGeometry* lineGeom, QgsVectorFileWriter* fileWriter, QgsFeatureList& memoryFeatures, int offsetField = -1, double offsetScale = 1.0,
                                bool forceSingleType = false );
@@ -25,20 +25,96 @@
 #include "qgsvectorfilewriter.h"
 #include "qgsvectordataprovider.h"
 #include "qgsdistancearea.h"
+#include "qgsvectoranalysisutils.h"
 #include <QProgressDialog>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+// Number of features of the first layer intersected at once
+#define FEATURE_BLOCK_SIZE 1000
+
+//! features of the first layer in one cell of the spatial partition and the overlay features their bounding boxes intersect
+struct OaPartition
+{
+  QgsFeatureList features;
+  QList< QList<QgsFeatureId> > candidates;
+  const QHash<QgsFeatureId, QgsFeature>* overlayFeatures;
+};
+
+static QgsFeatureList intersectPartition( const OaPartition& partition )
+{
+  QgsFeatureList result;
+  QgsGeosThreadContext* context = QgsGeosThreadContext::instance();
+  GEOSContextHandle_t handle = context->handle();
+
+  // overlay geometries converted in the context of this thread, neighbouring
+  // features of the partition share most of their candidates
+  QHash<QgsFeatureId, GEOSGeometry*> overlayGeos;
+
+  for ( int i = 0; i < partition.features.size(); ++i )
+  {
+    const QgsFeature& f = partition.features.at( i );
+    GEOSGeometry* featureGeos = context->toGeos( f.geometry() );
+    if ( !featureGeos )
+      continue;
+
+    // the feature is tested against many overlay features
+    const GEOSPreparedGeometry* prepared = GEOSPrepare_r( handle, featureGeos );
+
+    const QList<QgsFeatureId>& candidates = partition.candidates.at( i );
+    for ( QList<QgsFeatureId>::const_iterator it = candidates.constBegin(); it != candidates.constEnd(); ++it )
+    {
+      QHash<QgsFeatureId, QgsFeature>::const_iterator overlayIt = partition.overlayFeatures->constFind( *it );
+      if ( overlayIt == partition.overlayFeatures->constEnd() )
+        continue;
+
+      QHash<QgsFeatureId, GEOSGeometry*>::iterator geosIt = overlayGeos.find( *it );
+      if ( geosIt == overlayGeos.end() )
+      {
+        geosIt = overlayGeos.insert( *it, context->toGeos( overlayIt->geometry() ) );
+      }
+      if ( !*geosIt )
+        continue;
+
+      char intersects = prepared ? GEOSPreparedIntersects_r( handle, prepared, *geosIt )
+                        : GEOSIntersects_r( handle, featureGeos, *geosIt );
+      if ( intersects != 1 )
+        continue;
+
+      QgsFeature outFeature;
+      outFeature.setGeometry( context->fromGeos( GEOSIntersection_r( handle, featureGeos, *geosIt ) ) );
+      QgsAttributes attributes = f.attributes();
+      attributes += overlayIt->attributes();
+      outFeature.setAttributes( attributes );
+      result << outFeature;
+    }
+
+    if ( prepared )
+    {
+      GEOSPreparedGeom_destroy_r( handle, prepared );
+    }
+    context->destroy( featureGeos );
+  }
+
+  foreach ( GEOSGeometry* geos, overlayGeos )
+  {
+    context->destroy( geos );
+  }
+  return result;
+}
 
 bool QgsOverlayAnalyzer::intersection( QgsVectorLayer* layerA, QgsVectorLayer* layerB,
                                        const QString& shapefileName, bool onlySelectedFeatures,
                                        QProgressDialog* p )
 {
-  if ( !layerA && !layerB )
+  if ( !layerA || !layerB )
   {
     return false;
   }
 
   QgsVectorDataProvider* dpA = layerA->dataProvider();
   QgsVectorDataProvider* dpB = layerB->dataProvider();
-  if ( !dpA && !dpB )
+  if ( !dpA || !dpB )
   {
     return false;
   }
@@ -53,132 +129,103 @@ bool QgsOverlayAnalyzer::intersection( QgsVectorLayer* layerA, QgsVectorLayer* l
   QgsFeature currentFeature;
   QgsSpatialIndex index;
 
+  QgsFeatureRequest requestA;
+  QgsFeatureRequest requestB;
+  int featureCount = layerA->featureCount();
   //take only selection
   if ( onlySelectedFeatures )
   {
-    const QgsFeatureIds selectionB = layerB->selectedFeaturesIds();
-    QgsFeatureIds::const_iterator it = selectionB.constBegin();
-    for ( ; it != selectionB.constEnd(); ++it )
-    {
-      if ( !layerB->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
-      {
-        continue;
-      }
-      index.insertFeature( currentFeature );
-    }
-    //use QgsVectorLayer::featureAtId
-    const QgsFeatureIds selectionA = layerA->selectedFeaturesIds();
-    if ( p )
-    {
-      p->setMaximum( selectionA.size() );
-    }
-    QgsFeature currentFeature;
-    int processedFeatures = 0;
-    it = selectionA.constBegin();
-    for ( ; it != selectionA.constEnd(); ++it )
-    {
-      if ( p )
-      {
-        p->setValue( processedFeatures );
-      }
+    requestA.setFilterFids( layerA->selectedFeaturesIds() );
+    requestB.setFilterFids( layerB->selectedFeaturesIds() );
+    featureCount = layerA->selectedFeatureCount();
+  }
 
-      if ( p && p->wasCanceled() )
-      {
-        break;
-      }
-      if ( !layerA->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( currentFeature ) )
-      {
-        continue;
-      }
-      intersectFeature( currentFeature, &vWriter, layerB, &index );
-      ++processedFeatures;
-    }
+  // the overlay features are kept in memory and only read by the threads,
+  // which convert the geometries to GEOS in their own context
+  QHash<QgsFeatureId, QgsFeature> overlayFeatures;
+  QgsFeatureIterator fit = layerB->getFeatures( requestB );
+  while ( fit.nextFeature( currentFeature ) )
+  {
+    if ( !currentFeature.geometry() )
+      continue;
 
-    if ( p )
-    {
-      p->setValue( selectionA.size() );
-    }
+    index.insertFeature( currentFeature );
+    overlayFeatures.insert( currentFeature.id(), currentFeature );
   }
-  //take all features
-  else
+
+  QgsRectangle extent = layerA->extent();
+
+  if ( p )
+  {
+    p->setMaximum( featureCount );
+  }
+  int processedFeatures = 0;
+  int partitions = qMax( 1, QThreadPool::globalInstance()->maxThreadCount() ) * 4;
+
+  fit = layerA->getFeatures( requestA );
+  QgsFeatureList block;
+  bool more = true;
+  while ( more )
   {
-    QgsFeatureIterator fit = layerB->getFeatures();
-    while ( fit.nextFeature( currentFeature ) )
+    more = fit.nextFeature( currentFeature );
+    if ( more && currentFeature.geometry() )
     {
-      index.insertFeature( currentFeature );
+      block << currentFeature;
     }
 
-    int featureCount = layerA->featureCount();
-    if ( p )
+    if ( block.size() < FEATURE_BLOCK_SIZE && ( more || block.isEmpty() ) )
+      continue;
+
+    // order the block along a space filling curve and split it into partitions of neighbouring features
+    QList< QPair<quint32, int> > order;
+    for ( int i = 0; i < block.size(); ++i )
     {
-      p->setMaximum( featureCount );
+      order << qMakePair( qgsMortonCode( extent, block.at( i ).geometry()->boundingBox().center() ), i );
     }
-    int processedFeatures = 0;
-
-    fit = layerA->getFeatures();
+    qSort( order );
 
-    QgsFeature currentFeature;
-    while ( fit.nextFeature( currentFeature ) )
+    QList<OaPartition> tasks;
+    int partitionSize = qMax( 1, ( block.size() + partitions - 1 ) / partitions );
+    for ( int i = 0; i < order.size(); ++i )
     {
-      if ( p )
+      if ( i % partitionSize == 0 )
       {
-        p->setValue( processedFeatures );
-      }
-      if ( p && p->wasCanceled() )
-      {
-        break;
+        OaPartition partition;
+        partition.overlayFeatures = &overlayFeatures;
+        tasks << partition;
       }
-      intersectFeature( currentFeature, &vWriter, layerB, &index );
-      ++processedFeatures;
+      const QgsFeature& f = block.at( order.at( i ).second );
+      tasks.last().features << f;
+      tasks.last().candidates << index.intersects( f.geometry()->boundingBox() );
     }
-    if ( p )
-    {
-      p->setValue( featureCount );
-    }
-  }
-  return true;
-}
-
-void QgsOverlayAnalyzer::intersectFeature( QgsFeature& f, QgsVectorFileWriter* vfw,
-    QgsVectorLayer* vl, QgsSpatialIndex* index )
-{
-  QgsGeometry* featureGeometry = f.geometry();
-  QgsGeometry* intersectGeometry = 0;
-  QgsFeature overlayFeature;
-
-  if ( !featureGeometry )
-  {
-    return;
-  }
 
-  QList<QgsFeatureId> intersects;
-  intersects = index->intersects( featureGeometry->boundingBox() );
-  QList<QgsFeatureId>::const_iterator it = intersects.constBegin();
-  QgsFeature outFeature;
-  for ( ; it != intersects.constEnd(); ++it )
-  {
-    if ( !vl->getFeatures( QgsFeatureRequest().setFilterFid( *it ) ).nextFeature( overlayFeature ) )
+    QList<QgsFeatureList> results = QtConcurrent::blockingMapped( tasks, intersectPartition );
+    for ( QList<QgsFeatureList>::iterator resultIt = results.begin(); resultIt != results.end(); ++resultIt )
     {
-      continue;
+      for ( QgsFeatureList::iterator it = resultIt->begin(); it != resultIt->end(); ++it )
+      {
+        vWriter.addFeature( *it );
+      }
     }
 
-    if ( featureGeometry->intersects( overlayFeature.geometry() ) )
-    {
-      intersectGeometry = featureGeometry->intersection( overlayFeature.geometry() );
-
-      outFeature.setGeometry( intersectGeometry );
-      QgsAttributes attributesA = f.attributes();
-      QgsAttributes attributesB = overlayFeature.attributes();
-      combineAttributeMaps( attributesA, attributesB );
-      outFeature.setAttributes( attributesA );
+    processedFeatures += block.size();
+    block.clear();
 
-      //add it to vector file writer
-      if ( vfw )
+    if ( p )
+    {
+      p->setValue( processedFeatures );
+      if ( p->wasCanceled() )
       {
-        vfw->addFeature( outFeature );
+        break;
       }
     }
   }
+
+  if ( p )
+  {
+    p->setValue( featureCount );
+  }
+  return true;
 }
 
 void QgsOverlayAnalyzer::combineFieldLists( QgsFields& fieldListA, const QgsFields& fieldListB )
@@ -201,9 +248,3 @@ void QgsOverlayAnalyzer::combineFieldLists( QgsFields& fieldListA, const QgsFiel
     names.append( field.name() );
   }
 }
-
-void QgsOverlayAnalyzer::combineAttributeMaps( QgsAttributes& attributesA, const QgsAttributes& attributesB )
-{
-  attributesA += attributesB;
-}
-
@@ -32,6 +32,9 @@ class QProgressDialog;
 
 /** \ingroup analysis
  * The QGis class provides vector overlay analysis functions
+ *
+ * The features of the first layer are split into partitions of neighbouring features,
+ * which are intersected with the features of the second layer by the global thread pool.
  */
 
 class ANALYSIS_EXPORT QgsOverlayAnalyzer
@@ -52,8 +55,6 @@ class ANALYSIS_EXPORT QgsOverlayAnalyzer
   private:
 
     void combineFieldLists( QgsFields& fieldListA, const QgsFields& fieldListB );
-    void intersectFeature( QgsFeature& f, QgsVectorFileWriter* vfw, QgsVectorLayer* dp, QgsSpatialIndex* index );
-    void combineAttributeMaps( QgsAttributes& attributesA, const QgsAttributes& attributesB );
 };
 
 #endif //QGSVECTORANALYZER
@@ -0,0 +1,198 @@
+/***************************************************************************
+    qgsvectoranalysisutils.cpp - helpers of the parallel vector analysis tools
+                             -------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsvectoranalysisutils.h"
+
+#include "qgsgeometry.h"
+#include "qgslogger.h"
+#include "qgsmessagelog.h"
+#include "qgspoint.h"
+#include "qgsrectangle.h"
+
+#include <QObject>
+#include <QThreadStorage>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+quint32 qgsMortonCode( const QgsRectangle& extent, const QgsPoint& point )
+{
+  quint32 x = extent.width() > 0 ? ( quint32 )( qBound( 0.0, ( point.x() - extent.xMinimum() ) / extent.width(), 1.0 ) * 65535 ) : 0;
+  quint32 y = extent.height() > 0 ? ( quint32 )( qBound( 0.0, ( point.y() - extent.yMinimum() ) / extent.height(), 1.0 ) * 65535 ) : 0;
+  quint32 code = 0;
+  for ( int bit = 0; bit < 16; ++bit )
+  {
+    code |= (( x >> bit ) & 1 ) << ( 2 * bit );
+    code |= (( y >> bit ) & 1 ) << ( 2 * bit + 1 );
+  }
+  return code;
+}
+
+static void geosThreadNotice( const char *fmt, ... )
+{
+#if defined(QGISDEBUG)
+  va_list ap;
+  char buffer[1024];
+
+  va_start( ap, fmt );
+  vsnprintf( buffer, sizeof buffer, fmt, ap );
+  va_end( ap );
+
+  QgsDebugMsg( QString( "GEOS notice: %1" ).arg( QString::fromUtf8( buffer ) ) );
+#else
+  Q_UNUSED( fmt );
+#endif
+}
+
+// unlike the handler of the global context this one doesn't throw: the
+// reentrant functions return 0 on error, which the callers check
+static void geosThreadError( const char *fmt, ... )
+{
+  va_list ap;
+  char buffer[1024];
+
+  va_start( ap, fmt );
+  vsnprintf( buffer, sizeof buffer, fmt, ap );
+  va_end( ap );
+
+  QgsMessageLog::logMessage( QObject::tr( "Exception: %1" ).arg( QString::fromUtf8( buffer ) ), QObject::tr( "GEOS" ) );
+}
+
+QgsGeosThreadContext* QgsGeosThreadContext::instance()
+{
+  static QThreadStorage<QgsGeosThreadContext*> sContexts;
+  if ( !sContexts.hasLocalData() )
+  {
+    sContexts.setLocalData( new QgsGeosThreadContext() );
+  }
+  return sContexts.localData();
+}
+
+QgsGeosThreadContext::QgsGeosThreadContext()
+{
+  mHandle = initGEOS_r( geosThreadNotice, geosThreadError );
+  mReader = GEOSWKBReader_create_r( mHandle );
+  mWriter = GEOSWKBWriter_create_r( mHandle );
+}
+
+QgsGeosThreadContext::~QgsGeosThreadContext()
+{
+  GEOSWKBReader_destroy_r( mHandle, mReader );
+  GEOSWKBWriter_destroy_r( mHandle, mWriter );
+  finishGEOS_r( mHandle );
+}
+
+GEOSGeometry* QgsGeosThreadContext::toGeos( const QgsGeometry* geometry )
+{
+  if ( !geometry || !geometry->asWkb() )
+    return 0;
+
+  return GEOSWKBReader_read_r( mHandle, mReader, geometry->asWkb(), geometry->wkbSize() );
+}
+
+QgsGeometry* QgsGeosThreadContext::fromGeos( GEOSGeometry* geos )
+{
+  if ( !geos )
+    return 0;
+
+  size_t size = 0;
+  unsigned char* geosWkb = GEOSWKBWriter_write_r( mHandle, mWriter, geos, &size );
+  GEOSGeom_destroy_r( mHandle, geos );
+  if ( !geosWkb )
+    return 0;
+
+  // QgsGeometry takes ownership of memory allocated with new[]
+  unsigned char* wkb = new unsigned char[size];
+  memcpy( wkb, geosWkb, size );
+  GEOSFree_r( mHandle, geosWkb );
+
+  QgsGeometry* geometry = new QgsGeometry();
+  geometry->fromWkb( wkb, size );
+  return geometry;
+}
+
+void QgsGeosThreadContext::destroy( GEOSGeometry* geos )
+{
+  if ( geos )
+    GEOSGeom_destroy_r( mHandle, geos );
+}
+
+QgsGeometry* QgsGeosThreadContext::buffer( const QgsGeometry* geometry, double distance, int segments )
+{
+  GEOSGeometry* geos = toGeos( geometry );
+  if ( !geos )
+    return 0;
+
+  GEOSGeometry* result = GEOSBuffer_r( mHandle, geos, distance, segments );
+  destroy( geos );
+  return fromGeos( result );
+}
+
+QgsGeometry* QgsGeosThreadContext::simplify( const QgsGeometry* geometry, double tolerance )
+{
+  GEOSGeometry* geos = toGeos( geometry );
+  if ( !geos )
+    return 0;
+
+  GEOSGeometry* result = GEOSTopologyPreserveSimplify_r( mHandle, geos, tolerance );
+  destroy( geos );
+  return fromGeos( result );
+}
+
+QgsGeometry* QgsGeosThreadContext::centroid( const QgsGeometry* geometry )
+{
+  GEOSGeometry* geos = toGeos( geometry );
+  if ( !geos )
+    return 0;
+
+  GEOSGeometry* result = GEOSGetCentroid_r( mHandle, geos );
+  destroy( geos );
+  return fromGeos( result );
+}
+
+QgsGeometry* QgsGeosThreadContext::convexHull( const QgsGeometry* geometry )
+{
+  GEOSGeometry* geos = toGeos( geometry );
+  if ( !geos )
+    return 0;
+
+  GEOSGeometry* result = GEOSConvexHull_r( mHandle, geos );
+  destroy( geos );
+  return fromGeos( result );
+}
+
+QgsGeometry* QgsGeosThreadContext::combine( const QgsGeometry* geometry1, const QgsGeometry* geometry2 )
+{
+  GEOSGeometry* geos1 = toGeos( geometry1 );
+  GEOSGeometry* geos2 = toGeos( geometry2 );
+  GEOSGeometry* result = geos1 && geos2 ? GEOSUnion_r( mHandle, geos1, geos2 ) : 0;
+  destroy( geos1 );
+  destroy( geos2 );
+  if ( !result )
+    return 0;
+
+  if ( QGis::singleType( QGis::flatType( geometry1->wkbType() ) ) == QGis::WKBLineString )
+  {
+    GEOSGeometry* merged = GEOSLineMerge_r( mHandle, result );
+    if ( merged )
+    {
+      destroy( result );
+      result = merged;
+    }
+  }
+  return fromGeos( result );
+}
@@ -0,0 +1,75 @@
+/***************************************************************************
+    qgsvectoranalysisutils.h - helpers of the parallel vector analysis tools
+                             -------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSVECTORANALYSISUTILS_H
+#define QGSVECTORANALYSISUTILS_H
+
+#include <geos_c.h>
+
+#include <QtGlobal>
+
+class QgsGeometry;
+class QgsPoint;
+class QgsRectangle;
+
+/** Position of a point on a Z-order curve through a 2^16 x 2^16 grid covering the extent.
+ * Sorting geometries by the code of their center keeps neighbours together.
+ * @note not part of the public API
+ */
+quint32 qgsMortonCode( const QgsRectangle& extent, const QgsPoint& point );
+
+/** GEOS context of the calling thread for the analysis tools running on the thread pool.
+ * QgsGeometry only uses the global GEOS handle, which is not reentrant, so the workers
+ * convert geometries through WKB and use the reentrant GEOS API with the handle of
+ * their thread. The geometries passed in need a valid WKB representation, which is
+ * the case for geometries read from a layer and for the results of this class.
+ * @note not part of the public API
+ */
+class QgsGeosThreadContext
+{
+  public:
+    /** Context of the calling thread, created on first use and destroyed with the thread */
+    static QgsGeosThreadContext* instance();
+
+    ~QgsGeosThreadContext();
+
+    GEOSContextHandle_t handle() const { return mHandle; }
+
+    /** Converts a geometry to GEOS. The caller destroys the result with destroy(). Returns 0 on error */
+    GEOSGeometry* toGeos( const QgsGeometry* geometry );
+
+    /** Converts a GEOS geometry, which is destroyed. Returns 0 on error */
+    QgsGeometry* fromGeos( GEOSGeometry* geos );
+
+    void destroy( GEOSGeometry* geos );
+
+    QgsGeometry* buffer( const QgsGeometry* geometry, double distance, int segments );
+    QgsGeometry* simplify( const QgsGeometry* geometry, double tolerance );
+    QgsGeometry* centroid( const QgsGeometry* geometry );
+    QgsGeometry* convexHull( const QgsGeometry* geometry );
+
+    /** Union of two geometries, lines are merged like QgsGeometry::combine() does */
+    QgsGeometry* combine( const QgsGeometry* geometry1, const QgsGeometry* geometry2 );
+
+  private:
+    QgsGeosThreadContext();
+
+    GEOSContextHandle_t mHandle;
+    GEOSWKBReader* mReader;
+    GEOSWKBWriter* mWriter;
+};
+
+#endif // QGSVECTORANALYSISUTILS_H
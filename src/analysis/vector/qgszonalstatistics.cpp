@@ -17,12 +17,21 @@
 
 #include "qgszonalstatistics.h"
 #include "qgsgeometry.h"
+#include "qgslogger.h"
 #include "qgsvectordataprovider.h"
 #include "qgsvectorlayer.h"
 #include "gdal.h"
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+
+#include <cmath>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -30,12 +39,365 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+// Width and height in cells of the raster tiles processed by one thread
+#define TILE_SIZE 512
+
+// Number of tiles per thread processed between progress updates
+#define TILES_PER_BATCH 4
+
+// Number of features whose attributes are passed to the provider at once
+#define CHANGE_BATCH_SIZE 10000
+
+//! edge of a zone polygon in cell coordinates, y0 < y1
+struct ZsEdge
+{
+  double x0;
+  double y0;
+  double x1;
+  double y1;
+};
+
+//! polygon or multipolygon feature and the range of cells covering its bounding box
+struct ZsZone
+{
+  QgsFeatureId fid;
+  int firstColumn;
+  int lastColumn;
+  int firstRow;
+  int lastRow;
+  QVector<ZsEdge> edges;
+};
+
+static quint32 zsValueKey( float value )
+{
+  // 0 and -0 are the same value
+  union { float f; quint32 i; } u;
+  u.f = value == 0 ? 0 : value;
+  return u.i;
+}
+
+static float zsKeyValue( quint32 key )
+{
+  union { float f; quint32 i; } u;
+  u.i = key;
+  return u.f;
+}
+
+//! statistics of the cells of a zone within one or several tiles
+struct ZsStatistics
+{
+  ZsStatistics() : count( 0 ), sum( 0 ), min( 0 ), max( 0 ), mean( 0 ), m2( 0 ) {}
+
+  //! adds a cell, the weight is the covered fraction of the cell
+  void addValue( float value, bool majority, double weight = 1.0 )
+  {
+    if ( weight <= 0 )
+      return;
+
+    if ( count == 0 )
+    {
+      min = value;
+      max = value;
+    }
+    else
+    {
+      min = qMin( min, ( double ) value );
+      max = qMax( max, ( double ) value );
+    }
+    count += weight;
+    sum += value * weight;
+
+    // running weighted variance (Welford / West)
+    double delta = value - mean;
+    mean += delta * weight / count;
+    m2 += weight * delta * ( value - mean );
+
+    if ( majority )
+    {
+      values[ zsValueKey( value )] += weight;
+    }
+  }
+
+  void merge( const ZsStatistics& other )
+  {
+    if ( other.count == 0 )
+      return;
+
+    if ( count == 0 )
+    {
+      *this = other;
+      return;
+    }
+
+    // pairwise combination of mean and variance (Chan et al.)
+    double n = count + other.count;
+    double delta = other.mean - mean;
+    m2 += other.m2 + delta * delta * count * other.count / n;
+    mean += delta * other.count / n;
+    count = n;
+    sum += other.sum;
+    min = qMin( min, other.min );
+    max = qMax( max, other.max );
+
+    for ( QHash<quint32, double>::const_iterator it = other.values.constBegin(); it != other.values.constEnd(); ++it )
+    {
+      values[it.key()] += it.value();
+    }
+  }
+
+  double count;
+  double sum;
+  double min;
+  double max;
+  double mean;
+  //! sum of squared differences from the mean
+  double m2;
+  //! (weighted) number of cells for each value, only filled if the majority is calculated
+  QHash<quint32, double> values;
+};
+
+/**GDAL datasets must not be used by several threads at once. Each tile borrows
+  a dataset from the pool, so that each thread opens the raster at most once*/
+class ZsDatasetPool
+{
+  public:
+    explicit ZsDatasetPool( const QString& path ) : mPath( path ) {}
+
+    ~ZsDatasetPool()
+    {
+      foreach ( GDALDatasetH dataset, mDatasets )
+      {
+        GDALClose( dataset );
+      }
+    }
+
+    GDALDatasetH acquire()
+    {
+      {
+        QMutexLocker locker( &mMutex );
+        if ( !mDatasets.isEmpty() )
+        {
+          return mDatasets.takeLast();
+        }
+      }
+      return GDALOpen( TO8F( mPath ), GA_ReadOnly );
+    }
+
+    void release( GDALDatasetH dataset )
+    {
+      QMutexLocker locker( &mMutex );
+      mDatasets.append( dataset );
+    }
+
+  private:
+    QString mPath;
+    QMutex mMutex;
+    QList<GDALDatasetH> mDatasets;
+};
+
+//! parameters shared by all tiles
+struct ZsTileContext
+{
+  const QVector<ZsZone>* zones;
+  ZsDatasetPool* pool;
+  int band;
+  float nodata;
+  bool majority;
+};
+
+//! range of cells and the zones intersecting it
+struct ZsTile
+{
+  const ZsTileContext* context;
+  int column;
+  int row;
+  int columns;
+  int rows;
+  QVector<int> zones;
+};
+
+//! statistics for the zones of a tile, in the order of ZsTile::zones
+struct ZsTileResult
+{
+  QVector<int> zones;
+  QVector<ZsStatistics> statistics;
+};
+
+static ZsTileResult processTile( const ZsTile& tile )
+{
+  const ZsTileContext* context = tile.context;
+  ZsTileResult result;
+
+  GDALDatasetH dataset = context->pool->acquire();
+  if ( !dataset )
+  {
+    return result;
+  }
+
+  QVector<float> cells( tile.columns * tile.rows );
+  GDALRasterBandH band = GDALGetRasterBand( dataset, context->band );
+  CPLErr err = band ? GDALRasterIO( band, GF_Read, tile.column, tile.row, tile.columns, tile.rows, cells.data(),
+                                    tile.columns, tile.rows, GDT_Float32, 0, 0 ) : CE_Failure;
+  context->pool->release( dataset );
+  if ( err != CE_None )
+  {
+    QgsDebugMsg( QString( "reading tile at %1/%2 failed" ).arg( tile.column ).arg( tile.row ) );
+    return result;
+  }
+
+  result.zones = tile.zones;
+  result.statistics.resize( tile.zones.size() );
+
+  QVector<const ZsEdge*> edges;
+  QVector<double> crossings;
+  for ( int i = 0; i < tile.zones.size(); ++i )
+  {
+    const ZsZone& zone = context->zones->at( tile.zones.at( i ) );
+    ZsStatistics& stats = result.statistics[i];
+
+    int firstRow = qMax( zone.firstRow, tile.row );
+    int lastRow = qMin( zone.lastRow, tile.row + tile.rows - 1 );
+    double firstColumn = qMax( zone.firstColumn, tile.column );
+    double lastColumn = qMin( zone.lastColumn, tile.column + tile.columns - 1 );
+
+    // edges crossing the centers of the rows in the tile
+    edges.clear();
+    for ( QVector<ZsEdge>::const_iterator edgeIt = zone.edges.constBegin(); edgeIt != zone.edges.constEnd(); ++edgeIt )
+    {
+      if ( edgeIt->y0 <= lastRow + 0.5 && edgeIt->y1 > firstRow + 0.5 )
+      {
+        edges << &( *edgeIt );
+      }
+    }
+
+    for ( int row = firstRow; row <= lastRow; ++row )
+    {
+      double y = row + 0.5;
+      crossings.clear();
+      for ( int e = 0; e < edges.size(); ++e )
+      {
+        const ZsEdge* edge = edges.at( e );
+        if ( edge->y0 <= y && y < edge->y1 )
+        {
+          crossings << edge->x0 + ( y - edge->y0 ) * ( edge->x1 - edge->x0 ) / ( edge->y1 - edge->y0 );
+        }
+      }
+      qSort( crossings );
+
+      // even-odd rule, holes and the parts of multipolygons are filled correctly
+      const float* line = cells.constData() + ( row - tile.row ) * tile.columns - tile.column;
+      for ( int c = 0; c + 1 < crossings.size(); c += 2 )
+      {
+        // cells whose center is inside the span
+        int first = ( int ) qMax( floor( crossings.at( c ) - 0.5 ) + 1, firstColumn );
+        int last = ( int ) qMin( ceil( crossings.at( c + 1 ) - 0.5 ) - 1, lastColumn );
+        for ( int column = first; column <= last; ++column )
+        {
+          float value = line[column];
+          if ( value == context->nodata || qIsNaN( value ) ) //don't consider nodata values
+            continue;
+
+          stats.addValue( value, context->majority );
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+//! processes a tile on the thread pool of the calculation
+class ZsTileTask : public QRunnable
+{
+  public:
+    ZsTileTask( const ZsTile& tile, ZsTileResult* result ) : mTile( tile ), mResult( result ) {}
+
+    void run() { *mResult = processTile( mTile ); }
+
+  private:
+    ZsTile mTile;
+    ZsTileResult* mResult;
+};
+
+static void addEdges( const QgsPolygon& polygon, const QgsRectangle& rasterBBox, double cellSizeX, double cellSizeY, QVector<ZsEdge>& edges )
+{
+  for ( int ring = 0; ring < polygon.size(); ++ring )
+  {
+    const QgsPolyline& points = polygon.at( ring );
+    for ( int i = 1; i < points.size(); ++i )
+    {
+      double x0 = ( points.at( i - 1 ).x() - rasterBBox.xMinimum() ) / cellSizeX;
+      double y0 = ( rasterBBox.yMaximum() - points.at( i - 1 ).y() ) / cellSizeY;
+      double x1 = ( points.at( i ).x() - rasterBBox.xMinimum() ) / cellSizeX;
+      double y1 = ( rasterBBox.yMaximum() - points.at( i ).y() ) / cellSizeY;
+      if ( y0 == y1 )
+        continue; // horizontal edges never cross a row center
+
+      ZsEdge edge;
+      if ( y0 < y1 )
+      {
+        edge.x0 = x0; edge.y0 = y0; edge.x1 = x1; edge.y1 = y1;
+      }
+      else
+      {
+        edge.x0 = x1; edge.y0 = y1; edge.x1 = x0; edge.y1 = y0;
+      }
+      edges << edge;
+    }
+  }
+}
+
+//! statistics of a zone with precise pixel - polygon intersection test (slow), each cell is weighted with its covered fraction
+static void preciseStatistics( GDALRasterBandH band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
+                               double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, float nodata, bool majority, ZsStatistics& stats )
+{
+  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
+  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
+  QgsGeometry* pixelRectGeometry = 0;
+
+  double hCellSizeX = cellSizeX / 2.0;
+  double hCellSizeY = cellSizeY / 2.0;
+  double pixelArea = cellSizeX * cellSizeY;
+
+  for ( int row = 0; row < nCellsY; ++row )
+  {
+    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
+    for ( int col = 0; col < nCellsX; ++col )
+    {
+      GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, 1, 1, pixelData, 1, 1, GDT_Float32, 0, 0 );
+      if ( *pixelData == nodata || qIsNaN( *pixelData ) )
+      {
+        currentX += cellSizeX;
+        continue;
+      }
+
+      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
+      if ( pixelRectGeometry )
+      {
+        //intersection
+        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
+        if ( intersectGeometry )
+        {
+          stats.addValue( *pixelData, majority, intersectGeometry->area() / pixelArea );
+          delete intersectGeometry;
+        }
+        delete pixelRectGeometry;
+      }
+      currentX += cellSizeX;
+    }
+    currentY -= cellSizeY;
+  }
+  CPLFree( pixelData );
+}
+
 QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand )
     : mRasterFilePath( rasterFile )
     , mRasterBand( rasterBand )
     , mPolygonLayer( polygonLayer )
     , mAttributePrefix( attributePrefix )
     , mInputNodataValue( -1 )
+    , mStatistics( Default )
+    , mMaxThreads( 0 )
 {
 
 }
@@ -43,6 +405,8 @@ QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QStr
 QgsZonalStatistics::QgsZonalStatistics()
     : mRasterBand( 0 )
     , mPolygonLayer( 0 )
+    , mStatistics( Default )
+    , mMaxThreads( 0 )
 {
 
 }
@@ -109,27 +473,43 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   QgsRectangle rasterBBox( geoTransform[0], geoTransform[3] - ( nCellsYGDAL * cellsizeY ),
                            geoTransform[0] + ( nCellsXGDAL * cellsizeX ), geoTransform[3] );
 
-  //add the new count, sum, mean fields to the provider
+  // the dataset is reused by the tiles
+  ZsDatasetPool datasetPool( mRasterFilePath );
+  datasetPool.release( inputDataset );
+
+  //add the new fields to the provider
   QList<QgsField> newFieldList;
-  QString countFieldName = getUniqueFieldName( mAttributePrefix + "count" );
-  QString sumFieldName = getUniqueFieldName( mAttributePrefix + "sum" );
-  QString meanFieldName = getUniqueFieldName( mAttributePrefix + "mean" );
-  QgsField countField( countFieldName, QVariant::Double, "double precision" );
-  QgsField sumField( sumFieldName, QVariant::Double, "double precision" );
-  QgsField meanField( meanFieldName, QVariant::Double, "double precision" );
-  newFieldList.push_back( countField );
-  newFieldList.push_back( sumField );
-  newFieldList.push_back( meanField );
+  QList< QPair<Statistic, QString> > statisticFields;
+  statisticFields << qMakePair( Count, QString( "count" ) )
+  << qMakePair( Sum, QString( "sum" ) )
+  << qMakePair( Mean, QString( "mean" ) )
+  << qMakePair( Min, QString( "min" ) )
+  << qMakePair( Max, QString( "max" ) )
+  << qMakePair( StDev, QString( "stdev" ) )
+  << qMakePair( Majority, QString( "majority" ) );
+
+  QList< QPair<Statistic, QString> > fieldNames;
+  for ( int i = 0; i < statisticFields.size(); ++i )
+  {
+    if ( !( mStatistics & statisticFields.at( i ).first ) )
+      continue;
+
+    QString fieldName = getUniqueFieldName( mAttributePrefix + statisticFields.at( i ).second );
+    newFieldList.push_back( QgsField( fieldName, QVariant::Double, "double precision" ) );
+    fieldNames << qMakePair( statisticFields.at( i ).first, fieldName );
+  }
   vectorProvider->addAttributes( newFieldList );
 
   //index of the new fields
-  int countIndex = vectorProvider->fieldNameIndex( countFieldName );
-  int sumIndex = vectorProvider->fieldNameIndex( sumFieldName );
-  int meanIndex = vectorProvider->fieldNameIndex( meanFieldName );
-
-  if ( countIndex == -1 || sumIndex == -1 || meanIndex == -1 )
+  QMap<Statistic, int> fieldIndex;
+  for ( int i = 0; i < fieldNames.size(); ++i )
   {
-    return 8;
+    int index = vectorProvider->fieldNameIndex( fieldNames.at( i ).second );
+    if ( index == -1 )
+    {
+      return 8;
+    }
+    fieldIndex.insert( fieldNames.at( i ).first, index );
   }
 
   //progress dialog
@@ -139,105 +519,279 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
     p->setMaximum( featureCount );
   }
 
-
-  //iterate over each polygon
+  //read the polygons and convert their outlines to cell coordinates
   QgsFeatureRequest request;
   request.setSubsetOfAttributes( QgsAttributeList() );
   QgsFeatureIterator fi = vectorProvider->getFeatures( request );
   QgsFeature f;
-  double count = 0;
-  double sum = 0;
-  double mean = 0;
+  QVector<ZsZone> zones;
   int featureCounter = 0;
+  bool canceled = false;
 
   while ( fi.nextFeature( f ) )
   {
-    if ( p )
+    if ( p && featureCounter % 1000 == 0 )
     {
       p->setValue( featureCounter );
+      if ( p->wasCanceled() )
+      {
+        canceled = true;
+        break;
+      }
     }
-
-    if ( p && p->wasCanceled() )
-    {
-      break;
-    }
+    ++featureCounter;
 
     QgsGeometry* featureGeometry = f.geometry();
     if ( !featureGeometry )
     {
-      ++featureCounter;
       continue;
     }
 
     QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
     if ( featureRect.isEmpty() )
     {
-      ++featureCounter;
       continue;
     }
 
-    int offsetX, offsetY, nCellsX, nCellsY;
-    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+    ZsZone zone;
+    zone.fid = f.id();
+    zone.firstColumn = qBound( 0, ( int )(( featureRect.xMinimum() - rasterBBox.xMinimum() ) / cellsizeX ), nCellsXGDAL - 1 );
+    zone.lastColumn = qBound( 0, ( int )(( featureRect.xMaximum() - rasterBBox.xMinimum() ) / cellsizeX ), nCellsXGDAL - 1 );
+    zone.firstRow = qBound( 0, ( int )(( rasterBBox.yMaximum() - featureRect.yMaximum() ) / cellsizeY ), nCellsYGDAL - 1 );
+    zone.lastRow = qBound( 0, ( int )(( rasterBBox.yMaximum() - featureRect.yMinimum() ) / cellsizeY ), nCellsYGDAL - 1 );
+
+    if ( featureGeometry->isMultipart() )
     {
-      ++featureCounter;
-      continue;
+      QgsMultiPolygon multiPolygon = featureGeometry->asMultiPolygon();
+      for ( int i = 0; i < multiPolygon.size(); ++i )
+      {
+        addEdges( multiPolygon.at( i ), rasterBBox, cellsizeX, cellsizeY, zone.edges );
+      }
     }
-
-    //avoid access to cells outside of the raster (may occur because of rounding)
-    if (( offsetX + nCellsX ) > nCellsXGDAL )
+    else
     {
-      nCellsX = nCellsXGDAL - offsetX;
+      addEdges( featureGeometry->asPolygon(), rasterBBox, cellsizeX, cellsizeY, zone.edges );
     }
-    if (( offsetY + nCellsY ) > nCellsYGDAL )
+    zones << zone;
+  }
+
+  if ( canceled )
+  {
+    mPolygonLayer->updateFields();
+    return 9;
+  }
+
+  //assign the zones to the tiles covered by their bounding boxes
+  int nTilesX = ( nCellsXGDAL + TILE_SIZE - 1 ) / TILE_SIZE;
+  int nTilesY = ( nCellsYGDAL + TILE_SIZE - 1 ) / TILE_SIZE;
+  QVector< QVector<int> > tileZones( nTilesX * nTilesY );
+  for ( int i = 0; i < zones.size(); ++i )
+  {
+    const ZsZone& zone = zones.at( i );
+    for ( int tileY = zone.firstRow / TILE_SIZE; tileY <= zone.lastRow / TILE_SIZE; ++tileY )
     {
-      nCellsY = nCellsYGDAL - offsetY;
+      for ( int tileX = zone.firstColumn / TILE_SIZE; tileX <= zone.lastColumn / TILE_SIZE; ++tileX )
+      {
+        tileZones[tileY * nTilesX + tileX] << i;
+      }
     }
+  }
 
-    statisticsFromMiddlePointTest( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                   rasterBBox, sum, count );
+  ZsTileContext context;
+  context.zones = &zones;
+  context.pool = &datasetPool;
+  context.band = mRasterBand;
+  context.nodata = mInputNodataValue;
+  context.majority = mStatistics & Majority;
 
-    if ( count <= 1 )
+  QList<ZsTile> tiles;
+  for ( int tileY = 0; tileY < nTilesY; ++tileY )
+  {
+    for ( int tileX = 0; tileX < nTilesX; ++tileX )
     {
-      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
-      statisticsFromPreciseIntersection( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                         rasterBBox, sum, count );
+      if ( tileZones.at( tileY * nTilesX + tileX ).isEmpty() )
+        continue;
+
+      ZsTile tile;
+      tile.context = &context;
+      tile.column = tileX * TILE_SIZE;
+      tile.row = tileY * TILE_SIZE;
+      tile.columns = qMin( TILE_SIZE, nCellsXGDAL - tile.column );
+      tile.rows = qMin( TILE_SIZE, nCellsYGDAL - tile.row );
+      tile.zones = tileZones.at( tileY * nTilesX + tileX );
+      tiles << tile;
     }
+  }
+  tileZones.clear();
 
+  int threads = mMaxThreads > 0 ? mMaxThreads : QThreadPool::globalInstance()->maxThreadCount();
+  int batchSize = qMax( 1, threads ) * TILES_PER_BATCH;
 
-    if ( count == 0 )
+  //QtConcurrent only uses the global pool, the tiles are processed on a pool limited to the threads
+  QThreadPool threadPool;
+  threadPool.setMaxThreadCount( qMax( 1, threads ) );
+
+  QgsDebugMsg( QString( "%1 zones in %2 tiles with %3 threads" ).arg( zones.size() ).arg( tiles.size() ).arg( threads ) );
+
+  if ( p )
+  {
+    p->setMaximum( tiles.size() );
+    p->setValue( 0 );
+  }
+
+  //accumulate the tiles in parallel and merge the partial statistics of the zones
+  QVector<ZsStatistics> statistics( zones.size() );
+  for ( int start = 0; start < tiles.size(); start += batchSize )
+  {
+    QList<ZsTile> batch = tiles.mid( start, batchSize );
+    QVector<ZsTileResult> results( batch.size() );
+    if ( threads > 1 )
     {
-      mean = 0;
+      for ( int i = 0; i < batch.size(); ++i )
+      {
+        threadPool.start( new ZsTileTask( batch.at( i ), &results[i] ) );
+      }
+      threadPool.waitForDone();
     }
     else
     {
-      mean = sum / count;
+      for ( int i = 0; i < batch.size(); ++i )
+      {
+        results[i] = processTile( batch.at( i ) );
+      }
     }
 
-    //write the statistics value to the vector data provider
-    QgsChangedAttributesMap changeMap;
-    QgsAttributeMap changeAttributeMap;
-    changeAttributeMap.insert( countIndex, QVariant( count ) );
-    changeAttributeMap.insert( sumIndex, QVariant( sum ) );
-    changeAttributeMap.insert( meanIndex, QVariant( mean ) );
-    changeMap.insert( f.id(), changeAttributeMap );
-    vectorProvider->changeAttributeValues( changeMap );
+    foreach ( const ZsTileResult& result, results )
+    {
+      for ( int i = 0; i < result.zones.size(); ++i )
+      {
+        statistics[ result.zones.at( i )].merge( result.statistics.at( i ) );
+      }
+    }
 
-    ++featureCounter;
+    if ( p )
+    {
+      p->setValue( qMin( start + batchSize, tiles.size() ) );
+      if ( p->wasCanceled() )
+      {
+        mPolygonLayer->updateFields();
+        return 9;
+      }
+    }
   }
+  tiles.clear();
 
-  if ( p )
+  //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case.
+  //All the statistics of such a zone are replaced, so that they come from the same cells
+  QHash<QgsFeatureId, int> smallZones;
+  for ( int i = 0; i < zones.size(); ++i )
   {
-    p->setValue( featureCount );
+    if ( statistics.at( i ).count <= 1 )
+    {
+      smallZones.insert( zones.at( i ).fid, i );
+    }
   }
 
-  GDALClose( inputDataset );
-  mPolygonLayer->updateFields();
+  if ( !smallZones.isEmpty() )
+  {
+    GDALDatasetH dataset = datasetPool.acquire();
+    GDALRasterBandH band = dataset ? GDALGetRasterBand( dataset, mRasterBand ) : 0;
+
+    QgsFeatureRequest smallRequest;
+    smallRequest.setFilterFids( smallZones.keys().toSet() );
+    smallRequest.setSubsetOfAttributes( QgsAttributeList() );
+    QgsFeatureIterator smallIt = vectorProvider->getFeatures( smallRequest );
+    while ( band && smallIt.nextFeature( f ) )
+    {
+      QgsGeometry* featureGeometry = f.geometry();
+      if ( !featureGeometry )
+        continue;
+
+      QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
+      int offsetX, offsetY, nCellsX, nCellsY;
+      if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+        continue;
+
+      //avoid access to cells outside of the raster (may occur because of rounding)
+      if (( offsetX + nCellsX ) > nCellsXGDAL )
+      {
+        nCellsX = nCellsXGDAL - offsetX;
+      }
+      if (( offsetY + nCellsY ) > nCellsYGDAL )
+      {
+        nCellsY = nCellsYGDAL - offsetY;
+      }
 
-  if ( p && p->wasCanceled() )
+      ZsStatistics precise;
+      preciseStatistics( band, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
+                         rasterBBox, mInputNodataValue, mStatistics & Majority, precise );
+      statistics[ smallZones.value( f.id() )] = precise;
+    }
+
+    if ( dataset )
+    {
+      datasetPool.release( dataset );
+    }
+  }
+
+  //write the statistics values to the vector data provider
+  QgsChangedAttributesMap changeMap;
+  for ( int i = 0; i < zones.size(); ++i )
   {
-    return 9;
+    const ZsStatistics& stats = statistics.at( i );
+    double count = stats.count;
+    double sum = stats.sum;
+    double mean = count == 0 ? 0 : sum / count;
+
+    QgsAttributeMap changeAttributeMap;
+    if ( mStatistics & Count )
+      changeAttributeMap.insert( fieldIndex.value( Count ), QVariant( count ) );
+    if ( mStatistics & Sum )
+      changeAttributeMap.insert( fieldIndex.value( Sum ), QVariant( sum ) );
+    if ( mStatistics & Mean )
+      changeAttributeMap.insert( fieldIndex.value( Mean ), QVariant( mean ) );
+    if ( mStatistics & Min )
+      changeAttributeMap.insert( fieldIndex.value( Min ), stats.count > 0 ? QVariant( stats.min ) : QVariant( QVariant::Double ) );
+    if ( mStatistics & Max )
+      changeAttributeMap.insert( fieldIndex.value( Max ), stats.count > 0 ? QVariant( stats.max ) : QVariant( QVariant::Double ) );
+    if ( mStatistics & StDev )
+      changeAttributeMap.insert( fieldIndex.value( StDev ), stats.count > 0 ? QVariant( sqrt( stats.m2 / stats.count ) ) : QVariant( QVariant::Double ) );
+    if ( mStatistics & Majority )
+    {
+      QVariant majority( QVariant::Double );
+      double majorityCount = 0;
+      for ( QHash<quint32, double>::const_iterator it = stats.values.constBegin(); it != stats.values.constEnd(); ++it )
+      {
+        // the smallest of equally frequent values
+        float value = zsKeyValue( it.key() );
+        if ( it.value() > majorityCount || ( it.value() == majorityCount && value < majority.toDouble() ) )
+        {
+          majority = ( double ) value;
+          majorityCount = it.value();
+        }
+      }
+      changeAttributeMap.insert( fieldIndex.value( Majority ), majority );
+    }
+    changeMap.insert( zones.at( i ).fid, changeAttributeMap );
+
+    if ( changeMap.size() >= CHANGE_BATCH_SIZE )
+    {
+      vectorProvider->changeAttributeValues( changeMap );
+      changeMap.clear();
+    }
+  }
+  if ( !changeMap.isEmpty() )
+  {
+    vectorProvider->changeAttributeValues( changeMap );
   }
 
+  if ( p )
+  {
+    p->setValue( p->maximum() );
+  }
+
+  mPolygonLayer->updateFields();
+
   return 0;
 }
 
@@ -265,110 +819,6 @@ int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const Q
   return 0;
 }
 
-void QgsZonalStatistics::statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
-{
-  double cellCenterX, cellCenterY;
-
-  float* scanLine = ( float * ) CPLMalloc( sizeof( float ) * nCellsX );
-  cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  count = 0;
-  sum = 0;
-
-  const GEOSGeometry* polyGeos = poly->asGeos();
-  if ( !polyGeos )
-  {
-    return;
-  }
-
-  const GEOSPreparedGeometry* polyGeosPrepared = GEOSPrepare( poly->asGeos() );
-  if ( !polyGeosPrepared )
-  {
-    return;
-  }
-
-  GEOSCoordSequence* cellCenterCoords = 0;
-  GEOSGeometry* currentCellCenter = 0;
-
-  for ( int i = 0; i < nCellsY; ++i )
-  {
-    if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + i, nCellsX, 1, scanLine, nCellsX, 1, GDT_Float32, 0, 0 )
-         != CPLE_None )
-    {
-      continue;
-    }
-    cellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
-    for ( int j = 0; j < nCellsX; ++j )
-    {
-      GEOSGeom_destroy( currentCellCenter );
-      cellCenterCoords = GEOSCoordSeq_create( 1, 2 );
-      GEOSCoordSeq_setX( cellCenterCoords, 0, cellCenterX );
-      GEOSCoordSeq_setY( cellCenterCoords, 0, cellCenterY );
-      currentCellCenter = GEOSGeom_createPoint( cellCenterCoords );
-
-      if ( scanLine[j] != mInputNodataValue ) //don't consider nodata values
-      {
-        if ( GEOSPreparedContains( polyGeosPrepared, currentCellCenter ) )
-        {
-          if ( !qIsNaN( scanLine[j] ) )
-          {
-            sum += scanLine[j];
-          }
-          ++count;
-        }
-      }
-      cellCenterX += cellSizeX;
-    }
-    cellCenterY -= cellSizeY;
-  }
-  CPLFree( scanLine );
-  GEOSPreparedGeom_destroy( polyGeosPrepared );
-}
-
-void QgsZonalStatistics::statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
-{
-  sum = 0;
-  count = 0;
-  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
-  QgsGeometry* pixelRectGeometry = 0;
-
-  double hCellSizeX = cellSizeX / 2.0;
-  double hCellSizeY = cellSizeY / 2.0;
-  double pixelArea = cellSizeX * cellSizeY;
-  double weight = 0;
-
-  for ( int row = 0; row < nCellsY; ++row )
-  {
-    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
-    for ( int col = 0; col < nCellsX; ++col )
-    {
-      GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, nCellsX, 1, pixelData, 1, 1, GDT_Float32, 0, 0 );
-      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
-      if ( pixelRectGeometry )
-      {
-        //intersection
-        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
-        if ( intersectGeometry )
-        {
-          double intersectionArea = intersectGeometry->area();
-          if ( intersectionArea >= 0.0 )
-          {
-            weight = intersectionArea / pixelArea;
-            count += weight;
-            sum += *pixelData * weight;
-          }
-          delete intersectGeometry;
-        }
-      }
-      currentX += cellSizeX;
-    }
-    currentY -= cellSizeY;
-  }
-  CPLFree( pixelData );
-}
-
 QString QgsZonalStatistics::getUniqueFieldName( QString fieldName )
 {
   QgsVectorDataProvider* dp = mPolygonLayer->dataProvider();
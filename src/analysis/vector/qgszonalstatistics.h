@@ -21,17 +21,49 @@
 #include "qgsrectangle.h"
 #include <QString>
 
-class QgsGeometry;
 class QgsVectorLayer;
 class QProgressDialog;
 
-/**A class that calculates raster statistics (count, sum, mean) for a polygon or multipolygon layer and appends the results as attributes*/
+/**A class that calculates raster statistics (count, sum, mean, min, max, standard deviation, majority) for a polygon or multipolygon layer and appends the results as attributes.
+
+  The raster is processed in tiles by several threads. Within a tile, each polygon is filled
+  scanline by scanline and the cells whose center is inside the polygon are added to the statistics
+  of its zone. The partial statistics of the tiles are merged at the end.
+
+  Zones containing at most one cell center are computed again with a precise intersection of each
+  cell with the polygon instead, where a cell is weighted with its covered fraction. All the
+  statistics of such a zone come from this method, the count is then the sum of the weights.*/
 class ANALYSIS_EXPORT QgsZonalStatistics
 {
   public:
+    //! Statistics appended as attributes
+    enum Statistic
+    {
+      Count = 1,
+      Sum = 2,
+      Mean = 4,
+      Min = 8,
+      Max = 16,
+      StDev = 32,
+      Majority = 64,
+      Default = Count | Sum | Mean,
+      All = Count | Sum | Mean | Min | Max | StDev | Majority
+    };
+    Q_DECLARE_FLAGS( Statistics, Statistic )
+
     QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix = "", int rasterBand = 1 );
     ~QgsZonalStatistics();
 
+    /**Statistics to calculate, defaults to count, sum and mean
+      @note added in 2.4 */
+    void setStatistics( Statistics stats ) { mStatistics = stats; }
+    Statistics statistics() const { return mStatistics; }
+
+    /**Number of threads processing raster tiles on a dedicated thread pool, 0 to use as many threads as the global thread pool
+      @note added in 2.4 */
+    void setMaxThreads( int threads ) { mMaxThreads = threads; }
+    int maxThreads() const { return mMaxThreads; }
+
     /**Starts the calculation
       @return 0 in case of success*/
     int calculateStatistics( QProgressDialog* p );
@@ -43,17 +75,6 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     int cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
                          int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const;
 
-    /**Returns statistics by considering the pixels where the center point is within the polygon (fast)*/
-    void statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    void statisticsFromMiddlePointTest_improved( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    /**Returns statistics with precise pixel - polygon intersection test (slow) */
-    void statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
     QString getUniqueFieldName( QString fieldName );
 
     QString mRasterFilePath;
@@ -63,6 +84,10 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     QString mAttributePrefix;
     /**The nodata value of the input layer*/
     float mInputNodataValue;
+    Statistics mStatistics;
+    int mMaxThreads;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS( QgsZonalStatistics::Statistics )
+
 #endif // QGSZONALSTATISTICS_H
@@ -86,8 +86,16 @@
 #include <QProgressBar>
 #include <QProgressDialog>
 #include <QShortcut>
+#include <QThread>
+#include <QtConcurrentRun>
 
 
+//! saves an exported page, called from a worker thread
+static bool saveImage_( QImage image, QString fileName, QByteArray format )
+{
+  return image.save( fileName, format.constData() );
+}
+
 // sort function for QList<QAction*>, e.g. menu listings
 static bool cmpByText_( QAction* a, QAction* b )
 {
@@ -1668,6 +1676,11 @@ void QgsComposer::exportCompositionAsImage( QgsComposer::OutputMode mode )
 
     QProgressDialog progress( tr( "Rendering maps..." ), tr( "Abort" ), 0, atlasMap->numFeatures(), this );
 
+    // the maps of several pages are rendered at once and the pages are written in the background
+    int parallelPages = myQSettings.value( "/qgis/atlasParallelPages", qMin( QThread::idealThreadCount(), 8 ) ).toInt();
+    QByteArray imageFormat = format.toLocal8Bit();
+    QList< QFuture<bool> > pendingWrites;
+
     for ( int feature = 0; feature < atlasMap->numFeatures(); ++feature )
     {
       progress.setValue( feature );
@@ -1681,6 +1694,10 @@ void QgsComposer::exportCompositionAsImage( QgsComposer::OutputMode mode )
       }
       try
       {
+        if ( parallelPages > 1 && feature % parallelPages == 0 )
+        {
+          atlasMap->prerenderFeatures( feature, feature + parallelPages - 1 );
+        }
         atlasMap->prepareForFeature( feature );
       }
       catch ( std::runtime_error& e )
@@ -1699,16 +1716,19 @@ void QgsComposer::exportCompositionAsImage( QgsComposer::OutputMode mode )
       {
         QImage image = mComposition->printPageAsRaster( i );
 
-        if ( i == 0 )
-        {
-          image.save( filename, format.toLocal8Bit().constData() );
-        }
-        else
+        QString outputFilePath = filename;
+        if ( i > 0 )
         {
           QFileInfo fi( filename );
-          QString outputFilePath = fi.absolutePath() + "/" + fi.baseName() + "_" + QString::number( i + 1 ) + "." + fi.suffix();
-          image.save( outputFilePath, format.toLocal8Bit().constData() );
+          outputFilePath = fi.absolutePath() + "/" + fi.baseName() + "_" + QString::number( i + 1 ) + "." + fi.suffix();
         }
+        pendingWrites << QtConcurrent::run( saveImage_, image, outputFilePath, imageFormat );
+      }
+
+      // limit the number of pages waiting to be written, they are finished in order
+      while ( pendingWrites.size() > qMax( parallelPages, 1 ) * mComposition->numPages() )
+      {
+        pendingWrites.takeFirst().waitForFinished();
       }
 
       //
@@ -1726,6 +1746,10 @@ void QgsComposer::exportCompositionAsImage( QgsComposer::OutputMode mode )
         writeWorldFile( worldFileName, a, b, c, d, e, f );
       }
     }
+    for ( int i = 0; i < pendingWrites.size(); ++i )
+    {
+      pendingWrites[i].waitForFinished();
+    }
     atlasMap->endRender();
     mView->setPaintingEnabled( true );
     QApplication::restoreOverrideCursor();
@@ -87,6 +87,7 @@ QgsLegendLayer::QgsLegendLayer( QgsMapLayer* layer )
     connect( layer, SIGNAL( editingStarted() ), this, SLOT( updateIcon() ) );
     connect( layer, SIGNAL( editingStopped() ), this, SLOT( updateIcon() ) );
     connect( layer, SIGNAL( layerModified() ), this, SLOT( updateAfterLayerModification() ) ); // TODO[MD]: should have symbologyChanged signal
+    connect( layer, SIGNAL( symbolFeatureCountMapChanged() ), this, SLOT( updateAfterLayerModification() ) );
   }
   if ( qobject_cast<QgsRasterLayer *>( layer ) )
   {
@@ -570,12 +571,8 @@ void QgsLegendLayer::updateItemListCountV2( SymbologyList& itemList, QgsVectorLa
     return;
   }
 
-  // Count features
-  if ( !layer->countSymbolFeatures() )
-  {
-    QgsDebugMsg( "Cannot get feature counts" );
-    return;
-  }
+  // Count features in the background, the symbology is refreshed when the counts are available
+  layer->countSymbolFeaturesInBackground();
 
   QMap<QString, QPixmap> itemMap;
   SymbologyList::const_iterator symbologyIt = itemList.constBegin();
@@ -590,7 +587,9 @@ void QgsLegendLayer::updateItemListCountV2( SymbologyList& itemList, QgsVectorLa
   QgsLegendSymbolList::const_iterator symbolIt = symbolList.constBegin();
   for ( ; symbolIt != symbolList.constEnd(); ++symbolIt )
   {
-    itemList.push_back( qMakePair( symbolIt->first + " [" + QString::number( layer->featureCount( symbolIt->second ) ) + "]", itemMap[symbolIt->first] ) );
+    long count = layer->featureCount( symbolIt->second );
+    QString label = count >= 0 ? symbolIt->first + " [" + QString::number( count ) + "]" : symbolIt->first;
+    itemList.push_back( qMakePair( label, itemMap[symbolIt->first] ) );
   }
 }
 
@@ -27,6 +27,7 @@
 #include "qgscomposershape.h"
 #include "qgspaperitem.h"
 #include "qgsmaplayerregistry.h"
+#include "qgsmaprendererjob.h"
 
 QgsAtlasComposition::QgsAtlasComposition( QgsComposition* composition ) :
     mComposition( composition ),
@@ -303,6 +304,14 @@ bool QgsAtlasComposition::beginRender()
   QgsExpression::setSpecialColumn( "$numpages", QVariant( mComposition->numPages() ) );
   QgsExpression::setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
 
+  // keep the rendered map images, maps which do not change between pages are rendered only once
+  QList<QgsComposerMap*> maps;
+  mComposition->composerItems( maps );
+  for ( QList<QgsComposerMap*>::iterator mit = maps.begin(); mit != maps.end(); ++mit )
+  {
+    ( *mit )->setReuseRenderedImages( true );
+  }
+
   return true;
 }
 
@@ -321,6 +330,13 @@ void QgsAtlasComposition::endRender()
     ( *lit )->setExpressionContext( 0, 0 );
   }
 
+  QList<QgsComposerMap*> maps;
+  mComposition->composerItems( maps );
+  for ( QList<QgsComposerMap*>::iterator mit = maps.begin(); mit != maps.end(); ++mit )
+  {
+    ( *mit )->setReuseRenderedImages( false );
+  }
+
   updateAtlasMaps();
 
   emit renderEnded();
@@ -470,6 +486,69 @@ void QgsAtlasComposition::prepareForFeature( int featureI )
   }
 }
 
+void QgsAtlasComposition::prerenderFeatures( int first, int last )
+{
+  if ( !mCoverageLayer || mFeatureIds.isEmpty() )
+  {
+    return;
+  }
+
+  first = qMax( first, 0 );
+  last = qMin( last, mFeatureIds.size() - 1 );
+  if ( first > last )
+  {
+    return;
+  }
+
+  //the maps are rendered while the atlas variables are set for another page, so maps with
+  //layers depending on them are left for the page rendering
+  QList<QgsComposerMap*> maps;
+  QList<QgsComposerMap*> prerenderMaps;
+  mComposition->composerItems( maps );
+  for ( QList<QgsComposerMap*>::iterator mit = maps.begin(); mit != maps.end(); ++mit )
+  {
+    QgsComposerMap* currentMap = ( *mit );
+    if ( !currentMap->atlasDriven() || !currentMap->reuseRenderedImages()
+         || currentMap->containsAdvancedEffects() || currentMap->layersUseAtlasVariables() )
+    {
+      continue;
+    }
+    prerenderMaps << currentMap;
+  }
+
+  if ( prerenderMaps.isEmpty() )
+  {
+    return;
+  }
+
+  //resolution of the pages from printPageAsRaster(), as reported by QImage
+  int dpi = qRound(( int )( mComposition->printResolution() / 25.4 * 1000 ) * 0.0254 );
+
+  //start the jobs of all pages, they are rendered concurrently
+  QList< QPair< QgsComposerMap*, QgsMapSettings > > jobSettings;
+  QList< QgsMapRendererParallelJob* > jobs;
+  for ( int featureI = first; featureI <= last; ++featureI )
+  {
+    prepareForFeature( featureI );
+
+    for ( QList<QgsComposerMap*>::iterator mit = prerenderMaps.begin(); mit != prerenderMaps.end(); ++mit )
+    {
+      QgsMapSettings settings = ( *mit )->printMapSettings( dpi );
+      QgsMapRendererParallelJob* job = new QgsMapRendererParallelJob( settings );
+      job->start();
+      jobSettings << qMakePair( *mit, settings );
+      jobs << job;
+    }
+  }
+
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    jobs[i]->waitForFinished();
+    jobSettings[i].first->addPrerenderedImage( jobSettings[i].second, jobs[i]->renderedImage() );
+    delete jobs[i];
+  }
+}
+
 void QgsAtlasComposition::computeExtent( QgsComposerMap* map )
 {
   // compute the extent of the current feature, in the crs of the specified map
@@ -175,6 +175,13 @@ class CORE_EXPORT QgsAtlasComposition : public QObject
     /** Prepare the atlas map for the given feature. Sets the extent and context variables */
     void prepareForFeature( QgsFeature * feat );
 
+    /** Renders the atlas driven maps of the features first to last concurrently in background
+      jobs. The images are painted when the pages of these features are printed to images.
+      Maps whose layers depend on atlas variables are not rendered in advance.
+      Must be called between beginRender() and endRender(), the current feature is undefined afterwards.
+      @note added in 2.4 */
+    void prerenderFeatures( int first, int last );
+
     /** Returns the current filename. Must be called after prepareForFeature( i ) */
     const QString& currentFilename() const;
 
@@ -53,6 +53,7 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition, int x, int y, int w
     , mBottomGridAnnotationDirection( Horizontal ), mGridFrameStyle( NoGridFrame ),  mGridFrameWidth( 2.0 )
     , mGridFramePenThickness( 0.5 ), mGridFramePenColor( QColor( 0, 0, 0 ) ), mGridFrameFillColor1( Qt::white ), mGridFrameFillColor2( Qt::black )
     , mCrossLength( 3 ), mMapCanvas( 0 ), mDrawCanvasItems( true ), mAtlasDriven( false ), mAtlasFixedScale( false ), mAtlasMargin( 0.10 )
+    , mReuseRenderedImages( false ), mLayersUseAtlasVariables( false ), mPreviewJob( 0 ), mPreviewJobCancelled( false )
 {
   mComposition = composition;
   mOverviewFrameMapSymbol = 0;
@@ -90,6 +91,9 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition, int x, int y, int w
 
   connectUpdateSlot();
 
+  mPreviewUpdateTimer.setInterval( 250 );
+  connect( &mPreviewUpdateTimer, SIGNAL( timeout() ), this, SLOT( previewUpdateTimeout() ) );
+
   //calculate mExtent based on width/height ratio and map canvas extent
   mExtent = mComposition->mapSettings().visibleExtent();
 
@@ -111,6 +115,7 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition )
     , mBottomGridAnnotationDirection( Horizontal ), mGridFrameStyle( NoGridFrame ), mGridFrameWidth( 2.0 ), mGridFramePenThickness( 0.5 )
     , mGridFramePenColor( QColor( 0, 0, 0 ) ), mGridFrameFillColor1( Qt::white ), mGridFrameFillColor2( Qt::black )
     , mCrossLength( 3 ), mMapCanvas( 0 ), mDrawCanvasItems( true ), mAtlasDriven( false ), mAtlasFixedScale( false ), mAtlasMargin( 0.10 )
+    , mReuseRenderedImages( false ), mLayersUseAtlasVariables( false ), mPreviewJob( 0 ), mPreviewJobCancelled( false )
 {
   mOverviewFrameMapSymbol = 0;
   mGridLineSymbol = 0;
@@ -122,6 +127,9 @@ QgsComposerMap::QgsComposerMap( QgsComposition *composition )
 
   connectUpdateSlot();
 
+  mPreviewUpdateTimer.setInterval( 250 );
+  connect( &mPreviewUpdateTimer, SIGNAL( timeout() ), this, SLOT( previewUpdateTimeout() ) );
+
   mComposition = composition;
   mId = mComposition->composerMapItems().size();
   mPreviewMode = QgsComposerMap::Rectangle;
@@ -157,6 +165,7 @@ void QgsComposerMap::adjustExtentToItemShape( double itemWidth, double itemHeigh
 
 QgsComposerMap::~QgsComposerMap()
 {
+  stopPreviewRendering();
   delete mOverviewFrameMapSymbol;
   delete mGridLineSymbol;
 }
@@ -172,6 +181,19 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
     return;
   }
 
+  QgsMapSettings jobMapSettings = mapSettings( extent, size, dpi );
+
+  //update $map variable. Use QgsComposerItem's id since that is user-definable
+  QgsExpression::setSpecialColumn( "$map", QgsComposerItem::id() );
+
+  // render
+  QgsMapRendererCustomPainterJob job( jobMapSettings, painter );
+  job.start();
+  job.waitForFinished();
+}
+
+QgsMapSettings QgsComposerMap::mapSettings( const QgsRectangle& extent, const QSizeF& size, int dpi ) const
+{
   const QgsMapSettings& ms = mComposition->mapSettings();
 
   QgsMapSettings jobMapSettings;
@@ -204,18 +226,172 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
     theRendererContext->setUseRenderingOptimization( false );
   }*/
 
-  //update $map variable. Use QgsComposerItem's id since that is user-definable
-  QgsExpression::setSpecialColumn( "$map", QgsComposerItem::id() );
-
   // composer-specific overrides of flags
   jobMapSettings.setFlag( QgsMapSettings::ForceVectorOutput ); // force vector output (no caching of marker images etc.)
   jobMapSettings.setFlag( QgsMapSettings::DrawEditingInfo, false );
   jobMapSettings.setFlag( QgsMapSettings::UseAdvancedEffects, mComposition->useAdvancedEffects() ); // respect the composition's useAdvancedEffects flag
 
-  // render
-  QgsMapRendererCustomPainterJob job( jobMapSettings, painter );
-  job.start();
-  job.waitForFinished();
+  return jobMapSettings;
+}
+
+QgsMapSettings QgsComposerMap::printMapSettings( int dpi ) const
+{
+  //same computation as in paint()
+  QgsRectangle requestRectangle;
+  requestedExtent( requestRectangle );
+
+  QSizeF theSize( requestRectangle.width() * mapUnitsToMM(), requestRectangle.height() * mapUnitsToMM() );
+  double dotsPerMM = dpi / 25.4;
+  theSize *= dotsPerMM;
+
+  return mapSettings( requestRectangle, theSize, dpi );
+}
+
+void QgsComposerMap::setReuseRenderedImages( bool reuse )
+{
+  mReuseRenderedImages = reuse;
+  mRenderedImages.clear();
+  mLastRenderedImage = QPair< QgsMapSettings, QImage >();
+  mLayersUseAtlasVariables = reuse && layersUseAtlasVariables();
+}
+
+void QgsComposerMap::addPrerenderedImage( const QgsMapSettings& settings, const QImage& image )
+{
+  if ( !mReuseRenderedImages || image.isNull() )
+  {
+    return;
+  }
+
+  mRenderedImages.append( qMakePair( settings, image ) );
+
+  //bound the memory used by images which were never printed
+  while ( mRenderedImages.size() > 64 )
+  {
+    mRenderedImages.removeFirst();
+  }
+}
+
+bool QgsComposerMap::layersUseAtlasVariables() const
+{
+  QStringList variables;
+  variables << "$atlas" << "$feature" << "$numfeatures" << "$page" << "$numpages" << "$map";
+  return layersUseVariables( variables );
+}
+
+bool QgsComposerMap::layersUseVariables( const QStringList& variables ) const
+{
+  QStringList layers = layersToRender();
+  for ( QStringList::const_iterator layerIt = layers.constBegin(); layerIt != layers.constEnd(); ++layerIt )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( *layerIt );
+    if ( !layer )
+    {
+      continue;
+    }
+
+    //the layer xml contains the renderer, the symbols and the labeling settings
+    QDomDocument doc;
+    QDomElement layerElem = doc.createElement( "maplayer" );
+    doc.appendChild( layerElem );
+    layer->writeLayerXML( layerElem, doc );
+    QString xml = doc.toString();
+
+    for ( QStringList::const_iterator varIt = variables.constBegin(); varIt != variables.constEnd(); ++varIt )
+    {
+      if ( xml.contains( *varIt ) )
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+//! true if an image rendered with settings a can be painted instead of rendering with settings b
+static bool _sameMapRender( const QgsMapSettings& a, const QgsMapSettings& b )
+{
+  if ( a.outputSize() != b.outputSize() || a.outputDpi() != b.outputDpi() || a.flags() != b.flags()
+       || a.layers() != b.layers() || a.hasCrsTransformEnabled() != b.hasCrsTransformEnabled()
+       || a.destinationCrs() != b.destinationCrs() )
+  {
+    return false;
+  }
+
+  //the extents may differ by a small fraction of a pixel
+  double tolerance = 0.01 * b.mapUnitsPerPixel();
+  const QgsRectangle& ea = a.extent();
+  const QgsRectangle& eb = b.extent();
+  return qAbs( ea.xMinimum() - eb.xMinimum() ) < tolerance && qAbs( ea.xMaximum() - eb.xMaximum() ) < tolerance
+         && qAbs( ea.yMinimum() - eb.yMinimum() ) < tolerance && qAbs( ea.yMaximum() - eb.yMaximum() ) < tolerance;
+}
+
+bool QgsComposerMap::drawRenderedImage( QPainter* painter, const QgsRectangle& extent, const QSizeF& size, int dpi )
+{
+  if ( !mReuseRenderedImages || mLayersUseAtlasVariables || -1 != mCurrentExportLayer
+       || !painter->device() || painter->device()->devType() != QInternal::Image )
+  {
+    return false;
+  }
+
+  //images are composed from separately rendered layers, which is only the same as drawing
+  //the layers directly if no blending is involved
+  if ( containsAdvancedEffects() )
+  {
+    return false;
+  }
+
+  QgsMapSettings settings = mapSettings( extent, size, dpi );
+
+  //a prerendered image is only drawn once
+  QImage image;
+  for ( int i = 0; i < mRenderedImages.size(); ++i )
+  {
+    if ( _sameMapRender( mRenderedImages.at( i ).first, settings ) )
+    {
+      image = mRenderedImages.at( i ).second;
+      mRenderedImages.removeAt( i );
+      break;
+    }
+  }
+
+  if ( image.isNull() && !mLastRenderedImage.second.isNull() && _sameMapRender( mLastRenderedImage.first, settings ) )
+  {
+    image = mLastRenderedImage.second;
+  }
+
+  if ( image.isNull() )
+  {
+    image = QImage( settings.outputSize(), QImage::Format_ARGB32_Premultiplied );
+    if ( image.isNull() )
+    {
+      return false;
+    }
+    image.setDotsPerMeterX( dpi / 25.4 * 1000 );
+    image.setDotsPerMeterY( dpi / 25.4 * 1000 );
+    image.fill( 0 );
+
+    QgsExpression::setSpecialColumn( "$map", QgsComposerItem::id() );
+
+    QPainter imagePainter( &image );
+    QgsMapRendererCustomPainterJob job( settings, &imagePainter );
+    job.start();
+    job.waitForFinished();
+    imagePainter.end();
+  }
+
+  painter->drawImage( 0, 0, image );
+
+  //maps not driven by the atlas, e.g. overviews, usually look the same on the next page. The extent of
+  //atlas driven maps changes with each page, so their image is dropped once it is drawn
+  if ( atlasDriven() )
+  {
+    mLastRenderedImage = QPair< QgsMapSettings, QImage >();
+  }
+  else
+  {
+    mLastRenderedImage = qMakePair( settings, image );
+  }
+  return true;
 }
 
 void QgsComposerMap::cache( void )
@@ -230,8 +406,6 @@ void QgsComposerMap::cache( void )
     return;
   }
 
-  mDrawing = true;
-
   //in case of rotation, we need to request a larger rectangle and create a larger cache image
   QgsRectangle requestExtent;
   requestedExtent( requestExtent );
@@ -259,31 +433,116 @@ void QgsComposerMap::cache( void )
     h = 5000;
   }
 
-  mCacheImage = QImage( w, h,  QImage::Format_ARGB32 );
-
-  // set DPI of the image
-  mCacheImage.setDotsPerMeterX( 1000 * w / widthMM );
-  mCacheImage.setDotsPerMeterY( 1000 * h / heightMM );
+  if ( w <= 0 || h <= 0 )
+  {
+    return;
+  }
 
+  QgsMapSettings settings = mapSettings( requestExtent, QSizeF( w, h ), qRound( 25.4 * w / widthMM ) );
   if ( hasBackground() )
   {
     //Initially fill image with specified background color. This ensures that layers with blend modes will
     //preview correctly
-    mCacheImage.fill( backgroundColor().rgba() );
+    settings.setBackgroundColor( backgroundColor() );
   }
-  else
+
+  if ( mPreviewJob )
   {
-    //no background, but start with empty fill to avoid artifacts
-    mCacheImage.fill( QColor( 255, 255, 255, 0 ).rgba() );
+    if ( settings.extent() == mPreviewJobSettings.extent() && settings.outputSize() == mPreviewJobSettings.outputSize()
+         && settings.layers() == mPreviewJobSettings.layers() && settings.backgroundColor() == mPreviewJobSettings.backgroundColor() )
+    {
+      //the running job renders the same image already
+      return;
+    }
+    stopPreviewRendering();
   }
 
-  QPainter p( &mCacheImage );
+  //$map is a global value, which other maps could change while a background job is running.
+  //Layers referring to it are rendered right away, other layers don't read it
+  if ( layersUseVariables( QStringList() << "$map" ) )
+  {
+    mDrawing = true;
+    QImage image( settings.outputSize(), QImage::Format_ARGB32_Premultiplied );
+    image.fill( 0 );
 
-  draw( &p, requestExtent, QSizeF( w, h ), mCacheImage.logicalDpiX() );
-  p.end();
-  mCacheUpdated = true;
+    //update $map variable. Use QgsComposerItem's id since that is user-definable
+    QgsExpression::setSpecialColumn( "$map", QgsComposerItem::id() );
 
-  mDrawing = false;
+    QPainter painter( &image );
+    QgsMapRendererCustomPainterJob job( settings, &painter );
+    job.start();
+    job.waitForFinished();
+    painter.end();
+
+    mCacheImage = image;
+    mCacheImageExtent = requestExtent;
+    mCacheUpdated = true;
+    mDrawing = false;
+    return;
+  }
+
+  mPreviewJobCancelled = false;
+  mPreviewJobSettings = settings;
+  mPreviewJobExtent = requestExtent;
+  mPreviewJob = new QgsMapRendererParallelJob( settings );
+  //layers which did not change since the last preview with the same extent and scale are taken from the cache
+  mPreviewJob->setCache( &mPreviewCache );
+  connect( mPreviewJob, SIGNAL( finished() ), this, SLOT( previewJobFinished() ) );
+  mPreviewJob->start();
+
+  mPreviewUpdateTimer.start();
+}
+
+void QgsComposerMap::waitForPreview()
+{
+  if ( mPreviewJob )
+  {
+    mPreviewJob->waitForFinished();
+  }
+}
+
+void QgsComposerMap::stopPreviewRendering()
+{
+  if ( mPreviewJob )
+  {
+    mPreviewJobCancelled = true;
+    mPreviewJob->cancel();
+    Q_ASSERT( mPreviewJob == 0 ); // already deleted in previewJobFinished()
+  }
+}
+
+void QgsComposerMap::previewJobFinished()
+{
+  mPreviewUpdateTimer.stop();
+
+  foreach ( const QgsMapRendererJob::Error& error, mPreviewJob->errors() )
+  {
+    QgsDebugMsg( error.layerID + " :: " + error.message );
+  }
+
+  if ( !mPreviewJobCancelled )
+  {
+    mCacheImage = mPreviewJob->renderedImage();
+    mCacheImageExtent = mPreviewJobExtent;
+    mCacheUpdated = true;
+    QGraphicsRectItem::update();
+  }
+
+  // we are in a slot called from the job - do not delete it immediately
+  mPreviewJob->deleteLater();
+  mPreviewJob = 0;
+}
+
+void QgsComposerMap::previewUpdateTimeout()
+{
+  if ( !mPreviewJob )
+  {
+    return;
+  }
+
+  mCacheImage = mPreviewJob->renderedImage();
+  mCacheImageExtent = mPreviewJobExtent;
+  QGraphicsRectItem::update();
 }
 
 void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle, QWidget* pWidget )
@@ -317,34 +576,38 @@ void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* i
 
     //Background color is already included in cached image, so no need to draw
 
-    QgsRectangle requestRectangle;
-    requestedExtent( requestRectangle );
+    //the image may still show the previous extent while a new one is rendered, so it is placed
+    //according to the extent it was rendered for
+    QgsRectangle requestRectangle = mCacheImageExtent;
 
     QgsRectangle cExtent = *currentMapExtent();
 
-    double imagePixelWidth = cExtent.width() / requestRectangle.width() * mCacheImage.width() ; //how many pixels of the image are for the map extent?
-    double scale = rect().width() / imagePixelWidth;
-    QgsPoint rotationPoint = QgsPoint(( cExtent.xMaximum() + cExtent.xMinimum() ) / 2.0, ( cExtent.yMaximum() + cExtent.yMinimum() ) / 2.0 );
+    if ( !mCacheImage.isNull() && requestRectangle.width() > 0 )
+    {
+      double imagePixelWidth = cExtent.width() / requestRectangle.width() * mCacheImage.width() ; //how many pixels of the image are for the map extent?
+      double scale = rect().width() / imagePixelWidth;
+      QgsPoint rotationPoint = QgsPoint(( cExtent.xMaximum() + cExtent.xMinimum() ) / 2.0, ( cExtent.yMaximum() + cExtent.yMinimum() ) / 2.0 );
 
-    //shift such that rotation point is at 0/0 point in the coordinate system
-    double yShiftMM = ( requestRectangle.yMaximum() - rotationPoint.y() ) * mapUnitsToMM();
-    double xShiftMM = ( requestRectangle.xMinimum() - rotationPoint.x() ) * mapUnitsToMM();
+      //shift such that rotation point is at 0/0 point in the coordinate system
+      double yShiftMM = ( requestRectangle.yMaximum() - rotationPoint.y() ) * mapUnitsToMM();
+      double xShiftMM = ( requestRectangle.xMinimum() - rotationPoint.x() ) * mapUnitsToMM();
 
-    //shift such that top left point of the extent at point 0/0 in item coordinate system
-    double xTopLeftShift = ( rotationPoint.x() - cExtent.xMinimum() ) * mapUnitsToMM();
-    double yTopLeftShift = ( cExtent.yMaximum() - rotationPoint.y() ) * mapUnitsToMM();
+      //shift such that top left point of the extent at point 0/0 in item coordinate system
+      double xTopLeftShift = ( rotationPoint.x() - cExtent.xMinimum() ) * mapUnitsToMM();
+      double yTopLeftShift = ( cExtent.yMaximum() - rotationPoint.y() ) * mapUnitsToMM();
 
-    painter->save();
+      painter->save();
 
-    painter->translate( mXOffset, mYOffset );
-    painter->translate( xTopLeftShift, yTopLeftShift );
-    painter->rotate( mMapRotation );
-    painter->translate( xShiftMM, -yShiftMM );
-    painter->scale( scale, scale );
-    painter->drawImage( 0, 0, mCacheImage );
+      painter->translate( mXOffset, mYOffset );
+      painter->translate( xTopLeftShift, yTopLeftShift );
+      painter->rotate( mMapRotation );
+      painter->translate( xShiftMM, -yShiftMM );
+      painter->scale( scale, scale );
+      painter->drawImage( 0, 0, mCacheImage );
 
-    //restore rotation
-    painter->restore();
+      //restore rotation
+      painter->restore();
+    }
 
     //draw canvas items
     drawCanvasItems( painter, itemStyle );
@@ -395,7 +658,10 @@ void QgsComposerMap::paint( QPainter* painter, const QStyleOptionGraphicsItem* i
     double dotsPerMM = thePaintDevice->logicalDpiX() / 25.4;
     theSize *= dotsPerMM; // output size will be in dots (pixels)
     painter->scale( 1 / dotsPerMM, 1 / dotsPerMM ); // scale painter from mm to dots
-    draw( painter, requestRectangle, theSize, thePaintDevice->logicalDpiX() );
+    if ( !drawRenderedImage( painter, requestRectangle, theSize, thePaintDevice->logicalDpiX() ) )
+    {
+      draw( painter, requestRectangle, theSize, thePaintDevice->logicalDpiX() );
+    }
 
     //restore rotation
     painter->restore();
@@ -513,6 +779,11 @@ void QgsComposerMap::renderModeUpdateCachedImage()
 void QgsComposerMap::setCacheUpdated( bool u )
 {
   mCacheUpdated = u;
+  if ( !u )
+  {
+    //an explicit refresh renders all layers again
+    mPreviewCache.clear();
+  }
 }
 
 const QgsMapRenderer *QgsComposerMap::mapRenderer() const
@@ -821,7 +1092,8 @@ void QgsComposerMap::updateItem()
     return;
   }
 
-  if ( mPreviewMode != QgsComposerMap::Rectangle &&  !mCacheUpdated )
+  //no need to render the preview while exporting an atlas, the atlas updates the maps when it has finished
+  if ( mPreviewMode != QgsComposerMap::Rectangle &&  !mCacheUpdated && mComposition->atlasMode() != QgsComposition::ExportAtlas )
   {
     cache();
   }
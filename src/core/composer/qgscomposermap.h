@@ -19,12 +19,18 @@
 
 //#include "ui_qgscomposermapbase.h"
 #include "qgscomposeritem.h"
+#include "qgsmaprenderercache.h"
+#include "qgsmapsettings.h"
 #include "qgsrectangle.h"
 #include <QFont>
 #include <QGraphicsRectItem>
+#include <QImage>
+#include <QPair>
+#include <QTimer>
 
 class QgsComposition;
 class QgsMapRenderer;
+class QgsMapRendererQImageJob;
 class QgsMapToPixel;
 class QDomNode;
 class QDomDocument;
@@ -116,9 +122,53 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /** \brief Reimplementation of QCanvasItem::paint - draw on canvas */
     void paint( QPainter* painter, const QStyleOptionGraphicsItem* itemStyle, QWidget* pWidget );
 
-    /** \brief Create cache image */
+    /** \brief Create cache image. The layers are rendered in the background and the preview is
+        updated while rendering, a rendering which is still running is cancelled. Layers which did
+        not change since the last rendering with the same extent and scale are not rendered again. */
     void cache();
 
+    /** Returns true while the cache image is rendered in the background
+        @note added in 2.4 */
+    bool isRenderingPreview() const { return mPreviewJob != 0; }
+
+    /** Blocks until the rendering of the cache image has finished
+        @note added in 2.4 */
+    void waitForPreview();
+
+    /** Returns the settings draw() renders the map layers with
+        @param extent map extent
+        @param size size of the output in pixels
+        @param dpi output dpi
+        @note added in 2.4 */
+    QgsMapSettings mapSettings( const QgsRectangle& extent, const QSizeF& size, int dpi ) const;
+
+    /** Returns the settings the map layers are rendered with when the map is printed
+        to a device with the given resolution
+        @note added in 2.4 */
+    QgsMapSettings printMapSettings( int dpi ) const;
+
+    /** Sets whether the map layers are rendered to an image when printing to an image, so that
+        the image can be reused for following prints with nearly the same settings, e.g. for maps
+        which do not change between atlas pages. Disabling it releases the images.
+        @note added in 2.4 */
+    void setReuseRenderedImages( bool reuse );
+    bool reuseRenderedImages() const { return mReuseRenderedImages; }
+
+    /** Adds an image of the map layers which was rendered in advance, e.g. by a background job.
+        It is painted instead of rendering the layers when the map is printed with matching
+        settings. Only used if reuseRenderedImages() is enabled.
+        @note added in 2.4 */
+    void addPrerenderedImage( const QgsMapSettings& settings, const QImage& image );
+
+    /** Returns the number of images rendered in advance which were not printed yet
+        @note added in 2.4 */
+    int prerenderedImageCount() const { return mRenderedImages.size(); }
+
+    /** Returns true if the styles or labels of the rendered layers refer to atlas or composer
+        variables like $atlasfeatureid. Such layers must be rendered again for each atlas page.
+        @note added in 2.4 */
+    bool layersUseAtlasVariables() const;
+
     /** \brief Get identification number*/
     int id() const {return mId;}
 
@@ -471,6 +521,12 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
 
     void overviewExtentChanged();
 
+  private slots:
+    /**Takes the image of the finished preview job*/
+    void previewJobFinished();
+    /**Shows the layers rendered so far by the preview job*/
+    void previewUpdateTimeout();
+
   private:
 
     enum AnnotationCoordinate
@@ -495,6 +551,9 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     // Cache used in composer preview
     QImage mCacheImage;
 
+    // Requested extent the cache image was rendered for
+    QgsRectangle mCacheImageExtent;
+
     // Is cache up to date
     bool mCacheUpdated;
 
@@ -613,9 +672,41 @@ class CORE_EXPORT QgsComposerMap : public QgsComposerItem
     /**Margin size for atlas driven extents (percentage of feature size)*/
     double mAtlasMargin;
 
+    /**True if rendered map images are kept for following prints*/
+    bool mReuseRenderedImages;
+    /**True if the layers refer to atlas variables, checked when reusing images is enabled*/
+    bool mLayersUseAtlasVariables;
+    /**Images rendered in advance which were not printed yet, together with their render settings*/
+    QList< QPair< QgsMapSettings, QImage > > mRenderedImages;
+    /**Last printed image of a map which is not atlas driven, reused as long as the map does not change*/
+    QPair< QgsMapSettings, QImage > mLastRenderedImage;
+
+    /**Job rendering the cache image in the background*/
+    QgsMapRendererQImageJob* mPreviewJob;
+    /**True if the preview job was cancelled and its image must not be used*/
+    bool mPreviewJobCancelled;
+    /**Settings and requested extent of the preview job*/
+    QgsMapSettings mPreviewJobSettings;
+    QgsRectangle mPreviewJobExtent;
+    /**Images of the individual layers from the last preview rendering*/
+    QgsMapRendererCache mPreviewCache;
+    /**Triggers progressive updates of the preview while rendering*/
+    QTimer mPreviewUpdateTimer;
+
+    /**Cancels the rendering of the cache image*/
+    void stopPreviewRendering();
+
     /**Returns a list of the layers to render for this map item*/
     QStringList layersToRender() const;
 
+    /**Paints a kept image of the map layers, rendering and keeping it if there is no image
+      with matching settings
+      @return false if the layers need to be drawn directly*/
+    bool drawRenderedImage( QPainter* painter, const QgsRectangle& extent, const QSizeF& size, int dpi );
+
+    /**Returns true if the styles or labels of the rendered layers contain one of the variables*/
+    bool layersUseVariables( const QStringList& variables ) const;
+
     /**Draws the map grid*/
     void drawGrid( QPainter* p );
     void drawGridFrame( QPainter* p, const QList< QPair< double, QLineF > >& hLines, const QList< QPair< double, QLineF > >& vLines );
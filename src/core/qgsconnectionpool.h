@@ -17,6 +17,7 @@
 #define QGSCONNECTIONPOOL_H
 
 #include <QCoreApplication>
+#include <QList>
 #include <QMap>
 #include <QMutex>
 #include <QSemaphore>
@@ -79,7 +80,64 @@ class QgsConnectionPoolGroup
     {
       // we are going to acquire a resource - if no resource is available, we will block here
       sem.acquire();
+      return acquireReserved();
+    }
+
+    //! Like acquire(), but returns null instead of blocking when all connections are in use
+    T tryAcquire()
+    {
+      if ( !sem.tryAcquire() )
+        return 0;
+      return acquireReserved();
+    }
+
+    void release( T conn )
+    {
+      connMutex.lock();
+      if ( !acquiredConns.removeOne( conn ) )
+      {
+        // the connection has been invalidated while in use
+        qgsConnectionPool_ConnectionDestroy( conn );
+        connMutex.unlock();
+        sem.release();
+        return;
+      }
+
+      Item i;
+      i.c = conn;
+      i.lastUsedTime = QTime::currentTime();
+      conns.push( i );
+
+      if ( !expirationTimer->isActive() )
+      {
+        // will call the slot directly or queue the call (if the object lives in a different thread)
+        QMetaObject::invokeMethod( expirationTimer->parent(), "startExpirationTimer" );
+      }
+
+      connMutex.unlock();
+
+      sem.release(); // this can unlock a thread waiting in acquire()
+    }
+
+    //! Close all unused connections. Connections in use are closed instead of being returned to the pool.
+    //! Needed when the underlying data has been modified through another connection
+    void invalidateConnections()
+    {
+      connMutex.lock();
+      foreach ( Item item, conns )
+      {
+        qgsConnectionPool_ConnectionDestroy( item.c );
+      }
+      conns.clear();
+      acquiredConns.clear();
+      connMutex.unlock();
+    }
+
+  protected:
 
+    //! Takes a cached connection or creates a new one, the semaphore has been acquired already
+    T acquireReserved()
+    {
       // quick (preferred) way - use cached connection
       {
         QMutexLocker locker( &connMutex );
@@ -95,6 +153,7 @@ class QgsConnectionPoolGroup
             QMetaObject::invokeMethod( expirationTimer->parent(), "stopExpirationTimer" );
           }
 
+          acquiredConns.append( i.c );
           return i.c;
         }
       }
@@ -108,30 +167,12 @@ class QgsConnectionPoolGroup
         return 0;
       }
 
-      return c;
-    }
-
-    void release( T conn )
-    {
       connMutex.lock();
-      Item i;
-      i.c = conn;
-      i.lastUsedTime = QTime::currentTime();
-      conns.push( i );
-
-      if ( !expirationTimer->isActive() )
-      {
-        // will call the slot directly or queue the call (if the object lives in a different thread)
-        QMetaObject::invokeMethod( expirationTimer->parent(), "startExpirationTimer" );
-      }
-
+      acquiredConns.append( c );
       connMutex.unlock();
-
-      sem.release(); // this can unlock a thread waiting in acquire()
+      return c;
     }
 
-  protected:
-
     void initTimer( QObject* parent )
     {
       expirationTimer = new QTimer( parent );
@@ -174,6 +215,7 @@ class QgsConnectionPoolGroup
 
     QString connInfo;
     QStack<Item> conns;
+    QList<T> acquiredConns;
     QMutex connMutex;
     QSemaphore sem;
     QTimer* expirationTimer;
@@ -206,16 +248,15 @@ class QgsConnectionPool
     //! @return initialized connection or null on error
     T acquireConnection( const QString& connInfo )
     {
-      mMutex.lock();
-      typename T_Groups::iterator it = mGroups.find( connInfo );
-      if ( it == mGroups.end() )
-      {
-        it = mGroups.insert( connInfo, new T_Group( connInfo ) );
-      }
-      T_Group* group = *it;
-      mMutex.unlock();
+      return group( connInfo )->acquire();
+    }
 
-      return group->acquire();
+    //! Try to acquire a connection without blocking, e.g. when the calling thread may hold
+    //! connections of the same server or file already.
+    //! @return initialized connection or null on error or when all connections are in use
+    T tryAcquireConnection( const QString& connInfo )
+    {
+      return group( connInfo )->tryAcquire();
     }
 
     //! Release an existing connection so it will get back into the pool and can be reused
@@ -230,7 +271,32 @@ class QgsConnectionPool
       group->release( conn );
     }
 
+    //! Close the cached connections of a server or file so that new connections are
+    //! opened on next acquire. Connections in use are closed when they get released
+    void invalidateConnections( const QString& connInfo )
+    {
+      mMutex.lock();
+      typename T_Groups::iterator it = mGroups.find( connInfo );
+      if ( it != mGroups.end() )
+      {
+        ( *it )->invalidateConnections();
+      }
+      mMutex.unlock();
+    }
+
   protected:
+    //! group of a server or file, created on first use
+    T_Group* group( const QString& connInfo )
+    {
+      QMutexLocker locker( &mMutex );
+      typename T_Groups::iterator it = mGroups.find( connInfo );
+      if ( it == mGroups.end() )
+      {
+        it = mGroups.insert( connInfo, new T_Group( connInfo ) );
+      }
+      return *it;
+    }
+
     T_Groups mGroups;
     QMutex mMutex;
 
@@ -25,8 +25,11 @@
 #include <QDomElement>
 #include <QFileInfo>
 #include <QRegExp>
+#include <QSet>
 #include <QTextStream>
 #include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QSettings>
 
 #include "qgsapplication.h"
@@ -46,6 +49,166 @@
 
 CUSTOM_CRS_VALIDATION QgsCoordinateReferenceSystem::mCustomSrsValidation = NULL;
 
+/** Catalogue of the system srs.db, which is read once with one query.
+ * It indexes the definitions by srs_id, srid, authority id and proj4 string
+ * and keeps the parsed crs of each definition that was used.
+ * The user qgis.db is not in the catalogue, it is small and changes.
+ * All methods are thread safe.
+ */
+class QgsSrsCatalogue
+{
+  public:
+    struct Entry
+    {
+      long srsId;
+      QString projectionAcronym;
+      QString ellipsoidAcronym;
+    };
+
+    static QgsSrsCatalogue* instance()
+    {
+      static QgsSrsCatalogue mInstance;
+      return &mInstance;
+    }
+
+    /** Finds the srs_id of the first definition where a column of tbl_srs has a value.
+     * @param srsId srs_id or -1 if there is no such definition
+     * @return false if the catalogue cannot answer, i.e. it is not the system database,
+     * the expression is not indexed or the database cannot be read
+     */
+    bool find( const QString& db, const QString& expression, const QString& value, long& srsId )
+    {
+      QMutexLocker locker( &mMutex );
+      if ( !load( db ) )
+        return false;
+
+      if ( expression == "srs_id" )
+        srsId = mSrsIds.contains( value.toLong() ) ? value.toLong() : -1;
+      else if ( expression == "srid" )
+        srsId = mSrids.value( value.toLong(), -1 );
+      else if ( expression == "lower(auth_name||':'||auth_id)" )
+        srsId = mAuthIds.value( value.toLower(), -1 );
+      else
+        return false;
+
+      return true;
+    }
+
+    //! definitions with a proj4 string, the white space of the strings is normalised
+    bool findParameters( const QString& db, const QString& parameters, QList<Entry>& entries )
+    {
+      QMutexLocker locker( &mMutex );
+      if ( !load( db ) )
+        return false;
+
+      entries = mParameters.value( parameters.simplified() );
+      return true;
+    }
+
+    //! the parsed crs of a definition, if it was added before
+    bool crs( long srsId, QgsCoordinateReferenceSystem& crs )
+    {
+      QMutexLocker locker( &mMutex );
+      QHash<long, QgsCoordinateReferenceSystem>::const_iterator it = mCrs.constFind( srsId );
+      if ( it == mCrs.constEnd() )
+        return false;
+
+      crs = it.value();
+      return true;
+    }
+
+    void addCrs( long srsId, const QgsCoordinateReferenceSystem& crs )
+    {
+      QMutexLocker locker( &mMutex );
+      mCrs.insert( srsId, crs );
+    }
+
+    //! drops the catalogue, it is read again when needed
+    void clear()
+    {
+      QMutexLocker locker( &mMutex );
+      mDbPath.clear();
+      mSrsIds.clear();
+      mSrids.clear();
+      mAuthIds.clear();
+      mParameters.clear();
+      mCrs.clear();
+    }
+
+  private:
+    //! reads the database if it is the system database and not read yet, the mutex must be locked
+    bool load( const QString& db )
+    {
+      if ( db != QgsApplication::srsDbFilePath() )
+        return false;
+
+      if ( db == mDbPath )
+        return true;
+
+      mDbPath.clear();
+      mSrsIds.clear();
+      mSrids.clear();
+      mAuthIds.clear();
+      mParameters.clear();
+      mCrs.clear();
+
+      sqlite3 *database;
+      if ( !QFileInfo( db ).exists() || sqlite3_open_v2( db.toUtf8().data(), &database, SQLITE_OPEN_READONLY, NULL ) != SQLITE_OK )
+      {
+        QgsDebugMsg( "failed : " + db + " could not be opened!" );
+        return false;
+      }
+
+      // the first definition of a key wins, like in the queries ordered by deprecated
+      QString sql = "select srs_id,srid,lower(auth_name||':'||auth_id),parameters,projection_acronym,ellipsoid_acronym "
+                    "from tbl_srs order by deprecated,srs_id";
+      sqlite3_stmt *statement;
+      bool ok = sqlite3_prepare_v2( database, sql.toUtf8().data(), -1, &statement, NULL ) == SQLITE_OK;
+      if ( ok )
+      {
+        while ( sqlite3_step( statement ) == SQLITE_ROW )
+        {
+          Entry entry;
+          entry.srsId = sqlite3_column_int64( statement, 0 );
+          long srid = sqlite3_column_int64( statement, 1 );
+          QString authId = QString::fromUtf8(( char * )sqlite3_column_text( statement, 2 ) );
+          QString parameters = QString::fromUtf8(( char * )sqlite3_column_text( statement, 3 ) ).simplified();
+          entry.projectionAcronym = QString::fromUtf8(( char * )sqlite3_column_text( statement, 4 ) );
+          entry.ellipsoidAcronym = QString::fromUtf8(( char * )sqlite3_column_text( statement, 5 ) );
+
+          mSrsIds.insert( entry.srsId );
+          if ( !mSrids.contains( srid ) )
+            mSrids.insert( srid, entry.srsId );
+          if ( !mAuthIds.contains( authId ) )
+            mAuthIds.insert( authId, entry.srsId );
+          mParameters[ parameters ] << entry;
+        }
+      }
+      else
+      {
+        QgsDebugMsg( "failed : " + sql );
+      }
+      sqlite3_finalize( statement );
+      sqlite3_close( database );
+
+      if ( ok )
+      {
+        mDbPath = db;
+        QgsDebugMsg( QString( "%1 definitions read from %2" ).arg( mSrsIds.size() ).arg( db ) );
+      }
+      return ok;
+    }
+
+    QMutex mMutex;
+    //! path of the database which was read, empty if none
+    QString mDbPath;
+    QSet<long> mSrsIds;
+    QHash<long, long> mSrids;
+    QHash<QString, long> mAuthIds;
+    QHash<QString, QList<Entry> > mParameters;
+    QHash<long, QgsCoordinateReferenceSystem> mCrs;
+};
+
 //--------------------------
 
 QgsCoordinateReferenceSystem::QgsCoordinateReferenceSystem()
@@ -323,6 +486,26 @@ bool QgsCoordinateReferenceSystem::loadFromDb( QString db, QString expression, Q
   mIsValidFlag = false;
   mWkt.clear();
 
+  // the definitions of the system database are looked up in the catalogue
+  // and each of them is parsed only once
+  long catalogueSrsId = -1;
+  if ( QgsSrsCatalogue::instance()->find( db, expression, value, catalogueSrsId ) )
+  {
+    if ( catalogueSrsId < 0 )
+    {
+      QgsDebugMsg( "failed : no " + expression + " " + value + " in " + db );
+      return mIsValidFlag;
+    }
+
+    if ( QgsSrsCatalogue::instance()->crs( catalogueSrsId, *this ) )
+    {
+      return mIsValidFlag;
+    }
+
+    expression = "srs_id";
+    value = QString::number( catalogueSrsId );
+  }
+
   QFileInfo myInfo( db );
   if ( !myInfo.exists() )
   {
@@ -391,6 +574,11 @@ bool QgsCoordinateReferenceSystem::loadFromDb( QString db, QString expression, Q
     {
       setProj4String( mProj4 );
     }
+
+    if ( catalogueSrsId >= 0 )
+    {
+      QgsSrsCatalogue::instance()->addCrs( catalogueSrsId, *this );
+    }
   }
   else
   {
@@ -567,7 +755,7 @@ bool QgsCoordinateReferenceSystem::createFromProj4( const QString &theProj4Strin
    * - if the above does not match perform a whole text search on proj4 string (if not null)
    */
   // QgsDebugMsg( "wholetext match on name failed, trying proj4string match" );
-  myRecord = getRecord( "select * from tbl_srs where parameters=" + quotedValue( myProj4String ) + " order by deprecated" );
+  myRecord = getProj4Record( myProj4String );
   if ( myRecord.empty() )
   {
     // Ticket #722 - aaronr
@@ -602,7 +790,7 @@ bool QgsCoordinateReferenceSystem::createFromProj4( const QString &theProj4Strin
       myStart2 = myLat2RegExp.indexIn( theProj4String, myStart2 );
       theProj4StringModified.replace( myStart2 + LAT_PREFIX_LEN, myLength2 - LAT_PREFIX_LEN, lat1Str );
       QgsDebugMsg( "trying proj4string match with swapped lat_1,lat_2" );
-      myRecord = getRecord( "select * from tbl_srs where parameters=" + quotedValue( theProj4StringModified.trimmed() ) + " order by deprecated" );
+      myRecord = getProj4Record( theProj4StringModified.trimmed() );
     }
   }
 
@@ -705,57 +893,60 @@ bool QgsCoordinateReferenceSystem::createFromProj4( const QString &theProj4Strin
 }
 
 //private method meant for internal use by this class only
-QgsCoordinateReferenceSystem::RecordMap QgsCoordinateReferenceSystem::getRecord( QString theSql )
+QgsCoordinateReferenceSystem::RecordMap QgsCoordinateReferenceSystem::getRecord( QString theSql, bool theSystemDb )
 {
   QString myDatabaseFileName;
   QgsCoordinateReferenceSystem::RecordMap myMap;
   QString myFieldName;
   QString myFieldValue;
-  sqlite3      *myDatabase;
+  sqlite3      *myDatabase = 0;
   const char   *myTail;
-  sqlite3_stmt *myPreparedStatement;
+  sqlite3_stmt *myPreparedStatement = 0;
   int           myResult;
 
   QgsDebugMsg( "running query: " + theSql );
-  // Get the full path name to the sqlite3 spatial reference database.
-  myDatabaseFileName = QgsApplication::srsDbFilePath();
-  QFileInfo myInfo( myDatabaseFileName );
-  if ( !myInfo.exists() )
+  if ( theSystemDb )
   {
-    QgsDebugMsg( "failed : " + myDatabaseFileName + " does not exist!" );
-    return myMap;
-  }
+    // Get the full path name to the sqlite3 spatial reference database.
+    myDatabaseFileName = QgsApplication::srsDbFilePath();
+    QFileInfo myInfo( myDatabaseFileName );
+    if ( !myInfo.exists() )
+    {
+      QgsDebugMsg( "failed : " + myDatabaseFileName + " does not exist!" );
+      return myMap;
+    }
 
-  //check the db is available
-  myResult = openDb( myDatabaseFileName, &myDatabase );
-  if ( myResult != SQLITE_OK )
-  {
-    return myMap;
-  }
+    //check the db is available
+    myResult = openDb( myDatabaseFileName, &myDatabase );
+    if ( myResult != SQLITE_OK )
+    {
+      return myMap;
+    }
 
-  myResult = sqlite3_prepare( myDatabase, theSql.toUtf8(), theSql.toUtf8().length(), &myPreparedStatement, &myTail );
-  // XXX Need to free memory from the error msg if one is set
-  if ( myResult == SQLITE_OK && sqlite3_step( myPreparedStatement ) == SQLITE_ROW )
-  {
-    QgsDebugMsg( "trying system srs.db" );
-    int myColumnCount = sqlite3_column_count( myPreparedStatement );
-    //loop through each column in the record adding its expression name and value to the map
-    for ( int myColNo = 0; myColNo < myColumnCount; myColNo++ )
+    myResult = sqlite3_prepare( myDatabase, theSql.toUtf8(), theSql.toUtf8().length(), &myPreparedStatement, &myTail );
+    // XXX Need to free memory from the error msg if one is set
+    if ( myResult == SQLITE_OK && sqlite3_step( myPreparedStatement ) == SQLITE_ROW )
     {
-      myFieldName = QString::fromUtf8(( char * )sqlite3_column_name( myPreparedStatement, myColNo ) );
-      myFieldValue = QString::fromUtf8(( char * )sqlite3_column_text( myPreparedStatement, myColNo ) );
-      myMap[myFieldName] = myFieldValue;
+      QgsDebugMsg( "trying system srs.db" );
+      int myColumnCount = sqlite3_column_count( myPreparedStatement );
+      //loop through each column in the record adding its expression name and value to the map
+      for ( int myColNo = 0; myColNo < myColumnCount; myColNo++ )
+      {
+        myFieldName = QString::fromUtf8(( char * )sqlite3_column_name( myPreparedStatement, myColNo ) );
+        myFieldValue = QString::fromUtf8(( char * )sqlite3_column_text( myPreparedStatement, myColNo ) );
+        myMap[myFieldName] = myFieldValue;
+      }
+      if ( sqlite3_step( myPreparedStatement ) != SQLITE_DONE )
+      {
+        QgsDebugMsg( "Multiple records found in srs.db" );
+        myMap.clear();
+      }
     }
-    if ( sqlite3_step( myPreparedStatement ) != SQLITE_DONE )
+    else
     {
-      QgsDebugMsg( "Multiple records found in srs.db" );
-      myMap.clear();
+      QgsDebugMsg( "failed :  " + theSql );
     }
   }
-  else
-  {
-    QgsDebugMsg( "failed :  " + theSql );
-  }
 
   if ( myMap.empty() )
   {
@@ -818,6 +1009,27 @@ QgsCoordinateReferenceSystem::RecordMap QgsCoordinateReferenceSystem::getRecord(
   return myMap;
 }
 
+QgsCoordinateReferenceSystem::RecordMap QgsCoordinateReferenceSystem::getProj4Record( const QString& theProj4String )
+{
+  QString mySql = "select * from tbl_srs where parameters=" + quotedValue( theProj4String ) + " order by deprecated";
+
+  QList<QgsSrsCatalogue::Entry> myEntries;
+  if ( !QgsSrsCatalogue::instance()->findParameters( QgsApplication::srsDbFilePath(), theProj4String, myEntries ) )
+  {
+    return getRecord( mySql );
+  }
+
+  if ( myEntries.size() == 1 )
+  {
+    RecordMap myMap;
+    myMap["srs_id"] = QString::number( myEntries[0].srsId );
+    return myMap;
+  }
+
+  // not or not uniquely defined in srs.db
+  return getRecord( mySql, false );
+}
+
 // Accessors -----------------------------------
 
 long QgsCoordinateReferenceSystem::srsid() const
@@ -1051,40 +1263,56 @@ long QgsCoordinateReferenceSystem::findMatchingProj()
   // Get the full path name to the sqlite3 spatial reference database.
   QString myDatabaseFileName = QgsApplication::srsDbFilePath();
 
-  //check the db is available
-  myResult = openDb( myDatabaseFileName, &myDatabase );
-  if ( myResult != SQLITE_OK )
+  // the system database is searched in the catalogue
+  QList<QgsSrsCatalogue::Entry> myEntries;
+  if ( QgsSrsCatalogue::instance()->findParameters( myDatabaseFileName, toProj4(), myEntries ) )
   {
-    return 0;
+    foreach ( const QgsSrsCatalogue::Entry& myEntry, myEntries )
+    {
+      if ( myEntry.projectionAcronym == mProjectionAcronym && myEntry.ellipsoidAcronym == mEllipsoidAcronym )
+      {
+        QgsDebugMsg( "-------> MATCH FOUND in srs.db srsid: " + QString::number( myEntry.srsId ) );
+        return myEntry.srsId;
+      }
+    }
+    QgsDebugMsg( "no match found in srs.db, trying user db now!" );
   }
-
-  myResult = sqlite3_prepare( myDatabase, mySql.toUtf8(), mySql.toUtf8().length(), &myPreparedStatement, &myTail );
-// XXX Need to free memory from the error msg if one is set
-  if ( myResult == SQLITE_OK )
+  else
   {
+    //check the db is available
+    myResult = openDb( myDatabaseFileName, &myDatabase );
+    if ( myResult != SQLITE_OK )
+    {
+      return 0;
+    }
 
-    while ( sqlite3_step( myPreparedStatement ) == SQLITE_ROW )
+    myResult = sqlite3_prepare( myDatabase, mySql.toUtf8(), mySql.toUtf8().length(), &myPreparedStatement, &myTail );
+    // XXX Need to free memory from the error msg if one is set
+    if ( myResult == SQLITE_OK )
     {
-      QString mySrsId = QString::fromUtf8(( char * )sqlite3_column_text( myPreparedStatement, 0 ) );
-      QString myProj4String = QString::fromUtf8(( char * )sqlite3_column_text( myPreparedStatement, 1 ) );
-      if ( toProj4() == myProj4String.trimmed() )
-      {
-        QgsDebugMsg( "-------> MATCH FOUND in srs.db srsid: " + mySrsId );
-        // close the sqlite3 statement
-        sqlite3_finalize( myPreparedStatement );
-        sqlite3_close( myDatabase );
-        return mySrsId.toLong();
-      }
-      else
+      while ( sqlite3_step( myPreparedStatement ) == SQLITE_ROW )
       {
-// QgsDebugMsg(QString(" Not matched : %1").arg(myProj4String));
+        QString mySrsId = QString::fromUtf8(( char * )sqlite3_column_text( myPreparedStatement, 0 ) );
+        QString myProj4String = QString::fromUtf8(( char * )sqlite3_column_text( myPreparedStatement, 1 ) );
+        if ( toProj4() == myProj4String.trimmed() )
+        {
+          QgsDebugMsg( "-------> MATCH FOUND in srs.db srsid: " + mySrsId );
+          // close the sqlite3 statement
+          sqlite3_finalize( myPreparedStatement );
+          sqlite3_close( myDatabase );
+          return mySrsId.toLong();
+        }
+        else
+        {
+          // QgsDebugMsg(QString(" Not matched : %1").arg(myProj4String));
+        }
       }
     }
+    QgsDebugMsg( "no match found in srs.db, trying user db now!" );
+    // close the sqlite3 statement
+    sqlite3_finalize( myPreparedStatement );
+    sqlite3_close( myDatabase );
   }
-  QgsDebugMsg( "no match found in srs.db, trying user db now!" );
-  // close the sqlite3 statement
-  sqlite3_finalize( myPreparedStatement );
-  sqlite3_close( myDatabase );
   //
   // Try the users db now
   //
@@ -1952,6 +2180,9 @@ int QgsCoordinateReferenceSystem::syncDb()
 
   sqlite3_close( database );
 
+  // the catalogue is read again when needed
+  QgsSrsCatalogue::instance()->clear();
+
   qWarning( "CRS update (inserted:%d updated:%d deleted:%d errors:%d)", inserted, updated, deleted, errors );
 
   if ( errors > 0 )
@@ -423,9 +423,18 @@ class CORE_EXPORT QgsCoordinateReferenceSystem
      * @note only handles queries that return a single record.
      * @note it will first try the system srs.db then the users qgis.db!
      * @param theSql The sql query to execute
+     * @param theSystemDb false to only try the users qgis.db
      * @return An associative array of field name <-> value pairs
      */
-    RecordMap getRecord( QString theSql );
+    RecordMap getRecord( QString theSql, bool theSystemDb = true );
+
+    /*! Get the srs_id of a proj4 definition from the srs.db or qgis.db backends.
+     * The system srs.db is searched in the catalogue which is read once.
+     * @note only handles definitions which are unique in a database
+     * @param theProj4String The proj4 definition
+     * @return An associative array with the srs_id
+     */
+    RecordMap getProj4Record( const QString& theProj4String );
 
     // Open SQLite db and show message if cannot be opened
     // returns the same code as sqlite3_open
@@ -24,6 +24,9 @@
 #include <QDomNode>
 #include <QDomElement>
 #include <QApplication>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QPolygonF>
 #include <QStringList>
 #include <QVector>
@@ -37,6 +40,61 @@ extern "C"
 // if defined shows all information about transform to stdout
 // #define COORDINATE_TRANSFORM_VERBOSE
 
+/** Initialised proj handles by their definition, shared by all threads.
+ * A transform takes the handles it needs and gives them back when it is deleted or
+ * initialised again, so each handle is used by one transform at a time and
+ * pj_init_plus only runs for as many handles of a definition as are used at the same time.
+ */
+class QgsProjHandleCache
+{
+  public:
+    static QgsProjHandleCache* instance()
+    {
+      // never deleted, transforms in static caches give back their handles on exit
+      static QgsProjHandleCache* mInstance = new QgsProjHandleCache();
+      return mInstance;
+    }
+
+    //! a free handle of the definition or a new one, 0 if the definition is invalid
+    projPJ take( const QString& definition )
+    {
+      {
+        QMutexLocker locker( &mMutex );
+        QHash< QString, QList<projPJ> >::iterator it = mHandles.find( definition );
+        if ( it != mHandles.end() && !it.value().isEmpty() )
+        {
+          return it.value().takeLast();
+        }
+      }
+      return pj_init_plus( definition.toUtf8() );
+    }
+
+    //! gives back a handle which was taken with take()
+    void give( const QString& definition, projPJ handle )
+    {
+      if ( !handle )
+        return;
+
+      {
+        QMutexLocker locker( &mMutex );
+        QList<projPJ>& handles = mHandles[ definition ];
+        if ( handles.size() < MaxFreeHandles )
+        {
+          handles << handle;
+          return;
+        }
+      }
+      pj_free( handle );
+    }
+
+  private:
+    //! free handles kept for each definition
+    static const int MaxFreeHandles = 16;
+
+    QMutex mMutex;
+    QHash< QString, QList<projPJ> > mHandles;
+};
+
 QgsCoordinateTransform::QgsCoordinateTransform()
     : QObject()
     , mInitialisedFlag( false )
@@ -116,15 +174,9 @@ QgsCoordinateTransform::QgsCoordinateTransform( long theSourceSrid,
 
 QgsCoordinateTransform::~QgsCoordinateTransform()
 {
-  // free the proj objects
-  if ( mSourceProjection )
-  {
-    pj_free( mSourceProjection );
-  }
-  if ( mDestinationProjection )
-  {
-    pj_free( mDestinationProjection );
-  }
+  // give back the proj objects
+  QgsProjHandleCache::instance()->give( mSourceProjString, mSourceProjection );
+  QgsProjHandleCache::instance()->give( mDestinationProjString, mDestinationProjection );
 }
 
 QgsCoordinateTransform* QgsCoordinateTransform::clone() const
@@ -180,7 +232,8 @@ void QgsCoordinateTransform::initialise()
 
   // init the projections (destination and source)
 
-  pj_free( mSourceProjection );
+  QgsProjHandleCache::instance()->give( mSourceProjString, mSourceProjection );
+  mSourceProjection = 0;
   QString sourceProjString = mSourceCRS.toProj4();
   if ( !useDefaultDatumTransform )
   {
@@ -191,7 +244,8 @@ void QgsCoordinateTransform::initialise()
     sourceProjString += ( " " + datumTransformString( mSourceDatumTransform ) );
   }
 
-  pj_free( mDestinationProjection );
+  QgsProjHandleCache::instance()->give( mDestinationProjString, mDestinationProjection );
+  mDestinationProjection = 0;
   QString destProjString = mDestCRS.toProj4();
   if ( !useDefaultDatumTransform )
   {
@@ -207,8 +261,10 @@ void QgsCoordinateTransform::initialise()
     addNullGridShifts( sourceProjString, destProjString );
   }
 
-  mSourceProjection = pj_init_plus( sourceProjString.toUtf8() );
-  mDestinationProjection = pj_init_plus( destProjString.toUtf8() );
+  mSourceProjString = sourceProjString;
+  mSourceProjection = QgsProjHandleCache::instance()->take( sourceProjString );
+  mDestinationProjString = destProjString;
+  mDestinationProjection = QgsProjHandleCache::instance()->take( destProjString );
 
 #ifdef COORDINATE_TRANSFORM_VERBOSE
   QgsDebugMsg( "From proj : " + mSourceCRS.toProj4() );
@@ -284,6 +284,10 @@ class CORE_EXPORT QgsCoordinateTransform : public QObject
      */
     projPJ mDestinationProjection;
 
+    //! Definitions of the proj4 data structures, the structures are shared through a cache
+    QString mSourceProjString;
+    QString mDestinationProjString;
+
     int mSourceDatumTransform;
     int mDestinationDatumTransform;
 
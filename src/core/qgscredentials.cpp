@@ -16,10 +16,15 @@
 #include "qgscredentials.h"
 #include "qgslogger.h"
 
+#include <QMutexLocker>
 #include <QTextStream>
+#include <QThreadStorage>
 
 QgsCredentials *QgsCredentials::smInstance = 0;
 
+//! set for the threads on which requests are disabled
+static QThreadStorage<bool *> sRequestsDisabled;
+
 void QgsCredentials::setInstance( QgsCredentials *theInstance )
 {
   if ( smInstance )
@@ -42,15 +47,34 @@ QgsCredentials::~QgsCredentials()
 {
 }
 
+void QgsCredentials::setRequestsEnabled( bool enabled )
+{
+  sRequestsDisabled.setLocalData( enabled ? 0 : new bool( true ) );
+}
+
+bool QgsCredentials::requestsEnabled()
+{
+  return !sRequestsDisabled.hasLocalData();
+}
+
 bool QgsCredentials::get( QString realm, QString &username, QString &password, QString message )
 {
-  if ( mCredentialCache.contains( realm ) )
   {
-    QPair<QString, QString> credentials = mCredentialCache.take( realm );
-    username = credentials.first;
-    password = credentials.second;
-    QgsDebugMsg( QString( "retrieved realm:%1 username:%2 password:%3" ).arg( realm ).arg( username ).arg( password ) );
-    return true;
+    QMutexLocker locker( &mCacheMutex );
+    if ( mCredentialCache.contains( realm ) )
+    {
+      QPair<QString, QString> credentials = mCredentialCache.take( realm );
+      username = credentials.first;
+      password = credentials.second;
+      QgsDebugMsg( QString( "retrieved realm:%1 username:%2 password:%3" ).arg( realm ).arg( username ).arg( password ) );
+      return true;
+    }
+  }
+
+  if ( !requestsEnabled() )
+  {
+    QgsDebugMsg( QString( "requests disabled on this thread, realm:%1" ).arg( realm ) );
+    return false;
   }
   else if ( request( realm, username, password, message ) )
   {
@@ -67,6 +91,7 @@ bool QgsCredentials::get( QString realm, QString &username, QString &password, Q
 void QgsCredentials::put( QString realm, QString username, QString password )
 {
   QgsDebugMsg( QString( "inserting realm:%1 username:%2 password:%3" ).arg( realm ).arg( username ).arg( password ) );
+  QMutexLocker locker( &mCacheMutex );
   mCredentialCache.insert( realm, QPair<QString, QString>( username, password ) );
 }
 
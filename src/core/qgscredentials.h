@@ -21,6 +21,7 @@
 #include <QObject>
 #include <QPair>
 #include <QMap>
+#include <QMutex>
 
 /** \ingroup core
  * Interface for requesting credentials in QGIS in GUI independent way.
@@ -45,6 +46,18 @@ class CORE_EXPORT QgsCredentials
     //! retrieves instance
     static QgsCredentials *instance();
 
+    /** Sets whether get() may request credentials which are not cached, for the calling thread.
+     * Requests are disabled while providers are created on the thread pool, where a request
+     * would block on the GUI thread while it waits for the provider.
+     * @note added in 2.4
+     */
+    static void setRequestsEnabled( bool enabled );
+
+    /** Returns whether get() may request credentials on the calling thread
+     * @note added in 2.4
+     */
+    static bool requestsEnabled();
+
   protected:
     //! request a password
     virtual bool request( QString realm, QString &username, QString &password, QString message = QString::null ) = 0;
@@ -56,6 +69,9 @@ class CORE_EXPORT QgsCredentials
     //! cache for already requested credentials in this session
     QMap< QString, QPair<QString, QString> > mCredentialCache;
 
+    //! protects the cache, get() and put() are also called from other threads
+    QMutex mCacheMutex;
+
     //! Pointer to the credential instance
     static QgsCredentials *smInstance;
 };
@@ -1,11 +1,34 @@
 #include "qgsgeometrycache.h"
 
+#include "qgsspatialindex.h"
 #include "qgsvectorlayereditbuffer.h"
 
 QgsGeometryCache::QgsGeometryCache()
+    : mSegmentIndex( 0 )
+    , mRemovedSegments( 0 )
 {
 }
 
+QgsGeometryCache::QgsGeometryCache( const QgsGeometryCache& other )
+    : mCachedGeometries( other.mCachedGeometries )
+    , mCachedGeometriesRect( other.mCachedGeometriesRect )
+    , mSegmentIndex( 0 )
+    , mRemovedSegments( 0 )
+{
+}
+
+QgsGeometryCache& QgsGeometryCache::operator=( const QgsGeometryCache& other )
+{
+  if ( this != &other )
+  {
+    // the index of the other cache is not copied, it is built again when needed
+    clearIndex();
+    mCachedGeometries = other.mCachedGeometries;
+    mCachedGeometriesRect = other.mCachedGeometriesRect;
+  }
+  return *this;
+}
+
 QgsGeometryCache::~QgsGeometryCache()
 {
   // Destroy any cached geometries and clear the references to them
@@ -27,6 +50,20 @@ bool QgsGeometryCache::geometry( QgsFeatureId fid, QgsGeometry& geometry )
 void QgsGeometryCache::cacheGeometry( QgsFeatureId fid, const QgsGeometry& geom )
 {
   mCachedGeometries[fid] = geom;
+  if ( mSegmentIndex )
+  {
+    unindexGeometry( fid );
+    // the index may have been dropped, then it is built again with the new geometry
+    if ( mSegmentIndex )
+      indexGeometry( fid, geom );
+  }
+}
+
+void QgsGeometryCache::removeGeometry( QgsFeatureId fid )
+{
+  if ( mSegmentIndex )
+    unindexGeometry( fid );
+  mCachedGeometries.remove( fid );
 }
 
 
@@ -35,4 +72,138 @@ void QgsGeometryCache::deleteCachedGeometries()
   // Destroy any cached geometries
   mCachedGeometries.clear();
   mCachedGeometriesRect = QgsRectangle();
+  clearIndex();
+}
+
+QList<QgsGeometryCache::Segment> QgsGeometryCache::intersectingSegments( const QgsRectangle& rect )
+{
+  if ( !mSegmentIndex )
+  {
+    mSegmentIndex = new QgsSpatialIndex();
+    for ( QgsGeometryMap::const_iterator it = mCachedGeometries.constBegin(); it != mCachedGeometries.constEnd(); ++it )
+    {
+      indexGeometry( it.key(), it.value() );
+    }
+  }
+
+  // the ids of the segments of a feature are increasing with the vertex number
+  QList<QgsFeatureId> ids = mSegmentIndex->intersects( rect );
+  qSort( ids );
+
+  QMap< QgsFeatureId, QList<Segment> > segmentsByFeature;
+  foreach ( QgsFeatureId id, ids )
+  {
+    const Segment& segment = mSegments[ id ];
+    segmentsByFeature[ segment.featureId ] << segment;
+  }
+
+  QList<Segment> segments;
+  for ( QMap< QgsFeatureId, QList<Segment> >::const_iterator it = segmentsByFeature.constBegin(); it != segmentsByFeature.constEnd(); ++it )
+  {
+    segments << it.value();
+  }
+  return segments;
+}
+
+void QgsGeometryCache::indexGeometry( QgsFeatureId fid, const QgsGeometry& geom )
+{
+  // the vertex numbering of QgsGeometry: all points of all parts and rings, closing points included
+  QList<QgsPolyline> lines;
+  bool points = false;
+  switch ( QGis::flatType( geom.wkbType() ) )
+  {
+    case QGis::WKBPoint:
+      lines << ( QgsPolyline() << geom.asPoint() );
+      points = true;
+      break;
+
+    case QGis::WKBMultiPoint:
+      lines << geom.asMultiPoint();
+      points = true;
+      break;
+
+    case QGis::WKBLineString:
+      lines << geom.asPolyline();
+      break;
+
+    case QGis::WKBMultiLineString:
+      foreach ( const QgsPolyline& line, geom.asMultiPolyline() )
+        lines << line;
+      break;
+
+    case QGis::WKBPolygon:
+      foreach ( const QgsPolyline& ring, geom.asPolygon() )
+        lines << ring;
+      break;
+
+    case QGis::WKBMultiPolygon:
+      foreach ( const QgsPolygon& polygon, geom.asMultiPolygon() )
+      {
+        foreach ( const QgsPolyline& ring, polygon )
+          lines << ring;
+      }
+      break;
+
+    default:
+      return;
+  }
+
+  QVector<int>& featureSegments = mFeatureSegments[ fid ];
+  int vertex = 0;
+  foreach ( const QgsPolyline& line, lines )
+  {
+    for ( int i = 0; i < line.size(); ++i, ++vertex )
+    {
+      if ( !points && i == 0 )
+        continue;
+
+      Segment segment;
+      segment.featureId = fid;
+      segment.vertex = vertex;
+      segment.from = points ? line[i] : line[i - 1];
+      segment.to = line[i];
+
+      QgsPolyline segmentLine;
+      segmentLine << segment.from << segment.to;
+      QgsFeature segmentFeature( mSegments.size() );
+      segmentFeature.setGeometry( QgsGeometry::fromPolyline( segmentLine ) );
+      mSegmentIndex->insertFeature( segmentFeature );
+
+      featureSegments << mSegments.size();
+      mSegments << segment;
+    }
+  }
+}
+
+void QgsGeometryCache::unindexGeometry( QgsFeatureId fid )
+{
+  QHash< QgsFeatureId, QVector<int> >::iterator it = mFeatureSegments.find( fid );
+  if ( it == mFeatureSegments.end() )
+    return;
+
+  foreach ( int id, it.value() )
+  {
+    Segment& segment = mSegments[ id ];
+    QgsPolyline segmentLine;
+    segmentLine << segment.from << segment.to;
+    QgsFeature segmentFeature( id );
+    segmentFeature.setGeometry( QgsGeometry::fromPolyline( segmentLine ) );
+    mSegmentIndex->deleteFeature( segmentFeature );
+    segment.vertex = -1;
+  }
+  mRemovedSegments += it.value().size();
+  mFeatureSegments.erase( it );
+
+  // the ids of the removed segments are not reused, drop the index before they take over
+  if ( mRemovedSegments > mSegments.size() - mRemovedSegments )
+    clearIndex();
+}
+
+void QgsGeometryCache::clearIndex()
+{
+  delete mSegmentIndex;
+  mSegmentIndex = 0;
+  mSegments.clear();
+  mRemovedSegments = 0;
+  mFeatureSegments.clear();
 }
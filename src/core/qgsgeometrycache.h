@@ -5,14 +5,37 @@
 #include "qgsfeature.h"
 #include "qgsrectangle.h"
 
+#include <QHash>
 #include <QMap>
+#include <QVector>
+
+class QgsSpatialIndex;
+
+/** Segment of a cached geometry, see QgsGeometryCache::intersectingSegments()
+ * @note added in 2.4
+ */
+struct QgsGeometryCacheSegment
+{
+  QgsFeatureId featureId;
+  //! number of the last vertex of the segment, for points the number of the point
+  int vertex;
+  QgsPoint from;
+  QgsPoint to;
+};
 
 class CORE_EXPORT QgsGeometryCache
 {
   public:
+    typedef QgsGeometryCacheSegment Segment;
+
     QgsGeometryCache();
+    QgsGeometryCache( const QgsGeometryCache& other );
+    QgsGeometryCache& operator=( const QgsGeometryCache& other );
     ~QgsGeometryCache();
 
+    /** The cached geometries. Changes to the map which do not go through
+     * cacheGeometry() and removeGeometry() are not seen by intersectingSegments()
+     */
     inline QgsGeometryMap& cachedGeometries() { return mCachedGeometries; }
 
     //! fetch geometry from cache, return true if successful
@@ -22,7 +45,7 @@ class CORE_EXPORT QgsGeometryCache
     void cacheGeometry( QgsFeatureId fid, const QgsGeometry& geom );
 
     //! get rid of the cached geometry
-    void removeGeometry( QgsFeatureId fid ) { mCachedGeometries.remove( fid ); }
+    void removeGeometry( QgsFeatureId fid );
 
 
     /** Deletes the geometries in mCachedGeometries */
@@ -31,6 +54,17 @@ class CORE_EXPORT QgsGeometryCache
     void setCachedGeometriesRect( const QgsRectangle& extent ) { mCachedGeometriesRect = extent; }
     const QgsRectangle& cachedGeometriesRect() { return mCachedGeometriesRect; }
 
+    /** Returns the segments of the cached geometries whose bounding box intersects a rectangle,
+     * ordered by feature and vertex. Point geometries have one segment per point.
+     * The segment index is built on the first call and then kept up to date by
+     * cacheGeometry() and removeGeometry(), so vertex and segment snapping does not have
+     * to test every cached geometry. It is built again once more segments were removed
+     * from it than are left.
+     * @note added in 2.4
+     * @note not available in python bindings
+     */
+    QList<Segment> intersectingSegments( const QgsRectangle& rect );
+
   protected:
 
     /** cache of the committed geometries retrieved *for the current display* */
@@ -39,6 +73,22 @@ class CORE_EXPORT QgsGeometryCache
     /** extent for which there are cached geometries */
     QgsRectangle mCachedGeometriesRect;
 
+  private:
+    //! add the segments of a geometry to the index
+    void indexGeometry( QgsFeatureId fid, const QgsGeometry& geom );
+    //! remove the segments of a feature from the index
+    void unindexGeometry( QgsFeatureId fid );
+    //! drop the segment index, it is built again when needed
+    void clearIndex();
+
+    //! index of the segments, 0 until intersectingSegments() is called
+    QgsSpatialIndex* mSegmentIndex;
+    //! the indexed segments by their id in mSegmentIndex, removed segments have vertex -1
+    QVector<Segment> mSegments;
+    //! number of removed segments in mSegments, the index is dropped when they outnumber the others
+    int mRemovedSegments;
+    //! ids of the segments of each indexed feature
+    QHash< QgsFeatureId, QVector<int> > mFeatureSegments;
 };
 
 #endif // QGSGEOMETRYCACHE_H
@@ -155,53 +155,37 @@ void QgsMapLayer::drawLabels( QgsRenderContext& rendererContext )
   Q_UNUSED( rendererContext );
 }
 
-bool QgsMapLayer::readLayerXML( const QDomElement& layerElement )
+QString QgsMapLayer::projectDataSource( const QString& provider, const QString& dataSource )
 {
-  QgsCoordinateReferenceSystem savedCRS;
-  CUSTOM_CRS_VALIDATION savedValidation;
-  bool layerError;
-
-  QDomNode mnl;
-  QDomElement mne;
-
-  // read provider
-  QString provider;
-  mnl = layerElement.namedItem( "provider" );
-  mne = mnl.toElement();
-  provider = mne.text();
-
-  // set data source
-  mnl = layerElement.namedItem( "datasource" );
-  mne = mnl.toElement();
-  mDataSource = mne.text();
+  QString source = dataSource;
 
   // TODO: this should go to providers
   if ( provider == "spatialite" )
   {
-    QgsDataSourceURI uri( mDataSource );
+    QgsDataSourceURI uri( source );
     uri.setDatabase( QgsProject::instance()->readPath( uri.database() ) );
-    mDataSource = uri.uri();
+    source = uri.uri();
   }
   else if ( provider == "ogr" )
   {
-    QStringList theURIParts = mDataSource.split( "|" );
+    QStringList theURIParts = source.split( "|" );
     theURIParts[0] = QgsProject::instance()->readPath( theURIParts[0] );
-    mDataSource = theURIParts.join( "|" );
+    source = theURIParts.join( "|" );
   }
   else if ( provider == "delimitedtext" )
   {
-    QUrl urlSource = QUrl::fromEncoded( mDataSource.toAscii() );
+    QUrl urlSource = QUrl::fromEncoded( source.toAscii() );
 
-    if ( !mDataSource.startsWith( "file:" ) )
+    if ( !source.startsWith( "file:" ) )
     {
-      QUrl file = QUrl::fromLocalFile( mDataSource.left( mDataSource.indexOf( "?" ) ) );
+      QUrl file = QUrl::fromLocalFile( source.left( source.indexOf( "?" ) ) );
       urlSource.setScheme( "file" );
       urlSource.setPath( file.path() );
     }
 
     QUrl urlDest = QUrl::fromLocalFile( QgsProject::instance()->readPath( urlSource.toLocalFile() ) );
     urlDest.setQueryItems( urlSource.queryItems() );
-    mDataSource = QString::fromAscii( urlDest.toEncoded() );
+    source = QString::fromAscii( urlDest.toEncoded() );
   }
   else if ( provider == "wms" )
   {
@@ -216,13 +200,13 @@ bool QgsMapLayer::readLayerXML( const QDomElement& layerElement )
     // This is modified version of old QgsWmsProvider::parseUri
     // The new format has always params crs,format,layers,styles and that params
     // should not appear in old format url -> use them to identify version
-    if ( !mDataSource.contains( "crs=" ) && !mDataSource.contains( "format=" ) )
+    if ( !source.contains( "crs=" ) && !source.contains( "format=" ) )
     {
       QgsDebugMsg( "Old WMS URI format detected -> converting to new format" );
       QgsDataSourceURI uri;
-      if ( !mDataSource.startsWith( "http:" ) )
+      if ( !source.startsWith( "http:" ) )
       {
-        QStringList parts = mDataSource.split( "," );
+        QStringList parts = source.split( "," );
         QStringListIterator iter( parts );
         while ( iter.hasNext() )
         {
@@ -271,9 +255,9 @@ bool QgsMapLayer::readLayerXML( const QDomElement& layerElement )
       }
       else
       {
-        uri.setParam( "url", mDataSource );
+        uri.setParam( "url", source );
       }
-      mDataSource = uri.encodedUri();
+      source = uri.encodedUri();
       // At this point, the URI is obviously incomplete, we add additional params
       // in QgsRasterLayer::readXml
     }
@@ -281,9 +265,34 @@ bool QgsMapLayer::readLayerXML( const QDomElement& layerElement )
   }
   else
   {
-    mDataSource = QgsProject::instance()->readPath( mDataSource );
+    source = QgsProject::instance()->readPath( source );
   }
 
+  return source;
+}
+
+bool QgsMapLayer::readLayerXML( const QDomElement& layerElement )
+{
+  QgsCoordinateReferenceSystem savedCRS;
+  CUSTOM_CRS_VALIDATION savedValidation;
+  bool layerError;
+
+  QDomNode mnl;
+  QDomElement mne;
+
+  // read provider
+  QString provider;
+  mnl = layerElement.namedItem( "provider" );
+  mne = mnl.toElement();
+  provider = mne.text();
+
+  // set data source
+  mnl = layerElement.namedItem( "datasource" );
+  mne = mnl.toElement();
+  mDataSource = mne.text();
+
+  mDataSource = projectDataSource( provider, mDataSource );
+
   // Set the CRS from project file, asking the user if necessary.
   // Make it the saved CRS to have WMS layer projected correctly.
   // We will still overwrite whatever GDAL etc picks up anyway
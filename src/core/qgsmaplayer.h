@@ -200,6 +200,14 @@ class CORE_EXPORT QgsMapLayer : public QObject
      */
     bool readLayerXML( const QDomElement& layerElement );
 
+    /** Returns the data source of a layer stored in a project, with paths relative
+     * to the project file made absolute, as readLayerXML() sets it
+     * @param provider key of the data provider
+     * @param dataSource data source as stored in the project file
+     * @note added in 2.4
+     */
+    static QString projectDataSource( const QString& provider, const QString& dataSource );
+
 
     /** stores state in Dom node
        @param layerElement is a Dom element corresponding to ``maplayer'' tag
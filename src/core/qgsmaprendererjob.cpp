@@ -895,10 +895,13 @@ void QgsMapRendererParallelJob::renderLabelsStatic( QgsMapRendererParallelJob* s
 QImage QgsMapRendererJob::composeImage( const QgsMapSettings& settings, const LayerRenderJobs& jobs )
 {
   QImage image( settings.outputSize(), QImage::Format_ARGB32_Premultiplied );
-  image.fill( settings.backgroundColor().rgb() );
+  image.fill( 0 );
 
   QPainter painter( &image );
 
+  //fill through the painter, which keeps the alpha of the background color (the image is premultiplied)
+  painter.fillRect( image.rect(), settings.backgroundColor() );
+
   for ( LayerRenderJobs::const_iterator it = jobs.constBegin(); it != jobs.constEnd(); ++it )
   {
     const LayerRenderJob& job = *it;
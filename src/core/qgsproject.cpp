@@ -29,6 +29,7 @@
 #include "qgsprojectfiletransform.h"
 #include "qgsprojectproperty.h"
 #include "qgsprojectversion.h"
+#include "qgsproviderregistry.h"
 #include "qgsrasterlayer.h"
 #include "qgsrectangle.h"
 #include "qgsrelationmanager.h"
@@ -39,6 +40,7 @@
 #include <QDomNode>
 #include <QObject>
 #include <QTextStream>
+#include <QTime>
 
 // canonical project instance
 QgsProject *QgsProject::theProject_ = 0;
@@ -303,6 +305,9 @@ struct QgsProject::Imp
   /// true if project has been modified since it has been read or saved
   bool dirty;
 
+  /// time it took to load each layer in milliseconds, by layer id
+  QMap<QString, int> layerLoadTimes;
+
   Imp()
       : title( "" )
       , dirty( false )
@@ -676,6 +681,20 @@ QPair< bool, QList<QDomNode> > QgsProject::_getMapLayers( QDomDocument const &do
 
   emit layerLoaded( 0, nl.count() );
 
+  // open the data sources in parallel, the layers are still added one by one in their order
+  imp_->layerLoadTimes.clear();
+  QList< QPair<QString, QString> > dataSources;
+  for ( int i = 0; i < nl.count(); i++ )
+  {
+    QDomElement element = nl.item( i ).toElement();
+    QString provider = element.namedItem( "provider" ).toElement().text();
+    if ( element.attribute( "embedded" ) != "1" && !provider.isEmpty() )
+    {
+      dataSources << qMakePair( provider, QgsMapLayer::projectDataSource( provider, element.namedItem( "datasource" ).toElement().text() ) );
+    }
+  }
+  QgsProviderRegistry::instance()->prepareProviders( dataSources );
+
   //Collect vector layers with joins.
   //They need to refresh join caches and symbology infos after all layers are loaded
   QList< QPair< QgsVectorLayer*, QDomElement > > vLayerList;
@@ -704,6 +723,9 @@ QPair< bool, QList<QDomNode> > QgsProject::_getMapLayers( QDomDocument const &do
     emit layerLoaded( i + 1, nl.count() );
   }
 
+  // providers of layers which failed to load
+  QgsProviderRegistry::instance()->clearPreparedProviders();
+
   //Update field map of layers with joins and create join caches if necessary
   //Needs to be done here once all dependent layers are loaded
   QList< QPair< QgsVectorLayer*, QDomElement > >::iterator vIt = vLayerList.begin();
@@ -747,8 +769,13 @@ bool QgsProject::addLayer( const QDomElement& layerElem, QList<QDomNode>& broken
   Q_CHECK_PTR( mapLayer );
 
   // have the layer restore state that is stored in Dom node
+  QTime time;
+  time.start();
   if ( mapLayer->readLayerXML( layerElem ) && mapLayer->isValid() )
   {
+    imp_->layerLoadTimes.insert( mapLayer->id(), time.elapsed() );
+    QgsDebugMsg( QString( "Layer %1 loaded in %2 ms" ).arg( mapLayer->name() ).arg( time.elapsed() ) );
+
     emit readMapLayer( mapLayer, layerElem );
 
     QList<QgsMapLayer *> myLayers;
@@ -1828,3 +1855,8 @@ QgsRelationManager* QgsProject::relationManager() const
 {
   return mRelationManager;
 }
+
+QMap<QString, int> QgsProject::layerLoadTimes() const
+{
+  return imp_->layerLoadTimes;
+}
@@ -318,6 +318,12 @@ class CORE_EXPORT QgsProject : public QObject
 
     QgsRelationManager* relationManager() const;
 
+    /** Returns the time in milliseconds it took to load each layer of the last read project,
+      by layer id. Data providers are created in parallel, so this is the time spent waiting
+      for the provider and reading the layer.
+      @note added in 2.4 */
+    QMap<QString, int> layerLoadTimes() const;
+
   protected:
 
     /** Set error message from read/write operation
@@ -21,8 +21,16 @@
 #include <QString>
 #include <QDir>
 #include <QLibrary>
+#include <QRegExp>
+#include <QSemaphore>
+#include <QSettings>
+#include <QThread>
+#include <QThreadPool>
+#include <QTime>
+#include <QtConcurrentRun>
 
 #include "qgis.h"
+#include "qgscredentials.h"
 #include "qgsdataprovider.h"
 #include "qgslogger.h"
 #include "qgsmessageoutput.h"
@@ -40,6 +48,8 @@ typedef void buildsupportedrasterfilefilter_t( QString & theFileFiltersString );
 typedef QString databaseDrivers_t();
 typedef QString directoryDrivers_t();
 typedef QString protocolDrivers_t();
+typedef bool supportsThreadedCreation_t();
+typedef void prepareThreadedCreation_t();
 //typedef int dataCapabilities_t();
 //typedef QgsDataItem * dataItem_t(QString);
 
@@ -204,6 +214,9 @@ typedef void cleanupProviderFunction_t();
 
 QgsProviderRegistry::~QgsProviderRegistry()
 {
+  clearPreparedProviders();
+  qDeleteAll( mHostSemaphores );
+
   Providers::const_iterator it = mProviders.begin();
 
   while ( it != mProviders.end() )
@@ -318,6 +331,140 @@ typedef QgsDataProvider * classFactoryFunction_t( const QString * );
  *        in qgsrasterlayer, qgsvectorlayer, serversourceselect, etc.
  */
 QgsDataProvider *QgsProviderRegistry::provider( QString const & providerKey, QString const & dataSource )
+{
+  QFuture<QgsDataProvider*> prepared;
+  bool isPrepared = false;
+  mPreparedProvidersMutex.lock();
+  for ( int i = 0; i < mPreparedProviders.size(); ++i )
+  {
+    if ( mPreparedProviders[i].providerKey == providerKey && mPreparedProviders[i].dataSource == dataSource )
+    {
+      prepared = mPreparedProviders.takeAt( i ).provider;
+      isPrepared = true;
+      break;
+    }
+  }
+  mPreparedProvidersMutex.unlock();
+
+  if ( isPrepared )
+  {
+    // waits if the provider is still being created
+    QgsDataProvider *dataProvider = prepared.result();
+    if ( dataProvider && dataProvider->isValid() )
+      return dataProvider;
+
+    // credentials are not requested on the thread pool, try again here where they can be
+    QgsDebugMsg( QString( "Prepared %1 provider for %2 is not valid, creating it again" ).arg( providerKey ).arg( dataSource ) );
+    delete dataProvider;
+  }
+
+  return createProvider( providerKey, dataSource );
+}
+
+//! host of a data source, empty for local files
+static QString dataSourceHost( const QString& dataSource )
+{
+  QRegExp hostRe( "host='?([^\\s'|]+)" );
+  if ( hostRe.indexIn( dataSource ) != -1 )
+    return hostRe.cap( 1 );
+
+  QRegExp urlRe( "(https?|ftp)(://|%3A%2F%2F)([^/:%&|]+)", Qt::CaseInsensitive );
+  if ( urlRe.indexIn( dataSource ) != -1 )
+    return urlRe.cap( 3 );
+
+  return QString();
+}
+
+void QgsProviderRegistry::prepareProviders( const QList< QPair<QString, QString> >& dataSources )
+{
+  QSettings settings;
+  int perHost = qMax( 1, settings.value( "/qgis/parallelProvidersPerHost", 4 ).toInt() );
+
+  QMap<QString, bool> threadedCreation;
+  QMutexLocker locker( &mPreparedProvidersMutex );
+  for ( int i = 0; i < dataSources.size(); ++i )
+  {
+    const QString& providerKey = dataSources[i].first;
+    if ( !threadedCreation.contains( providerKey ) )
+    {
+      supportsThreadedCreation_t *supportsThreadedCreation = ( supportsThreadedCreation_t * ) cast_to_fptr( function( providerKey, "supportsThreadedCreation" ) );
+      bool supported = supportsThreadedCreation && supportsThreadedCreation();
+      if ( supported )
+      {
+        // global state of the provider (e.g. driver registration) is set up here,
+        // the constructors in the pool threads leave it alone
+        prepareThreadedCreation_t *prepareThreadedCreation = ( prepareThreadedCreation_t * ) cast_to_fptr( function( providerKey, "prepareThreadedCreation" ) );
+        if ( prepareThreadedCreation )
+          prepareThreadedCreation();
+      }
+      threadedCreation.insert( providerKey, supported );
+    }
+    if ( !threadedCreation[ providerKey ] )
+      continue;
+
+    // local files are only limited by the size of the thread pool
+    QString host = dataSourceHost( dataSources[i].second );
+    QSemaphore *hostSemaphore = 0;
+    if ( !host.isEmpty() )
+    {
+      if ( !mHostSemaphores.contains( host ) )
+        mHostSemaphores.insert( host, new QSemaphore( perHost ) );
+      hostSemaphore = mHostSemaphores[ host ];
+    }
+
+    PreparedProvider prepared;
+    prepared.providerKey = providerKey;
+    prepared.dataSource = dataSources[i].second;
+    prepared.provider = QtConcurrent::run( createPreparedProvider, providerKey, dataSources[i].second, hostSemaphore, QThread::currentThread() );
+    mPreparedProviders << prepared;
+  }
+  QgsDebugMsg( QString( "%1 of %2 providers are created in parallel" ).arg( mPreparedProviders.size() ).arg( dataSources.size() ) );
+}
+
+int QgsProviderRegistry::preparedProviderCount() const
+{
+  QMutexLocker locker( &mPreparedProvidersMutex );
+  return mPreparedProviders.size();
+}
+
+void QgsProviderRegistry::clearPreparedProviders()
+{
+  mPreparedProvidersMutex.lock();
+  QList<PreparedProvider> preparedProviders = mPreparedProviders;
+  mPreparedProviders.clear();
+  mPreparedProvidersMutex.unlock();
+
+  foreach ( PreparedProvider prepared, preparedProviders )
+  {
+    delete prepared.provider.result();
+  }
+}
+
+QgsDataProvider *QgsProviderRegistry::createPreparedProvider( QString providerKey, QString dataSource, QSemaphore *hostSemaphore, QThread *thread )
+{
+  if ( hostSemaphore )
+    hostSemaphore->acquire();
+
+  // the thread waiting for the provider might be the one which would show the request
+  QgsCredentials::setRequestsEnabled( false );
+
+  QTime time;
+  time.start();
+  QgsDataProvider *dataProvider = instance()->createProvider( providerKey, dataSource );
+  QgsDebugMsg( QString( "Created %1 provider for %2 in %3 ms" ).arg( providerKey ).arg( dataSource ).arg( time.elapsed() ) );
+
+  QgsCredentials::setRequestsEnabled( true );
+
+  if ( hostSemaphore )
+    hostSemaphore->release();
+
+  // the layer uses the provider in its own thread
+  if ( dataProvider )
+    dataProvider->moveToThread( thread );
+  return dataProvider;
+}
+
+QgsDataProvider *QgsProviderRegistry::createProvider( QString const & providerKey, QString const & dataSource )
 {
   // XXX should I check for and possibly delete any pre-existing providers?
   // XXX How often will that scenario occur?
@@ -369,7 +516,7 @@ QgsDataProvider *QgsProviderRegistry::provider( QString const & providerKey, QSt
 
   QgsDebugMsg( QString( "Instantiated the data provider plugin: %1" ).arg( dataProvider->name() ) );
   return dataProvider;
-} // QgsProviderRegistry::setDataProvider
+} // QgsProviderRegistry::createProvider
 
 // This should be QWidget, not QDialog
 typedef QWidget * selectFactoryFunction_t( QWidget * parent, Qt::WindowFlags fl );
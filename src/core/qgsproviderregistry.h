@@ -22,7 +22,11 @@
 #include <map>
 
 #include <QDir>
+#include <QFuture>
 #include <QLibrary>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
 #include <QString>
 
 
@@ -30,6 +34,8 @@ class QgsDataProvider;
 class QgsProviderMetadata;
 class QgsVectorLayer;
 class QgsCoordinateReferenceSystem;
+class QSemaphore;
+class QThread;
 
 
 /** \ingroup core
@@ -68,6 +74,31 @@ class CORE_EXPORT QgsProviderRegistry
     QgsDataProvider *provider( const QString & providerKey,
                                const QString & dataSource );
 
+    /** Starts creating the providers of data sources on the global thread pool, e.g. for
+     * the layers of a project. Only providers which export supportsThreadedCreation() are
+     * prepared, currently gdal, ogr and postgres. Their optional prepareThreadedCreation()
+     * is called on the calling thread first. At most "/qgis/parallelProvidersPerHost"
+     * (default 4) providers are created at the same time for the same host.
+     * provider() hands out the prepared providers with the same key and data source in the
+     * given order, waiting for them if they are not ready yet. Credentials are not requested
+     * on the thread pool, a prepared provider which is not valid is created again by
+     * provider(). Other providers are created as before, e.g. wms and wfs, which use the
+     * network access manager of the main thread.
+     * @param dataSources provider keys and data sources
+     * @note added in 2.4
+     */
+    void prepareProviders( const QList< QPair<QString, QString> >& dataSources );
+
+    /** Deletes the prepared providers which were not asked for
+     * @note added in 2.4
+     */
+    void clearPreparedProviders();
+
+    /** Returns the number of prepared providers which were not asked for yet
+     * @note added in 2.4
+     */
+    int preparedProviderCount() const;
+
     QWidget *selectWidget( const QString & providerKey,
                            QWidget * parent = 0, Qt::WindowFlags fl = 0 );
 
@@ -158,9 +189,33 @@ class CORE_EXPORT QgsProviderRegistry
     /** ctor private since instance() creates it */
     QgsProviderRegistry( QString pluginPath );
 
+    /** create an instance of the provider from its library */
+    QgsDataProvider *createProvider( const QString & providerKey, const QString & dataSource );
+
+    /** create a provider in a thread of the pool and move it to the given thread */
+    static QgsDataProvider *createPreparedProvider( QString providerKey, QString dataSource,
+        QSemaphore *hostSemaphore, QThread *thread );
+
+    /** provider which is being created by prepareProviders() */
+    struct PreparedProvider
+    {
+      QString providerKey;
+      QString dataSource;
+      QFuture<QgsDataProvider*> provider;
+    };
+
     /** associative container of provider metadata handles */
     Providers mProviders;
 
+    /** providers created by prepareProviders(), in their order */
+    QList<PreparedProvider> mPreparedProviders;
+
+    /** limits the number of providers created at the same time for a host */
+    QMap<QString, QSemaphore*> mHostSemaphores;
+
+    /** protects mPreparedProviders and mHostSemaphores */
+    mutable QMutex mPreparedProvidersMutex;
+
     /** directory in which provider plugins are installed */
     QDir mLibraryDirectory;
 
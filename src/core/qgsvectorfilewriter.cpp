@@ -27,6 +27,7 @@
 #include "qgsrendererv2.h"
 #include "qgssymbollayerv2.h"
 #include "qgsvectordataprovider.h"
+#include "qgsvectorlayerfeatureiterator.h"
 
 #include <QFile>
 #include <QSettings>
@@ -36,6 +37,11 @@
 #include <QTextStream>
 #include <QSet>
 #include <QMetaType>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QTime>
+#include <QWaitCondition>
 
 #include <cassert>
 #include <cstdlib> // size_t
@@ -68,7 +74,7 @@ QgsVectorFileWriter::QgsVectorFileWriter(
 )
     : mDS( NULL )
     , mLayer( NULL )
-    , mGeom( NULL )
+    , mFeature( NULL )
     , mError( NoError )
     , mSymbologyExport( symbologyExport )
 {
@@ -470,21 +476,11 @@ QgsVectorFileWriter::QgsVectorFileWriter(
   QgsDebugMsg( "Done creating fields" );
 
   mWkbType = geometryType;
-  if ( mWkbType != QGis::WKBNoGeometry )
-  {
-    // create geometry which will be used for import
-    mGeom = createEmptyGeometry( mWkbType );
-  }
 
   if ( newFilename )
     *newFilename = vectorFileName;
 }
 
-OGRGeometryH QgsVectorFileWriter::createEmptyGeometry( QGis::WkbType wkbType )
-{
-  return OGR_G_CreateGeometry(( OGRwkbGeometryType ) wkbType );
-}
-
 QMap<QString, QgsVectorFileWriter::MetaData> QgsVectorFileWriter::initMetaData()
 {
   QMap<QString, MetaData> driverMetadata;
@@ -1546,8 +1542,16 @@ QString QgsVectorFileWriter::errorMessage()
 
 bool QgsVectorFileWriter::addFeature( QgsFeature& feature, QgsFeatureRendererV2* renderer, QGis::UnitType outputUnit )
 {
-  // create the feature
-  OGRFeatureH poFeature = createFeature( feature );
+  // the OGR feature is reused for all features written with addFeature
+  if ( !mFeature )
+  {
+    mFeature = OGR_F_Create( OGR_L_GetLayerDefn( mLayer ) );
+  }
+  OGRFeatureH poFeature = mFeature;
+  if ( !fillFeature( feature, poFeature ) )
+  {
+    return false;
+  }
 
   //add OGR feature style type
   if ( mSymbologyExport != NoSymbology && renderer )
@@ -1604,13 +1608,24 @@ bool QgsVectorFileWriter::addFeature( QgsFeature& feature, QgsFeatureRendererV2*
     }
   }
 
-  OGR_F_Destroy( poFeature );
   return true;
 }
 
 OGRFeatureH QgsVectorFileWriter::createFeature( QgsFeature& feature )
 {
   OGRFeatureH poFeature = OGR_F_Create( OGR_L_GetLayerDefn( mLayer ) );
+  if ( !fillFeature( feature, poFeature ) )
+  {
+    OGR_F_Destroy( poFeature );
+    return 0;
+  }
+  return poFeature;
+}
+
+bool QgsVectorFileWriter::fillFeature( QgsFeature& feature, OGRFeatureH poFeature )
+{
+  // the feature may be reused, the id is assigned by the driver
+  OGR_F_SetFID( poFeature, OGRNullFID );
 
   qint64 fid = FID_TO_NUMBER( feature.id() );
   if ( fid > std::numeric_limits<int>::max() )
@@ -1639,7 +1654,11 @@ OGRFeatureH QgsVectorFileWriter::createFeature( QgsFeature& feature )
     int ogrField = mAttrIdxToOgrIdx[ fldIdx ];
 
     if ( !attrValue.isValid() || attrValue.isNull() )
+    {
+      // clear the value of a previously written feature
+      OGR_F_UnsetField( poFeature, ogrField );
       continue;
+    }
 
     switch ( attrValue.type() )
     {
@@ -1680,7 +1699,7 @@ OGRFeatureH QgsVectorFileWriter::createFeature( QgsFeature& feature )
                         .arg( attrValue.toString() );
         QgsMessageLog::logMessage( mErrorMessage, QObject::tr( "OGR" ) );
         mError = ErrFeatureWriteFailed;
-        return 0;
+        return false;
     }
   }
 
@@ -1695,61 +1714,32 @@ OGRFeatureH QgsVectorFileWriter::createFeature( QgsFeature& feature )
       geom->convertToMultiType();
     }
 
-    if ( geom && geom->wkbType() != mWkbType )
+    if ( !geom )
     {
-      // there's a problem when layer type is set as wkbtype Polygon
-      // although there are also features of type MultiPolygon
-      // (at least in OGR provider)
-      // If the feature's wkbtype is different from the layer's wkbtype,
-      // try to export it too.
-      //
-      // Btw. OGRGeometry must be exactly of the type of the geometry which it will receive
-      // i.e. Polygons can't be imported to OGRMultiPolygon
-
-      OGRGeometryH mGeom2 = createEmptyGeometry( geom->wkbType() );
-
-      if ( !mGeom2 )
-      {
-        mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
-                        .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
-        mError = ErrFeatureWriteFailed;
-        QgsMessageLog::logMessage( mErrorMessage, QObject::tr( "OGR" ) );
-        OGR_F_Destroy( poFeature );
-        return 0;
-      }
-
-      OGRErr err = OGR_G_ImportFromWkb( mGeom2, const_cast<unsigned char *>( geom->asWkb() ), ( int ) geom->wkbSize() );
-      if ( err != OGRERR_NONE )
-      {
-        mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
-                        .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
-        mError = ErrFeatureWriteFailed;
-        QgsMessageLog::logMessage( mErrorMessage, QObject::tr( "OGR" ) );
-        OGR_F_Destroy( poFeature );
-        return 0;
-      }
-
-      // pass ownership to geometry
-      OGR_F_SetGeometryDirectly( poFeature, mGeom2 );
+      // clear the geometry of a previously written feature
+      OGR_F_SetGeometryDirectly( poFeature, 0 );
+      return true;
     }
-    else if ( geom )
-    {
-      OGRErr err = OGR_G_ImportFromWkb( mGeom, const_cast<unsigned char *>( geom->asWkb() ), ( int ) geom->wkbSize() );
-      if ( err != OGRERR_NONE )
-      {
-        mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
-                        .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
-        mError = ErrFeatureWriteFailed;
-        QgsMessageLog::logMessage( mErrorMessage, QObject::tr( "OGR" ) );
-        OGR_F_Destroy( poFeature );
-        return 0;
-      }
 
-      // set geometry (ownership is not passed to OGR)
-      OGR_F_SetGeometry( poFeature, mGeom );
+    // The geometry is created with the type of the WKB. This also exports features whose
+    // wkbtype is different from the layer's wkbtype, e.g. MultiPolygons in a Polygon layer
+    // (at least in OGR provider). The geometry is parsed once and passed to the feature
+    // without copying it.
+    OGRGeometryH ogrGeom = 0;
+    OGRErr err = OGR_G_CreateFromWkb( const_cast<unsigned char *>( geom->asWkb() ), 0, &ogrGeom, ( int ) geom->wkbSize() );
+    if ( err != OGRERR_NONE || !ogrGeom )
+    {
+      mErrorMessage = QObject::tr( "Feature geometry not imported (OGR error: %1)" )
+                      .arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
+      mError = ErrFeatureWriteFailed;
+      QgsMessageLog::logMessage( mErrorMessage, QObject::tr( "OGR" ) );
+      return false;
     }
+
+    // pass ownership to feature
+    OGR_F_SetGeometryDirectly( poFeature, ogrGeom );
   }
-  return poFeature;
+  return true;
 }
 
 bool QgsVectorFileWriter::writeFeature( OGRLayerH layer, OGRFeatureH feature )
@@ -1759,7 +1749,6 @@ bool QgsVectorFileWriter::writeFeature( OGRLayerH layer, OGRFeatureH feature )
     mErrorMessage = QObject::tr( "Feature creation error (OGR error: %1)" ).arg( QString::fromUtf8( CPLGetLastErrorMsg() ) );
     mError = ErrFeatureWriteFailed;
     QgsMessageLog::logMessage( mErrorMessage, QObject::tr( "OGR" ) );
-    OGR_F_Destroy( feature );
     return false;
   }
   return true;
@@ -1767,9 +1756,9 @@ bool QgsVectorFileWriter::writeFeature( OGRLayerH layer, OGRFeatureH feature )
 
 QgsVectorFileWriter::~QgsVectorFileWriter()
 {
-  if ( mGeom )
+  if ( mFeature )
   {
-    OGR_G_DestroyGeometry( mGeom );
+    OGR_F_Destroy( mFeature );
   }
 
   if ( mDS )
@@ -1778,6 +1767,171 @@ QgsVectorFileWriter::~QgsVectorFileWriter()
   }
 }
 
+//! number of features passed at once from the reading to the writing thread
+#define FEATURE_BLOCK_SIZE 1000
+//! maximum number of blocks waiting to be written
+#define FEATURE_QUEUE_BLOCKS 8
+
+/** Bounded queue passing blocks of features from the thread reading the source layer
+ * to the thread writing them with OGR */
+class QgsVectorFileWriterFeatureQueue
+{
+  public:
+    QgsVectorFileWriterFeatureQueue() : mFinished( false ), mCancelled( false ) {}
+
+    //! adds a block, waits while the queue is full. Returns false if the writer stopped
+    bool push( const QgsFeatureList& block )
+    {
+      QMutexLocker locker( &mMutex );
+      while ( mBlocks.size() >= FEATURE_QUEUE_BLOCKS && !mCancelled )
+      {
+        mNotFull.wait( &mMutex );
+      }
+      if ( mCancelled )
+      {
+        return false;
+      }
+      mBlocks.enqueue( block );
+      mNotEmpty.wakeOne();
+      return true;
+    }
+
+    //! takes the next block, waits while the queue is empty. Returns false if all blocks were taken
+    bool pop( QgsFeatureList& block )
+    {
+      QMutexLocker locker( &mMutex );
+      while ( mBlocks.isEmpty() && !mFinished )
+      {
+        mNotEmpty.wait( &mMutex );
+      }
+      if ( mBlocks.isEmpty() )
+      {
+        return false;
+      }
+      block = mBlocks.dequeue();
+      mNotFull.wakeOne();
+      return true;
+    }
+
+    //! called by the reader when there are no more features
+    void finish()
+    {
+      QMutexLocker locker( &mMutex );
+      mFinished = true;
+      mNotEmpty.wakeAll();
+    }
+
+    //! called by the writer to stop the reader
+    void cancel()
+    {
+      QMutexLocker locker( &mMutex );
+      mCancelled = true;
+      mBlocks.clear();
+      mNotFull.wakeAll();
+    }
+
+  private:
+    QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    QWaitCondition mNotFull;
+    QQueue<QgsFeatureList> mBlocks;
+    bool mFinished;
+    bool mCancelled;
+};
+
+/** Reads, filters and transforms the features of a layer in a separate thread, so that
+ * reading overlaps with encoding and writing the features. A thread of its own is used
+ * instead of the global thread pool, the writer would wait forever for a reader queued
+ * behind busy pool threads. */
+class QgsVectorFileWriterReader : public QThread
+{
+  public:
+    QgsVectorFileWriterReader( QgsVectorLayer* layer, const QgsFeatureRequest& request, QgsVectorFileWriterFeatureQueue* queue )
+        : mSource( new QgsVectorLayerFeatureSource( layer ) )
+        , mRequest( request )
+        , mQueue( queue )
+        , mSelectedIds( 0 )
+        , mTransform( 0 )
+        , mFilterExtent( 0 )
+        , mSkipAttributes( false )
+        , mError( QgsVectorFileWriter::NoError )
+        , mFeatureCount( 0 )
+        , mElapsed( 0 )
+    {}
+
+    ~QgsVectorFileWriterReader() { delete mSource; }
+
+    void run()
+    {
+      QTime t;
+      t.start();
+
+      QgsFeatureIterator fit = mSource->getFeatures( mRequest );
+      QgsFeatureList block;
+      block.reserve( FEATURE_BLOCK_SIZE );
+      QgsFeature fet;
+      while ( fit.nextFeature( fet ) )
+      {
+        if ( mSelectedIds && !mSelectedIds->contains( fet.id() ) )
+          continue;
+
+        if ( mTransform && fet.geometry() )
+        {
+          try
+          {
+            fet.geometry()->transform( *mTransform );
+          }
+          catch ( QgsCsException &e )
+          {
+            mErrorMessage = QObject::tr( "Failed to transform a point while drawing a feature with ID '%1'. Writing stopped. (Exception: %2)" )
+                            .arg( fet.id() ).arg( e.what() );
+            mError = QgsVectorFileWriter::ErrProjection;
+            break;
+          }
+        }
+
+        if ( fet.geometry() && mFilterExtent && !fet.geometry()->intersects( *mFilterExtent ) )
+          continue;
+
+        if ( mSkipAttributes )
+        {
+          fet.initAttributes( 0 );
+        }
+
+        block << fet;
+        ++mFeatureCount;
+        if ( block.size() >= FEATURE_BLOCK_SIZE )
+        {
+          if ( !mQueue->push( block ) )
+          {
+            break;
+          }
+          block.clear();
+        }
+      }
+
+      if ( !block.isEmpty() && mError == QgsVectorFileWriter::NoError )
+      {
+        mQueue->push( block );
+      }
+      mQueue->finish();
+      mElapsed = t.elapsed();
+    }
+
+    QgsVectorLayerFeatureSource* mSource;
+    QgsFeatureRequest mRequest;
+    QgsVectorFileWriterFeatureQueue* mQueue;
+    const QgsFeatureIds* mSelectedIds;
+    const QgsCoordinateTransform* mTransform;
+    const QgsRectangle* mFilterExtent;
+    bool mSkipAttributes;
+
+    QgsVectorFileWriter::WriterError mError;
+    QString mErrorMessage;
+    int mFeatureCount;
+    int mElapsed;
+};
+
 QgsVectorFileWriter::WriterError
 QgsVectorFileWriter::writeAsVectorFormat( QgsVectorLayer* layer,
     const QString& fileName,
@@ -1878,7 +2032,6 @@ QgsVectorFileWriter::WriterError QgsVectorFileWriter::writeAsVectorFormat( QgsVe
   }
 
   QgsAttributeList allAttr = skipAttributeCreation ? QgsAttributeList() : layer->pendingAllAttributesList();
-  QgsFeature fet;
 
   //add possible attributes needed by renderer
   writer->addRendererAttributes( layer, allAttr );
@@ -1889,7 +2042,6 @@ QgsVectorFileWriter::WriterError QgsVectorFileWriter::writeAsVectorFormat( QgsVe
     req.setFlags( QgsFeatureRequest::NoGeometry );
   }
   req.setSubsetOfAttributes( allAttr );
-  QgsFeatureIterator fit = layer->getFeatures( req );
 
   const QgsFeatureIds& ids = layer->selectedFeaturesIds();
 
@@ -1905,6 +2057,7 @@ QgsVectorFileWriter::WriterError QgsVectorFileWriter::writeAsVectorFormat( QgsVe
     if ( r->capabilities() & QgsFeatureRendererV2::SymbolLevels
          && r->usingSymbolLevels() )
     {
+      QgsFeatureIterator fit = layer->getFeatures( req );
       QgsVectorFileWriter::WriterError error = writer->exportFeaturesSymbolLevels( layer, fit, ct, errorMessage );
       delete writer;
       delete ct;
@@ -1923,7 +2076,10 @@ QgsVectorFileWriter::WriterError QgsVectorFileWriter::writeAsVectorFormat( QgsVe
 
   writer->startRender( layer );
 
-  // enabling transaction on databases that support it
+  // enabling transaction on databases that support it. Drivers without transactions accept the
+  // calls as well. Large exports are committed in batches, which bounds the size of the journal.
+  QSettings settings;
+  int transactionSize = settings.value( "/qgis/vectorFileWriterTransactionSize", 100000 ).toInt();
   bool transactionsEnabled = true;
 
   if ( OGRERR_NONE != OGR_L_StartTransaction( writer->mLayer ) )
@@ -1932,71 +2088,72 @@ QgsVectorFileWriter::WriterError QgsVectorFileWriter::writeAsVectorFormat( QgsVe
     transactionsEnabled = false;
   }
 
+  // the features are read in a worker thread, OGR is only used from this thread
+  QgsVectorFileWriterFeatureQueue queue;
+  QgsVectorFileWriterReader reader( layer, req, &queue );
+  reader.mSelectedIds = onlySelected ? &ids : 0;
+  reader.mTransform = shallTransform ? ct : 0;
+  reader.mFilterExtent = filterExtent;
+  reader.mSkipAttributes = allAttr.size() < 1 && skipAttributeCreation;
+  reader.start();
+
+  QTime writeTime;
+  writeTime.start();
+  int writeElapsed = 0;
+  int nTransaction = 0;
+
   // write all features
-  while ( fit.nextFeature( fet ) )
+  QgsFeatureList block;
+  bool stopped = false;
+  while ( !stopped && queue.pop( block ) )
   {
-    if ( onlySelected && !ids.contains( fet.id() ) )
-      continue;
-
-    if ( shallTransform )
+    writeTime.restart();
+    for ( QgsFeatureList::iterator fetIt = block.begin(); fetIt != block.end(); ++fetIt )
     {
-      try
+      if ( !writer->addFeature( *fetIt, layer->rendererV2(), mapUnits ) )
       {
-        if ( fet.geometry() )
+        WriterError err = writer->hasError();
+        if ( err != NoError && errorMessage )
         {
-          fet.geometry()->transform( *ct );
+          if ( errorMessage->isEmpty() )
+          {
+            *errorMessage = QObject::tr( "Feature write errors:" );
+          }
+          *errorMessage += "\n" + writer->errorMessage();
         }
-      }
-      catch ( QgsCsException &e )
-      {
-        delete ct;
-        delete writer;
-
-        QString msg = QObject::tr( "Failed to transform a point while drawing a feature with ID '%1'. Writing stopped. (Exception: %2)" )
-                      .arg( fet.id() ).arg( e.what() );
-        QgsLogger::warning( msg );
-        if ( errorMessage )
-          *errorMessage = msg;
+        errors++;
 
-        return ErrProjection;
-      }
-    }
-
-    if ( fet.geometry() && filterExtent && !fet.geometry()->intersects( *filterExtent ) )
-      continue;
-
-    if ( allAttr.size() < 1 && skipAttributeCreation )
-    {
-      fet.initAttributes( 0 );
-    }
-
-    if ( !writer->addFeature( fet, layer->rendererV2(), mapUnits ) )
-    {
-      WriterError err = writer->hasError();
-      if ( err != NoError && errorMessage )
-      {
-        if ( errorMessage->isEmpty() )
+        if ( errors > 1000 )
         {
-          *errorMessage = QObject::tr( "Feature write errors:" );
+          if ( errorMessage )
+          {
+            *errorMessage += QObject::tr( "Stopping after %1 errors" ).arg( errors );
+          }
+
+          n = -1;
+          stopped = true;
+          break;
         }
-        *errorMessage += "\n" + writer->errorMessage();
       }
-      errors++;
+      n++;
 
-      if ( errors > 1000 )
+      if ( transactionsEnabled && transactionSize > 0 && ++nTransaction >= transactionSize )
       {
-        if ( errorMessage )
+        nTransaction = 0;
+        if ( OGRERR_NONE != OGR_L_CommitTransaction( writer->mLayer ) ||
+             OGRERR_NONE != OGR_L_StartTransaction( writer->mLayer ) )
         {
-          *errorMessage += QObject::tr( "Stopping after %1 errors" ).arg( errors );
+          QgsDebugMsg( "Error while committing transaction on OGRLayer." );
+          transactionsEnabled = false;
         }
-
-        n = -1;
-        break;
       }
     }
-    n++;
+    writeElapsed += writeTime.elapsed();
   }
 
+  queue.cancel();
+  reader.wait();
+
   if ( transactionsEnabled )
   {
     if ( OGRERR_NONE != OGR_L_CommitTransaction( writer->mLayer ) )
@@ -2005,9 +2162,20 @@ QgsVectorFileWriter::WriterError QgsVectorFileWriter::writeAsVectorFormat( QgsVe
     }
   }
 
+  QgsDebugMsg( QString( "read %1 features in %2 ms, wrote %3 features in %4 ms" )
+               .arg( reader.mFeatureCount ).arg( reader.mElapsed ).arg( n ).arg( writeElapsed ) );
+
   writer->stopRender( layer );
   delete writer;
 
+  if ( reader.mError != NoError )
+  {
+    QgsLogger::warning( reader.mErrorMessage );
+    if ( errorMessage )
+      *errorMessage = reader.mErrorMessage;
+    return reader.mError;
+  }
+
   if ( errors > 0 && errorMessage && n > 0 )
   {
     *errorMessage += QObject::tr( "\nOnly %1 of %2 features written." ).arg( n - errors ).arg( n );
@@ -274,12 +274,10 @@ class CORE_EXPORT QgsVectorFileWriter
     static bool driverMetadata( const QString& driverName, MetaData& driverMetadata );
 
   protected:
-    //! @note not available in python bindings
-    OGRGeometryH createEmptyGeometry( QGis::WkbType wkbType );
-
     OGRDataSourceH mDS;
     OGRLayerH mLayer;
-    OGRGeometryH mGeom;
+    //! feature reused by addFeature()
+    OGRFeatureH mFeature;
 
     QgsFields mFields;
 
@@ -312,6 +310,9 @@ class CORE_EXPORT QgsVectorFileWriter
     static bool driverMetadata( QString driverName, QString &longName, QString &trLongName, QString &glob, QString &ext );
     void createSymbolLayerTable( QgsVectorLayer* vl,  const QgsCoordinateTransform* ct, OGRDataSourceH ds );
     OGRFeatureH createFeature( QgsFeature& feature );
+    /**Sets the attributes and the geometry of an OGR feature, which may be reused*/
+    bool fillFeature( QgsFeature& feature, OGRFeatureH poFeature );
+    /**Adds the feature to the layer, the feature is still owned by the caller*/
     bool writeFeature( OGRLayerH layer, OGRFeatureH feature );
 
     /**Writes features considering symbol level order*/
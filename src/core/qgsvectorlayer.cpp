@@ -30,8 +30,11 @@
 #include <QProgressDialog>
 #include <QSettings>
 #include <QString>
+#include <QAtomicInt>
 #include <QDomNode>
+#include <QFutureWatcher>
 #include <QVector>
+#include <QtConcurrentRun>
 
 #include "qgsvectorlayer.h"
 
@@ -139,6 +142,7 @@ QgsVectorLayer::QgsVectorLayer( QString vectorLayerPath,
     , mValidExtent( false )
     , mLazyExtent( true )
     , mSymbolFeatureCounted( false )
+    , mSymbolFeatureCountWatcher( 0 )
 
 {
   mActions = new QgsAttributeAction( this );
@@ -196,6 +200,8 @@ QgsVectorLayer::~QgsVectorLayer()
 
   mValid = false;
 
+  cancelSymbolFeatureCount();
+
   delete mDataProvider;
   delete mEditBuffer;
   delete mJoinBuffer;
@@ -737,6 +743,7 @@ long QgsVectorLayer::featureCount( QgsSymbolV2* symbol )
 bool QgsVectorLayer::countSymbolFeatures( bool showProgress )
 {
   if ( mSymbolFeatureCounted ) return true;
+  invalidateSymbolCountedFlag();
   mSymbolFeatureCountMap.clear();
 
   if ( !mDataProvider )
@@ -804,6 +811,91 @@ bool QgsVectorLayer::countSymbolFeatures( bool showProgress )
   return true;
 }
 
+//! counts the features for each legend symbol of a renderer until canceled is set, the source and the renderer are deleted afterwards
+static QList<long> countSymbolFeaturesInThread( QgsAbstractFeatureSource* source, QgsFeatureRendererV2* renderer, QgsFields fields, QSharedPointer<QAtomicInt> canceled )
+{
+  QgsLegendSymbolList symbolList = renderer->legendSymbolItems();
+  QHash<QgsSymbolV2*, int> symbolIndex;
+  QList<long> counts;
+  for ( int i = 0; i < symbolList.size(); ++i )
+  {
+    symbolIndex.insert( symbolList[i].second, i );
+    counts << 0;
+  }
+
+  QgsFeatureIterator fit = source->getFeatures( QgsFeatureRequest().setFlags( QgsFeatureRequest::NoGeometry ) );
+
+  // Renderer (rule based) may depend on context scale, with scale is ignored if 0
+  QgsRenderContext renderContext;
+  renderContext.setRendererScale( 0 );
+  renderer->startRender( renderContext, fields );
+
+  QgsFeature f;
+  while ( *canceled == 0 && fit.nextFeature( f ) )
+  {
+    foreach ( QgsSymbolV2* symbol, renderer->symbolsForFeature( f ) )
+    {
+      int index = symbolIndex.value( symbol, -1 );
+      if ( index >= 0 )
+        counts[index] += 1;
+    }
+  }
+  renderer->stopRender( renderContext );
+  fit.close();
+
+  delete renderer;
+  delete source;
+  return counts;
+}
+
+void QgsVectorLayer::countSymbolFeaturesInBackground()
+{
+  if ( mSymbolFeatureCounted || mSymbolFeatureCountWatcher )
+    return;
+
+  if ( !mDataProvider )
+  {
+    QgsDebugMsg( "invoked with null mDataProvider" );
+    return;
+  }
+  if ( !mRendererV2 )
+  {
+    QgsDebugMsg( "invoked with null mRendererV2" );
+    return;
+  }
+
+  // the thread works on a snapshot of the layer and a copy of the renderer
+  mSymbolFeatureCountCanceled = QSharedPointer<QAtomicInt>( new QAtomicInt( 0 ) );
+  mSymbolFeatureCountWatcher = new QFutureWatcher< QList<long> >( this );
+  connect( mSymbolFeatureCountWatcher, SIGNAL( finished() ), this, SLOT( symbolFeatureCountFinished() ) );
+  mSymbolFeatureCountWatcher->setFuture( QtConcurrent::run( countSymbolFeaturesInThread, new QgsVectorLayerFeatureSource( this ), mRendererV2->clone(), pendingFields(), mSymbolFeatureCountCanceled ) );
+}
+
+void QgsVectorLayer::symbolFeatureCountFinished()
+{
+  QList<long> counts = mSymbolFeatureCountWatcher->result();
+  mSymbolFeatureCountWatcher->deleteLater();
+  mSymbolFeatureCountWatcher = 0;
+  mSymbolFeatureCountCanceled.clear();
+
+  // the copy of the renderer has its symbols in the same order
+  QgsLegendSymbolList symbolList = mRendererV2->legendSymbolItems();
+  if ( symbolList.size() != counts.size() )
+  {
+    QgsDebugMsg( "legend symbols of the renderer copy differ" );
+    return;
+  }
+
+  mSymbolFeatureCountMap.clear();
+  for ( int i = 0; i < symbolList.size(); ++i )
+  {
+    mSymbolFeatureCountMap.insert( symbolList[i].second, counts[i] );
+  }
+  mSymbolFeatureCounted = true;
+
+  emit symbolFeatureCountMapChanged();
+}
+
 void QgsVectorLayer::updateExtents()
 {
   mValidExtent = false;
@@ -1355,6 +1447,9 @@ bool QgsVectorLayer::setDataProvider( QString const & provider )
       // TODO: Check if the provider has the capability to send fullExtentCalculated
       connect( mDataProvider, SIGNAL( fullExtentCalculated() ), this, SLOT( updateExtents() ) );
 
+      // providers loading features asynchronously notify about new data
+      connect( mDataProvider, SIGNAL( dataChanged() ), this, SIGNAL( repaintRequested() ) );
+
       // get and store the feature type
       mWkbType = mDataProvider->geometryType();
 
@@ -2548,15 +2643,21 @@ int QgsVectorLayer::snapWithContext( const QgsPoint& startPoint, double snapping
 
   if ( mCache->cachedGeometriesRect().contains( searchRect ) )
   {
+    // only the segments near the point are tested, they are ordered by feature
     QgsGeometryMap& cachedGeometries = mCache->cachedGeometries();
-    for ( QgsGeometryMap::iterator it = cachedGeometries.begin(); it != cachedGeometries.end() ; ++it )
+    QList<QgsGeometryCache::Segment> segments = mCache->intersectingSegments( searchRect );
+    int first = 0;
+    while ( first < segments.size() )
     {
-      QgsGeometry* g = &( it.value() );
-      if ( g->boundingBox().intersects( searchRect ) )
-      {
-        snapToGeometry( startPoint, it.key(), g, sqrSnappingTolerance, snappingResults, snap_to );
-        ++n;
-      }
+      QgsFeatureId fid = segments[first].featureId;
+      int last = first + 1;
+      while ( last < segments.size() && segments[last].featureId == fid )
+        ++last;
+
+      snapToSegments( startPoint, &cachedGeometries[fid], segments.mid( first, last - first ),
+                      sqrSnappingTolerance, snappingResults, snap_to );
+      ++n;
+      first = last;
     }
   }
   else
@@ -2641,6 +2742,101 @@ void QgsVectorLayer::snapToGeometry( const QgsPoint& startPoint,
   }
 }
 
+void QgsVectorLayer::snapToSegments( const QgsPoint& startPoint,
+                                     QgsGeometry* geom,
+                                     const QList<QgsGeometryCacheSegment>& segments,
+                                     double sqrSnappingTolerance,
+                                     QMultiMap<double, QgsSnappingResult>& snappingResults,
+                                     QgsSnapper::SnappingType snap_to ) const
+{
+  if ( !geom || segments.isEmpty() )
+  {
+    return;
+  }
+
+  QgsSnappingResult snappingResult;
+  snappingResult.snappedAtGeometry = segments.first().featureId;
+  snappingResult.layer = this;
+  bool points = geometryType() == QGis::Point;
+
+  if ( snap_to == QgsSnapper::SnapToVertex || snap_to == QgsSnapper::SnapToVertexAndSegment )
+  {
+    // both ends of the segments, in the order of the vertices like QgsGeometry::closestVertex
+    int atVertex = -1;
+    double sqrDistVertexSnap = std::numeric_limits<double>::max();
+    foreach ( const QgsGeometryCache::Segment& segment, segments )
+    {
+      double dist;
+      if ( !points )
+      {
+        dist = startPoint.sqrDist( segment.from );
+        if ( dist < sqrDistVertexSnap )
+        {
+          sqrDistVertexSnap = dist;
+          atVertex = segment.vertex - 1;
+          snappingResult.snappedVertex = segment.from;
+        }
+      }
+      dist = startPoint.sqrDist( segment.to );
+      if ( dist < sqrDistVertexSnap )
+      {
+        sqrDistVertexSnap = dist;
+        atVertex = segment.vertex;
+        snappingResult.snappedVertex = segment.to;
+      }
+    }
+
+    if ( sqrDistVertexSnap < sqrSnappingTolerance )
+    {
+      int beforeVertex, afterVertex;
+      geom->adjacentVertices( atVertex, beforeVertex, afterVertex );
+      snappingResult.snappedVertexNr = atVertex;
+      snappingResult.beforeVertexNr = beforeVertex;
+      if ( beforeVertex != -1 ) // make sure the vertex is valid
+      {
+        snappingResult.beforeVertex = geom->vertexAt( beforeVertex );
+      }
+      snappingResult.afterVertexNr = afterVertex;
+      if ( afterVertex != -1 ) // make sure the vertex is valid
+      {
+        snappingResult.afterVertex = geom->vertexAt( afterVertex );
+      }
+      snappingResults.insert( sqrt( sqrDistVertexSnap ), snappingResult );
+      return;
+    }
+  }
+  if ( snap_to == QgsSnapper::SnapToSegment || snap_to == QgsSnapper::SnapToVertexAndSegment ) // snap to segment
+  {
+    if ( !points ) // cannot snap to segment for points/multipoints
+    {
+      double epsilon = crs().geographicFlag() ? 1e-12 : 1e-8;
+      double sqrDistSegmentSnap = std::numeric_limits<double>::max();
+      const QgsGeometryCache::Segment* closest = 0;
+      foreach ( const QgsGeometryCache::Segment& segment, segments )
+      {
+        QgsPoint pointOnSegment;
+        double dist = startPoint.sqrDistToSegment( segment.from.x(), segment.from.y(), segment.to.x(), segment.to.y(), pointOnSegment, epsilon );
+        if ( dist < sqrDistSegmentSnap )
+        {
+          sqrDistSegmentSnap = dist;
+          closest = &segment;
+          snappingResult.snappedVertex = pointOnSegment;
+        }
+      }
+
+      if ( closest && sqrDistSegmentSnap < sqrSnappingTolerance )
+      {
+        snappingResult.snappedVertexNr = -1;
+        snappingResult.beforeVertexNr = closest->vertex - 1;
+        snappingResult.afterVertexNr = closest->vertex;
+        snappingResult.beforeVertex = closest->from;
+        snappingResult.afterVertex = closest->to;
+        snappingResults.insert( sqrt( sqrDistSegmentSnap ), snappingResult );
+      }
+    }
+  }
+}
+
 int QgsVectorLayer::insertSegmentVerticesForSnap( const QList<QgsSnappingResult>& snapResults )
 {
   QgsVectorLayerEditUtils utils( this );
@@ -2882,7 +3078,7 @@ void QgsVectorLayer::setRendererV2( QgsFeatureRendererV2 *r )
   {
     delete mRendererV2;
     mRendererV2 = r;
-    mSymbolFeatureCounted = false;
+    invalidateSymbolCountedFlag();
     mSymbolFeatureCountMap.clear();
 
     emit rendererChanged();
@@ -3688,6 +3884,21 @@ QString QgsVectorLayer::metadata()
 void QgsVectorLayer::invalidateSymbolCountedFlag()
 {
   mSymbolFeatureCounted = false;
+
+  cancelSymbolFeatureCount();
+}
+
+void QgsVectorLayer::cancelSymbolFeatureCount()
+{
+  if ( !mSymbolFeatureCountWatcher )
+    return;
+
+  // the thread stops at the next feature, its result is dropped
+  mSymbolFeatureCountCanceled->fetchAndStoreOrdered( 1 );
+  mSymbolFeatureCountCanceled.clear();
+  mSymbolFeatureCountWatcher->disconnect( this );
+  mSymbolFeatureCountWatcher->deleteLater();
+  mSymbolFeatureCountWatcher = 0;
 }
 
 void QgsVectorLayer::onRelationsLoaded()
@@ -21,6 +21,7 @@
 #include <QMap>
 #include <QSet>
 #include <QList>
+#include <QSharedPointer>
 #include <QStringList>
 
 #include "qgis.h"
@@ -36,6 +37,8 @@
 
 class QPainter;
 class QImage;
+class QAtomicInt;
+template <typename T> class QFutureWatcher;
 
 class QgsAttributeAction;
 class QgsCoordinateTransform;
@@ -56,6 +59,7 @@ class QgsFeatureRendererV2;
 class QgsDiagramRendererV2;
 class QgsDiagramLayerSettings;
 class QgsGeometryCache;
+struct QgsGeometryCacheSegment;
 class QgsVectorLayerEditBuffer;
 class QgsSymbolV2;
 class QgsAbstractGeometrySimplifier;
@@ -423,6 +427,13 @@ struct CORE_EXPORT QgsVectorJoinInfo
  *
  *   Determines whether the provider generates a spatial index.  The default is no.
  *
+ * -persistIndex=(yes|no)
+ *
+ *   Determines whether the results of scanning the file (extents, field types,
+ *   record positions and the subset and spatial indexes) are saved in a .dtidx
+ *   file alongside it, and reused while the file and the uri are unchanged.
+ *   The default is no.
+ *
  * -watchFile=(yes|no)
  *
  *   Defines whether the file will be monitored for changes. The default is
@@ -843,6 +854,14 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
      */
     bool countSymbolFeatures( bool showProgress = true );
 
+    /**
+     * Count features for symbols in a background thread. featureCount( QgsSymbolV2* ) returns -1
+     * until the counts are available, then symbolFeatureCountMapChanged() is emitted.
+     * Nothing is done if the counts are available or being calculated.
+     * @note added in 2.4
+     */
+    void countSymbolFeaturesInBackground();
+
     /**
      * Set the string (typically sql) used to define a subset of the layer
      * @param subset The subset string. This may be the where clause of a sql statement
@@ -1443,6 +1462,7 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
 
   protected slots:
     void invalidateSymbolCountedFlag();
+    void symbolFeatureCountFinished();
 
   signals:
 
@@ -1524,6 +1544,12 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     /** Signal emitted on symbology changes, when setRendererV2() is called */
     void rendererChanged();
 
+    /**
+     * Is emitted when the feature counts for symbols calculated by countSymbolFeaturesInBackground() are available
+     * @note added in 2.4
+     */
+    void symbolFeatureCountMapChanged();
+
     /** Signal emitted when setFeatureBlendMode() is called */
     void featureBlendModeChanged( const QPainter::CompositionMode &blendMode );
 
@@ -1590,12 +1616,31 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
                          QMultiMap<double, QgsSnappingResult>& snappingResults,
                          QgsSnapper::SnappingType snap_to ) const;
 
+    /**Snaps to the segments of a geometry found in the segment index of the geometry cache,
+     like snapToGeometry but without looking at the other vertices of the geometry
+     @param startPoint start point of the snap
+     @param geom geometry to snap
+     @param segments segments of the geometry near the start point ordered by vertex
+     @param sqrSnappingTolerance squared search tolerance of the snap
+     @param snappingResults list to which the result is appended
+     @param snap_to snap to vertex or to segment
+    */
+    void snapToSegments( const QgsPoint& startPoint,
+                         QgsGeometry* geom,
+                         const QList<QgsGeometryCacheSegment>& segments,
+                         double sqrSnappingTolerance,
+                         QMultiMap<double, QgsSnappingResult>& snappingResults,
+                         QgsSnapper::SnappingType snap_to ) const;
+
     /** Add joined attributes to a feature */
     //void addJoinedAttributes( QgsFeature& f, bool all = false );
 
     /** Read labeling from SLD */
     void readSldLabeling( const QDomNode& node );
 
+    /** Stops a running countSymbolFeaturesInBackground() and drops its result */
+    void cancelSymbolFeatureCount();
+
   private:                       // Private attributes
 
     /** Pointer to data provider derived from the abastract base class QgsDataProvider */
@@ -1724,6 +1769,12 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     // Feature counts for each renderer symbol
     QMap<QgsSymbolV2*, long> mSymbolFeatureCountMap;
 
+    // Watches the counting of countSymbolFeaturesInBackground(), 0 if not counting
+    QFutureWatcher< QList<long> >* mSymbolFeatureCountWatcher;
+
+    // Set to stop the counting watched by mSymbolFeatureCountWatcher, shared with the counting thread
+    QSharedPointer<QAtomicInt> mSymbolFeatureCountCanceled;
+
     friend class QgsVectorLayerFeatureSource;
 };
 
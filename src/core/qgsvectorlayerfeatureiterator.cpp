@@ -22,6 +22,11 @@
 #include "qgsgeometrysimplifier.h"
 #include "qgssimplifymethod.h"
 
+//! joined layers with more features are not indexed completely by the feature iterator
+#define JOIN_INDEX_MAX_FEATURES 1000000
+//! maximum number of join values remembered for joined layers which are not indexed completely
+#define JOIN_LOOKUP_CACHE_SIZE 10000
+
 
 QgsVectorLayerFeatureSource::QgsVectorLayerFeatureSource( QgsVectorLayer *layer )
 {
@@ -449,6 +454,8 @@ void QgsVectorLayerFeatureIterator::prepareJoins()
       FetchJoinInfo info;
       info.joinInfo = joinInfo;
       info.joinLayer = joinLayer;
+      info.indexBuilt = false;
+      info.indexComplete = false;
 
       if ( joinInfo->targetFieldName.isEmpty() )
         info.targetField = joinInfo->targetFieldIndex;    //for compatibility with 1.x
@@ -486,10 +493,10 @@ void QgsVectorLayerFeatureIterator::addJoinedAttributes( QgsFeature &f )
   // make sure we have space for newly added attributes
   f.attributes().resize( mSource->mFields.count() );  // f.attributes().count() + mJoinedAttributesCount );
 
-  QMap<QgsVectorLayer*, FetchJoinInfo>::const_iterator joinIt = mFetchJoinInfo.constBegin();
-  for ( ; joinIt != mFetchJoinInfo.constEnd(); ++joinIt )
+  QMap<QgsVectorLayer*, FetchJoinInfo>::iterator joinIt = mFetchJoinInfo.begin();
+  for ( ; joinIt != mFetchJoinInfo.end(); ++joinIt )
   {
-    const FetchJoinInfo& info = joinIt.value();
+    FetchJoinInfo& info = joinIt.value();
     Q_ASSERT( joinIt.key() );
 
     QVariant targetFieldValue = f.attribute( info.targetField );
@@ -497,10 +504,12 @@ void QgsVectorLayerFeatureIterator::addJoinedAttributes( QgsFeature &f )
       continue;
 
     const QHash< QString, QgsAttributes>& memoryCache = info.joinInfo->cachedAttributes;
-    if ( memoryCache.isEmpty() )
-      info.addJoinedAttributesDirect( f, targetFieldValue );
-    else
+    if ( !memoryCache.isEmpty() )
       info.addJoinedAttributesCached( f, targetFieldValue );
+    else if ( mRequest.filterType() == QgsFeatureRequest::FilterFid )
+      info.addJoinedAttributesDirect( f, targetFieldValue ); // a single feature is not worth indexing the joined layer
+    else
+      info.addJoinedAttributesIndexed( f, targetFieldValue );
   }
 }
 
@@ -549,22 +558,76 @@ void QgsVectorLayerFeatureIterator::FetchJoinInfo::addJoinedAttributesCached( Qg
   if ( it == memoryCache.constEnd() )
     return; // joined value not found -> leaving the attributes empty (null)
 
-  int index = indexOffset;
+  setJoinedAttributes( f, it.value() );
+}
 
-  const QgsAttributes& featureAttributes = it.value();
-  for ( int i = 0; i < featureAttributes.count(); ++i )
-  {
-    // skip the join field to avoid double field names (fields often have the same name)
-    if ( i == joinField )
-      continue;
 
-    f.setAttribute( index++, featureAttributes[i] );
+
+void QgsVectorLayerFeatureIterator::FetchJoinInfo::addJoinedAttributesDirect( QgsFeature& f, const QVariant& joinValue ) const
+{
+  setJoinedAttributes( f, fetchJoinedAttributes( joinValue ) );
+}
+
+
+void QgsVectorLayerFeatureIterator::FetchJoinInfo::addJoinedAttributesIndexed( QgsFeature& f, const QVariant& joinValue )
+{
+  if ( !indexBuilt )
+    buildIndex();
+
+  QString key = joinValue.toString();
+  QHash<QString, QgsAttributes>::const_iterator it = joinIndex.constFind( key );
+  if ( it != joinIndex.constEnd() )
+  {
+    setJoinedAttributes( f, it.value() );
+    return;
   }
+
+  if ( indexComplete )
+    return; // joined value not found -> leaving the attributes empty (null)
+
+  // joined layer too large to be indexed: query it and remember the result (also if there is no match)
+  if ( joinIndex.size() >= JOIN_LOOKUP_CACHE_SIZE )
+    joinIndex.clear();
+
+  QgsAttributes joinAttributes = fetchJoinedAttributes( joinValue );
+  joinIndex.insert( key, joinAttributes );
+  setJoinedAttributes( f, joinAttributes );
 }
 
 
+void QgsVectorLayerFeatureIterator::FetchJoinInfo::buildIndex()
+{
+  indexBuilt = true;
+  indexComplete = false;
+  joinIndex.clear();
 
-void QgsVectorLayerFeatureIterator::FetchJoinInfo::addJoinedAttributesDirect( QgsFeature& f, const QVariant& joinValue ) const
+  if ( joinField < 0 || joinLayer->pendingFeatureCount() > JOIN_INDEX_MAX_FEATURES )
+    return;
+
+  // one pass over the joined layer instead of one query per feature
+  QgsAttributeList fetchAttributes = attributes;
+  if ( !fetchAttributes.contains( joinField ) )
+    fetchAttributes << joinField;
+
+  QgsFeatureRequest request;
+  request.setFlags( QgsFeatureRequest::NoGeometry );
+  request.setSubsetOfAttributes( fetchAttributes );
+  QgsFeatureIterator fi = joinLayer->getFeatures( request );
+
+  QgsFeature fet;
+  while ( fi.nextFeature( fet ) )
+  {
+    const QgsAttributes& attr = fet.attributes();
+    QString key = attr.value( joinField ).toString();
+    if ( !joinIndex.contains( key ) ) // the first matching feature wins, as with the direct query
+      joinIndex.insert( key, attr );
+  }
+
+  indexComplete = true;
+}
+
+
+QgsAttributes QgsVectorLayerFeatureIterator::FetchJoinInfo::fetchJoinedAttributes( const QVariant& joinValue ) const
 {
   // no memory cache, query the joined values by setting substring
   QString subsetString = joinLayer->dataProvider()->subsetString(); // provider might already have a subset string
@@ -614,18 +677,11 @@ void QgsVectorLayerFeatureIterator::FetchJoinInfo::addJoinedAttributesDirect( Qg
   QgsFeatureIterator fi = joinLayer->getFeatures( request );
 
   // get first feature
+  QgsAttributes joinAttributes;
   QgsFeature fet;
   if ( fi.nextFeature( fet ) )
   {
-    int index = indexOffset;
-    const QgsAttributes& attr = fet.attributes();
-    for ( int i = 0; i < attr.count(); ++i )
-    {
-      if ( i == joinField )
-        continue;
-
-      f.setAttribute( index++, attr[i] );
-    }
+    joinAttributes = fet.attributes();
   }
   else
   {
@@ -633,6 +689,21 @@ void QgsVectorLayerFeatureIterator::FetchJoinInfo::addJoinedAttributesDirect( Qg
   }
 
   joinLayer->dataProvider()->setSubsetString( bkSubsetString, false );
+  return joinAttributes;
+}
+
+
+void QgsVectorLayerFeatureIterator::FetchJoinInfo::setJoinedAttributes( QgsFeature& f, const QgsAttributes& joinAttributes ) const
+{
+  int index = indexOffset;
+  for ( int i = 0; i < joinAttributes.count(); ++i )
+  {
+    // skip the join field to avoid double field names (fields often have the same name)
+    if ( i == joinField )
+      continue;
+
+    f.setAttribute( index++, joinAttributes[i] );
+  }
 }
 
 
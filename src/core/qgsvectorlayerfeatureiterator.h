@@ -129,9 +129,21 @@ class CORE_EXPORT QgsVectorLayerFeatureIterator : public QgsAbstractFeatureItera
       QgsVectorLayer* joinLayer;        //!< resolved pointer to the joined layer
       int targetField;                  //!< index of field (of this layer) that drives the join
       int joinField;                    //!< index of field (of the joined layer) must have equal value
+      bool indexBuilt;                  //!< whether buildIndex() has been called
+      bool indexComplete;               //!< whether joinIndex contains all features of the joined layer
+      QHash< QString, QgsAttributes > joinIndex; //!< attributes of the joined layer by join value (empty attributes if no match)
 
       void addJoinedAttributesCached( QgsFeature& f, const QVariant& joinValue ) const;
       void addJoinedAttributesDirect( QgsFeature& f, const QVariant& joinValue ) const;
+      void addJoinedAttributesIndexed( QgsFeature& f, const QVariant& joinValue );
+
+      //! reads the join value and requested attributes of all features of the joined layer
+      //! into joinIndex, if the layer is not too large to be held in memory
+      void buildIndex();
+      //! queries the joined layer for the feature matching the join value
+      QgsAttributes fetchJoinedAttributes( const QVariant& joinValue ) const;
+      //! copies attributes of a feature of the joined layer to the joined fields of f
+      void setJoinedAttributes( QgsFeature& f, const QgsAttributes& joinAttributes ) const;
     };
 
     /** Informations about joins used in the current select() statement.
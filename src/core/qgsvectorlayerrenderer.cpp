@@ -4,6 +4,7 @@
 //#include "qgsfeatureiterator.h"
 #include "diagram/qgsdiagram.h"
 #include "qgsdiagramrendererv2.h"
+#include "qgsgeometry.h"
 #include "qgsgeometrycache.h"
 #include "qgsmessagelog.h"
 #include "qgspallabeling.h"
@@ -65,6 +66,8 @@ QgsVectorLayerRenderer::QgsVectorLayerRenderer( QgsVectorLayer* layer, QgsRender
 
   mVertexMarkerSize = settings.value( "/qgis/digitizing/marker_size", 3 ).toInt();
 
+  mSymbolLevelsMemory = ( qint64 ) settings.value( "/qgis/symbol_levels_memory", 64 ).toInt() * 1024 * 1024;
+
   if ( !mRendererV2 )
     return;
 
@@ -176,7 +179,7 @@ bool QgsVectorLayerRenderer::render()
   QgsFeatureIterator fit = mSource->getFeatures( featureRequest );
 
   if (( mRendererV2->capabilities() & QgsFeatureRendererV2::SymbolLevels ) && mRendererV2->usingSymbolLevels() )
-    drawRendererV2Levels( fit );
+    drawRendererV2Levels( fit, featureRequest );
   else
     drawRendererV2( fit );
 
@@ -261,9 +264,23 @@ void QgsVectorLayerRenderer::drawRendererV2( QgsFeatureIterator& fit )
   stopRendererV2( NULL );
 }
 
-void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
+// Approximate memory used by a feature
+static int featureMemorySize( const QgsFeature& feature )
+{
+  int size = sizeof( QgsFeature ) + feature.attributes().size() * sizeof( QVariant );
+  if ( feature.geometry() )
+  {
+    size += sizeof( QgsGeometry ) + feature.geometry()->wkbSize();
+  }
+  return size;
+}
+
+void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit, const QgsFeatureRequest& request )
 {
   QHash< QgsSymbolV2*, QList<QgsFeature> > features; // key = symbol, value = array of features
+  // features which did not fit into memory, they are fetched again when drawing
+  QHash< QgsSymbolV2*, QgsFeatureIds > spilledFeatures;
+  qint64 memoryUsed = 0;
 
   QgsSingleSymbolRendererV2* selRenderer = NULL;
   if ( !mSelectedFeatureIds.isEmpty() )
@@ -294,11 +311,15 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
       continue;
     }
 
-    if ( !features.contains( sym ) )
+    if ( memoryUsed < mSymbolLevelsMemory )
     {
-      features.insert( sym, QList<QgsFeature>() );
+      memoryUsed += featureMemorySize( fet );
+      features[sym].append( fet );
+    }
+    else
+    {
+      spilledFeatures[sym].insert( fet.id() );
     }
-    features[sym].append( fet );
 
     if ( mCache )
     {
@@ -319,6 +340,12 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
     }
   }
 
+  if ( !spilledFeatures.isEmpty() )
+  {
+    QgsDebugMsg( QString( "symbol levels: %1 bytes of features kept in memory, features of %2 symbols are fetched again" )
+                 .arg( memoryUsed ).arg( spilledFeatures.count() ) );
+  }
+
   // find out the order
   QgsSymbolV2LevelOrder levels;
   QgsSymbolV2List symbols = mRendererV2->symbols();
@@ -344,7 +371,8 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
     for ( int i = 0; i < level.count(); i++ )
     {
       QgsSymbolV2LevelItem& item = level[i];
-      if ( !features.contains( item.symbol() ) )
+      QHash< QgsSymbolV2*, QgsFeatureIds >::const_iterator spilledIt = spilledFeatures.constFind( item.symbol() );
+      if ( !features.contains( item.symbol() ) && spilledIt == spilledFeatures.constEnd() )
       {
         QgsDebugMsg( "level item's symbol not found!" );
         continue;
@@ -360,19 +388,28 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
           return;
         }
 
-        bool sel = mSelectedFeatureIds.contains( fit->id() );
-        // maybe vertex markers should be drawn only during the last pass...
-        bool drawMarker = ( mDrawVertexMarkers && mContext.drawEditingInformation() && ( !mVertexMarkerOnlyForSelection || sel ) );
+        drawLevelFeature( *fit, layer );
+      }
+
+      if ( spilledIt == spilledFeatures.constEnd() )
+        continue;
 
-        try
+      // the original request is run again and the ids are filtered here: most providers
+      // implement a request for a set of ids as a scan of the whole layer
+      const QgsFeatureIds& spilledIds = spilledIt.value();
+      QgsFeatureIterator spilledFit = mSource->getFeatures( request );
+      QgsFeature spilledFeature;
+      while ( spilledFit.nextFeature( spilledFeature ) )
+      {
+        if ( mContext.renderingStopped() )
         {
-          mRendererV2->renderFeature( *fit, mContext, layer, sel, drawMarker );
+          stopRendererV2( selRenderer );
+          return;
         }
-        catch ( const QgsCsException &cse )
+
+        if ( spilledIds.contains( spilledFeature.id() ) )
         {
-          Q_UNUSED( cse );
-          QgsDebugMsg( QString( "Failed to transform a point while drawing a feature with ID '%1'. Ignoring this feature. %2" )
-                       .arg( fet.id() ).arg( cse.what() ) );
+          drawLevelFeature( spilledFeature, layer );
         }
       }
     }
@@ -382,6 +419,25 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
 }
 
 
+void QgsVectorLayerRenderer::drawLevelFeature( QgsFeature& feature, int layer )
+{
+  bool sel = mSelectedFeatureIds.contains( feature.id() );
+  // maybe vertex markers should be drawn only during the last pass...
+  bool drawMarker = ( mDrawVertexMarkers && mContext.drawEditingInformation() && ( !mVertexMarkerOnlyForSelection || sel ) );
+
+  try
+  {
+    mRendererV2->renderFeature( feature, mContext, layer, sel, drawMarker );
+  }
+  catch ( const QgsCsException &cse )
+  {
+    Q_UNUSED( cse );
+    QgsDebugMsg( QString( "Failed to transform a point while drawing a feature with ID '%1'. Ignoring this feature. %2" )
+                 .arg( feature.id() ).arg( cse.what() ) );
+  }
+}
+
+
 void QgsVectorLayerRenderer::stopRendererV2( QgsSingleSymbolRendererV2* selRenderer )
 {
   mRendererV2->stopRender( mContext );
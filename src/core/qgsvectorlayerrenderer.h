@@ -52,9 +52,13 @@ class QgsVectorLayerRenderer : public QgsMapLayerRenderer
      */
     void drawRendererV2( QgsFeatureIterator& fit );
 
-    /** Draw layer with renderer V2 using symbol levels. QgsFeatureRenderer::startRender() needs to be called before using this method
+    /** Draw layer with renderer V2 using symbol levels. QgsFeatureRenderer::startRender() needs to be called before using this method.
+     * Features are kept in memory up to mSymbolLevelsMemory bytes, the remaining ones are fetched again with the request for each level.
      */
-    void drawRendererV2Levels( QgsFeatureIterator& fit );
+    void drawRendererV2Levels( QgsFeatureIterator& fit, const QgsFeatureRequest& request );
+
+    /** Draw a symbol layer of a feature during rendering with symbol levels */
+    void drawLevelFeature( QgsFeature& feature, int layer );
 
     /** Stop version 2 renderer and selected renderer (if required) */
     void stopRendererV2( QgsSingleSymbolRendererV2* selRenderer );
@@ -91,6 +95,9 @@ class QgsVectorLayerRenderer : public QgsMapLayerRenderer
 
     QgsVectorSimplifyMethod mSimplifyMethod;
     bool mSimplifyGeometry;
+
+    //! maximum memory used for features kept for rendering with symbol levels
+    qint64 mSymbolLevelsMemory;
 };
 
 
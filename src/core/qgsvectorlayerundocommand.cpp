@@ -70,6 +70,7 @@ void QgsVectorLayerUndoCommandAddFeature::redo()
 
 QgsVectorLayerUndoCommandDeleteFeature::QgsVectorLayerUndoCommandDeleteFeature( QgsVectorLayerEditBuffer* buffer, QgsFeatureId fid )
     : QgsVectorLayerUndoCommand( buffer )
+    , mWasCached( false )
 {
   mFid = fid;
 
@@ -92,6 +93,9 @@ void QgsVectorLayerUndoCommandDeleteFeature::undo()
     mBuffer->mDeletedFeatureIds.remove( mFid );
   }
 
+  if ( mWasCached )
+    cache()->cacheGeometry( mFid, mOldCachedGeom );
+
   emit mBuffer->featureAdded( mFid );
 }
 
@@ -106,6 +110,11 @@ void QgsVectorLayerUndoCommandDeleteFeature::redo()
     mBuffer->mDeletedFeatureIds.insert( mFid );
   }
 
+  // deleted features are not snapped to
+  mWasCached = cache()->geometry( mFid, mOldCachedGeom );
+  if ( mWasCached )
+    cache()->removeGeometry( mFid );
+
   emit mBuffer->featureDeleted( mFid );
 }
 
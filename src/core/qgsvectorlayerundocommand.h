@@ -74,6 +74,9 @@ class CORE_EXPORT QgsVectorLayerUndoCommandDeleteFeature : public QgsVectorLayer
   private:
     QgsFeatureId mFid;
     QgsFeature mOldAddedFeature;
+    //! the cached geometry of the feature, put back into the cache on undo
+    QgsGeometry mOldCachedGeom;
+    bool mWasCached;
 };
 
 
@@ -0,0 +1,85 @@
+/***************************************************************************
+    qgsmarkerstampcache.cpp
+    ---------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsmarkerstampcache.h"
+
+#include <QMutexLocker>
+
+// default upper limit for the cached images
+#define DEFAULT_MAXIMUM_SIZE ( 32 * 1024 * 1024 )
+
+uint qHash( const QgsMarkerStampCache::Key& key )
+{
+  return qHash( key.symbolKey ) ^ qHash( key.variant );
+}
+
+QgsMarkerStampCache* QgsMarkerStampCache::instance()
+{
+  static QgsMarkerStampCache mInstance;
+  return &mInstance;
+}
+
+QgsMarkerStampCache::QgsMarkerStampCache()
+    : mStamps( DEFAULT_MAXIMUM_SIZE )
+{
+}
+
+QgsMarkerStampCache::~QgsMarkerStampCache()
+{
+}
+
+bool QgsMarkerStampCache::stamp( const QString& symbolKey, quint64 variant, QgsMarkerStamp& stamp ) const
+{
+  QMutexLocker locker( &mMutex );
+  // QCache::object() is not const as it updates the usage order
+  QgsMarkerStamp* s = const_cast< QCache<Key, QgsMarkerStamp>& >( mStamps ).object( Key( symbolKey, variant ) );
+  if ( !s )
+    return false;
+
+  // the image is implicitly shared, the copy is cheap and safe to use outside of the lock
+  stamp = *s;
+  return true;
+}
+
+void QgsMarkerStampCache::insertStamp( const QString& symbolKey, quint64 variant, const QgsMarkerStamp& stamp )
+{
+  int cost = qMax( stamp.image.byteCount(), 1 );
+
+  QMutexLocker locker( &mMutex );
+  mStamps.insert( Key( symbolKey, variant ), new QgsMarkerStamp( stamp ), cost );
+}
+
+void QgsMarkerStampCache::clear()
+{
+  QMutexLocker locker( &mMutex );
+  mStamps.clear();
+}
+
+void QgsMarkerStampCache::setMaximumSize( int bytes )
+{
+  QMutexLocker locker( &mMutex );
+  mStamps.setMaxCost( bytes );
+}
+
+int QgsMarkerStampCache::maximumSize() const
+{
+  QMutexLocker locker( &mMutex );
+  return mStamps.maxCost();
+}
+
+int QgsMarkerStampCache::size() const
+{
+  QMutexLocker locker( &mMutex );
+  return mStamps.totalCost();
+}
@@ -0,0 +1,85 @@
+/***************************************************************************
+    qgsmarkerstampcache.h
+    ---------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSMARKERSTAMPCACHE_H
+#define QGSMARKERSTAMPCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QPointF>
+#include <QString>
+
+/**A rasterised marker together with the position of the marker center in the image
+  @note added in 2.4 */
+class CORE_EXPORT QgsMarkerStamp
+{
+  public:
+    QgsMarkerStamp() {}
+    QgsMarkerStamp( const QImage& theImage, const QPointF& theAnchor ) : image( theImage ), anchor( theAnchor ) {}
+
+    QImage image;
+    //! position of the marker center in image pixels
+    QPointF anchor;
+};
+
+/**Cache of rasterised markers which is shared by all symbol layers, renders and threads.
+
+  A stamp is identified by a key describing the properties of the symbol layer it
+  was rendered from and a variant, which encodes e.g. the size, rotation and subpixel
+  offset the marker was rendered with. The least recently used stamps are removed
+  when the total size of the images exceeds the maximum size of the cache.
+  @note added in 2.4 */
+class CORE_EXPORT QgsMarkerStampCache
+{
+  public:
+    static QgsMarkerStampCache* instance();
+    ~QgsMarkerStampCache();
+
+    /**Looks up a stamp
+      @return true if the stamp is in the cache*/
+    bool stamp( const QString& symbolKey, quint64 variant, QgsMarkerStamp& stamp ) const;
+
+    /**Adds a stamp to the cache, possibly removing the least recently used ones*/
+    void insertStamp( const QString& symbolKey, quint64 variant, const QgsMarkerStamp& stamp );
+
+    void clear();
+
+    /**Maximum total size of the images in bytes*/
+    void setMaximumSize( int bytes );
+    int maximumSize() const;
+
+    /**Total size of the cached images in bytes*/
+    int size() const;
+
+  protected:
+    //! protected constructor
+    QgsMarkerStampCache();
+
+  private:
+    struct Key
+    {
+      Key( const QString& s, quint64 v ) : symbolKey( s ), variant( v ) {}
+      bool operator==( const Key& other ) const { return variant == other.variant && symbolKey == other.symbolKey; }
+
+      QString symbolKey;
+      quint64 variant;
+    };
+    friend uint qHash( const QgsMarkerStampCache::Key& key );
+
+    mutable QMutex mMutex;
+    QCache<Key, QgsMarkerStamp> mStamps;
+};
+
+#endif // QGSMARKERSTAMPCACHE_H
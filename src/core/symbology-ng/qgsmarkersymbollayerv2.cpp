@@ -32,6 +32,12 @@
 
 #include <cmath>
 
+// stamp variants per pixel of marker size and of marker position
+#define STAMP_SIZE_STEPS 4
+#define STAMP_SUBPIXEL_STEPS 4
+// stamps kept by a symbol layer during a render
+#define STAMP_MAX_LOCAL 1024
+
 Q_GUI_EXPORT extern int qt_defaultDpiX();
 Q_GUI_EXPORT extern int qt_defaultDpiY();
 
@@ -189,12 +195,12 @@ void QgsSimpleMarkerSymbolLayerV2::startRender( QgsSymbolV2RenderContext& contex
   bool hasDataDefinedRotation = context.renderHints() & QgsSymbolV2::DataDefinedRotation || dataDefinedProperty( "angle" );
   bool hasDataDefinedSize = context.renderHints() & QgsSymbolV2::DataDefinedSizeScale || dataDefinedProperty( "size" );
 
-  // use caching only when:
-  // - size, rotation, shape, color, border color is not data-defined
+  // use cached stamps only when:
+  // - shape, color, border color and border width are not data-defined
   // - drawing to screen (not printer)
-  mUsingCache = !hasDataDefinedRotation && !hasDataDefinedSize && !context.renderContext().forceVectorOutput()
-                && !dataDefinedProperty( "name" ) && !dataDefinedProperty( "color" ) && !dataDefinedProperty( "color_border" ) && !dataDefinedProperty( "outline_width" ) &&
-                !dataDefinedProperty( "size" );
+  // data-defined size and rotation are fine, they select the stamp variant
+  mUsingCache = !context.renderContext().forceVectorOutput()
+                && !dataDefinedProperty( "name" ) && !dataDefinedProperty( "color" ) && !dataDefinedProperty( "color_border" ) && !dataDefinedProperty( "outline_width" );
 
   // use either QPolygonF or QPainterPath for drawing
   // TODO: find out whether drawing directly doesn't bring overhead - if not, use it for all shapes
@@ -215,40 +221,44 @@ void QgsSimpleMarkerSymbolLayerV2::startRender( QgsSymbolV2RenderContext& contex
     }
   }
 
-  QMatrix transform;
-
-  // scale the shape (if the size is not going to be modified)
-  if ( !hasDataDefinedSize )
+  mStamps.clear();
+  if ( mUsingCache )
   {
-    double scaledSize = mSize * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mSizeUnit );
-    if ( mUsingCache )
-      scaledSize *= context.renderContext().rasterScaleFactor();
-    double half = scaledSize / 2.0;
-    transform.scale( half, half );
+    // stamps are rendered from the unit shape, the key holds everything
+    // that determines their look apart from size, rotation and offset
+    double rasterScaleFactor = context.renderContext().rasterScaleFactor();
+    mStampKey = QString( "%1|%2|%3|%4|%5|%6|%7|%8" )
+                .arg( mName )
+                .arg( mBrush.color().rgba() )
+                .arg( mPen.color().rgba() )
+                .arg( mPen.widthF() * rasterScaleFactor )
+                .arg( mOutlineStyle )
+                .arg( mSelBrush.color().rgba() )
+                .arg( mSelPen.color().rgba() )
+                .arg( context.renderContext().selectionColor().rgba() );
   }
-
-  // rotate if the rotation is not going to be changed during the rendering
-  if ( !hasDataDefinedRotation && mAngle != 0 )
+  else
   {
-    transform.rotate( mAngle );
-  }
+    QMatrix transform;
 
-  if ( !mPolygon.isEmpty() )
-    mPolygon = transform.map( mPolygon );
-  else
-    mPath = transform.map( mPath );
+    // scale the shape (if the size is not going to be modified)
+    if ( !hasDataDefinedSize )
+    {
+      double scaledSize = mSize * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mSizeUnit );
+      double half = scaledSize / 2.0;
+      transform.scale( half, half );
+    }
 
-  if ( mUsingCache )
-  {
-    if ( !prepareCache( context ) )
+    // rotate if the rotation is not going to be changed during the rendering
+    if ( !hasDataDefinedRotation && mAngle != 0 )
     {
-      mUsingCache = false;
+      transform.rotate( mAngle );
     }
-  }
-  else
-  {
-    mCache = QImage();
-    mSelCache = QImage();
+
+    if ( !mPolygon.isEmpty() )
+      mPolygon = transform.map( mPolygon );
+    else
+      mPath = transform.map( mPath );
   }
 
   prepareExpressions( context.fields(), context.renderContext().rendererScale() );
@@ -259,63 +269,116 @@ void QgsSimpleMarkerSymbolLayerV2::startRender( QgsSymbolV2RenderContext& contex
 }
 
 
-bool QgsSimpleMarkerSymbolLayerV2::prepareCache( QgsSymbolV2RenderContext& context )
+bool QgsSimpleMarkerSymbolLayerV2::drawStamp( QPainter* p, const QPointF& point, double size, double angle, QgsSymbolV2RenderContext& context )
 {
-  double scaledSize = mSize * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mSizeUnit );
+  double rasterScaleFactor = context.renderContext().rasterScaleFactor();
+  double deviceSize = size * rasterScaleFactor;
+  if ( deviceSize > mMaximumCacheWidth )
+  {
+    return false;
+  }
 
-  // calculate necessary image size for the cache
-  double pw = (( mPen.widthF() == 0 ? 1 : mPen.widthF() ) + 1 ) / 2 * 2; // make even (round up); handle cosmetic pen
-  int imageSize = (( int ) scaledSize + pw ) / 2 * 2 + 1; //  make image width, height odd; account for pen width
-  double center = imageSize / 2.0;
+  // markers which would look the same share a stamp: size in quarter pixels,
+  // rotation in whole degrees and the position in quarter pixels
+  int sizeStep = qRound( deviceSize * STAMP_SIZE_STEPS );
+  int angleStep = qRound( angle ) % 360;
+  if ( angleStep < 0 )
+    angleStep += 360;
 
-  if ( imageSize > mMaximumCacheWidth )
+  // without scaling or rotation on the painter the stamp is copied to whole
+  // device pixels, so the subpixel position has to be rendered into it
+  const QTransform& t = p->transform();
+  bool aligned = rasterScaleFactor == 1.0 && t.type() <= QTransform::TxTranslate;
+  QPointF devicePoint( point.x() + t.dx(), point.y() + t.dy() );
+  int subX = 0, subY = 0;
+  if ( aligned )
   {
-    return false;
+    subX = qBound( 0, ( int )(( devicePoint.x() - floor( devicePoint.x() ) ) * STAMP_SUBPIXEL_STEPS ), STAMP_SUBPIXEL_STEPS - 1 );
+    subY = qBound( 0, ( int )(( devicePoint.y() - floor( devicePoint.y() ) ) * STAMP_SUBPIXEL_STEPS ), STAMP_SUBPIXEL_STEPS - 1 );
   }
 
-  mCache = QImage( QSize( imageSize, imageSize ), QImage::Format_ARGB32_Premultiplied );
-  mCache.fill( 0 );
+  bool selected = context.selected();
+  quint64 variant = (( quint64 ) sizeStep << 32 ) | ( angleStep << 8 ) | ( subX << 5 ) | ( subY << 2 ) | ( selected ? 1 : 0 );
 
-  QPainter p;
-  p.begin( &mCache );
-  p.setRenderHint( QPainter::Antialiasing );
-  p.setBrush( mBrush );
-  p.setPen( mPen );
-  p.translate( QPointF( center, center ) );
-  drawMarker( &p, context );
-  p.end();
+  QgsMarkerStamp stamp;
+  QHash<quint64, QgsMarkerStamp>::const_iterator it = mStamps.constFind( variant );
+  if ( it != mStamps.constEnd() )
+  {
+    stamp = it.value();
+  }
+  else if ( !QgsMarkerStampCache::instance()->stamp( mStampKey, variant, stamp ) )
+  {
+    double half = sizeStep / ( 2.0 * STAMP_SIZE_STEPS );
+    QMatrix transform;
+    transform.scale( half, half );
+    if ( angleStep != 0 )
+      transform.rotate( angleStep );
 
-  // Construct the selected version of the Cache
+    QPolygonF polygon;
+    QPainterPath path;
+    QRectF bounds;
+    if ( !mPolygon.isEmpty() )
+    {
+      polygon = transform.map( mPolygon );
+      bounds = polygon.boundingRect();
+    }
+    else
+    {
+      path = transform.map( mPath );
+      bounds = path.boundingRect();
+    }
 
-  QColor selColor = context.renderContext().selectionColor();
+    QPen pen = selected ? mSelPen : mPen;
+    pen.setWidthF( pen.widthF() * rasterScaleFactor );
+    double margin = ( pen.widthF() == 0 ? 1 : pen.widthF() ) / 2 + 1; // handle cosmetic pen, leave room for antialiasing
 
-  mSelCache = QImage( QSize( imageSize, imageSize ), QImage::Format_ARGB32_Premultiplied );
-  mSelCache.fill( 0 );
+    QPointF anchor( ceil( margin - bounds.left() ) + ( subX + 0.5 ) / STAMP_SUBPIXEL_STEPS,
+                    ceil( margin - bounds.top() ) + ( subY + 0.5 ) / STAMP_SUBPIXEL_STEPS );
+    int width = ( int ) ceil( anchor.x() + bounds.right() + margin );
+    int height = ( int ) ceil( anchor.y() + bounds.bottom() + margin );
 
-  p.begin( &mSelCache );
-  p.setRenderHint( QPainter::Antialiasing );
-  p.setBrush( mSelBrush );
-  p.setPen( mSelPen );
-  p.translate( QPointF( center, center ) );
-  drawMarker( &p, context );
-  p.end();
+    QImage image( width, height, QImage::Format_ARGB32_Premultiplied );
+    image.fill( 0 );
 
-  // Check that the selected version is different.  If not, then re-render,
-  // filling the background with the selection color and using the normal
-  // colors for the symbol .. could be ugly!
+    QPainter sp( &image );
+    sp.setRenderHint( QPainter::Antialiasing );
+    if ( selected && mSelBrush.color() == mBrush.color() && mSelPen.color() == mPen.color() )
+    {
+      // the selected version would not differ: fill the background with
+      // the selection color and use the normal colors for the symbol
+      sp.fillRect( image.rect(), context.renderContext().selectionColor() );
+    }
+    sp.setBrush( selected ? mSelBrush : mBrush );
+    sp.setPen( pen );
+    sp.translate( anchor );
+    if ( !polygon.isEmpty() )
+      sp.drawPolygon( polygon );
+    else
+      sp.drawPath( path );
+    sp.end();
 
-  if ( mSelCache == mCache )
+    stamp = QgsMarkerStamp( image, anchor );
+    QgsMarkerStampCache::instance()->insertStamp( mStampKey, variant, stamp );
+  }
+
+  if ( it == mStamps.constEnd() && mStamps.size() < STAMP_MAX_LOCAL )
   {
-    p.begin( &mSelCache );
-    p.setRenderHint( QPainter::Antialiasing );
-    p.fillRect( 0, 0, imageSize, imageSize, selColor );
-    p.setBrush( mBrush );
-    p.setPen( mPen );
-    p.translate( QPointF( center, center ) );
-    drawMarker( &p, context );
-    p.end();
+    mStamps.insert( variant, stamp );
   }
 
+  if ( aligned )
+  {
+    // anchor and subpixel position have the same fraction, so the image lands on whole device pixels
+    p->drawImage( QPointF( floor( devicePoint.x() ) + ( subX + 0.5 ) / STAMP_SUBPIXEL_STEPS - stamp.anchor.x() - t.dx(),
+                           floor( devicePoint.y() ) + ( subY + 0.5 ) / STAMP_SUBPIXEL_STEPS - stamp.anchor.y() - t.dy() ), stamp.image );
+  }
+  else
+  {
+    p->drawImage( QRectF( point.x() - stamp.anchor.x() / rasterScaleFactor,
+                          point.y() - stamp.anchor.y() / rasterScaleFactor,
+                          stamp.image.width() / rasterScaleFactor,
+                          stamp.image.height() / rasterScaleFactor ), stamp.image );
+  }
   return true;
 }
 
@@ -498,80 +561,75 @@ void QgsSimpleMarkerSymbolLayerV2::renderPoint( const QPointF& point, QgsSymbolV
     }
   }
 
-  if ( mUsingCache )
-  {
-    // we will use cached image
-    QImage &img = context.selected() ? mSelCache : mCache;
-    double s = img.width() / context.renderContext().rasterScaleFactor();
-    p->drawImage( QRectF( point.x() - s / 2.0 + off.x(),
-                          point.y() - s / 2.0 + off.y(),
-                          s, s ), img );
-  }
-  else
-  {
-    QMatrix transform;
-
-    // move to the desired position
-    transform.translate( point.x() + off.x(), point.y() + off.y() );
-
-    QgsExpression *sizeExpression = expression( "size" );
-    bool hasDataDefinedSize = context.renderHints() & QgsSymbolV2::DataDefinedSizeScale || sizeExpression;
+  QgsExpression *sizeExpression = expression( "size" );
+  bool hasDataDefinedSize = context.renderHints() & QgsSymbolV2::DataDefinedSizeScale || sizeExpression;
+  bool hasDataDefinedRotation = context.renderHints() & QgsSymbolV2::DataDefinedRotation || mAngleExpression;
 
-    // resize if necessary
-    if ( hasDataDefinedSize )
+  double scaledSize = mSize;
+  if ( hasDataDefinedSize )
+  {
+    if ( sizeExpression )
     {
-      double scaledSize = mSize;
-      if ( sizeExpression )
-      {
-        scaledSize = sizeExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toDouble();
-      }
+      scaledSize = sizeExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toDouble();
+    }
 
-      switch ( mScaleMethod )
-      {
-        case QgsSymbolV2::ScaleArea:
-          scaledSize = sqrt( scaledSize );
-          break;
-        case QgsSymbolV2::ScaleDiameter:
-          break;
-      }
+    switch ( mScaleMethod )
+    {
+      case QgsSymbolV2::ScaleArea:
+        scaledSize = sqrt( scaledSize );
+        break;
+      case QgsSymbolV2::ScaleDiameter:
+        break;
+    }
+  }
+  scaledSize *= QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mSizeUnit );
 
-      scaledSize *= QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mSizeUnit );
+  if ( mUsingCache && drawStamp( p, point + off, scaledSize, angle, context ) )
+  {
+    return;
+  }
 
-      double half = scaledSize / 2.0;
-      transform.scale( half, half );
-    }
+  QMatrix transform;
 
-    bool hasDataDefinedRotation = context.renderHints() & QgsSymbolV2::DataDefinedRotation || mAngleExpression;
-    if ( angle != 0 && hasDataDefinedRotation )
-      transform.rotate( angle );
+  // move to the desired position
+  transform.translate( point.x() + off.x(), point.y() + off.y() );
 
-    QgsExpression* colorExpression = expression( "color" );
-    QgsExpression* colorBorderExpression = expression( "color_border" );
-    QgsExpression* outlineWidthExpression = expression( "outline_width" );
-    if ( colorExpression )
-    {
-      mBrush.setColor( QgsSymbolLayerV2Utils::decodeColor( colorExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toString() ) );
-    }
-    if ( colorBorderExpression )
-    {
-      mPen.setColor( QgsSymbolLayerV2Utils::decodeColor( colorBorderExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toString() ) );
-      mSelPen.setColor( QgsSymbolLayerV2Utils::decodeColor( colorBorderExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toString() ) );
-    }
-    if ( outlineWidthExpression )
-    {
-      double outlineWidth = outlineWidthExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toDouble();
-      mPen.setWidthF( outlineWidth * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mOutlineWidthUnit ) );
-      mSelPen.setWidthF( outlineWidth * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mOutlineWidthUnit ) );
-    }
+  // resize if necessary (shapes for stamps are kept at unit size)
+  if ( hasDataDefinedSize || mUsingCache )
+  {
+    double half = scaledSize / 2.0;
+    transform.scale( half, half );
+  }
 
-    p->setBrush( context.selected() ? mSelBrush : mBrush );
-    p->setPen( context.selected() ? mSelPen : mPen );
+  if ( angle != 0 && ( hasDataDefinedRotation || mUsingCache ) )
+    transform.rotate( angle );
 
-    if ( !mPolygon.isEmpty() )
-      p->drawPolygon( transform.map( mPolygon ) );
-    else
-      p->drawPath( transform.map( mPath ) );
+  QgsExpression* colorExpression = expression( "color" );
+  QgsExpression* colorBorderExpression = expression( "color_border" );
+  QgsExpression* outlineWidthExpression = expression( "outline_width" );
+  if ( colorExpression )
+  {
+    mBrush.setColor( QgsSymbolLayerV2Utils::decodeColor( colorExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toString() ) );
   }
+  if ( colorBorderExpression )
+  {
+    mPen.setColor( QgsSymbolLayerV2Utils::decodeColor( colorBorderExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toString() ) );
+    mSelPen.setColor( QgsSymbolLayerV2Utils::decodeColor( colorBorderExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toString() ) );
+  }
+  if ( outlineWidthExpression )
+  {
+    double outlineWidth = outlineWidthExpression->evaluate( const_cast<QgsFeature*>( context.feature() ) ).toDouble();
+    mPen.setWidthF( outlineWidth * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mOutlineWidthUnit ) );
+    mSelPen.setWidthF( outlineWidth * QgsSymbolLayerV2Utils::lineWidthScaleFactor( context.renderContext(), mOutlineWidthUnit ) );
+  }
+
+  p->setBrush( context.selected() ? mSelBrush : mBrush );
+  p->setPen( context.selected() ? mSelPen : mPen );
+
+  if ( !mPolygon.isEmpty() )
+    p->drawPolygon( transform.map( mPolygon ) );
+  else
+    p->drawPath( transform.map( mPath ) );
 }
 
 
@@ -17,6 +17,7 @@
 #define QGSMARKERSYMBOLLAYERV2_H
 
 #include "qgssymbollayerv2.h"
+#include "qgsmarkerstampcache.h"
 #include "qgsvectorlayer.h"
 
 #define DEFAULT_SIMPLEMARKER_NAME         "circle"
@@ -30,6 +31,7 @@
 #include <QPicture>
 #include <QPolygonF>
 #include <QFont>
+#include <QHash>
 
 class CORE_EXPORT QgsSimpleMarkerSymbolLayerV2 : public QgsMarkerSymbolLayerV2
 {
@@ -102,9 +104,9 @@ class CORE_EXPORT QgsSimpleMarkerSymbolLayerV2 : public QgsMarkerSymbolLayerV2
     bool prepareShape( QString name = QString() );
     bool preparePath( QString name = QString() );
 
-    /**Prepares cache image
-    @return true in case of success, false if cache image size too large*/
-    bool prepareCache( QgsSymbolV2RenderContext& context );
+    /**Draws the marker from a rasterised stamp shared through QgsMarkerStampCache
+    @return true in case of success, false if the stamp would be too large*/
+    bool drawStamp( QPainter* p, const QPointF& point, double size, double angle, QgsSymbolV2RenderContext& context );
 
     QColor mBorderColor;
     Qt::PenStyle mOutlineStyle;
@@ -115,11 +117,13 @@ class CORE_EXPORT QgsSimpleMarkerSymbolLayerV2 : public QgsMarkerSymbolLayerV2
     QPolygonF mPolygon;
     QPainterPath mPath;
     QString mName;
-    QImage mCache;
     QPen mSelPen;
     QBrush mSelBrush;
-    QImage mSelCache;
     bool mUsingCache;
+    //! identifies the appearance of the marker in the stamp cache
+    QString mStampKey;
+    //! stamps used during this render, avoids locking the shared cache for every point
+    QHash<quint64, QgsMarkerStamp> mStamps;
 
     //Maximum width/height of cache image
     static const int mMaximumCacheWidth = 3000;
@@ -23,17 +23,421 @@
 #include "qgsogcutils.h"
 
 #include <QSet>
+#include <QVarLengthArray>
 
 #include <QDomDocument>
 #include <QDomElement>
 
+#include <algorithm>
+#include <limits>
+
+// rules with fewer active children evaluate all their filters
+#define RULE_INDEX_MIN_CHILDREN 8
+
+/**
+  Lookup of the active children of a rule which may match a feature.
+
+  The filters of the children are split into AND-ed conditions. A child with a
+  condition comparing an attribute for equality with literals (= or IN) is found
+  through a hash of the literals, a child with numeric range conditions on an
+  attribute through a sorted list of the range bounds. All children indexed by the
+  same attribute share a single lookup of its value. The index returns a superset
+  of the matching children: their filters still have to be evaluated, but those of
+  the other children are skipped. Comparisons follow QgsExpression: numbers are
+  compared if both sides convert to numbers, strings otherwise.
+ */
+class QgsRuleBasedRendererV2::Rule::ChildIndex
+{
+  public:
+    //! @return NULL if none of the children can be indexed
+    static ChildIndex* build( const RuleList& children, const QgsFields& fields );
+
+    //! positions of the children which may match the feature, ascending
+    void candidates( const QgsFeature& feat, QVarLengthArray<int, 32>& positions ) const;
+
+  private:
+    struct Range
+    {
+      Range() : min( -std::numeric_limits<double>::infinity() ), max( std::numeric_limits<double>::infinity() ), minInclusive( false ), maxInclusive( false ) {}
+      bool contains( double v ) const
+      {
+        return ( minInclusive ? v >= min : v > min ) && ( maxInclusive ? v <= max : v < max );
+      }
+
+      double min, max;
+      bool minInclusive, maxInclusive;
+    };
+
+    struct AttributeIndex
+    {
+      int field;
+      //! children by the literals they compare with, see valueKeys()
+      QHash<QString, QList<int> > values;
+      //! range bounds, ascending
+      QVector<double> bounds;
+      //! children for each segment: (-inf, b0), b0, (b0, b1), b1, ..., bn, (bn, +inf)
+      QVector< QList<int> > segments;
+      //! children with ranges, for values which are no numbers
+      QList<int> rangeChildren;
+      //! ranges of the children, only while building
+      QList< QPair<int, Range> > ranges;
+    };
+
+    static bool isDoubleSafe( const QVariant& v );
+    //! keys a value is found under: a number key for values which convert to numbers and a string key
+    static void valueKeys( const QVariant& v, QStringList& keys );
+    static void collectConjuncts( const QgsExpression::Node* node, QList<const QgsExpression::Node*>& conjuncts );
+    //! column name of a comparison between a column and a literal, which is returned together with the operator as seen from the column
+    static QString columnComparison( const QgsExpression::Node* node, QgsExpression::BinaryOperator& op, QVariant& literal );
+
+    AttributeIndex& attributeIndex( int field );
+    bool addEquality( int child, const QgsExpression::Node* node, const QgsFields& fields );
+    bool addRange( int child, const QList<const QgsExpression::Node*>& conjuncts, const QgsFields& fields );
+
+    QList<AttributeIndex> mAttributes;
+    //! children which are always candidates
+    QList<int> mUnindexed;
+};
+
+bool QgsRuleBasedRendererV2::Rule::ChildIndex::isDoubleSafe( const QVariant& v )
+{
+  // same as the comparison operators of QgsExpression
+  if ( v.type() == QVariant::Double || v.type() == QVariant::Int ) return true;
+  if ( v.type() == QVariant::String ) { bool ok; v.toString().toDouble( &ok ); return ok; }
+  return false;
+}
+
+void QgsRuleBasedRendererV2::Rule::ChildIndex::valueKeys( const QVariant& v, QStringList& keys )
+{
+  if ( isDoubleSafe( v ) )
+  {
+    double d = v.toDouble();
+    if ( d == 0 )
+      d = 0; // -0 equals 0
+    keys << "n" + QString::number( d, 'g', 17 );
+  }
+  keys << "s" + v.toString();
+}
+
+void QgsRuleBasedRendererV2::Rule::ChildIndex::collectConjuncts( const QgsExpression::Node* node, QList<const QgsExpression::Node*>& conjuncts )
+{
+  if ( node->nodeType() == QgsExpression::ntBinaryOperator )
+  {
+    const QgsExpression::NodeBinaryOperator* binOp = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+    if ( binOp->op() == QgsExpression::boAnd )
+    {
+      collectConjuncts( binOp->opLeft(), conjuncts );
+      collectConjuncts( binOp->opRight(), conjuncts );
+      return;
+    }
+  }
+  conjuncts << node;
+}
+
+QString QgsRuleBasedRendererV2::Rule::ChildIndex::columnComparison( const QgsExpression::Node* node, QgsExpression::BinaryOperator& op, QVariant& literal )
+{
+  if ( node->nodeType() != QgsExpression::ntBinaryOperator )
+    return QString();
+
+  const QgsExpression::NodeBinaryOperator* binOp = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+  op = binOp->op();
+  if ( op != QgsExpression::boEQ && op != QgsExpression::boLT && op != QgsExpression::boGT &&
+       op != QgsExpression::boLE && op != QgsExpression::boGE )
+    return QString();
+
+  const QgsExpression::Node* left = binOp->opLeft();
+  const QgsExpression::Node* right = binOp->opRight();
+  if ( left->nodeType() == QgsExpression::ntLiteral && right->nodeType() == QgsExpression::ntColumnRef )
+  {
+    // literal on the left side: mirror the operator
+    qSwap( left, right );
+    switch ( op )
+    {
+      case QgsExpression::boLT: op = QgsExpression::boGT; break;
+      case QgsExpression::boGT: op = QgsExpression::boLT; break;
+      case QgsExpression::boLE: op = QgsExpression::boGE; break;
+      case QgsExpression::boGE: op = QgsExpression::boLE; break;
+      default: break;
+    }
+  }
+  if ( left->nodeType() != QgsExpression::ntColumnRef || right->nodeType() != QgsExpression::ntLiteral )
+    return QString();
+
+  literal = static_cast<const QgsExpression::NodeLiteral*>( right )->value();
+  if ( literal.isNull() )
+    return QString();
+
+  return static_cast<const QgsExpression::NodeColumnRef*>( left )->name();
+}
+
+QgsRuleBasedRendererV2::Rule::ChildIndex::AttributeIndex& QgsRuleBasedRendererV2::Rule::ChildIndex::attributeIndex( int field )
+{
+  for ( int i = 0; i < mAttributes.count(); ++i )
+  {
+    if ( mAttributes[i].field == field )
+      return mAttributes[i];
+  }
+  AttributeIndex index;
+  index.field = field;
+  mAttributes << index;
+  return mAttributes.last();
+}
+
+bool QgsRuleBasedRendererV2::Rule::ChildIndex::addEquality( int child, const QgsExpression::Node* node, const QgsFields& fields )
+{
+  QString column;
+  QList<QVariant> literals;
+
+  QgsExpression::BinaryOperator op;
+  QVariant literal;
+  if ( node->nodeType() == QgsExpression::ntInOperator )
+  {
+    const QgsExpression::NodeInOperator* inOp = static_cast<const QgsExpression::NodeInOperator*>( node );
+    if ( inOp->isNotIn() || inOp->node()->nodeType() != QgsExpression::ntColumnRef )
+      return false;
+    column = static_cast<const QgsExpression::NodeColumnRef*>( inOp->node() )->name();
+    foreach ( QgsExpression::Node* item, inOp->list()->list() )
+    {
+      // NULL items never match
+      if ( item->nodeType() != QgsExpression::ntLiteral )
+        return false;
+      QVariant value = static_cast<const QgsExpression::NodeLiteral*>( item )->value();
+      if ( !value.isNull() )
+        literals << value;
+    }
+  }
+  else
+  {
+    column = columnComparison( node, op, literal );
+    if ( column.isEmpty() || op != QgsExpression::boEQ )
+      return false;
+    literals << literal;
+  }
+
+  int field = fields.indexFromName( column );
+  if ( field < 0 )
+    return false;
+
+  AttributeIndex& index = attributeIndex( field );
+  QStringList keys;
+  foreach ( const QVariant& value, literals )
+  {
+    valueKeys( value, keys );
+  }
+  foreach ( const QString& key, keys )
+  {
+    QList<int>& children = index.values[key];
+    if ( children.isEmpty() || children.last() != child )
+      children << child;
+  }
+  return true;
+}
+
+bool QgsRuleBasedRendererV2::Rule::ChildIndex::addRange( int child, const QList<const QgsExpression::Node*>& conjuncts, const QgsFields& fields )
+{
+  // intersect all numeric bounds on the column of the first comparison
+  QString rangeColumn;
+  Range range;
+  foreach ( const QgsExpression::Node* node, conjuncts )
+  {
+    QgsExpression::BinaryOperator op;
+    QVariant literal;
+    QString column = columnComparison( node, op, literal );
+    if ( column.isEmpty() || op == QgsExpression::boEQ || !isDoubleSafe( literal ) )
+      continue;
+    if ( rangeColumn.isEmpty() )
+      rangeColumn = column;
+    else if ( column != rangeColumn )
+      continue;
+
+    double v = literal.toDouble();
+    if ( op == QgsExpression::boGT || op == QgsExpression::boGE )
+    {
+      bool inclusive = op == QgsExpression::boGE;
+      if ( v > range.min || ( v == range.min && !inclusive ) )
+      {
+        range.min = v;
+        range.minInclusive = inclusive;
+      }
+    }
+    else
+    {
+      bool inclusive = op == QgsExpression::boLE;
+      if ( v < range.max || ( v == range.max && !inclusive ) )
+      {
+        range.max = v;
+        range.maxInclusive = inclusive;
+      }
+    }
+  }
+
+  int field = rangeColumn.isEmpty() ? -1 : fields.indexFromName( rangeColumn );
+  if ( field < 0 )
+    return false;
+
+  AttributeIndex& index = attributeIndex( field );
+  index.ranges << qMakePair( child, range );
+  index.rangeChildren << child;
+  return true;
+}
+
+QgsRuleBasedRendererV2::Rule::ChildIndex* QgsRuleBasedRendererV2::Rule::ChildIndex::build( const RuleList& children, const QgsFields& fields )
+{
+  ChildIndex* index = new ChildIndex;
+  bool indexed = false;
+
+  for ( int i = 0; i < children.count(); ++i )
+  {
+    QgsExpression* filter = children[i]->filter();
+    if ( children[i]->isElse() || !filter || filter->hasParserError() || !filter->rootNode() )
+    {
+      index->mUnindexed << i;
+      continue;
+    }
+
+    QList<const QgsExpression::Node*> conjuncts;
+    collectConjuncts( filter->rootNode(), conjuncts );
+
+    bool added = false;
+    foreach ( const QgsExpression::Node* node, conjuncts )
+    {
+      if ( index->addEquality( i, node, fields ) )
+      {
+        added = true;
+        break;
+      }
+    }
+    if ( !added )
+      added = index->addRange( i, conjuncts, fields );
+
+    if ( added )
+      indexed = true;
+    else
+      index->mUnindexed << i;
+  }
+
+  if ( !indexed )
+  {
+    delete index;
+    return NULL;
+  }
+
+  // split the number line at the range bounds, each segment lists the ranges containing it
+  for ( int a = 0; a < index->mAttributes.count(); ++a )
+  {
+    AttributeIndex& attr = index->mAttributes[a];
+    if ( attr.ranges.isEmpty() )
+      continue;
+
+    for ( int r = 0; r < attr.ranges.count(); ++r )
+    {
+      const Range& range = attr.ranges[r].second;
+      if ( range.min > -std::numeric_limits<double>::infinity() )
+        attr.bounds << range.min;
+      if ( range.max < std::numeric_limits<double>::infinity() )
+        attr.bounds << range.max;
+    }
+    qSort( attr.bounds );
+    attr.bounds.erase( std::unique( attr.bounds.begin(), attr.bounds.end() ), attr.bounds.end() );
+
+    int n = attr.bounds.count();
+    attr.segments.resize( 2 * n + 1 );
+    for ( int s = 0; s < attr.segments.count(); ++s )
+    {
+      // a value inside the segment
+      double v;
+      if ( n == 0 )
+        v = 0;
+      else if ( s % 2 == 1 )
+        v = attr.bounds[s / 2];
+      else if ( s == 0 )
+        v = attr.bounds[0] - qMax( 1.0, qAbs( attr.bounds[0] ) );
+      else if ( s == 2 * n )
+        v = attr.bounds[n - 1] + qMax( 1.0, qAbs( attr.bounds[n - 1] ) );
+      else
+        v = ( attr.bounds[s / 2 - 1] + attr.bounds[s / 2] ) / 2;
+
+      for ( int r = 0; r < attr.ranges.count(); ++r )
+      {
+        if ( attr.ranges[r].second.contains( v ) )
+          attr.segments[s] << attr.ranges[r].first;
+      }
+    }
+    attr.ranges.clear();
+  }
+
+  return index;
+}
+
+void QgsRuleBasedRendererV2::Rule::ChildIndex::candidates( const QgsFeature& feat, QVarLengthArray<int, 32>& positions ) const
+{
+  positions.clear();
+  foreach ( int child, mUnindexed )
+    positions.append( child );
+
+  QStringList keys;
+  for ( int a = 0; a < mAttributes.count(); ++a )
+  {
+    const AttributeIndex& attr = mAttributes[a];
+    QVariant value = feat.attribute( attr.field );
+    if ( value.isNull() )
+      continue; // comparisons with NULL are never true
+
+    if ( !attr.values.isEmpty() )
+    {
+      keys.clear();
+      valueKeys( value, keys );
+      foreach ( const QString& key, keys )
+      {
+        QHash<QString, QList<int> >::const_iterator it = attr.values.constFind( key );
+        if ( it == attr.values.constEnd() )
+          continue;
+        foreach ( int child, it.value() )
+          positions.append( child );
+      }
+    }
+
+    if ( !attr.rangeChildren.isEmpty() )
+    {
+      double v = value.toDouble();
+      if ( !isDoubleSafe( value ) || v != v )
+      {
+        // compared as strings or NaN: no shortcut
+        foreach ( int child, attr.rangeChildren )
+          positions.append( child );
+        continue;
+      }
+
+      // segment of the value: 2 * i + 1 if it equals bound i, 2 * i for the gap before bound i
+      const double* begin = attr.bounds.constData();
+      const double* end = begin + attr.bounds.count();
+      const double* it = qLowerBound( begin, end, v );
+      int segment = 2 * ( it - begin );
+      if ( it != end && *it == v )
+        segment += 1;
+      foreach ( int child, attr.segments[segment] )
+        positions.append( child );
+    }
+  }
+
+  // keep the order of the children, remove duplicates
+  qSort( positions.begin(), positions.end() );
+  int count = 0;
+  for ( int i = 0; i < positions.size(); ++i )
+  {
+    if ( count == 0 || positions[count - 1] != positions[i] )
+      positions[count++] = positions[i];
+  }
+  positions.resize( count );
+}
+
 
 
 QgsRuleBasedRendererV2::Rule::Rule( QgsSymbolV2* symbol, int scaleMinDenom, int scaleMaxDenom, QString filterExp, QString label, QString description , bool elseRule )
     : mParent( NULL ), mSymbol( symbol )
     , mScaleMinDenom( scaleMinDenom ), mScaleMaxDenom( scaleMaxDenom )
     , mFilterExp( filterExp ), mLabel( label ), mDescription( description )
-    , mElseRule( elseRule ), mFilter( NULL )
+    , mElseRule( elseRule ), mFilter( NULL ), mChildIndex( NULL )
 {
   initFilter();
 }
@@ -42,6 +446,7 @@ QgsRuleBasedRendererV2::Rule::~Rule()
 {
   delete mSymbol;
   delete mFilter;
+  delete mChildIndex;
   qDeleteAll( mChildren );
   // do NOT delete parent
 }
@@ -348,6 +753,8 @@ void QgsRuleBasedRendererV2::Rule::toSld( QDomDocument& doc, QDomElement &elemen
 bool QgsRuleBasedRendererV2::Rule::startRender( QgsRenderContext& context, const QgsFields& fields )
 {
   mActiveChildren.clear();
+  delete mChildIndex;
+  mChildIndex = NULL;
 
   // filter out rules which are not compatible with this scale
   if ( !isScaleOK( context.rendererScale() ) )
@@ -370,9 +777,29 @@ bool QgsRuleBasedRendererV2::Rule::startRender( QgsRenderContext& context, const
       mActiveChildren.append( rule );
     }
   }
+
+  // with many children, look up those matching a feature instead of trying all filters
+  if ( mActiveChildren.count() >= RULE_INDEX_MIN_CHILDREN )
+    mChildIndex = ChildIndex::build( mActiveChildren, fields );
+
   return true;
 }
 
+QgsRuleBasedRendererV2::RuleList QgsRuleBasedRendererV2::Rule::activeChildrenForFeature( QgsFeature& feat )
+{
+  if ( !mChildIndex )
+    return mActiveChildren;
+
+  QVarLengthArray<int, 32> positions;
+  mChildIndex->candidates( feat, positions );
+
+  RuleList children;
+  children.reserve( positions.size() );
+  for ( int i = 0; i < positions.size(); ++i )
+    children.append( mActiveChildren.at( positions[i] ) );
+  return children;
+}
+
 QSet<int> QgsRuleBasedRendererV2::Rule::collectZLevels()
 {
   QSet<int> symbolZLevelsSet;
@@ -439,7 +866,8 @@ bool QgsRuleBasedRendererV2::Rule::renderFeature( QgsRuleBasedRendererV2::Featur
   bool willrendersomething = false;
 
   // process children
-  for ( QList<Rule*>::iterator it = mActiveChildren.begin(); it != mActiveChildren.end(); ++it )
+  RuleList children = activeChildrenForFeature( featToRender.feat );
+  for ( QList<Rule*>::iterator it = children.begin(); it != children.end(); ++it )
   {
     Rule* rule = *it;
     if ( rule->isElse() )
@@ -470,7 +898,8 @@ bool QgsRuleBasedRendererV2::Rule::willRenderFeature( QgsFeature& feat )
   if ( mSymbol )
     return true;
 
-  for ( QList<Rule*>::iterator it = mActiveChildren.begin(); it != mActiveChildren.end(); ++it )
+  RuleList children = activeChildrenForFeature( feat );
+  for ( QList<Rule*>::iterator it = children.begin(); it != children.end(); ++it )
   {
     Rule* rule = *it;
     if ( rule->willRenderFeature( feat ) )
@@ -487,7 +916,8 @@ QgsSymbolV2List QgsRuleBasedRendererV2::Rule::symbolsForFeature( QgsFeature& fea
   if ( mSymbol )
     lst.append( mSymbol );
 
-  for ( QList<Rule*>::iterator it = mActiveChildren.begin(); it != mActiveChildren.end(); ++it )
+  RuleList children = activeChildrenForFeature( feat );
+  for ( QList<Rule*>::iterator it = children.begin(); it != children.end(); ++it )
   {
     Rule* rule = *it;
     lst += rule->symbolsForFeature( feat );
@@ -504,7 +934,8 @@ QgsRuleBasedRendererV2::RuleList QgsRuleBasedRendererV2::Rule::rulesForFeature(
   if ( mSymbol )
     lst.append( this );
 
-  for ( QList<Rule*>::iterator it = mActiveChildren.begin(); it != mActiveChildren.end(); ++it )
+  RuleList children = activeChildrenForFeature( feat );
+  for ( QList<Rule*>::iterator it = children.begin(); it != children.end(); ++it )
   {
     Rule* rule = *it;
     lst += rule->rulesForFeature( feat );
@@ -525,6 +956,8 @@ void QgsRuleBasedRendererV2::Rule::stopRender( QgsRenderContext& context )
 
   mActiveChildren.clear();
   mSymbolNormZLevels.clear();
+  delete mChildIndex;
+  mChildIndex = NULL;
 }
 
 QgsRuleBasedRendererV2::Rule* QgsRuleBasedRendererV2::Rule::create( QDomElement& ruleElem, QgsSymbolV2Map& symbolMap )
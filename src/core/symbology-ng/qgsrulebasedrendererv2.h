@@ -172,6 +172,11 @@ class CORE_EXPORT QgsRuleBasedRendererV2 : public QgsFeatureRendererV2
       protected:
         void initFilter();
 
+        //! active children which may match the feature, in their original order
+        RuleList activeChildrenForFeature( QgsFeature& feat );
+
+        class ChildIndex;
+
         Rule* mParent; // parent rule (NULL only for root rule)
         QgsSymbolV2* mSymbol;
         int mScaleMinDenom, mScaleMaxDenom;
@@ -185,6 +190,8 @@ class CORE_EXPORT QgsRuleBasedRendererV2 : public QgsFeatureRendererV2
         // temporary while rendering
         QList<int> mSymbolNormZLevels;
         RuleList mActiveChildren;
+        // lookup of the active children by the attributes tested in their filters (NULL for few children)
+        ChildIndex* mChildIndex;
     };
 
     /////
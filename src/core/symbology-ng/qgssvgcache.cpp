@@ -28,6 +28,7 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QFile>
+#include <QMutexLocker>
 #include <QImage>
 #include <QPainter>
 #include <QPicture>
@@ -68,7 +69,7 @@ int QgsSvgCacheEntry::dataSize() const
   }
   if ( image )
   {
-    size += ( image->width() * image->height() * 32 );
+    size += image->byteCount();
   }
   return size;
 }
@@ -81,6 +82,79 @@ double rasterScaleFactor;
 QColor fill;
 QColor outline;
 
+
+// size of an image rendered from an svg, also used to decide whether it fits into the cache
+static int _svgImageSize( const QSvgRenderer& r, double size, int& wImgSize, int& hImgSize )
+{
+  double hwRatio = 1.0;
+  if ( r.viewBoxF().width() > 0 )
+  {
+    hwRatio = r.viewBoxF().height() / r.viewBoxF().width();
+  }
+  wImgSize = qMax(( int )size, 1 );
+  hImgSize = qMax(( int )( size * hwRatio ), 1 );
+  return wImgSize * hImgSize * 4;
+}
+
+static QImage _renderSvgImage( QSvgRenderer& r, double size )
+{
+  int wImgSize, hImgSize;
+  _svgImageSize( r, size, wImgSize, hImgSize );
+
+  // cast double image sizes to int for QImage
+  QImage image( wImgSize, hImgSize, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 ); // transparent background
+
+  QPainter p( &image );
+  if ( r.viewBoxF().width() == r.viewBoxF().height() )
+  {
+    r.render( &p );
+  }
+  else
+  {
+    double hwRatio = r.viewBoxF().width() > 0 ? r.viewBoxF().height() / r.viewBoxF().width() : 1.0;
+    QSizeF s( r.viewBoxF().size() );
+    s.scale( size, size * hwRatio, Qt::KeepAspectRatio );
+    QRectF rect(( wImgSize - s.width() ) / 2, ( hImgSize - s.height() ) / 2, s.width(), s.height() );
+    r.render( &p, rect );
+  }
+  p.end();
+  return image;
+}
+
+static QPicture _renderSvgPicture( QSvgRenderer& r, double size )
+{
+  double hwRatio = 1.0;
+  if ( r.viewBoxF().width() > 0 )
+  {
+    hwRatio = r.viewBoxF().height() / r.viewBoxF().width();
+  }
+
+  double wSize = size;
+  double hSize = wSize * hwRatio;
+  QSizeF s( r.viewBoxF().size() );
+  s.scale( wSize, hSize, Qt::KeepAspectRatio );
+  QRectF rect( -s.width() / 2.0, -s.height() / 2.0, s.width(), s.height() );
+
+  QPicture picture;
+  QPainter p( &picture );
+  r.render( &p, rect );
+  p.end();
+  return picture;
+}
+
+QgsSvgCache::Shard::Shard()
+    : totalSize( 0 )
+    , leastRecentEntry( 0 )
+    , mostRecentEntry( 0 )
+    , documents( QgsSvgCache::mMaximumSize / QgsSvgCache::ShardCount )
+    , contents( QgsSvgCache::mMaximumSize / QgsSvgCache::ShardCount )
+    , hits( 0 )
+    , misses( 0 )
+    , evictions( 0 )
+{
+}
+
 QgsSvgCache* QgsSvgCache::instance()
 {
   static QgsSvgCache mInstance;
@@ -89,112 +163,117 @@ QgsSvgCache* QgsSvgCache::instance()
 
 QgsSvgCache::QgsSvgCache( QObject *parent )
     : QObject( parent )
-    , mTotalSize( 0 )
-    , mLeastRecentEntry( 0 )
-    , mMostRecentEntry( 0 )
 {
   mMissingSvg = QString( "<svg width='10' height='10'><text x='5' y='10' font-size='10' text-anchor='middle'>?</text></svg>" ).toAscii();
 }
 
 QgsSvgCache::~QgsSvgCache()
 {
-  QMultiHash< QString, QgsSvgCacheEntry* >::iterator it = mEntryLookup.begin();
-  for ( ; it != mEntryLookup.end(); ++it )
-  {
-    delete it.value();
-  }
+  clear();
 }
 
+QgsSvgCache::Shard& QgsSvgCache::shard( const QString& file )
+{
+  return mShards[ qHash( file ) % ShardCount ];
+}
 
-const QImage& QgsSvgCache::svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                                       double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache )
+QImage QgsSvgCache::svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                                double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache )
 {
   fitsInCache = true;
-  QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+  Shard& s = shard( file );
+  // larger images would push too many entries out of the shard, those are cached as pictures
+  int maximumImageSize = mMaximumSize / ShardCount / 2;
 
-  //if current entry image is 0: cache image for entry
-  // checks to see if image will fit into cache
-  //update stats for memory usage
-  if ( !currentEntry->image )
   {
-    QSvgRenderer r( currentEntry->svgContent );
-    double hwRatio = 1.0;
-    if ( r.viewBoxF().width() > 0 )
+    QMutexLocker locker( &s.mutex );
+    QgsSvgCacheEntry* entry = findEntry( s, file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+    if ( entry && entry->image )
     {
-      hwRatio = r.viewBoxF().height() / r.viewBoxF().width();
+      ++s.hits;
+      return *entry->image;
     }
-    long cachedDataSize = 0;
-    cachedDataSize += currentEntry->svgContent.size();
-    cachedDataSize += ( int )( currentEntry->size * currentEntry->size * hwRatio * 32 );
-    if ( cachedDataSize > mMaximumSize / 2 )
+    if ( entry && entry->picture && entry->picture->boundingRect().width() * entry->picture->boundingRect().height() * 4 > maximumImageSize )
     {
+      ++s.hits;
       fitsInCache = false;
-      delete currentEntry->image;
-      currentEntry->image = 0;
-      //currentEntry->image = new QImage( 0, 0 );
-
-      // instead cache picture
-      if ( !currentEntry->picture )
-      {
-        cachePicture( currentEntry, false );
-      }
-    }
-    else
-    {
-      cacheImage( currentEntry );
+      return QImage();
     }
-    trimToMaximumSize();
+    ++s.misses;
   }
 
-  return *( currentEntry->image );
-}
-
-const QPicture& QgsSvgCache::svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-    double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput )
-{
-  QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+  // render without holding the lock, other threads may use the shard meanwhile
+  QByteArray content = svgContent( s, file, fill, outline, outlineWidth );
+  QSvgRenderer r( content );
+  int wImgSize, hImgSize;
+  QImage image;
+  QPicture picture;
+  if ( content.size() + _svgImageSize( r, size, wImgSize, hImgSize ) > maximumImageSize )
+  {
+    fitsInCache = false;
+    picture = _renderSvgPicture( r, size );
+  }
+  else
+  {
+    image = _renderSvgImage( r, size );
+  }
 
-  //if current entry picture is 0: cache picture for entry
-  //update stats for memory usage
-  if ( !currentEntry->picture )
+  QMutexLocker locker( &s.mutex );
+  QgsSvgCacheEntry* entry = findEntry( s, file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+  if ( !entry )
+  {
+    entry = insertEntry( s, file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor, content );
+  }
+  if ( fitsInCache && !entry->image )
   {
-    cachePicture( currentEntry, forceVectorOutput );
-    trimToMaximumSize();
+    entry->image = new QImage( image );
+    s.totalSize += image.byteCount();
   }
+  else if ( !fitsInCache && !entry->picture )
+  {
+    entry->picture = new QPicture( picture );
+    s.totalSize += picture.size();
+  }
+  trimToMaximumSize( s );
 
-  return *( currentEntry->picture );
+  return image;
 }
 
-QgsSvgCacheEntry* QgsSvgCache::insertSVG( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-    double widthScaleFactor, double rasterScaleFactor )
+QPicture QgsSvgCache::svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                                    double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput )
 {
-  // The file may be relative path (e.g. if path is data defined)
-  QString path = QgsSymbolLayerV2Utils::symbolNameToPath( file );
-
-  QgsSvgCacheEntry* entry = new QgsSvgCacheEntry( path, size, outlineWidth, widthScaleFactor, rasterScaleFactor, fill, outline );
+  Q_UNUSED( forceVectorOutput );
+  Shard& s = shard( file );
 
-  replaceParamsAndCacheSvg( entry );
+  {
+    QMutexLocker locker( &s.mutex );
+    QgsSvgCacheEntry* entry = findEntry( s, file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+    if ( entry && entry->picture )
+    {
+      ++s.hits;
+      return *entry->picture;
+    }
+    ++s.misses;
+  }
 
-  mEntryLookup.insert( file, entry );
+  QByteArray content = svgContent( s, file, fill, outline, outlineWidth );
+  QSvgRenderer r( content );
+  QPicture picture = _renderSvgPicture( r, size );
 
-  //insert to most recent place in entry list
-  if ( !mMostRecentEntry ) //inserting first entry
+  QMutexLocker locker( &s.mutex );
+  QgsSvgCacheEntry* entry = findEntry( s, file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+  if ( !entry )
   {
-    mLeastRecentEntry = entry;
-    mMostRecentEntry = entry;
-    entry->previousEntry = 0;
-    entry->nextEntry = 0;
+    entry = insertEntry( s, file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor, content );
   }
-  else
+  if ( !entry->picture )
   {
-    entry->previousEntry = mMostRecentEntry;
-    entry->nextEntry = 0;
-    mMostRecentEntry->nextEntry = entry;
-    mMostRecentEntry = entry;
+    entry->picture = new QPicture( picture );
+    s.totalSize += picture.size();
   }
+  trimToMaximumSize( s );
 
-  trimToMaximumSize();
-  return entry;
+  return picture;
 }
 
 void QgsSvgCache::containsParams( const QString& path, bool& hasFillParam, QColor& defaultFillColor, bool& hasOutlineParam, QColor& defaultOutlineColor,
@@ -214,25 +293,59 @@ void QgsSvgCache::containsParams( const QString& path, bool& hasFillParam, QColo
   containsElemParams( docElem, hasFillParam, defaultFillColor, hasOutlineParam, defaultOutlineColor, hasOutlineWidthParam, defaultOutlineWidth );
 }
 
-void QgsSvgCache::replaceParamsAndCacheSvg( QgsSvgCacheEntry* entry )
+QByteArray QgsSvgCache::svgContent( Shard& s, const QString& file, const QColor& fill, const QColor& outline, double outlineWidth )
 {
-  if ( !entry )
+  QString key = QString( "%1|%2|%3|%4" ).arg( file ).arg( fill.rgba() ).arg( outline.rgba() ).arg( outlineWidth );
+
+  QDomDocument* svgDoc = 0;
   {
-    return;
+    QMutexLocker locker( &s.mutex );
+    QByteArray* content = s.contents.object( key );
+    if ( content )
+    {
+      return *content;
+    }
+    QDomDocument* doc = s.documents.object( file );
+    if ( doc )
+    {
+      svgDoc = new QDomDocument( doc->cloneNode( true ).toDocument() );
+    }
   }
 
-  QDomDocument svgDoc;
-  if ( !svgDoc.setContent( getImageData( entry->file ) ) )
+  if ( !svgDoc )
   {
-    return;
+    // read and parse without holding the lock, the file may have to be downloaded
+    // The file may be relative path (e.g. if path is data defined)
+    QByteArray data = getImageData( QgsSymbolLayerV2Utils::symbolNameToPath( file ) );
+    QDomDocument* doc = new QDomDocument();
+    if ( !doc->setContent( data ) )
+    {
+      *doc = QDomDocument();
+    }
+    else
+    {
+      svgDoc = new QDomDocument( doc->cloneNode( true ).toDocument() );
+    }
+
+    QMutexLocker locker( &s.mutex );
+    s.documents.insert( file, doc, qMax( data.size(), 1 ) );
   }
 
-  //replace fill color, outline color, outline with in all nodes
-  QDomElement docElem = svgDoc.documentElement();
-  replaceElemParams( docElem, entry->fill, entry->outline, entry->outlineWidth );
+  if ( !svgDoc || svgDoc->isNull() )
+  {
+    delete svgDoc;
+    return QByteArray();
+  }
 
-  entry->svgContent = svgDoc.toByteArray();
-  mTotalSize += entry->svgContent.size();
+  //replace fill color, outline color, outline with in all nodes
+  QDomElement docElem = svgDoc->documentElement();
+  replaceElemParams( docElem, fill, outline, outlineWidth );
+  QByteArray content = svgDoc->toByteArray();
+  delete svgDoc;
+
+  QMutexLocker locker( &s.mutex );
+  s.contents.insert( key, new QByteArray( content ), qMax( content.size(), 1 ) );
+  return content;
 }
 
 QByteArray QgsSvgCache::getImageData( const QString &path ) const
@@ -350,134 +463,69 @@ QByteArray QgsSvgCache::getImageData( const QString &path ) const
   return ba;
 }
 
-void QgsSvgCache::cacheImage( QgsSvgCacheEntry* entry )
+QgsSvgCacheEntry* QgsSvgCache::findEntry( Shard& s, const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+    double widthScaleFactor, double rasterScaleFactor )
 {
-  if ( !entry )
+  //search entries in the lookup of the shard
+  QgsSvgCacheEntry* currentEntry = 0;
+  QMultiHash< QString, QgsSvgCacheEntry* >::const_iterator entryIt = s.entryLookup.constFind( file );
+  for ( ; entryIt != s.entryLookup.constEnd() && entryIt.key() == file; ++entryIt )
   {
-    return;
+    QgsSvgCacheEntry* cacheEntry = entryIt.value();
+    if ( qgsDoubleNear( cacheEntry->size, size ) && cacheEntry->fill == fill && cacheEntry->outline == outline &&
+         cacheEntry->outlineWidth == outlineWidth && cacheEntry->widthScaleFactor == widthScaleFactor && cacheEntry->rasterScaleFactor == rasterScaleFactor )
+    {
+      currentEntry = cacheEntry;
+      break;
+    }
   }
 
-  delete entry->image;
-  entry->image = 0;
-
-  QSvgRenderer r( entry->svgContent );
-  double hwRatio = 1.0;
-  if ( r.viewBoxF().width() > 0 )
-  {
-    hwRatio = r.viewBoxF().height() / r.viewBoxF().width();
-  }
-  double wSize = entry->size;
-  int wImgSize = ( int )wSize;
-  if ( wImgSize < 1 )
+  if ( !currentEntry || currentEntry == s.mostRecentEntry )
   {
-    wImgSize = 1;
+    return currentEntry;
   }
-  double hSize = wSize * hwRatio;
-  int hImgSize = ( int )hSize;
-  if ( hImgSize < 1 )
-  {
-    hImgSize = 1;
-  }
-  // cast double image sizes to int for QImage
-  QImage* image = new QImage( wImgSize, hImgSize, QImage::Format_ARGB32_Premultiplied );
-  image->fill( 0 ); // transparent background
 
-  QPainter p( image );
-  if ( r.viewBoxF().width() == r.viewBoxF().height() )
+  takeEntryFromList( s, currentEntry );
+  if ( !s.mostRecentEntry ) //list is empty
   {
-    r.render( &p );
+    s.mostRecentEntry = currentEntry;
+    s.leastRecentEntry = currentEntry;
+    currentEntry->previousEntry = 0;
   }
   else
   {
-    QSizeF s( r.viewBoxF().size() );
-    s.scale( wSize, hSize, Qt::KeepAspectRatio );
-    QRectF rect(( wImgSize - s.width() ) / 2, ( hImgSize - s.height() ) / 2, s.width(), s.height() );
-    r.render( &p, rect );
-  }
-
-  entry->image = image;
-  mTotalSize += ( image->width() * image->height() * 32 );
-}
-
-void QgsSvgCache::cachePicture( QgsSvgCacheEntry *entry, bool forceVectorOutput )
-{
-  Q_UNUSED( forceVectorOutput );
-  if ( !entry )
-  {
-    return;
+    s.mostRecentEntry->nextEntry = currentEntry;
+    currentEntry->previousEntry = s.mostRecentEntry;
+    s.mostRecentEntry = currentEntry;
   }
+  currentEntry->nextEntry = 0;
 
-  delete entry->picture;
-  entry->picture = 0;
-
-  //correct QPictures dpi correction
-  QPicture* picture = new QPicture();
-  QRectF rect;
-  QSvgRenderer r( entry->svgContent );
-  double hwRatio = 1.0;
-  if ( r.viewBoxF().width() > 0 )
-  {
-    hwRatio = r.viewBoxF().height() / r.viewBoxF().width();
-  }
-
-  double wSize = entry->size;
-  double hSize = wSize * hwRatio;
-  QSizeF s( r.viewBoxF().size() );
-  s.scale( wSize, hSize, Qt::KeepAspectRatio );
-  rect = QRectF( -s.width() / 2.0, -s.height() / 2.0, s.width(), s.height() );
-
-  QPainter p( picture );
-  r.render( &p, rect );
-  entry->picture = picture;
-  mTotalSize += entry->picture->size();
+  return currentEntry;
 }
 
-QgsSvgCacheEntry* QgsSvgCache::cacheEntry( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-    double widthScaleFactor, double rasterScaleFactor )
+QgsSvgCacheEntry* QgsSvgCache::insertEntry( Shard& s, const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+    double widthScaleFactor, double rasterScaleFactor, const QByteArray& svgContent )
 {
-  //search entries in mEntryLookup
-  QgsSvgCacheEntry* currentEntry = 0;
-  QList<QgsSvgCacheEntry*> entries = mEntryLookup.values( file );
+  QgsSvgCacheEntry* entry = new QgsSvgCacheEntry( file, size, outlineWidth, widthScaleFactor, rasterScaleFactor, fill, outline );
+  entry->svgContent = svgContent;
+  s.totalSize += svgContent.size();
 
-  QList<QgsSvgCacheEntry*>::iterator entryIt = entries.begin();
-  for ( ; entryIt != entries.end(); ++entryIt )
-  {
-    QgsSvgCacheEntry* cacheEntry = *entryIt;
-    if ( cacheEntry->file == file && qgsDoubleNear( cacheEntry->size, size ) && cacheEntry->fill == fill && cacheEntry->outline == outline &&
-         cacheEntry->outlineWidth == outlineWidth && cacheEntry->widthScaleFactor == widthScaleFactor && cacheEntry->rasterScaleFactor == rasterScaleFactor )
-    {
-      currentEntry = cacheEntry;
-      break;
-    }
-  }
+  s.entryLookup.insert( file, entry );
 
-  //if not found: create new entry
-  //cache and replace params in svg content
-  if ( !currentEntry )
+  //insert to most recent place in entry list
+  entry->previousEntry = s.mostRecentEntry;
+  entry->nextEntry = 0;
+  if ( !s.mostRecentEntry ) //inserting first entry
   {
-    currentEntry = insertSVG( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
+    s.leastRecentEntry = entry;
   }
   else
   {
-    takeEntryFromList( currentEntry );
-    if ( !mMostRecentEntry ) //list is empty
-    {
-      mMostRecentEntry = currentEntry;
-      mLeastRecentEntry = currentEntry;
-    }
-    else
-    {
-      mMostRecentEntry->nextEntry = currentEntry;
-      currentEntry->previousEntry = mMostRecentEntry;
-      currentEntry->nextEntry = 0;
-      mMostRecentEntry = currentEntry;
-    }
+    s.mostRecentEntry->nextEntry = entry;
   }
+  s.mostRecentEntry = entry;
 
-  //debugging
-  //printEntryList();
-
-  return currentEntry;
+  return entry;
 }
 
 void QgsSvgCache::replaceElemParams( QDomElement& elem, const QColor& fill, const QColor& outline, double outlineWidth )
@@ -662,49 +710,24 @@ void QgsSvgCache::containsElemParams( const QDomElement& elem, bool& hasFillPara
   }
 }
 
-void QgsSvgCache::removeCacheEntry( QString s, QgsSvgCacheEntry* entry )
-{
-  delete entry;
-  mEntryLookup.remove( s , entry );
-}
-
-void QgsSvgCache::printEntryList()
+void QgsSvgCache::trimToMaximumSize( Shard& s )
 {
-  QgsDebugMsg( "****************svg cache entry list*************************" );
-  QgsDebugMsg( "Cache size: " + QString::number( mTotalSize ) );
-  QgsSvgCacheEntry* entry = mLeastRecentEntry;
-  while ( entry )
-  {
-    QgsDebugMsg( "***Entry:" );
-    QgsDebugMsg( "File:" + entry->file );
-    QgsDebugMsg( "Size:" + QString::number( entry->size ) );
-    QgsDebugMsg( "Width scale factor" + QString::number( entry->widthScaleFactor ) );
-    QgsDebugMsg( "Raster scale factor" + QString::number( entry->rasterScaleFactor ) );
-    entry = entry->nextEntry;
-  }
-}
-
-void QgsSvgCache::trimToMaximumSize()
-{
-  //only one entry in cache
-  if ( mLeastRecentEntry == mMostRecentEntry )
-  {
-    return;
-  }
-  QgsSvgCacheEntry* entry = mLeastRecentEntry;
-  while ( entry && ( mTotalSize > mMaximumSize ) )
+  //never remove the most recent entry, it is about to be used
+  QgsSvgCacheEntry* entry = s.leastRecentEntry;
+  while ( entry && entry != s.mostRecentEntry && ( s.totalSize > mMaximumSize / ShardCount ) )
   {
     QgsSvgCacheEntry* bkEntry = entry;
     entry = entry->nextEntry;
 
-    takeEntryFromList( bkEntry );
-    mEntryLookup.remove( bkEntry->file, bkEntry );
-    mTotalSize -= bkEntry->dataSize();
+    takeEntryFromList( s, bkEntry );
+    s.entryLookup.remove( bkEntry->file, bkEntry );
+    s.totalSize -= bkEntry->dataSize();
+    ++s.evictions;
     delete bkEntry;
   }
 }
 
-void QgsSvgCache::takeEntryFromList( QgsSvgCacheEntry* entry )
+void QgsSvgCache::takeEntryFromList( Shard& s, QgsSvgCacheEntry* entry )
 {
   if ( !entry )
   {
@@ -717,7 +740,7 @@ void QgsSvgCache::takeEntryFromList( QgsSvgCacheEntry* entry )
   }
   else
   {
-    mLeastRecentEntry = entry->nextEntry;
+    s.leastRecentEntry = entry->nextEntry;
   }
   if ( entry->nextEntry )
   {
@@ -725,10 +748,78 @@ void QgsSvgCache::takeEntryFromList( QgsSvgCacheEntry* entry )
   }
   else
   {
-    mMostRecentEntry = entry->previousEntry;
+    s.mostRecentEntry = entry->previousEntry;
+  }
+}
+
+void QgsSvgCache::clear()
+{
+  for ( int i = 0; i < ShardCount; ++i )
+  {
+    Shard& s = mShards[i];
+    QMutexLocker locker( &s.mutex );
+
+    QMultiHash< QString, QgsSvgCacheEntry* >::iterator it = s.entryLookup.begin();
+    for ( ; it != s.entryLookup.end(); ++it )
+    {
+      delete it.value();
+    }
+    s.entryLookup.clear();
+    s.documents.clear();
+    s.contents.clear();
+    s.leastRecentEntry = 0;
+    s.mostRecentEntry = 0;
+    s.totalSize = 0;
+    s.hits = 0;
+    s.misses = 0;
+    s.evictions = 0;
   }
 }
 
+int QgsSvgCache::hits() const
+{
+  int hits = 0;
+  for ( int i = 0; i < ShardCount; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    hits += mShards[i].hits;
+  }
+  return hits;
+}
+
+int QgsSvgCache::misses() const
+{
+  int misses = 0;
+  for ( int i = 0; i < ShardCount; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    misses += mShards[i].misses;
+  }
+  return misses;
+}
+
+int QgsSvgCache::evictions() const
+{
+  int evictions = 0;
+  for ( int i = 0; i < ShardCount; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    evictions += mShards[i].evictions;
+  }
+  return evictions;
+}
+
+long QgsSvgCache::totalSize() const
+{
+  long size = 0;
+  for ( int i = 0; i < ShardCount; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    size += mShards[i].totalSize;
+  }
+  return size;
+}
+
 void QgsSvgCache::downloadProgress( qint64 bytesReceived, qint64 bytesTotal )
 {
   QString msg = tr( "%1 of %2 bytes of svg image downloaded." ).arg( bytesReceived ).arg( bytesTotal < 0 ? QString( "unknown number of" ) : QString::number( bytesTotal ) );
@@ -18,15 +18,18 @@
 #ifndef QGSSVGCACHE_H
 #define QGSSVGCACHE_H
 
+#include <QCache>
 #include <QColor>
+#include <QDomDocument>
+#include <QImage>
 #include <QMap>
 #include <QMultiHash>
+#include <QMutex>
+#include <QPicture>
 #include <QString>
 #include <QUrl>
 
 class QDomElement;
-class QImage;
-class QPicture;
 
 class CORE_EXPORT QgsSvgCacheEntry
 {
@@ -68,7 +71,12 @@ class CORE_EXPORT QgsSvgCacheEntry
 
 /**A cache for images / pictures derived from svg files. This class supports parameter replacement in svg files
 according to the svg params specification (http://www.w3.org/TR/2009/WD-SVGParamPrimer-20090616/). Supported are
-the parameters 'fill-color', 'pen-color', 'outline-width', 'stroke-width'. E.g. <circle fill="param(fill-color red)" stroke="param(pen-color black)" stroke-width="param(outline-width 1)"*/
+the parameters 'fill-color', 'pen-color', 'outline-width', 'stroke-width'. E.g. <circle fill="param(fill-color red)" stroke="param(pen-color black)" stroke-width="param(outline-width 1)"
+
+The cache may be used from several render threads at once. Entries are spread over shards by file name, each with
+its own lock, so threads only contend when they use the same files. Svg files are parsed once and the parameters are
+replaced on a copy of the parsed document, so further sizes and colors of a symbol do not read the file again.
+Images and pictures are rendered without holding a lock.*/
 class CORE_EXPORT QgsSvgCache : public QObject
 {
     Q_OBJECT
@@ -86,11 +94,12 @@ class CORE_EXPORT QgsSvgCache : public QObject
      * @param outlineWidth width of outline
      * @param widthScaleFactor width scale factor
      * @param rasterScaleFactor raster scale factor
-     * @param fitsInCache
+     * @param fitsInCache set to false if the image would be too large, a null image is returned in that case
+     * @note returns the image by value since 2.4, the image data is shared with the cache
      */
-    const QImage& svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                              double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache );
-    /** Get SVG  as QPicture&.
+    QImage svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                       double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache );
+    /** Get SVG  as QPicture.
      * @param file Absolute or relative path to SVG file.
      * @param size size of cached image
      * @param fill color of fill
@@ -99,9 +108,10 @@ class CORE_EXPORT QgsSvgCache : public QObject
      * @param widthScaleFactor width scale factor
      * @param rasterScaleFactor raster scale factor
      * @param forceVectorOutput
+     * @note returns the picture by value since 2.4, the picture data is shared with the cache
      */
-    const QPicture& svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                                  double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput = false );
+    QPicture svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                           double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput = false );
 
     /**Tests if an svg file contains parameters for fill, outline color, outline width. If yes, possible default values are returned. If there are several
       default values in the svg file, only the first one is considered*/
@@ -111,6 +121,23 @@ class CORE_EXPORT QgsSvgCache : public QObject
     /**Get image data*/
     QByteArray getImageData( const QString &path ) const;
 
+    /**Removes all entries, parsed documents and statistics
+      @note added in 2.4 */
+    void clear();
+
+    /**Number of image and picture requests served from the cache
+      @note added in 2.4 */
+    int hits() const;
+    /**Number of image and picture requests that had to be rendered
+      @note added in 2.4 */
+    int misses() const;
+    /**Number of entries removed to keep the cache below its maximum size
+      @note added in 2.4 */
+    int evictions() const;
+    /**Estimated memory used by the entries in bytes
+      @note added in 2.4 */
+    long totalSize() const;
+
   signals:
     /** Emit a signal to be caught by qgisapp and display a msg on status bar */
     void statusChanged( const QString&  theStatusQString );
@@ -119,48 +146,60 @@ class CORE_EXPORT QgsSvgCache : public QObject
     //! protected constructor
     QgsSvgCache( QObject * parent = 0 );
 
-    /**Creates new cache entry and returns pointer to it
-     * @param file Absolute or relative path to SVG file. If the path is relative the file is searched by QgsSymbolLayerV2Utils::symbolNameToPath() in SVG paths.
-    in settings svg/searchPathsForSVG
-     * @param size size of cached image
-     * @param fill color of fill
-     * @param outline color of outline
-     * @param outlineWidth width of outline
-     * @param widthScaleFactor width scale factor
-     * @param rasterScaleFactor raster scale factor
-     */
-    QgsSvgCacheEntry* insertSVG( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                                 double widthScaleFactor, double rasterScaleFactor );
+  private slots:
+    void downloadProgress( qint64, qint64 );
 
-    void replaceParamsAndCacheSvg( QgsSvgCacheEntry* entry );
-    void cacheImage( QgsSvgCacheEntry* entry );
-    void cachePicture( QgsSvgCacheEntry* entry, bool forceVectorOutput = false );
-    /**Returns entry from cache or creates a new entry if it does not exist already*/
-    QgsSvgCacheEntry* cacheEntry( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                                  double widthScaleFactor, double rasterScaleFactor );
+  private:
+    //! number of independently locked parts of the cache
+    enum { ShardCount = 8 };
+
+    struct Shard
+    {
+      Shard();
+
+      mutable QMutex mutex;
+      /**Entry pointers accessible by file name*/
+      QMultiHash< QString, QgsSvgCacheEntry* > entryLookup;
+      /**Estimated total size of all images, pictures and svgContent*/
+      long totalSize;
+
+      //The shard keeps its entries on a double connected list, moving the current entry to the front.
+      //That way, removing entries for more space can start with the least used objects.
+      QgsSvgCacheEntry* leastRecentEntry;
+      QgsSvgCacheEntry* mostRecentEntry;
+
+      /**Parsed svg files by file name, null documents for files which could not be parsed*/
+      QCache< QString, QDomDocument > documents;
+      /**Svg content with replaced parameters, by file name and parameter values*/
+      QCache< QString, QByteArray > contents;
+
+      int hits;
+      int misses;
+      int evictions;
+    };
+
+    //Maximum cache size, shared equally by the shards
+    static const long mMaximumSize = 20000000;
 
-    /**Removes the least used items until the maximum size is under the limit*/
-    void trimToMaximumSize();
+    Shard mShards[ShardCount];
 
-    //Removes entry from the ordered list (but does not delete the entry itself)
-    void takeEntryFromList( QgsSvgCacheEntry* entry );
+    Shard& shard( const QString& file );
 
-  private slots:
-    void downloadProgress( qint64, qint64 );
+    /**Returns the matching entry and makes it the most recent one, 0 if there is none. Expects the shard to be locked*/
+    QgsSvgCacheEntry* findEntry( Shard& shard, const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                                 double widthScaleFactor, double rasterScaleFactor );
+    /**Creates a new entry as the most recent one. Expects the shard to be locked*/
+    QgsSvgCacheEntry* insertEntry( Shard& shard, const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                                   double widthScaleFactor, double rasterScaleFactor, const QByteArray& svgContent );
 
-  private:
-    /**Entry pointers accessible by file name*/
-    QMultiHash< QString, QgsSvgCacheEntry* > mEntryLookup;
-    /**Estimated total size of all images, pictures and svgContent*/
-    long mTotalSize;
+    /**Returns the svg content with replaced parameters, parsing the file if it is not in the shard yet*/
+    QByteArray svgContent( Shard& shard, const QString& file, const QColor& fill, const QColor& outline, double outlineWidth );
 
-    //The svg cache keeps the entries on a double connected list, moving the current entry to the front.
-    //That way, removing entries for more space can start with the least used objects.
-    QgsSvgCacheEntry* mLeastRecentEntry;
-    QgsSvgCacheEntry* mMostRecentEntry;
+    /**Removes the least used items until the maximum size is under the limit. Expects the shard to be locked*/
+    void trimToMaximumSize( Shard& shard );
 
-    //Maximum cache size
-    static const long mMaximumSize = 20000000;
+    //Removes entry from the ordered list (but does not delete the entry itself)
+    void takeEntryFromList( Shard& shard, QgsSvgCacheEntry* entry );
 
     /**Replaces parameters in elements of a dom node and calls method for all child nodes*/
     void replaceElemParams( QDomElement& elem, const QColor& fill, const QColor& outline, double outlineWidth );
@@ -168,12 +207,6 @@ class CORE_EXPORT QgsSvgCache : public QObject
     void containsElemParams( const QDomElement& elem, bool& hasFillParam, QColor& defaultFill, bool& hasOutlineParam, QColor& defaultOutline,
                              bool& hasOutlineWidthParam, double& defaultOutlineWidth ) const;
 
-    /**Release memory and remove cache entry from mEntryLookup*/
-    void removeCacheEntry( QString s, QgsSvgCacheEntry* entry );
-
-    /**For debugging*/
-    void printEntryList();
-
     /** SVG content to be rendered if SVG file was not found. */
     QByteArray mMissingSvg;
 };
@@ -19,6 +19,7 @@
 
 #include "qgsfield.h"
 #include "qgsvectorlayer.h"
+#include "qgsvectordataprovider.h"
 #include "qgslogger.h"
 #include "qgsattributeaction.h"
 #include "qgsmapcanvas.h"
@@ -27,10 +28,85 @@
 #include "qgsexpression.h"
 #include "qgsmaplayeractionregistry.h"
 
+#include <QDateTime>
 #include <QVariant>
+#include <QVector>
 
 #include <limits>
 
+//! maximum number of loaded rows which are appended to the model at once
+static const int LOAD_CHUNK_SIZE = 10000;
+
+/** Compares two attribute values by their type, NULL is sorted before all other values
+ */
+static bool variantLessThan( const QVariant &left, const QVariant &right )
+{
+  if ( left.isNull() )
+    return !right.isNull();
+
+  if ( right.isNull() )
+    return false;
+
+  switch ( left.type() )
+  {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+      return left.toLongLong() < right.toLongLong();
+
+    case QVariant::Double:
+      return left.toDouble() < right.toDouble();
+
+    case QVariant::Date:
+      return left.toDate() < right.toDate();
+
+    case QVariant::DateTime:
+      return left.toDateTime() < right.toDateTime();
+
+    default:
+      return left.toString().localeAwareCompare( right.toString() ) < 0;
+  }
+}
+
+template <typename T>
+static bool valueLessThan( const QPair<T, QgsFeatureId> &left, const QPair<T, QgsFeatureId> &right )
+{
+  return left.first < right.first;
+}
+
+static bool stringLessThan( const QPair<QString, QgsFeatureId> &left, const QPair<QString, QgsFeatureId> &right )
+{
+  return left.first.localeAwareCompare( right.first ) < 0;
+}
+
+/** Converts the cached values to T and sorts them once. Equal values get the same rank,
+ * NULL values get rank 0.
+ */
+template <typename T, typename LessThan>
+static void rankValues( const QHash<QgsFeatureId, QVariant> &cache, LessThan lessThan, QHash<QgsFeatureId, int> &ranks )
+{
+  QVector< QPair<T, QgsFeatureId> > values;
+  values.reserve( cache.size() );
+  for ( QHash<QgsFeatureId, QVariant>::const_iterator it = cache.constBegin(); it != cache.constEnd(); ++it )
+  {
+    if ( it.value().isNull() )
+      ranks.insert( it.key(), 0 );
+    else
+      values << qMakePair( it.value().value<T>(), it.key() );
+  }
+
+  qSort( values.begin(), values.end(), lessThan );
+
+  int rank = 0;
+  for ( int i = 0; i < values.size(); ++i )
+  {
+    if ( i == 0 || lessThan( values[i - 1], values[i] ) )
+      ++rank;
+    ranks.insert( values[i].second, rank );
+  }
+}
+
 QgsAttributeTableModel::QgsAttributeTableModel( QgsVectorLayerCache *layerCache, QObject *parent )
     : QAbstractTableModel( parent )
     , mLayerCache( layerCache )
@@ -80,6 +156,7 @@ void QgsAttributeTableModel::featureDeleted( QgsFeatureId fid )
 {
   QgsDebugMsgLevel( QString( "(%2) fid: %1" ).arg( fid ).arg( mFeatureRequest.filterType() ), 4 );
   mFieldCache.remove( fid );
+  mFieldCacheRanks.remove( fid );
 
   int row = idToRow( fid );
 
@@ -201,6 +278,11 @@ void QgsAttributeTableModel::attributeValueChanged( QgsFeatureId fid, int idx, c
   // No filter request: skip all possibly heavy checks
   if ( mFeatureRequest.filterType() == QgsFeatureRequest::FilterNone )
   {
+    if ( idx == mCachedField )
+    {
+      mFieldCache[ fid ] = value;
+      mFieldCacheRanks.remove( fid );
+    }
     setData( index( idToRow( fid ), fieldCol( idx ) ), value, Qt::EditRole );
   }
   else
@@ -217,7 +299,10 @@ void QgsAttributeTableModel::attributeValueChanged( QgsFeatureId fid, int idx, c
         else
         {
           if ( idx == mCachedField )
+          {
             mFieldCache[ fid ] = value;
+            mFieldCacheRanks.remove( fid );
+          }
           // Update representation
           setData( index( idToRow( fid ), fieldCol( idx ) ), value, Qt::EditRole );
         }
@@ -353,20 +438,54 @@ void QgsAttributeTableModel::loadLayer()
   removeRows( 0, rowCount() );
   endRemoveRows();
 
-  QgsFeatureIterator features = mLayerCache->getFeatures( mFeatureRequest );
+  QgsFeatureIterator features;
+  if ( loadsFeaturesOnDemand() )
+  {
+    // Only the ids are needed to create the rows. The displayed rows are fetched
+    // through the layer cache, so there is no need to fetch all features upfront.
+    QgsFeatureRequest request( mFeatureRequest );
+    switch ( request.filterType() )
+    {
+      case QgsFeatureRequest::FilterNone:
+      case QgsFeatureRequest::FilterFid:
+      case QgsFeatureRequest::FilterFids:
+        request.setFlags( request.flags() | QgsFeatureRequest::NoGeometry );
+        request.setSubsetOfAttributes( QgsAttributeList() );
+        break;
+
+      case QgsFeatureRequest::FilterRect:
+        request.setSubsetOfAttributes( QgsAttributeList() );
+        break;
+
+      case QgsFeatureRequest::FilterExpression:
+        break;
+    }
+    features = layer()->getFeatures( request );
+  }
+  else
+  {
+    // the layer cache holds all features, fill it while loading
+    features = mLayerCache->getFeatures( mFeatureRequest );
+  }
 
   int i = 0;
 
   QTime t;
   t.start();
 
+  QList<QgsFeatureId> ids;
   QgsFeature feat;
   while ( features.nextFeature( feat ) )
   {
     ++i;
+    ids << feat.id();
 
     if ( t.elapsed() > 1000 )
     {
+      // show the rows loaded so far
+      appendFeatureIds( ids );
+      ids.clear();
+
       bool cancel = false;
       emit( progress( i, cancel ) );
       if ( cancel )
@@ -374,15 +493,47 @@ void QgsAttributeTableModel::loadLayer()
 
       t.restart();
     }
-    mFeat = feat;
-    featureAdded( feat.id() );
+    else if ( ids.size() >= LOAD_CHUNK_SIZE )
+    {
+      appendFeatureIds( ids );
+      ids.clear();
+    }
   }
+  appendFeatureIds( ids );
+
+  // the cached column has to cover the new rows
+  if ( mCachedField != -1 )
+    prefetchColumnData( fieldCol( mCachedField ) );
 
   emit finished();
 
   mFieldCount = mAttributes.size();
 }
 
+bool QgsAttributeTableModel::loadsFeaturesOnDemand() const
+{
+  return layer() && layer()->dataProvider() &&
+         ( layer()->dataProvider()->capabilities() & QgsVectorDataProvider::SelectAtId );
+}
+
+void QgsAttributeTableModel::appendFeatureIds( const QList<QgsFeatureId> &ids )
+{
+  if ( ids.isEmpty() )
+    return;
+
+  int n = mRowIdMap.size();
+  beginInsertRows( QModelIndex(), n, n + ids.size() - 1 );
+
+  foreach ( QgsFeatureId fid, ids )
+  {
+    mIdRowMap.insert( fid, n );
+    mRowIdMap.insert( n, fid );
+    ++n;
+  }
+
+  endInsertRows();
+}
+
 void QgsAttributeTableModel::swapRows( QgsFeatureId a, QgsFeatureId b )
 {
   if ( a == b )
@@ -692,6 +843,7 @@ QgsFeature QgsAttributeTableModel::feature( const QModelIndex &idx ) const
 void QgsAttributeTableModel::prefetchColumnData( int column )
 {
   mFieldCache.clear();
+  mFieldCacheRanks.clear();
 
   if ( column == -1 )
   {
@@ -706,7 +858,10 @@ void QgsAttributeTableModel::prefetchColumnData( int column )
     QStringList fldNames;
     fldNames << fields[ fieldId ].name();
 
-    QgsFeatureIterator it = mLayerCache->getFeatures( QgsFeatureRequest().setFlags( QgsFeatureRequest::NoGeometry ).setSubsetOfAttributes( fldNames, fields ) );
+    QgsFeatureRequest request = QgsFeatureRequest().setFlags( QgsFeatureRequest::NoGeometry ).setSubsetOfAttributes( fldNames, fields );
+
+    // don't push every feature through the layer cache, if it does not hold all of them anyway
+    QgsFeatureIterator it = loadsFeaturesOnDemand() ? layer()->getFeatures( request ) : mLayerCache->getFeatures( request );
 
     QgsFeature f;
     while ( it.nextFeature( f ) )
@@ -715,7 +870,53 @@ void QgsAttributeTableModel::prefetchColumnData( int column )
     }
 
     mCachedField = fieldId;
+
+    // sort the values once, so comparing two rows while sorting is a comparison of their ranks
+    switch ( fields[ fieldId ].type() )
+    {
+      case QVariant::Int:
+      case QVariant::UInt:
+      case QVariant::LongLong:
+      case QVariant::ULongLong:
+        rankValues<qlonglong>( mFieldCache, valueLessThan<qlonglong>, mFieldCacheRanks );
+        break;
+
+      case QVariant::Double:
+        rankValues<double>( mFieldCache, valueLessThan<double>, mFieldCacheRanks );
+        break;
+
+      case QVariant::Date:
+        rankValues<QDate>( mFieldCache, valueLessThan<QDate>, mFieldCacheRanks );
+        break;
+
+      case QVariant::DateTime:
+        rankValues<QDateTime>( mFieldCache, valueLessThan<QDateTime>, mFieldCacheRanks );
+        break;
+
+      default:
+        rankValues<QString>( mFieldCache, stringLessThan, mFieldCacheRanks );
+        break;
+    }
+  }
+}
+
+bool QgsAttributeTableModel::sortLessThan( const QModelIndex &left, const QModelIndex &right ) const
+{
+  if ( mCachedField != -1 && left.column() < mFieldCount && mAttributes[ left.column()] == mCachedField )
+  {
+    QgsFeatureId leftId = rowToId( left.row() );
+    QgsFeatureId rightId = rowToId( right.row() );
+
+    // values changed after the column was cached have no rank
+    QHash<QgsFeatureId, int>::const_iterator leftRank = mFieldCacheRanks.constFind( leftId );
+    QHash<QgsFeatureId, int>::const_iterator rightRank = mFieldCacheRanks.constFind( rightId );
+    if ( leftRank != mFieldCacheRanks.constEnd() && rightRank != mFieldCacheRanks.constEnd() )
+      return leftRank.value() < rightRank.value();
+
+    return variantLessThan( mFieldCache.value( leftId ), mFieldCache.value( rightId ) );
   }
+
+  return variantLessThan( left.data( SortRole ), right.data( SortRole ) );
 }
 
 void QgsAttributeTableModel::setRequest( const QgsFeatureRequest& request )
@@ -194,6 +194,19 @@ class GUI_EXPORT QgsAttributeTableModel: public QAbstractTableModel
      */
     void prefetchColumnData( int column );
 
+    /**
+     * Compares the values of two rows in the same column for sorting. The rows of the
+     * column cached by prefetchColumnData() are compared by the rank of their values,
+     * which is computed once when the column is cached. The values of other columns
+     * are fetched and compared by their type.
+     *
+     * @param left  index of the left row
+     * @param right index of the right row
+     * @return true if the left row is sorted before the right row
+     * @note added in 2.4
+     */
+    bool sortLessThan( const QModelIndex &left, const QModelIndex &right ) const;
+
     void setRequest( const QgsFeatureRequest& request );
 
   signals:
@@ -275,12 +288,25 @@ class GUI_EXPORT QgsAttributeTableModel: public QAbstractTableModel
      */
     virtual bool loadFeatureAtId( QgsFeatureId fid ) const;
 
+    /**
+     * Returns true if the provider fetches single features efficiently. The rows are then
+     * loaded without attributes and the features of the displayed rows are fetched on demand.
+     */
+    bool loadsFeaturesOnDemand() const;
+
+    /**
+     * Appends rows for the features in one go
+     */
+    void appendFeatureIds( const QList<QgsFeatureId> &ids );
+
     QgsFeatureRequest mFeatureRequest;
 
     /** The currently cached column */
     int mCachedField;
     /** Allows to cache one specific column (used for sorting) */
     QHash<QgsFeatureId, QVariant> mFieldCache;
+    /** Ranks of the values in the field cache, equal values have the same rank and NULL has rank 0 */
+    QHash<QgsFeatureId, int> mFieldCacheRanks;
 
     /**
      * Holds the bounds of changed cells while an update operation is running
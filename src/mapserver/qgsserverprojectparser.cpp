@@ -23,6 +23,7 @@
 #include "qgsdatasourceuri.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsmslayercache.h"
+#include "qgsproviderregistry.h"
 #include "qgsrasterlayer.h"
 
 #include <QDomDocument>
@@ -75,6 +76,20 @@ void QgsServerProjectParser::projectLayerMap( QMap<QString, QgsMapLayer*>& layer
 {
   layerMap.clear();
 
+  // open the data sources of the layers which are not cached in parallel
+  QList< QPair<QString, QString> > dataSources;
+  foreach ( const QDomElement& elem, mProjectLayerElements )
+  {
+    QString provider = elem.firstChildElement( "provider" ).text();
+    QString absoluteUri = absoluteDataSource( elem );
+    if ( !provider.isEmpty() && !QgsMSLayerCache::instance()->searchLayer( absoluteUri, layerId( elem ) ) )
+    {
+      QString dataSource = elem.firstChildElement( "datasource" ).text();
+      dataSources << qMakePair( provider, QgsMapLayer::projectDataSource( provider, dataSource ) );
+    }
+  }
+  QgsProviderRegistry::instance()->prepareProviders( dataSources );
+
   QList<QDomElement>::const_iterator layerElemIt = mProjectLayerElements.constBegin();
   for ( ; layerElemIt != mProjectLayerElements.constEnd(); ++layerElemIt )
   {
@@ -86,6 +101,7 @@ void QgsServerProjectParser::projectLayerMap( QMap<QString, QgsMapLayer*>& layer
       layerMap.insert( layer->id(), layer );
     }
   }
+  QgsProviderRegistry::instance()->clearPreparedProviders();
 }
 
 QString QgsServerProjectParser::convertToAbsolutePath( const QString& file ) const
@@ -140,13 +156,8 @@ QString QgsServerProjectParser::convertToAbsolutePath( const QString& file ) con
   return projElems.join( "/" );
 }
 
-QgsMapLayer* QgsServerProjectParser::createLayerFromElement( const QDomElement& elem, bool useCache ) const
+QString QgsServerProjectParser::absoluteDataSource( const QDomElement& elem ) const
 {
-  if ( elem.isNull() || !mXMLDoc )
-  {
-    return 0;
-  }
-
   QDomElement dataSourceElem = elem.firstChildElement( "datasource" );
   QString uri = dataSourceElem.text();
   QString absoluteUri;
@@ -197,6 +208,17 @@ QgsMapLayer* QgsServerProjectParser::createLayerFromElement( const QDomElement&
       }
     }
   }
+  return absoluteUri;
+}
+
+QgsMapLayer* QgsServerProjectParser::createLayerFromElement( const QDomElement& elem, bool useCache ) const
+{
+  if ( elem.isNull() || !mXMLDoc )
+  {
+    return 0;
+  }
+
+  QString absoluteUri = absoluteDataSource( elem );
 
   QString id = layerId( elem );
   QgsMapLayer* layer = 0;
@@ -46,6 +46,10 @@ class QgsServerProjectParser
     /**Converts a (possibly relative) path to absolute*/
     QString convertToAbsolutePath( const QString& file ) const;
 
+    /**Returns the data source of a layer element with paths relative to the project made absolute.
+      The data source in the element is changed to the absolute one*/
+    QString absoluteDataSource( const QDomElement& elem ) const;
+
     /**Creates a maplayer object from <maplayer> element. The layer cash owns the maplayer, so don't delete it
     @return the maplayer or 0 in case of error*/
     QgsMapLayer* createLayerFromElement( const QDomElement& elem, bool useCache = true ) const;
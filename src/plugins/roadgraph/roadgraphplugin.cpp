@@ -140,7 +140,9 @@ void RoadGraphPlugin::unload()
 
 void RoadGraphPlugin::setGuiElementsToDefault()
 {
-
+  // the settings or the layers may have changed, the network is read again
+  if ( mQShortestPathDock )
+    mQShortestPathDock->resetNetwork();
 } // RoadGraphPlugin::setGuiElementsToDefault()
 
 //method defined in interface
@@ -197,19 +199,21 @@ QgisInterface* RoadGraphPlugin::iface()
   return mQGisIface;
 }
 
-const QgsGraphDirector* RoadGraphPlugin::director() const
+QgsVectorLayer* RoadGraphPlugin::roadLayer() const
 {
-  QString layerId;
-  QgsVectorLayer *layer = NULL;
   QMap< QString, QgsMapLayer* > mapLayers = QgsMapLayerRegistry::instance()->mapLayers();
   QMap< QString, QgsMapLayer* >::const_iterator it;
   for ( it = mapLayers.begin(); it != mapLayers.end(); ++it )
   {
-    if ( it.value()->name() != mSettings->mLayer )
-      continue;
-    layer = dynamic_cast< QgsVectorLayer* >( it.value() );
-    break;
+    if ( it.value()->name() == mSettings->mLayer )
+      return dynamic_cast< QgsVectorLayer* >( it.value() );
   }
+  return NULL;
+}
+
+const QgsGraphDirector* RoadGraphPlugin::director() const
+{
+  QgsVectorLayer *layer = roadLayer();
   if ( layer == NULL )
     return NULL;
   if ( layer->wkbType() == QGis::WKBLineString
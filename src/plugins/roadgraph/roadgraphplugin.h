@@ -31,6 +31,7 @@ class QDockWidget;
 
 //forward declarations RoadGraph plugins classes
 class QgsGraphDirector;
+class QgsVectorLayer;
 class RgShortestPathWidget;
 class RgLineVectorLayerSettings;
 
@@ -61,6 +62,11 @@ class RoadGraphPlugin: public QObject, public QgisPlugin
      */
     const QgsGraphDirector* director() const;
 
+    /**
+     * return the road layer chosen in the settings, NULL if there is none
+     */
+    QgsVectorLayer* roadLayer() const;
+
     /**
      * get time unit name
      */
@@ -16,6 +16,7 @@
  */
 
 //qt includes
+#include <QCheckBox>
 #include <qcombobox.h>
 #include <qlayout.h>
 #include <qpushbutton.h>
@@ -43,6 +44,7 @@
 #include <qgsgraphbuilder.h>
 #include <qgsgraph.h>
 #include <qgsgraphanalyzer.h>
+#include <qgscontractionhierarchy.h>
 
 // roadgraph plugin includes
 #include "roadgraphplugin.h"
@@ -52,6 +54,60 @@
 #include "settings.h"
 
 //standard includes
+#include <cmath>
+#include <limits>
+
+//! squared distance of a point to the segment a-b and the nearest point on it
+static double sqrDistToSegment( const QgsPoint& pt, const QgsPoint& a, const QgsPoint& b, QgsPoint& nearest )
+{
+  double dx = b.x() - a.x();
+  double dy = b.y() - a.y();
+  double len = dx * dx + dy * dy;
+  double t = 0.0;
+  if ( len > 0.0 )
+    t = qBound( 0.0, (( pt.x() - a.x() ) * dx + ( pt.y() - a.y() ) * dy ) / len, 1.0 );
+  nearest = QgsPoint( a.x() + t * dx, a.y() + t * dy );
+  return nearest.sqrDist( pt );
+}
+
+//! position of a point on the arc, 0 at its out vertex and 1 at its in vertex
+static double arcFraction( const QgsGraph* graph, const QgsGraphArc& arc, const QgsPoint& pt )
+{
+  const QgsPoint& a = graph->vertex( arc.outVertex() ).point();
+  double len = a.sqrDist( graph->vertex( arc.inVertex() ).point() );
+  if ( len <= 0.0 )
+    return 0.0;
+  return qBound( 0.0, sqrt( a.sqrDist( pt ) / len ), 1.0 );
+}
+
+//! arcs from u to v and from v to u
+static QVector< int > arcsBetween( const QgsGraph* graph, int u, int v )
+{
+  QVector< int > arcs;
+  foreach ( int i, graph->vertex( u ).outArc() )
+  {
+    if ( graph->arc( i ).inVertex() == v )
+      arcs << i;
+  }
+  if ( u != v )
+  {
+    foreach ( int i, graph->vertex( v ).outArc() )
+    {
+      if ( graph->arc( i ).inVertex() == u )
+        arcs << i;
+    }
+  }
+  return arcs;
+}
+
+//! properties of a part of an arc
+static QVector< QVariant > partOfArc( const QgsGraphArc& arc, double fraction )
+{
+  QVector< QVariant > properties = arc.properties();
+  for ( int i = 0; i < properties.size(); ++i )
+    properties[i] = properties[i].toDouble() * fraction;
+  return properties;
+}
 
 RgShortestPathWidget::RgShortestPathWidget( QWidget* theParent, RoadGraphPlugin *thePlugin )   : QDockWidget( theParent ), mPlugin( thePlugin )
 {
@@ -115,6 +171,11 @@ RgShortestPathWidget::RgShortestPathWidget( QWidget* theParent, RoadGraphPlugin
   h->addWidget( mPathTimeLineEdit );
   v->addLayout( h );
 
+  mKeepNetworkCheckBox = new QCheckBox( tr( "Keep network for next paths" ), myWidget );
+  mKeepNetworkCheckBox->setToolTip( tr( "The road network is read once and preprocessed, then each path is found in a few milliseconds. "
+                                        "It is read again after the road layer was edited." ) );
+  v->addWidget( mKeepNetworkCheckBox );
+
   h = new QHBoxLayout();
   mCalculate = new QPushButton( tr( "Calculate" ), myWidget );
   h->addWidget( mCalculate );
@@ -164,6 +225,11 @@ RgShortestPathWidget::RgShortestPathWidget( QWidget* theParent, RoadGraphPlugin
   mrbPath = new QgsRubberBand( mPlugin->iface()->mapCanvas(), QGis::Line );
   mrbPath->setWidth( 2 );
 
+  mNetwork = NULL;
+  mNetworkLayer = NULL;
+  mHierarchy[0] = NULL;
+  mHierarchy[1] = NULL;
+
   connect( mPlugin->iface()->mapCanvas(), SIGNAL( extentsChanged() ), this, SLOT( mapCanvasExtentsChanged() ) );
 
 } //RgShortestPathWidget::RgShortestPathWidget()
@@ -175,8 +241,27 @@ RgShortestPathWidget::~RgShortestPathWidget()
   delete mrbFrontPoint;
   delete mrbBackPoint;
   delete mrbPath;
+
+  resetNetwork();
 } //RgShortestPathWidget::~RgShortestPathWidget()
 
+void RgShortestPathWidget::resetNetwork()
+{
+  delete mHierarchy[0];
+  delete mHierarchy[1];
+  delete mNetwork;
+  mHierarchy[0] = NULL;
+  mHierarchy[1] = NULL;
+  mNetwork = NULL;
+  mNetworkKey = QString();
+
+  if ( mNetworkLayer )
+  {
+    disconnect( mNetworkLayer, 0, this, 0 );
+    mNetworkLayer = NULL;
+  }
+}
+
 void RgShortestPathWidget::mapCanvasExtentsChanged()
 {
   // update rubberbands
@@ -239,6 +324,9 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
     return NULL;
   }
 
+  if ( mKeepNetworkCheckBox->isChecked() )
+    return getPathFromNetwork( p1, p2 );
+
   QgsGraphBuilder builder(
     mPlugin->iface()->mapCanvas()->mapSettings().destinationCrs(),
     mPlugin->iface()->mapCanvas()->mapSettings().hasCrsTransformEnabled(),
@@ -310,6 +398,165 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
   return shortestpathTree;
 }
 
+int RgShortestPathWidget::nearestArc( const QgsPoint& pt, QgsPoint& tiedPoint ) const
+{
+  int nearest = -1;
+  double minDist = std::numeric_limits<double>::max();
+  for ( int i = 0; i < mNetwork->arcCount(); ++i )
+  {
+    const QgsGraphArc& arc = mNetwork->arc( i );
+    QgsPoint pointOnArc;
+    double dist = sqrDistToSegment( pt, mNetwork->vertex( arc.outVertex() ).point(),
+                                    mNetwork->vertex( arc.inVertex() ).point(), pointOnArc );
+    if ( dist < minDist )
+    {
+      minDist = dist;
+      nearest = i;
+      tiedPoint = pointOnArc;
+    }
+  }
+  return nearest;
+}
+
+QgsGraph* RgShortestPathWidget::getPathFromNetwork( QgsPoint& p1, QgsPoint& p2 )
+{
+  const QgsMapSettings& mapSettings = mPlugin->iface()->mapCanvas()->mapSettings();
+  QString networkKey = QString( "%1:%2:%3" )
+                       .arg( mapSettings.destinationCrs().authid() )
+                       .arg( mapSettings.hasCrsTransformEnabled() )
+                       .arg( mPlugin->topologyToleranceFactor() );
+  if ( mNetwork == NULL || networkKey != mNetworkKey )
+  {
+    resetNetwork();
+
+    const QgsGraphDirector *director = mPlugin->director();
+    if ( director == NULL )
+    {
+      QMessageBox::critical( this, tr( "Plugin isn't configured" ), tr( "Plugin isn't configured!" ) );
+      return NULL;
+    }
+    connect( director, SIGNAL( buildProgress( int, int ) ), mPlugin->iface()->mainWindow(), SLOT( showProgress( int, int ) ) );
+    connect( director, SIGNAL( buildMessage( QString ) ), mPlugin->iface()->mainWindow(), SLOT( showStatusMessage( QString ) ) );
+
+    QgsGraphBuilder builder( mapSettings.destinationCrs(), mapSettings.hasCrsTransformEnabled(), mPlugin->topologyToleranceFactor() );
+    QVector< QgsPoint > tiedPoint;
+    director->makeGraph( &builder, QVector< QgsPoint >(), tiedPoint );
+    delete director;
+
+    mNetwork = builder.graph();
+    mNetworkKey = networkKey;
+
+    // the network includes uncommitted edits, every change of the road layer invalidates it
+    mNetworkLayer = mPlugin->roadLayer();
+    if ( mNetworkLayer )
+    {
+      connect( mNetworkLayer, SIGNAL( layerModified() ), this, SLOT( resetNetwork() ) );
+      connect( mNetworkLayer, SIGNAL( editingStopped() ), this, SLOT( resetNetwork() ) );
+      connect( mNetworkLayer, SIGNAL( layerDeleted() ), this, SLOT( resetNetwork() ) );
+    }
+  }
+
+  if ( mNetwork->arcCount() == 0 )
+  {
+    mPlugin->iface()->messageBar()->pushMessage(
+      tr( "Cannot calculate path" ),
+      tr( "The created graph is empty. Please check your input data." ),
+      QgsMessageBar::WARNING,
+      mPlugin->iface()->messageTimeout()
+    );
+    resetNetwork();
+    return NULL;
+  }
+
+  int criterionNum = 0;
+  if ( mCriterionName->currentIndex() > 0 )
+    criterionNum = 1;
+  if ( mHierarchy[ criterionNum ] == NULL )
+    mHierarchy[ criterionNum ] = new QgsContractionHierarchy( mNetwork, criterionNum );
+
+  // the points are tied to the nearest arc, the path may start and end on every
+  // arc between the two vertices of that arc
+  int startArc = nearestArc( mFrontPoint, p1 );
+  int endArc = nearestArc( mBackPoint, p2 );
+
+  QVector< int > startArcs = arcsBetween( mNetwork, mNetwork->arc( startArc ).outVertex(), mNetwork->arc( startArc ).inVertex() );
+  QVector< int > endArcs = arcsBetween( mNetwork, mNetwork->arc( endArc ).outVertex(), mNetwork->arc( endArc ).inVertex() );
+
+  // from p1 the path leaves along the start arcs, p2 is reached along the end arcs
+  QVector< int > startVertices;
+  QVector< double > startCosts;
+  foreach ( int i, startArcs )
+  {
+    const QgsGraphArc& arc = mNetwork->arc( i );
+    startVertices << arc.inVertex();
+    startCosts << ( 1.0 - arcFraction( mNetwork, arc, p1 ) ) * arc.property( criterionNum ).toDouble();
+  }
+  QVector< int > endVertices;
+  QVector< double > endCosts;
+  int directArc = -1;
+  double directCost = std::numeric_limits<double>::infinity();
+  foreach ( int i, endArcs )
+  {
+    const QgsGraphArc& arc = mNetwork->arc( i );
+    double endFraction = arcFraction( mNetwork, arc, p2 );
+    endVertices << arc.outVertex();
+    endCosts << endFraction * arc.property( criterionNum ).toDouble();
+
+    // both points on the same arc, p1 before p2
+    double startFraction = arcFraction( mNetwork, arc, p1 );
+    if ( startArcs.contains( i ) && startFraction <= endFraction &&
+         ( endFraction - startFraction ) * arc.property( criterionNum ).toDouble() < directCost )
+    {
+      directCost = ( endFraction - startFraction ) * arc.property( criterionNum ).toDouble();
+      directArc = i;
+    }
+  }
+
+  QVector< int > arcs;
+  int start = -1;
+  double cost = mHierarchy[ criterionNum ]->shortestPath( startVertices, startCosts, endVertices, endCosts, &arcs, &start );
+  if ( std::isinf( cost ) && directArc == -1 )
+  {
+    QMessageBox::critical( this, tr( "Path not found" ), tr( "Path not found" ) );
+    return NULL;
+  }
+
+  // the path as a graph from p1 to p2, like the shortest path tree
+  QgsGraph *path = new QgsGraph();
+  int last = path->addVertex( p1 );
+  if ( directCost <= cost )
+  {
+    const QgsGraphArc& arc = mNetwork->arc( directArc );
+    path->addArc( last, path->addVertex( p2 ), partOfArc( arc, arcFraction( mNetwork, arc, p2 ) - arcFraction( mNetwork, arc, p1 ) ) );
+    return path;
+  }
+
+  const QgsGraphArc& firstArc = mNetwork->arc( startArcs[ start ] );
+  int vertex = path->addVertex( mNetwork->vertex( firstArc.inVertex() ).point() );
+  path->addArc( last, vertex, partOfArc( firstArc, 1.0 - arcFraction( mNetwork, firstArc, p1 ) ) );
+  last = vertex;
+  int networkVertex = firstArc.inVertex();
+  foreach ( int i, arcs )
+  {
+    const QgsGraphArc& arc = mNetwork->arc( i );
+    vertex = path->addVertex( mNetwork->vertex( arc.inVertex() ).point() );
+    path->addArc( last, vertex, arc.properties() );
+    last = vertex;
+    networkVertex = arc.inVertex();
+  }
+
+  // the cheapest end arc leaving the last vertex
+  int lastArc = -1;
+  for ( int i = 0; i < endVertices.size(); ++i )
+  {
+    if ( endVertices[i] == networkVertex && ( lastArc == -1 || endCosts[i] < endCosts[ lastArc ] ) )
+      lastArc = i;
+  }
+  const QgsGraphArc& arc = mNetwork->arc( endArcs[ lastArc ] );
+  path->addArc( last, path->addVertex( p2 ), partOfArc( arc, arcFraction( mNetwork, arc, p2 ) ) );
+  return path;
+}
+
 void RgShortestPathWidget::findingPath()
 {
   QgsPoint p1, p2;
@@ -365,6 +612,7 @@ void RgShortestPathWidget::clear()
   mrbPath->reset( QGis::Line );
   mPathCostLineEdit->setText( QString() );
   mPathTimeLineEdit->setText( QString() );
+  resetNetwork();
 }
 
 void RgShortestPathWidget::exportPath()
@@ -22,6 +22,7 @@
 
 // forward declaration
 
+class QCheckBox;
 class QComboBox;
 class QLineEdit;
 class QPushButton;
@@ -33,6 +34,8 @@ class QgsMapCanvas;
 class RoadGraphPlugin;
 
 class QgsGraph;
+class QgsContractionHierarchy;
+class QgsVectorLayer;
 
 /**
 @author Sergey Yakushev
@@ -55,6 +58,12 @@ class RgShortestPathWidget : public QDockWidget
      */
     ~RgShortestPathWidget();
 
+  public slots:
+    /**
+     * drop the preprocessed network, it is built again for the next path
+     */
+    void resetNetwork();
+
   private slots:
     /**
      * export path
@@ -107,6 +116,16 @@ class RgShortestPathWidget : public QDockWidget
      */
     QgsGraph* getPath( QgsPoint& p1, QgsPoint& p2 );
 
+    /**
+     * return path as a graph, using the preprocessed network
+     */
+    QgsGraph* getPathFromNetwork( QgsPoint& p1, QgsPoint& p2 );
+
+    /**
+     * return the index of the network arc next to the point, -1 if there is no arc
+     */
+    int nearestArc( const QgsPoint& pt, QgsPoint& tiedPoint ) const;
+
     /**
      * This line edit show front points coordinates
      */
@@ -132,6 +151,11 @@ class RgShortestPathWidget : public QDockWidget
      */
     QLineEdit *mPathTimeLineEdit;
 
+    /**
+     * keep the network and its contraction hierarchies for the next paths
+     */
+    QCheckBox *mKeepNetworkCheckBox;
+
     /**
      * this button called to find shortest path
      */
@@ -181,5 +205,25 @@ class RgShortestPathWidget : public QDockWidget
      * show shortest path
      */
     QgsRubberBand *mrbPath;
+
+    /**
+     * network without tied points, kept for the next paths
+     */
+    QgsGraph *mNetwork;
+
+    /**
+     * settings the network was built with
+     */
+    QString mNetworkKey;
+
+    /**
+     * road layer the network was read from, its edits and removal reset the network
+     */
+    QgsVectorLayer *mNetworkLayer;
+
+    /**
+     * contraction hierarchies of the network for length and time
+     */
+    QgsContractionHierarchy *mHierarchy[2];
 };
 #endif
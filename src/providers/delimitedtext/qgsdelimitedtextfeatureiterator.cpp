@@ -467,6 +467,7 @@ QgsDelimitedTextFeatureSource::QgsDelimitedTextFeatureSource( const QgsDelimited
 {
   mFile = new QgsDelimitedTextFile();
   mFile->setFromUrl( p->mFile->url() );
+  mFile->setLineIndex( p->mFile->lineIndex() );
 }
 
 QgsDelimitedTextFeatureSource::~QgsDelimitedTextFeatureSource()
@@ -28,16 +28,43 @@
 #include <QRegExp>
 #include <QUrl>
 
+#include <cstring>
+
 static QString DefaultFieldName( "field_%1" );
 static QRegExp InvalidFieldRegexp( "^\\d*(\\.\\d*)?$" );
 // field_ is optional in following regexp to simplify QgsDelimitedTextFile::fieldNumber()
 static QRegExp DefaultFieldRegexp( "^(?:field_)?(\\d+)$", Qt::CaseInsensitive );
 
+// Number of lines between entries in the line index
+#define LINE_INDEX_INTERVAL 64
+
+// Classes of ASCII bytes used by parseQuotedBytes
+#define BYTE_DELIM 1
+#define BYTE_QUOTE 2
+
+// Encodings in which every byte below 0x80 is the ASCII character it
+// represents, so that lines and fields can be split before decoding.
+static bool isByteSafeCodec( QTextCodec *codec )
+{
+  QByteArray name = codec->name().toUpper();
+  return name == "UTF-8"
+         || name == "US-ASCII"
+         || name.startsWith( "ISO-8859-" )
+         || name.startsWith( "WINDOWS-125" )
+         || name.startsWith( "KOI8-" );
+}
+
 QgsDelimitedTextFile::QgsDelimitedTextFile( QString url ) :
     mFileName( QString() ),
     mEncoding( "UTF-8" ),
     mFile( 0 ),
     mStream( 0 ),
+    mCodec( 0 ),
+    mByteMode( false ),
+    mUtf8( false ),
+    mParseBytes( false ),
+    mStartPosition( 0 ),
+    mLinePosition( -1 ),
     mUseWatcher( true ),
     mWatcher( 0 ),
     mDefinitionValid( false ),
@@ -87,6 +114,10 @@ void QgsDelimitedTextFile::close()
   mRecordNumber = -1;
   mMaxRecordNumber = -1;
   mHoldCurrentRecord = false;
+  mCodec = 0;
+  mByteMode = false;
+  mParseBytes = false;
+  mLinePosition = -1;
 }
 
 bool QgsDelimitedTextFile::open()
@@ -103,11 +134,51 @@ bool QgsDelimitedTextFile::open()
     }
     if ( mFile )
     {
-      mStream = new QTextStream( mFile );
-      if ( ! mEncoding.isEmpty() )
+      if ( ! mEncoding.isEmpty() ) mCodec = QTextCodec::codecForName( mEncoding.toAscii() );
+      if ( ! mCodec ) mCodec = QTextCodec::codecForLocale();
+
+      // Read the file as bytes if the encoding allows it, so that line offsets
+      // can be indexed and CSV records split without decoding every character.
+      // As QTextStream does, a byte order mark overrides the encoding.
+
+      QByteArray head = mFile->peek( 4 );
+      mStartPosition = 0;
+      if ( head.startsWith( "\xef\xbb\xbf" ) )
       {
-        QTextCodec *codec =  QTextCodec::codecForName( mEncoding.toAscii() );
-        mStream->setCodec( codec );
+        mCodec = QTextCodec::codecForName( "UTF-8" );
+        mStartPosition = 3;
+      }
+      bool unicodeBom = head.startsWith( "\xff\xfe" ) || head.startsWith( "\xfe\xff" )
+                        || head == QByteArray( "\0\0\xfe\xff", 4 );
+      mByteMode = ! unicodeBom && isByteSafeCodec( mCodec );
+      mUtf8 = mCodec->name().toUpper() == "UTF-8";
+
+      if ( mByteMode )
+      {
+        mFile->seek( mStartPosition );
+      }
+      else
+      {
+        mStream = new QTextStream( mFile );
+        mStream->setCodec( mCodec );
+      }
+
+      // Single byte delimiters and quotes can be located in the raw line
+
+      mParseBytes = mByteMode && mType == DelimTypeCSV
+                    && ( mEscapeChar.isEmpty() || mEscapeChar == mQuoteChar );
+      memset( mByteClass, 0, sizeof( mByteClass ) );
+      for ( int i = 0; mParseBytes && i < mDelimChars.size(); i++ )
+      {
+        ushort c = mDelimChars[i].unicode();
+        mParseBytes = c > 0 && c < 0x80;
+        if ( mParseBytes ) mByteClass[c] |= BYTE_DELIM;
+      }
+      for ( int i = 0; mParseBytes && i < mQuoteChar.size(); i++ )
+      {
+        ushort c = mQuoteChar[i].unicode();
+        mParseBytes = c > 0 && c < 0x80;
+        if ( mParseBytes ) mByteClass[c] |= BYTE_QUOTE;
       }
       if ( mUseWatcher )
       {
@@ -123,6 +194,7 @@ bool QgsDelimitedTextFile::open()
 void QgsDelimitedTextFile::updateFile()
 {
   close();
+  mLineIndex.clear();
   emit( fileUpdated() );
 }
 
@@ -130,6 +202,7 @@ void QgsDelimitedTextFile::updateFile()
 void QgsDelimitedTextFile::resetDefinition()
 {
   close();
+  mLineIndex.clear();
   mFieldNames.clear();
   mMaxFieldCount = 0;
 }
@@ -528,7 +601,8 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextRecord( QStringList &reco
 
     // Find the first non-blank line to read
     QString buffer;
-    status = nextLine( buffer, true );
+    bool parseBytes = mParseBytes && mFile;
+    status = parseBytes ? nextRawLine( true ) : nextLine( buffer, true );
     if ( status != RecordOk ) return RecordEOF;
 
     mCurrentRecord.clear();
@@ -538,7 +612,15 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextRecord( QStringList &reco
       mRecordNumber++;
       if ( mRecordNumber > mMaxRecordNumber ) mMaxRecordNumber = mRecordNumber;
     }
-    status = ( this->*mParser )( buffer, mCurrentRecord );
+    if ( ! parseBytes || ! parseQuotedBytes( mLineBytes, mCurrentRecord, status ) )
+    {
+      if ( parseBytes )
+      {
+        mCurrentRecord.clear();
+        buffer = decodeBytes( mLineBytes.constData(), mLineBytes.size() );
+      }
+      status = ( this->*mParser )( buffer, mCurrentRecord );
+    }
   }
   if ( status == RecordOk )
   {
@@ -554,16 +636,15 @@ QgsDelimitedTextFile::Status  QgsDelimitedTextFile::reset()
   if ( ! isValid() || ! open() ) return InvalidDefinition;
 
   // Reset the file pointer
-  mStream->seek( 0 );
-  mLineNumber = 0;
+  seekStart();
   mRecordNumber = -1;
   mRecordLineNumber = -1;
 
   // Skip header lines
+  QString buffer;
   for ( int i = mSkipLines; i-- > 0; )
   {
-    if ( mStream->readLine().isNull() ) return RecordEOF;
-    mLineNumber++;
+    if ( nextLine( buffer ) != RecordOk ) return RecordEOF;
   }
   // Read the column names
   Status result = RecordOk;
@@ -577,14 +658,35 @@ QgsDelimitedTextFile::Status  QgsDelimitedTextFile::reset()
   return result;
 }
 
+void QgsDelimitedTextFile::seekStart()
+{
+  if ( mStream )
+  {
+    mStream->seek( 0 );
+  }
+  else
+  {
+    mFile->seek( mStartPosition );
+  }
+  mLineNumber = 0;
+}
+
 QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextLine( QString &buffer, bool skipBlank )
 {
-  if ( ! mStream )
+  if ( ! mFile )
   {
     Status status = reset();
     if ( status != RecordOk ) return status;
   }
 
+  if ( mByteMode )
+  {
+    Status status = nextRawLine( skipBlank );
+    if ( status == RecordOk ) buffer = decodeBytes( mLineBytes.constData(), mLineBytes.size() );
+    return status;
+  }
+
+  mLinePosition = -1;
   while ( ! mStream->atEnd() )
   {
     buffer = mStream->readLine();
@@ -598,19 +700,84 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextLine( QString &buffer, bo
   return RecordEOF;
 }
 
+QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextRawLine( bool skipBlank )
+{
+  while ( ! mFile->atEnd() )
+  {
+    mLinePosition = mFile->pos();
+    mLineBytes = mFile->readLine();
+    if ( mLineBytes.isEmpty() ) break;
+    mLineNumber++;
+
+    // Record the offset of every LINE_INDEX_INTERVAL lines as the file
+    // is read sequentially
+    if (( mLineNumber - 1 ) % LINE_INDEX_INTERVAL == 0
+        && ( mLineNumber - 1 ) / LINE_INDEX_INTERVAL == mLineIndex.size() )
+    {
+      mLineIndex.append( mLinePosition );
+    }
+
+    // Strip the line terminator as QTextStream::readLine does
+    int size = mLineBytes.size();
+    if ( mLineBytes[size-1] == '\n' )
+    {
+      size--;
+      if ( size > 0 && mLineBytes[size-1] == '\r' ) size--;
+      mLineBytes.truncate( size );
+    }
+    if ( skipBlank && mLineBytes.isEmpty() ) continue;
+    return RecordOk;
+  }
+
+  mLineBytes.clear();
+  return RecordEOF;
+}
+
+QString QgsDelimitedTextFile::decodeBytes( const char *data, int size )
+{
+  if ( mUtf8 ) return QString::fromUtf8( data, size );
+  return mCodec->toUnicode( data, size );
+}
+
+int QgsDelimitedTextFile::lineIndexInterval()
+{
+  return LINE_INDEX_INTERVAL;
+}
+
+void QgsDelimitedTextFile::setLineIndex( const QVector<qint64> &lineIndex )
+{
+  mLineIndex = lineIndex;
+}
+
 bool QgsDelimitedTextFile::setNextLineNumber( long nextLineNumber )
 {
-  if ( ! mStream ) return false;
+  if ( ! mFile ) return false;
+
+  // If the line index has an entry between the current position and the
+  // requested line then seek to it rather than reading the lines in between.
+
+  if ( mByteMode && nextLineNumber > 0 && ! mLineIndex.isEmpty() )
+  {
+    int entry = qMin(( int )(( nextLineNumber - 1 ) / LINE_INDEX_INTERVAL ), mLineIndex.size() - 1 );
+    long entryLineNumber = ( long ) entry * LINE_INDEX_INTERVAL + 1;
+    if ( mLineNumber > nextLineNumber - 1 || mLineNumber < entryLineNumber - 1 )
+    {
+      if ( ! mFile->seek( mLineIndex[entry] ) ) return false;
+      mRecordNumber = -1;
+      mLineNumber = entryLineNumber - 1;
+    }
+  }
+
   if ( mLineNumber > nextLineNumber - 1 )
   {
     mRecordNumber = -1;
-    mStream->seek( 0 );
-    mLineNumber = 0;
+    seekStart();
   }
   QString buffer;
   while ( mLineNumber < nextLineNumber - 1 )
   {
-    if ( nextLine( buffer, false ) != RecordOk ) return false;
+    Status status = mByteMode ? nextRawLine( false ) : nextLine( buffer, false );
+    if ( status != RecordOk ) return false;
   }
   return true;
 
@@ -837,6 +1004,110 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
   return status;
 }
 
+// Equivalent of parseQuoted working on the undecoded line.  Fields are located
+// by scanning for the ASCII delimiter and quote bytes, and each field is then
+// decoded in one call rather than appended character by character.  The
+// whitespace rules of parseQuoted depend on QChar::isSpace, so lines with
+// non-ASCII characters where those rules apply are left to parseQuoted.
+
+bool QgsDelimitedTextFile::parseQuotedBytes( const QByteArray &line, QStringList &fields, Status &status )
+{
+  const char *data = line.constData();
+  int size = line.size();
+  bool escapeQuotes = ! mEscapeChar.isEmpty();
+  QByteArray quotedField; // Content of a quoted field
+  int fieldStart = 0;     // Start of an unquoted field
+  int segmentStart = 0;   // Start of the unescaped part of a quoted field
+  bool quoted = false;    // In quotes
+  char quoteChar = 0;     // Actual quote character used to open quotes
+  bool started = false;   // Non-blank chars in field or quotes started
+  bool ended = false;     // Quoted field ended
+
+  for ( int cp = 0; cp < size; cp++ )
+  {
+    unsigned char c = data[cp];
+
+    if ( c >= 0x80 )
+    {
+      if ( ! quoted && ( ! started || ended ) ) return false;
+      continue;
+    }
+
+    if ( mByteClass[c] & BYTE_DELIM )
+    {
+      if ( quoted ) continue;
+      appendField( fields, ended ? decodeBytes( quotedField.constData(), quotedField.size() )
+                   : decodeBytes( data + fieldStart, cp - fieldStart ), ended );
+      fieldStart = cp + 1;
+      started = false;
+      ended = false;
+    }
+    else if ( mByteClass[c] & BYTE_QUOTE )
+    {
+      if ( quoted )
+      {
+        if ( c != quoteChar ) continue;
+        // Quote escaped by repeating it
+        if ( escapeQuotes && cp + 1 < size && data[cp+1] == quoteChar )
+        {
+          cp++;
+          quotedField.append( data + segmentStart, cp - segmentStart );
+          segmentStart = cp + 1;
+        }
+        else
+        {
+          quotedField.append( data + segmentStart, cp - segmentStart );
+          quoted = false;
+          ended = true;
+        }
+      }
+      else if ( ! started )
+      {
+        quotedField.clear();
+        segmentStart = cp + 1;
+        quoteChar = c;
+        quoted = true;
+        started = true;
+      }
+      else
+      {
+        fields.clear();
+        status = RecordInvalid;
+        return true;
+      }
+    }
+    else if ( quoted )
+    {
+      continue;
+    }
+    else if ( c == ' ' || ( c >= '\t' && c <= '\r' ) )
+    {
+      continue;
+    }
+    else
+    {
+      if ( ended )
+      {
+        fields.clear();
+        status = RecordInvalid;
+        return true;
+      }
+      started = true;
+    }
+  }
+
+  // Quoted field continues on the next line
+  if ( quoted ) return false;
+
+  if ( started )
+  {
+    appendField( fields, ended ? decodeBytes( quotedField.constData(), quotedField.size() )
+                 : decodeBytes( data + fieldStart, size - fieldStart ), ended );
+  }
+  status = RecordOk;
+  return true;
+}
+
 bool QgsDelimitedTextFile::isValid()
 {
 
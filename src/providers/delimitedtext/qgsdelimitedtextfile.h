@@ -21,11 +21,13 @@
 #include <QStringList>
 #include <QRegExp>
 #include <QUrl>
+#include <QVector>
 
 class QgsFeature;
 class QgsField;
 class QFile;
 class QFileSystemWatcher;
+class QTextCodec;
 class QTextStream;
 
 
@@ -264,6 +266,26 @@ class QgsDelimitedTextFile : public QObject
      */
     Status reset();
 
+    /** Return the index of line offsets in the file built while reading it.
+     *  Entry i is the byte offset of line number i * lineIndexInterval() + 1.
+     *  The index is only built for encodings that can be read byte by byte
+     *  (eg UTF-8, ISO-8859-x), otherwise it is empty.
+     *  @return lineIndex The offsets of lines read so far
+     */
+    const QVector<qint64> &lineIndex() { return mLineIndex; }
+
+    /** Set the index of line offsets, for example from the index built by
+     *  another reader of the same file or loaded from a saved index. It is
+     *  used by setNextRecordId() to seek close to a record rather than
+     *  reading the file from the beginning.
+     *  @param lineIndex The line offsets as returned by lineIndex()
+     */
+    void setLineIndex( const QVector<qint64> &lineIndex );
+
+    /** Number of lines between entries of the line index
+     */
+    static int lineIndexInterval();
+
     /** Return a string defining the type of the delimiter as a string
      *  @return type The delimiter type as a string
      */
@@ -333,6 +355,24 @@ class QgsDelimitedTextFile : public QObject
      */
     Status nextLine( QString &buffer, bool skipBlank = false );
 
+    /** Read the next line into mLineBytes without decoding it.  Only
+     * used when the file is read byte by byte.
+     */
+    Status nextRawLine( bool skipBlank = false );
+
+    /** Position the file before the first line */
+    void seekStart();
+
+    /** Decode bytes read from the file using the file encoding */
+    QString decodeBytes( const char *data, int size );
+
+    /** Parse a CSV line directly from the bytes read from the file.  Only used
+     * for single byte delimiter and quote characters.  Returns false if the line
+     * cannot be handled this way (eg a quoted field continues on the next line),
+     * in which case it must be decoded and passed to parseQuoted.
+     */
+    bool parseQuotedBytes( const QByteArray &line, QStringList &fields, Status &status );
+
     /** Set the next line to read from the file.
      */
     bool setNextLineNumber( long nextLineNumber );
@@ -349,6 +389,19 @@ class QgsDelimitedTextFile : public QObject
     QString mEncoding;
     QFile *mFile;
     QTextStream *mStream;
+    QTextCodec *mCodec;
+    // File is read as bytes rather than through mStream
+    bool mByteMode;
+    bool mUtf8;
+    // Use parseQuotedBytes for CSV records
+    bool mParseBytes;
+    // Offset of the first line (after any byte order mark)
+    qint64 mStartPosition;
+    QByteArray mLineBytes;
+    qint64 mLinePosition;
+    QVector<qint64> mLineIndex;
+    // Character classes of ASCII bytes for parseQuotedBytes
+    char mByteClass[128];
     bool mUseWatcher;
     QFileSystemWatcher *mWatcher;
 
@@ -21,6 +21,7 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDataStream>
+#include <QDateTime>
 #include <QTextStream>
 #include <QStringList>
 #include <QMessageBox>
@@ -53,6 +54,12 @@ static const QString TEXT_PROVIDER_DESCRIPTION = "Delimited text data provider";
 
 static const int SUBSET_ID_THRESHOLD_FACTOR = 10;
 
+// Persistent index file identification
+
+static const quint32 INDEX_FILE_MAGIC = 0x51445449;
+static const qint32 INDEX_FILE_VERSION = 1;
+static const QString INDEX_FILE_EXTENSION = ".dtidx";
+
 QRegExp QgsDelimitedTextProvider::WktPrefixRegexp( "^\\s*(?:\\d+\\s+|SRID\\=\\d+\\;)", Qt::CaseInsensitive );
 QRegExp QgsDelimitedTextProvider::WktZMRegexp( "\\s*(?:z|m|zm)(?=\\s*\\()", Qt::CaseInsensitive );
 QRegExp QgsDelimitedTextProvider::WktCrdRegexp( "(\\-?\\d+(?:\\.\\d*)?\\s+\\-?\\d+(?:\\.\\d*)?)\\s[\\s\\d\\.\\-]+" );
@@ -83,6 +90,7 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
     , mGeometryType( QGis::UnknownGeometry )
     , mBuildSpatialIndex( false )
     , mSpatialIndex( 0 )
+    , mPersistIndex( false )
 {
   QgsDebugMsg( "Delimited text file uri is " + uri );
 
@@ -145,6 +153,11 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
     mBuildSpatialIndex = ! url.queryItemValue( "spatialIndex" ).toLower().startsWith( "n" );
   }
 
+  if ( url.hasQueryItem( "persistIndex" ) )
+  {
+    mPersistIndex = ! url.queryItemValue( "persistIndex" ).toLower().startsWith( "n" );
+  }
+
   if ( url.hasQueryItem( "subset" ) )
   {
     subset = url.queryItemValue( "subset" );
@@ -401,7 +414,28 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   QList<bool> couldBeInt;
   QList<bool> couldBeDouble;
 
-  while ( true )
+  // If the file has already been scanned with the same parameters then load
+  // the results from the index file instead, otherwise save them as the file
+  // is scanned.
+
+  IndexSummary summary;
+  bool indexLoaded = mPersistIndex && readIndexFile( buildSpatialIndex, buildSubsetIndex, summary );
+  QFile indexFile;
+  QDataStream indexStream;
+  bool writeIndex = mPersistIndex && ! indexLoaded && createIndexFile( indexFile, indexStream, summary );
+  qint64 nIndexRecords = 0;
+
+  if ( indexLoaded )
+  {
+    nBadFormatRecords = ( long ) summary.nBadFormatRecords;
+    nEmptyGeometry = ( long ) summary.nEmptyGeometry;
+    nInvalidGeometry = ( long ) summary.nInvalidGeometry;
+    nIncompatibleGeometry = ( long ) summary.nIncompatibleGeometry;
+    couldBeInt = summary.couldBeInt;
+    couldBeDouble = summary.couldBeDouble;
+  }
+
+  while ( ! indexLoaded )
   {
     QgsDelimitedTextFile::Status status = mFile->nextRecord( parts );
     if ( status == QgsDelimitedTextFile::RecordEOF ) break;
@@ -420,6 +454,8 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
 
     // Check geometries are valid
     bool geomValid = true;
+    QgsRectangle recordBox;
+    recordBox.setMinimal();
 
     if ( mGeomRep == GeomAsWkt )
     {
@@ -448,6 +484,7 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
           {
             if ( mGeometryType == QGis::UnknownGeometry || geom->type() == mGeometryType )
             {
+              recordBox = geom->boundingBox();
               mGeometryType = geom->type();
               if ( mNumberFeatures == 0 )
               {
@@ -508,6 +545,7 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
 
         if ( ok )
         {
+          recordBox.set( pt.x(), pt.y(), pt.x(), pt.y() );
           if ( mNumberFeatures > 0 )
           {
             mExtent.combineExtentWith( pt.x(), pt.y() );
@@ -546,6 +584,13 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
 
     if ( buildSubsetIndex ) mSubsetIndex.append( mFile->recordId() );
 
+    if ( writeIndex && mGeomRep != GeomNone )
+    {
+      indexStream << ( qint64 ) mFile->recordId()
+      << recordBox.xMinimum() << recordBox.yMinimum()
+      << recordBox.xMaximum() << recordBox.yMaximum();
+      nIndexRecords++;
+    }
 
     // If we are going to use this record, then assess the potential types of each colum
 
@@ -585,10 +630,24 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
     }
   }
 
+  if ( writeIndex )
+  {
+    summary.nRecords = nIndexRecords;
+    summary.recordCount = mFile->recordCount();
+    summary.nBadFormatRecords = nBadFormatRecords;
+    summary.nEmptyGeometry = nEmptyGeometry;
+    summary.nInvalidGeometry = nInvalidGeometry;
+    summary.nIncompatibleGeometry = nIncompatibleGeometry;
+    summary.fieldNames = mFile->fieldNames();
+    summary.couldBeInt = couldBeInt;
+    summary.couldBeDouble = couldBeDouble;
+    finishIndexFile( indexFile, indexStream, summary );
+  }
+
   // Now create the attribute fields.  Field types are integer by preference,
   // failing that double, failing that text.
 
-  QStringList fieldNames = mFile->fieldNames();
+  QStringList fieldNames = indexLoaded ? summary.fieldNames : mFile->fieldNames();
   mFieldCount = fieldNames.size();
   attributeColumns.clear();
   attributeFields.clear();
@@ -658,7 +717,7 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
 
   if ( buildSubsetIndex )
   {
-    long recordCount = mFile->recordCount();
+    long recordCount = indexLoaded ? ( long ) summary.recordCount : mFile->recordCount();
     recordCount -= recordCount / SUBSET_ID_THRESHOLD_FACTOR;
     mUseSubsetIndex = mSubsetIndex.size() < recordCount;
     if ( ! mUseSubsetIndex ) mSubsetIndex = QList<quintptr>();
@@ -1051,6 +1110,185 @@ void QgsDelimitedTextProvider::setUriParameter( QString parameter, QString value
   setDataSourceUri( QString::fromAscii( url.toEncoded() ) );
 }
 
+QString QgsDelimitedTextProvider::indexFileName()
+{
+  return mFile->fileName() + INDEX_FILE_EXTENSION;
+}
+
+QString QgsDelimitedTextProvider::indexKey()
+{
+  // Parameters which do not affect the result of scanning the file are
+  // excluded, so that the index remains valid if they are changed.
+
+  QStringList excluded;
+  excluded << "subset" << "quiet" << "watchFile" << "crs"
+  << "spatialIndex" << "subsetIndex" << "persistIndex";
+
+  QUrl url = QUrl::fromEncoded( dataSourceUri().toAscii() );
+  QStringList items;
+  QPair<QString, QString> item;
+  foreach ( item, url.queryItems() )
+  {
+    if ( ! excluded.contains( item.first ) ) items.append( item.first + "=" + item.second );
+  }
+  items.sort();
+  return items.join( "&" );
+}
+
+bool QgsDelimitedTextProvider::readIndexFile( bool buildSpatialIndex, bool buildSubsetIndex, IndexSummary &summary )
+{
+  QFile file( indexFileName() );
+  if ( ! file.open( QIODevice::ReadOnly ) ) return false;
+
+  QDataStream stream( &file );
+  stream.setVersion( QDataStream::Qt_4_7 );
+
+  quint32 magic;
+  qint32 version;
+  qint64 summaryOffset;
+  QString key;
+  stream >> magic >> version;
+  if ( stream.status() != QDataStream::Ok || magic != INDEX_FILE_MAGIC || version != INDEX_FILE_VERSION )
+  {
+    QgsDebugMsg( "Delimited text index file " + file.fileName() + " is not a valid index" );
+    return false;
+  }
+  stream >> summaryOffset >> key >> summary.fileSize >> summary.fileModified;
+
+  QFileInfo info( mFile->fileName() );
+  if ( stream.status() != QDataStream::Ok
+       || key != indexKey()
+       || summary.fileSize != info.size()
+       || summary.fileModified != info.lastModified().toMSecsSinceEpoch() )
+  {
+    QgsDebugMsg( "Delimited text index file " + file.fileName() + " is out of date" );
+    return false;
+  }
+
+  qint64 recordsOffset = file.pos();
+  if ( ! file.seek( summaryOffset ) ) return false;
+
+  qint64 numberFeatures;
+  qint32 wkbType;
+  qint32 geometryType;
+  bool wktHasPrefix;
+  bool wktHasZM;
+  double xMin, yMin, xMax, yMax;
+  QVector<qint64> lineIndex;
+
+  stream >> summary.nRecords >> summary.recordCount
+  >> summary.nBadFormatRecords >> summary.nEmptyGeometry
+  >> summary.nInvalidGeometry >> summary.nIncompatibleGeometry
+  >> summary.fieldNames >> summary.couldBeInt >> summary.couldBeDouble
+  >> numberFeatures >> wkbType >> geometryType >> wktHasPrefix >> wktHasZM
+  >> xMin >> yMin >> xMax >> yMax >> lineIndex;
+  if ( stream.status() != QDataStream::Ok ) return false;
+
+  // Rebuild the spatial and subset indexes from the saved record extents
+
+  if ( buildSpatialIndex || buildSubsetIndex )
+  {
+    file.seek( recordsOffset );
+    for ( qint64 i = 0; i < summary.nRecords && stream.status() == QDataStream::Ok; i++ )
+    {
+      qint64 id;
+      double rxMin, ryMin, rxMax, ryMax;
+      stream >> id >> rxMin >> ryMin >> rxMax >> ryMax;
+      // Records without a geometry are saved with a minimal (inverted) extent
+      if ( buildSpatialIndex && rxMin <= rxMax )
+      {
+        QgsFeature f;
+        f.setFeatureId( id );
+        if ( rxMin == rxMax && ryMin == ryMax )
+        {
+          f.setGeometry( QgsGeometry::fromPoint( QgsPoint( rxMin, ryMin ) ) );
+        }
+        else
+        {
+          f.setGeometry( QgsGeometry::fromRect( QgsRectangle( rxMin, ryMin, rxMax, ryMax ) ) );
+        }
+        mSpatialIndex->insertFeature( f );
+      }
+      if ( buildSubsetIndex ) mSubsetIndex.append(( quintptr ) id );
+    }
+    if ( stream.status() != QDataStream::Ok )
+    {
+      QgsDebugMsg( "Delimited text index file " + file.fileName() + " is truncated" );
+      resetIndexes();
+      return false;
+    }
+  }
+
+  mNumberFeatures = numberFeatures;
+  mWkbType = ( QGis::WkbType ) wkbType;
+  mGeometryType = ( QGis::GeometryType ) geometryType;
+  mWktHasPrefix = wktHasPrefix;
+  mWktHasZM = wktHasZM;
+  mExtent = QgsRectangle( xMin, yMin, xMax, yMax );
+  mFile->setLineIndex( lineIndex );
+
+  QgsDebugMsg( "Delimited text scan results loaded from " + file.fileName() );
+  return true;
+}
+
+bool QgsDelimitedTextProvider::createIndexFile( QFile &file, QDataStream &stream, IndexSummary &summary )
+{
+  // Write to a temporary file which replaces the index once it is complete
+
+  file.setFileName( indexFileName() + ".tmp" );
+  if ( ! file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+  {
+    QgsDebugMsg( "Cannot write delimited text index file " + file.fileName() );
+    return false;
+  }
+
+  QFileInfo info( mFile->fileName() );
+  summary.fileSize = info.size();
+  summary.fileModified = info.lastModified().toMSecsSinceEpoch();
+
+  // The summary offset is filled in by finishIndexFile
+
+  stream.setDevice( &file );
+  stream.setVersion( QDataStream::Qt_4_7 );
+  stream << INDEX_FILE_MAGIC << INDEX_FILE_VERSION << ( qint64 ) 0
+  << indexKey() << summary.fileSize << summary.fileModified;
+  return stream.status() == QDataStream::Ok;
+}
+
+void QgsDelimitedTextProvider::finishIndexFile( QFile &file, QDataStream &stream, const IndexSummary &summary )
+{
+  qint64 summaryOffset = file.pos();
+  stream << summary.nRecords << summary.recordCount
+  << summary.nBadFormatRecords << summary.nEmptyGeometry
+  << summary.nInvalidGeometry << summary.nIncompatibleGeometry
+  << summary.fieldNames << summary.couldBeInt << summary.couldBeDouble
+  << ( qint64 ) mNumberFeatures << ( qint32 ) mWkbType << ( qint32 ) mGeometryType
+  << mWktHasPrefix << mWktHasZM
+  << mExtent.xMinimum() << mExtent.yMinimum() << mExtent.xMaximum() << mExtent.yMaximum()
+  << mFile->lineIndex();
+
+  bool ok = stream.status() == QDataStream::Ok && file.seek( sizeof( quint32 ) + sizeof( qint32 ) );
+  if ( ok )
+  {
+    stream << summaryOffset;
+    ok = stream.status() == QDataStream::Ok;
+  }
+  file.close();
+
+  // Don't keep the index if the file was modified while it was scanned
+
+  QFileInfo info( mFile->fileName() );
+  ok = ok && info.size() == summary.fileSize && info.lastModified().toMSecsSinceEpoch() == summary.fileModified;
+
+  QString indexName = indexFileName();
+  QFile::remove( indexName );
+  if ( ! ok || ! QFile::rename( file.fileName(), indexName ) )
+  {
+    QgsDebugMsg( "Cannot write delimited text index file " + indexName );
+    file.remove();
+  }
+}
+
 void QgsDelimitedTextProvider::onFileUpdated()
 {
   if ( ! mRescanRequired )
@@ -28,6 +28,7 @@ class QgsFeature;
 class QgsField;
 class QgsGeometry;
 class QgsPoint;
+class QDataStream;
 class QFile;
 class QTextStream;
 
@@ -220,6 +221,23 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     static QRegExp WktZMRegexp;
     static QRegExp WktCrdRegexp;
 
+    // Results of scanning the file which are saved in the persistent index
+    // file along with the layer extents, geometry type and indexes
+    struct IndexSummary
+    {
+      qint64 fileSize;
+      qint64 fileModified;
+      qint64 nRecords;
+      qint64 recordCount;
+      qint64 nBadFormatRecords;
+      qint64 nEmptyGeometry;
+      qint64 nInvalidGeometry;
+      qint64 nIncompatibleGeometry;
+      QStringList fieldNames;
+      QList<bool> couldBeInt;
+      QList<bool> couldBeDouble;
+    };
+
     void scanFile( bool buildIndexes );
     void rescanFile();
     void resetCachedSubset();
@@ -230,6 +248,14 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     static bool recordIsEmpty( QStringList &record );
     void setUriParameter( QString parameter, QString value );
 
+    // Persistent index of the scan results, saved alongside the data file and
+    // used in place of scanning it while the file and uri are unchanged
+    QString indexFileName();
+    QString indexKey();
+    bool readIndexFile( bool buildSpatialIndex, bool buildSubsetIndex, IndexSummary &summary );
+    bool createIndexFile( QFile &file, QDataStream &stream, IndexSummary &summary );
+    void finishIndexFile( QFile &file, QDataStream &stream, const IndexSummary &summary );
+
 
     static QgsGeometry *geomFromWkt( QString &sWkt, bool wktHasPrefixRegexp, bool wktHasZM );
     static bool pointFromXY( QString &sX, QString &sY, QgsPoint &point, const QString& decimalPoint, bool xyDms );
@@ -316,6 +342,9 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     bool mCachedUseSpatialIndex;
     QgsSpatialIndex *mSpatialIndex;
 
+    // Save scan results and indexes to an index file
+    bool mPersistIndex;
+
     friend class QgsDelimitedTextFeatureIterator;
     friend class QgsDelimitedTextFeatureSource;
 };
@@ -1869,6 +1869,24 @@ QGISEXTERN bool isProvider()
   return true;
 }
 
+/**
+ * The provider can be created in a thread of the pool when a project is read,
+ * see QgsProviderRegistry::prepareProviders()
+ */
+QGISEXTERN bool supportsThreadedCreation()
+{
+  return true;
+}
+
+/**
+ * Registers the drivers on the thread which calls prepareProviders(), the
+ * providers created in the pool find them registered
+ */
+QGISEXTERN void prepareThreadedCreation()
+{
+  QgsGdalProviderBase::registerGdalDrivers();
+}
+
 void buildSupportedRasterFileFilterAndExtensions( QString & theFileFiltersString, QStringList & theExtensions, QStringList & theWildcards )
 {
   QgsDebugMsg( "Entered" );
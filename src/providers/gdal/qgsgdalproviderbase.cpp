@@ -22,6 +22,7 @@
 #include "qgslogger.h"
 #include "qgsgdalproviderbase.h"
 
+#include <QMutex>
 #include <QSettings>
 
 QgsGdalProviderBase::QgsGdalProviderBase()
@@ -253,6 +254,16 @@ int QgsGdalProviderBase::colorInterpretationFromGdal( int gdalColorInterpretatio
 
 void QgsGdalProviderBase::registerGdalDrivers()
 {
+  // the skip list of QgsApplication must not be modified while providers are
+  // created in other threads. Later changes of the list are applied by
+  // QgsApplication::skipGdalDriver() and restoreGdalDriver() themselves.
+  static QMutex sMutex;
+  static bool sRegistered = false;
+  QMutexLocker locker( &sMutex );
+  if ( sRegistered )
+    return;
+  sRegistered = true;
+
   GDALAllRegister();
   QSettings mySettings;
   QString myJoinedList = mySettings.value( "gdal/skipList", "" ).toString();
@@ -0,0 +1,433 @@
+/***************************************************************************
+    qgsmemorycolumnstore.cpp
+    ---------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsmemorycolumnstore.h"
+
+#include "qgsgeometry.h"
+
+#include <QBitArray>
+#include <QDateTime>
+#include <QHash>
+#include <QSharedData>
+#include <QVector>
+
+#include <cstring>
+
+// Maximum size of the buffers holding geometry WKB
+#define WKB_CHUNK_SIZE ( 64 * 1024 * 1024 )
+
+// Deleted rows and replaced geometries are only removed once there are at
+// least this many and they make up half of the store
+#define MIN_COMPACT_ROWS 1024
+#define MIN_COMPACT_BYTES ( 1024 * 1024 )
+
+struct QgsMemoryColumn
+{
+  QVariant::Type type;
+  QVector<int> ints;          // Int, Bool, Date (julian day), Time (msecs of the day) and String (dictionary code) values
+  QVector<qint64> longs;      // LongLong and DateTime (msecs since epoch) values
+  QVector<double> doubles;    // Double values
+  QVector<QString> strings;   // String dictionary
+  QHash<QString, int> codes;  // String dictionary lookup
+  QBitArray nulls;
+};
+
+class QgsMemoryColumnStoreData : public QSharedData
+{
+  public:
+    QgsMemoryColumnStoreData()
+        : deletedCount( 0 )
+        , wkbSize( 0 )
+        , wkbGarbage( 0 )
+    {}
+
+    QVector<QgsFeatureId> ids;
+    QBitArray deleted;
+    int deletedCount;
+
+    QList<QgsMemoryColumn> columns;
+
+    // WKB of the geometries.  Positions are the chunk index in the upper and the
+    // offset in the chunk in the lower 32 bits, or -1 for rows without geometry.
+    QList<QByteArray> wkbChunks;
+    QVector<qint64> wkbPositions;
+    QVector<int> wkbSizes;
+    QVector<QgsRectangle> boxes;
+    qint64 wkbSize;
+    qint64 wkbGarbage;
+};
+
+static void resizeColumn( QgsMemoryColumn& column, int size )
+{
+  switch ( column.type )
+  {
+    case QVariant::LongLong:
+    case QVariant::DateTime:
+      column.longs.resize( size );
+      break;
+    case QVariant::Double:
+      column.doubles.resize( size );
+      break;
+    default:
+      column.ints.resize( size );
+      break;
+  }
+  column.nulls.resize( size );
+}
+
+static void storeValue( QgsMemoryColumn& column, int row, const QVariant& value )
+{
+  QVariant v( value );
+  // values converted to an invalid date or time are null as well
+  bool isNull = v.isNull() || !v.convert( column.type ) || v.isNull();
+  column.nulls.setBit( row, isNull );
+
+  switch ( column.type )
+  {
+    case QVariant::Int:
+      column.ints[row] = isNull ? 0 : v.toInt();
+      break;
+    case QVariant::Bool:
+      column.ints[row] = isNull ? 0 : v.toBool();
+      break;
+    case QVariant::Date:
+      column.ints[row] = isNull ? 0 : v.toDate().toJulianDay();
+      break;
+    case QVariant::Time:
+      column.ints[row] = isNull ? 0 : QTime( 0, 0 ).msecsTo( v.toTime() );
+      break;
+    case QVariant::LongLong:
+      column.longs[row] = isNull ? 0 : v.toLongLong();
+      break;
+    case QVariant::DateTime:
+      column.longs[row] = isNull ? 0 : v.toDateTime().toMSecsSinceEpoch();
+      break;
+    case QVariant::Double:
+      column.doubles[row] = isNull ? 0.0 : v.toDouble();
+      break;
+    default:
+    {
+      int code = -1;
+      if ( !isNull )
+      {
+        QString s = v.toString();
+        QHash<QString, int>::const_iterator it = column.codes.constFind( s );
+        if ( it == column.codes.constEnd() )
+        {
+          code = column.strings.size();
+          column.strings.append( s );
+          column.codes.insert( s, code );
+        }
+        else
+        {
+          code = it.value();
+        }
+      }
+      column.ints[row] = code;
+      break;
+    }
+  }
+}
+
+static qint64 appendWkb( QgsMemoryColumnStoreData& data, const char* wkb, int size )
+{
+  if ( data.wkbChunks.isEmpty() ||
+       ( data.wkbChunks.last().size() > 0 && data.wkbChunks.last().size() + size > WKB_CHUNK_SIZE ) )
+  {
+    data.wkbChunks.append( QByteArray() );
+  }
+  QByteArray& chunk = data.wkbChunks.last();
+  qint64 position = (( qint64 )( data.wkbChunks.size() - 1 ) << 32 ) | chunk.size();
+  chunk.append( wkb, size );
+  data.wkbSize += size;
+  return position;
+}
+
+static const char* wkbData( const QgsMemoryColumnStoreData& data, qint64 position )
+{
+  return data.wkbChunks[( int )( position >> 32 )].constData() + ( position & 0xffffffff );
+}
+
+
+QgsMemoryColumnStore::QgsMemoryColumnStore()
+    : d( new QgsMemoryColumnStoreData )
+{
+}
+
+QgsMemoryColumnStore::QgsMemoryColumnStore( const QgsMemoryColumnStore& other )
+    : d( other.d )
+{
+}
+
+QgsMemoryColumnStore::~QgsMemoryColumnStore()
+{
+}
+
+QgsMemoryColumnStore& QgsMemoryColumnStore::operator=( const QgsMemoryColumnStore & other )
+{
+  d = other.d;
+  return *this;
+}
+
+int QgsMemoryColumnStore::rowCount() const
+{
+  return d->ids.size();
+}
+
+int QgsMemoryColumnStore::featureCount() const
+{
+  return d->ids.size() - d->deletedCount;
+}
+
+int QgsMemoryColumnStore::row( QgsFeatureId fid ) const
+{
+  QVector<QgsFeatureId>::const_iterator it = qBinaryFind( d->ids.constBegin(), d->ids.constEnd(), fid );
+  if ( it == d->ids.constEnd() )
+    return -1;
+
+  int row = it - d->ids.constBegin();
+  return d->deleted.testBit( row ) ? -1 : row;
+}
+
+QgsFeatureId QgsMemoryColumnStore::featureId( int row ) const
+{
+  return d->ids[row];
+}
+
+bool QgsMemoryColumnStore::isDeleted( int row ) const
+{
+  return d->deleted.testBit( row );
+}
+
+int QgsMemoryColumnStore::columnCount() const
+{
+  return d->columns.size();
+}
+
+void QgsMemoryColumnStore::addColumn( QVariant::Type type )
+{
+  QgsMemoryColumn column;
+  column.type = type;
+  resizeColumn( column, d->ids.size() );
+  column.nulls.fill( true );
+  d->columns.append( column );
+}
+
+void QgsMemoryColumnStore::removeColumn( int column )
+{
+  if ( column >= 0 && column < d->columns.size() )
+    d->columns.removeAt( column );
+}
+
+void QgsMemoryColumnStore::addFeature( QgsFeatureId fid, const QgsFeature& feature )
+{
+  Q_ASSERT( d->ids.isEmpty() || fid > d->ids.last() );
+
+  int row = d->ids.size();
+  d->ids.append( fid );
+  d->deleted.resize( row + 1 );
+
+  const QgsAttributes& attrs = feature.attributes();
+  for ( int i = 0; i < d->columns.size(); ++i )
+  {
+    QgsMemoryColumn& column = d->columns[i];
+    resizeColumn( column, row + 1 );
+    storeValue( column, row, i < attrs.size() ? attrs[i] : QVariant() );
+  }
+
+  QgsRectangle noBox;
+  noBox.setMinimal();
+  d->wkbPositions.append( -1 );
+  d->wkbSizes.append( 0 );
+  d->boxes.append( noBox );
+  setGeometry( row, feature.geometry() );
+}
+
+bool QgsMemoryColumnStore::deleteFeature( QgsFeatureId fid )
+{
+  int r = row( fid );
+  if ( r < 0 )
+    return false;
+
+  setGeometry( r, 0 );
+  d->deleted.setBit( r );
+  d->deletedCount++;
+
+  if ( d->deletedCount >= MIN_COMPACT_ROWS && d->deletedCount > d->ids.size() / 2 )
+    compactRows();
+
+  return true;
+}
+
+QVariant QgsMemoryColumnStore::attribute( int row, int column ) const
+{
+  if ( column < 0 || column >= d->columns.size() )
+    return QVariant();
+
+  const QgsMemoryColumn& c = d->columns[column];
+  if ( c.nulls.testBit( row ) )
+    return QVariant();
+
+  switch ( c.type )
+  {
+    case QVariant::Int:
+      return QVariant( c.ints[row] );
+    case QVariant::Bool:
+      return QVariant( c.ints[row] != 0 );
+    case QVariant::Date:
+      return QVariant( QDate::fromJulianDay( c.ints[row] ) );
+    case QVariant::Time:
+      return QVariant( QTime( 0, 0 ).addMSecs( c.ints[row] ) );
+    case QVariant::LongLong:
+      return QVariant( c.longs[row] );
+    case QVariant::DateTime:
+      return QVariant( QDateTime::fromMSecsSinceEpoch( c.longs[row] ) );
+    case QVariant::Double:
+      return QVariant( c.doubles[row] );
+    default:
+      return QVariant( c.strings[c.ints[row]] );
+  }
+}
+
+void QgsMemoryColumnStore::setAttribute( int row, int column, const QVariant& value )
+{
+  if ( column < 0 || column >= d->columns.size() )
+    return;
+
+  storeValue( d->columns[column], row, value );
+}
+
+bool QgsMemoryColumnStore::hasGeometry( int row ) const
+{
+  return d->wkbPositions[row] >= 0;
+}
+
+const QgsRectangle& QgsMemoryColumnStore::boundingBox( int row ) const
+{
+  return d->boxes[row];
+}
+
+QgsGeometry* QgsMemoryColumnStore::geometry( int row ) const
+{
+  qint64 position = d->wkbPositions[row];
+  if ( position < 0 )
+    return 0;
+
+  int size = d->wkbSizes[row];
+  unsigned char* wkb = new unsigned char[size];
+  memcpy( wkb, wkbData( *d, position ), size );
+
+  QgsGeometry* geom = new QgsGeometry();
+  geom->fromWkb( wkb, size );
+  return geom;
+}
+
+void QgsMemoryColumnStore::setGeometry( int row, const QgsGeometry* geometry )
+{
+  if ( d->wkbPositions[row] >= 0 )
+    d->wkbGarbage += d->wkbSizes[row];
+
+  d->wkbPositions[row] = -1;
+  d->wkbSizes[row] = 0;
+  d->boxes[row].setMinimal();
+
+  if ( geometry && geometry->asWkb() && geometry->wkbSize() > 0 )
+  {
+    d->wkbPositions[row] = appendWkb( *d, ( const char* ) geometry->asWkb(), geometry->wkbSize() );
+    d->wkbSizes[row] = geometry->wkbSize();
+    // boundingBox() is not const as it may update the cached WKB
+    d->boxes[row] = const_cast<QgsGeometry*>( geometry )->boundingBox();
+  }
+
+  if ( d->wkbGarbage >= MIN_COMPACT_BYTES && d->wkbGarbage > d->wkbSize / 2 )
+    compactGeometries();
+}
+
+QgsRectangle QgsMemoryColumnStore::extent() const
+{
+  QgsRectangle rect;
+  rect.setMinimal();
+  for ( int i = 0; i < d->boxes.size(); ++i )
+  {
+    if ( d->wkbPositions[i] >= 0 )
+      rect.unionRect( d->boxes[i] );
+  }
+  return rect;
+}
+
+void QgsMemoryColumnStore::compactRows()
+{
+  int count = d->ids.size();
+  int kept = 0;
+  for ( int i = 0; i < count; ++i )
+  {
+    if ( d->deleted.testBit( i ) )
+      continue;
+
+    if ( kept != i )
+    {
+      d->ids[kept] = d->ids[i];
+      d->wkbPositions[kept] = d->wkbPositions[i];
+      d->wkbSizes[kept] = d->wkbSizes[i];
+      d->boxes[kept] = d->boxes[i];
+      for ( int c = 0; c < d->columns.size(); ++c )
+      {
+        QgsMemoryColumn& column = d->columns[c];
+        switch ( column.type )
+        {
+          case QVariant::LongLong:
+          case QVariant::DateTime:
+            column.longs[kept] = column.longs[i];
+            break;
+          case QVariant::Double:
+            column.doubles[kept] = column.doubles[i];
+            break;
+          default:
+            column.ints[kept] = column.ints[i];
+            break;
+        }
+        column.nulls.setBit( kept, column.nulls.testBit( i ) );
+      }
+    }
+    kept++;
+  }
+
+  d->ids.resize( kept );
+  d->wkbPositions.resize( kept );
+  d->wkbSizes.resize( kept );
+  d->boxes.resize( kept );
+  for ( int c = 0; c < d->columns.size(); ++c )
+    resizeColumn( d->columns[c], kept );
+  d->deleted = QBitArray( kept );
+  d->deletedCount = 0;
+}
+
+void QgsMemoryColumnStore::compactGeometries()
+{
+  QgsMemoryColumnStoreData& data = *d;
+  QList<QByteArray> chunks = data.wkbChunks;
+  data.wkbChunks.clear();
+  data.wkbSize = 0;
+  data.wkbGarbage = 0;
+
+  for ( int i = 0; i < data.wkbPositions.size(); ++i )
+  {
+    qint64 position = data.wkbPositions[i];
+    if ( position < 0 )
+      continue;
+
+    const char* wkb = chunks[( int )( position >> 32 )].constData() + ( position & 0xffffffff );
+    data.wkbPositions[i] = appendWkb( data, wkb, data.wkbSizes[i] );
+  }
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+    qgsmemorycolumnstore.h
+    ---------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSMEMORYCOLUMNSTORE_H
+#define QGSMEMORYCOLUMNSTORE_H
+
+#include "qgsfeature.h"
+#include "qgsrectangle.h"
+
+#include <QSharedDataPointer>
+#include <QVariant>
+
+class QgsGeometry;
+class QgsMemoryColumnStoreData;
+
+/**
+ * Column oriented storage of features for the memory provider.
+ *
+ * Each attribute is stored as a typed array with a null bitmap, strings
+ * are dictionary encoded, and geometries are kept as WKB packed in large
+ * buffers along with an array of bounding boxes.  Rows are kept in order
+ * of increasing feature id, so no id to row map is needed.  Deleted rows
+ * are flagged and removed once they make up half of the store.
+ *
+ * The store is implicitly shared, so copying it for a feature source is
+ * cheap and only the arrays that are modified afterwards are copied.
+ */
+class QgsMemoryColumnStore
+{
+  public:
+    QgsMemoryColumnStore();
+    QgsMemoryColumnStore( const QgsMemoryColumnStore& other );
+    ~QgsMemoryColumnStore();
+    QgsMemoryColumnStore& operator=( const QgsMemoryColumnStore& other );
+
+    /** number of rows, including deleted rows */
+    int rowCount() const;
+
+    /** number of features (rows which have not been deleted) */
+    int featureCount() const;
+
+    /** return the row of a feature or -1 if there is no such feature */
+    int row( QgsFeatureId fid ) const;
+
+    QgsFeatureId featureId( int row ) const;
+
+    bool isDeleted( int row ) const;
+
+    int columnCount() const;
+
+    /** append a column of the given type, values of existing rows are null */
+    void addColumn( QVariant::Type type );
+
+    void removeColumn( int column );
+
+    /** append a feature, its id must be greater than that of all stored features */
+    void addFeature( QgsFeatureId fid, const QgsFeature& feature );
+
+    bool deleteFeature( QgsFeatureId fid );
+
+    /** return an attribute value, null values are returned as invalid variants as with the map storage */
+    QVariant attribute( int row, int column ) const;
+
+    /** set an attribute value, values which cannot be converted to the column type are stored as null */
+    void setAttribute( int row, int column, const QVariant& value );
+
+    bool hasGeometry( int row ) const;
+
+    /** bounding box of the geometry of a row, a minimal (inverted) rectangle if it has none */
+    const QgsRectangle& boundingBox( int row ) const;
+
+    /** return a new geometry for a row or 0 if it has none; caller takes ownership */
+    QgsGeometry* geometry( int row ) const;
+
+    void setGeometry( int row, const QgsGeometry* geometry );
+
+    /** combined bounding box of all geometries */
+    QgsRectangle extent() const;
+
+  private:
+    void compactRows();
+    void compactGeometries();
+
+    QSharedDataPointer<QgsMemoryColumnStoreData> d;
+};
+
+#endif // QGSMEMORYCOLUMNSTORE_H
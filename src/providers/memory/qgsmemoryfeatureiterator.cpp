@@ -25,6 +25,7 @@
 QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource( source, ownSource, request )
     , mSelectRectGeom( 0 )
+    , mRow( 0 )
 {
 
   if ( mRequest.filterType() == QgsFeatureRequest::FilterRect && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
@@ -43,9 +44,17 @@ QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryFeatureSource* sour
   else if ( mRequest.filterType() == QgsFeatureRequest::FilterFid )
   {
     mUsingFeatureIdList = true;
-    QgsFeatureMap::const_iterator it = mSource->mFeatures.find( mRequest.filterFid() );
-    if ( it != mSource->mFeatures.end() )
-      mFeatureIdList.append( mRequest.filterFid() );
+    if ( mSource->mColumnar )
+    {
+      if ( mSource->mColumns.row( mRequest.filterFid() ) >= 0 )
+        mFeatureIdList.append( mRequest.filterFid() );
+    }
+    else
+    {
+      QgsFeatureMap::const_iterator it = mSource->mFeatures.find( mRequest.filterFid() );
+      if ( it != mSource->mFeatures.end() )
+        mFeatureIdList.append( mRequest.filterFid() );
+    }
   }
   else
   {
@@ -68,6 +77,9 @@ bool QgsMemoryFeatureIterator::fetchFeature( QgsFeature& feature )
   if ( mClosed )
     return false;
 
+  if ( mSource->mColumnar )
+    return nextFeatureFromColumns( feature );
+
   if ( mUsingFeatureIdList )
     return nextFeatureUsingList( feature );
   else
@@ -161,6 +173,76 @@ bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
   return hasFeature;
 }
 
+bool QgsMemoryFeatureIterator::nextFeatureFromColumns( QgsFeature& feature )
+{
+  const QgsMemoryColumnStore& columns = mSource->mColumns;
+  bool filterRect = mRequest.filterType() == QgsFeatureRequest::FilterRect;
+  bool exactIntersect = filterRect && mRequest.flags() & QgsFeatureRequest::ExactIntersect;
+  int row = -1;
+
+  while ( true )
+  {
+    if ( mUsingFeatureIdList )
+    {
+      if ( mFeatureIdListIterator == mFeatureIdList.constEnd() )
+        break;
+      row = columns.row( *mFeatureIdListIterator );
+      ++mFeatureIdListIterator;
+      if ( row < 0 )
+        continue;
+    }
+    else
+    {
+      if ( mRow >= columns.rowCount() )
+        break;
+      row = mRow++;
+      if ( columns.isDeleted( row ) )
+        continue;
+    }
+
+    // bounding boxes are stored together, so they can be tested without
+    // touching the geometries
+    QgsGeometry* geom = 0;
+    if ( filterRect )
+    {
+      if ( !columns.boundingBox( row ).intersects( mRequest.filterRect() ) )
+        continue;
+
+      if ( exactIntersect )
+      {
+        geom = columns.geometry( row );
+        if ( !geom || !geom->intersects( mSelectRectGeom ) )
+        {
+          delete geom;
+          continue;
+        }
+      }
+    }
+
+    // only the requested attributes and geometry are read from the columns
+    feature.setFeatureId( columns.featureId( row ) );
+    feature.setFields( &mSource->mFields, true );
+    if ( mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes )
+    {
+      foreach ( int idx, mRequest.subsetOfAttributes() )
+        feature.setAttribute( idx, columns.attribute( row, idx ) );
+    }
+    else
+    {
+      for ( int idx = 0; idx < columns.columnCount(); ++idx )
+        feature.setAttribute( idx, columns.attribute( row, idx ) );
+    }
+    if ( !geom && !( mRequest.flags() & QgsFeatureRequest::NoGeometry ) )
+      geom = columns.geometry( row );
+    feature.setGeometry( geom );
+    feature.setValid( true );
+    return true;
+  }
+
+  close();
+  return false;
+}
+
 bool QgsMemoryFeatureIterator::rewind()
 {
   if ( mClosed )
@@ -170,6 +252,7 @@ bool QgsMemoryFeatureIterator::rewind()
     mFeatureIdListIterator = mFeatureIdList.constBegin();
   else
     mSelectIterator = mSource->mFeatures.constBegin();
+  mRow = 0;
 
   return true;
 }
@@ -193,6 +276,8 @@ bool QgsMemoryFeatureIterator::close()
 QgsMemoryFeatureSource::QgsMemoryFeatureSource( const QgsMemoryProvider* p )
     : mFields( p->mFields )
     , mFeatures( p->mFeatures )
+    , mColumnar( p->mColumnar )
+    , mColumns( p->mColumns )
     , mSpatialIndex( p->mSpatialIndex ? new QgsSpatialIndex( *p->mSpatialIndex ) : 0 )  // just shallow copy
 {
 }
@@ -16,6 +16,7 @@
 #define QGSMEMORYFEATUREITERATOR_H
 
 #include "qgsfeatureiterator.h"
+#include "qgsmemorycolumnstore.h"
 
 class QgsMemoryProvider;
 
@@ -35,6 +36,8 @@ class QgsMemoryFeatureSource : public QgsAbstractFeatureSource
   protected:
     QgsFields mFields;
     QgsFeatureMap mFeatures;
+    bool mColumnar;
+    QgsMemoryColumnStore mColumns;
     QgsSpatialIndex* mSpatialIndex;
 
     friend class QgsMemoryFeatureIterator;
@@ -61,12 +64,14 @@ class QgsMemoryFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Qgs
 
     bool nextFeatureUsingList( QgsFeature& feature );
     bool nextFeatureTraverseAll( QgsFeature& feature );
+    bool nextFeatureFromColumns( QgsFeature& feature );
 
     QgsGeometry* mSelectRectGeom;
     QgsFeatureMap::const_iterator mSelectIterator;
     bool mUsingFeatureIdList;
     QList<QgsFeatureId> mFeatureIdList;
     QList<QgsFeatureId>::const_iterator mFeatureIdListIterator;
+    int mRow;
 
 };
 
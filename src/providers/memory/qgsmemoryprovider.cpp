@@ -32,6 +32,7 @@ static const QString TEXT_PROVIDER_DESCRIPTION = "Memory provider";
 
 QgsMemoryProvider::QgsMemoryProvider( QString uri )
     : QgsVectorDataProvider( uri )
+    , mColumnar( false )
     , mSpatialIndex( 0 )
 {
   // Initialize the geometry with the uri to support old style uri's
@@ -71,6 +72,13 @@ QgsMemoryProvider::QgsMemoryProvider( QString uri )
 
   mNextFeatureId = 1;
 
+  // Attributes and geometries can be stored in typed arrays rather than
+  // as a map of features, which is much more compact for large layers
+  if ( url.hasQueryItem( "storage" ) && url.queryItemValue( "storage" ) == "columnar" )
+  {
+    mColumnar = true;
+  }
+
   mNativeTypes
   << QgsVectorDataProvider::NativeType( tr( "Whole number (integer)" ), "integer", QVariant::Int, 0, 10 )
   // Decimal number from OGR/Shapefile/dbf may come with length up to 32 and
@@ -231,6 +239,10 @@ QString QgsMemoryProvider::dataSourceUri() const
   {
     uri.addQueryItem( "index", "yes" );
   }
+  if ( mColumnar )
+  {
+    uri.addQueryItem( "storage", "columnar" );
+  }
 
   QgsAttributeList attrs = const_cast<QgsMemoryProvider *>( this )->attributeIndexes();
   for ( int i = 0; i < attrs.size(); i++ )
@@ -268,6 +280,9 @@ QGis::WkbType QgsMemoryProvider::geometryType() const
 
 long QgsMemoryProvider::featureCount() const
 {
+  if ( mColumnar )
+    return mColumns.featureCount();
+
   return mFeatures.count();
 }
 
@@ -293,6 +308,19 @@ bool QgsMemoryProvider::addFeatures( QgsFeatureList & flist )
   // TODO: sanity checks of fields and geometries
   for ( QgsFeatureList::iterator it = flist.begin(); it != flist.end(); ++it )
   {
+    if ( mColumnar )
+    {
+      mColumns.addFeature( mNextFeatureId, *it );
+      it->setFeatureId( mNextFeatureId );
+
+      // update spatial index
+      if ( mSpatialIndex )
+        mSpatialIndex->insertFeature( *it );
+
+      mNextFeatureId++;
+      continue;
+    }
+
     mFeatures[mNextFeatureId] = *it;
     QgsFeature& newfeat = mFeatures[mNextFeatureId];
     newfeat.setFeatureId( mNextFeatureId );
@@ -314,6 +342,24 @@ bool QgsMemoryProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
   {
+    if ( mColumnar )
+    {
+      int row = mColumns.row( *it );
+      if ( row < 0 )
+        continue;
+
+      // update spatial index
+      if ( mSpatialIndex )
+      {
+        QgsFeature f( *it );
+        f.setGeometry( mColumns.geometry( row ) );
+        mSpatialIndex->deleteFeature( f );
+      }
+
+      mColumns.deleteFeature( *it );
+      continue;
+    }
+
     QgsFeatureMap::iterator fit = mFeatures.find( *it );
 
     // check whether such feature exists
@@ -343,6 +389,9 @@ bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
       case QVariant::Double:
       case QVariant::String:
       case QVariant::Date:
+      case QVariant::Time:
+      case QVariant::DateTime:
+      case QVariant::Bool:
       case QVariant::LongLong:
         break;
       default:
@@ -352,6 +401,12 @@ bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
     // add new field as a last one
     mFields.append( *it );
 
+    if ( mColumnar )
+    {
+      mColumns.addColumn( it->type() );
+      continue;
+    }
+
     for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
     {
       QgsFeature& f = fit.value();
@@ -372,6 +427,12 @@ bool QgsMemoryProvider::deleteAttributes( const QgsAttributeIds& attributes )
     int idx = *it;
     mFields.remove( idx );
 
+    if ( mColumnar )
+    {
+      mColumns.removeColumn( idx );
+      continue;
+    }
+
     for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
     {
       QgsFeature& f = fit.value();
@@ -385,6 +446,18 @@ bool QgsMemoryProvider::changeAttributeValues( const QgsChangedAttributesMap & a
 {
   for ( QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); ++it )
   {
+    if ( mColumnar )
+    {
+      int row = mColumns.row( it.key() );
+      if ( row < 0 )
+        continue;
+
+      const QgsAttributeMap& attrs = it.value();
+      for ( QgsAttributeMap::const_iterator it2 = attrs.begin(); it2 != attrs.end(); ++it2 )
+        mColumns.setAttribute( row, it2.key(), it2.value() );
+      continue;
+    }
+
     QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
     if ( fit == mFeatures.end() )
       continue;
@@ -400,6 +473,32 @@ bool QgsMemoryProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 {
   for ( QgsGeometryMap::const_iterator it = geometry_map.begin(); it != geometry_map.end(); ++it )
   {
+    if ( mColumnar )
+    {
+      int row = mColumns.row( it.key() );
+      if ( row < 0 )
+        continue;
+
+      QgsFeature f( it.key() );
+
+      // update spatial index
+      if ( mSpatialIndex )
+      {
+        f.setGeometry( mColumns.geometry( row ) );
+        mSpatialIndex->deleteFeature( f );
+      }
+
+      mColumns.setGeometry( row, &it.value() );
+
+      // update spatial index
+      if ( mSpatialIndex )
+      {
+        f.setGeometry( it.value() );
+        mSpatialIndex->insertFeature( f );
+      }
+      continue;
+    }
+
     QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
     if ( fit == mFeatures.end() )
       continue;
@@ -431,6 +530,16 @@ bool QgsMemoryProvider::createSpatialIndex()
     {
       mSpatialIndex->insertFeature( *it );
     }
+
+    for ( int row = 0; row < mColumns.rowCount(); ++row )
+    {
+      if ( mColumns.isDeleted( row ) || !mColumns.hasGeometry( row ) )
+        continue;
+
+      QgsFeature f( mColumns.featureId( row ) );
+      f.setGeometry( mColumns.geometry( row ) );
+      mSpatialIndex->insertFeature( f );
+    }
   }
   return true;
 }
@@ -445,10 +554,14 @@ int QgsMemoryProvider::capabilities() const
 
 void QgsMemoryProvider::updateExtent()
 {
-  if ( mFeatures.count() == 0 )
+  if ( featureCount() == 0 )
   {
     mExtent = QgsRectangle();
   }
+  else if ( mColumnar )
+  {
+    mExtent = mColumns.extent();
+  }
   else
   {
     mExtent.setMinimal();
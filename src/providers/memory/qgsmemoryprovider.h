@@ -15,6 +15,7 @@
 
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
+#include "qgsmemorycolumnstore.h"
 
 
 typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
@@ -167,6 +168,10 @@ class QgsMemoryProvider : public QgsVectorDataProvider
     QgsFeatureMap mFeatures;
     QgsFeatureId mNextFeatureId;
 
+    // column oriented storage used instead of mFeatures with storage=columnar
+    bool mColumnar;
+    QgsMemoryColumnStore mColumns;
+
     // indexing
     QgsSpatialIndex* mSpatialIndex;
 
@@ -0,0 +1,53 @@
+/***************************************************************************
+    qgsogrconnpool.cpp
+    ---------------------
+    begin                : April 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsogrconnpool.h"
+
+#include "qgsogrprovider.h"
+
+
+void qgsConnectionPool_ConnectionCreate( QString connInfo, QgsOgrConn*& c )
+{
+  // strip the layer part of QgsOgrConnPool::connectionKey()
+  QString filePath = connInfo.left( connInfo.lastIndexOf( "|layer" ) );
+  OGRDataSourceH ds = OGROpen( TO8F( filePath ), false, NULL );
+  if ( !ds )
+  {
+    c = 0;
+    return;
+  }
+
+  c = new QgsOgrConn;
+  c->key = connInfo;
+  c->ds = ds;
+}
+
+void qgsConnectionPool_ConnectionDestroy( QgsOgrConn* c )
+{
+  OGR_DS_Destroy( c->ds );
+  delete c;
+}
+
+QgsOgrConnPool* QgsOgrConnPool::instance()
+{
+  static QgsOgrConnPool sInstance;
+  return &sInstance;
+}
+
+QString QgsOgrConnPool::connectionKey( const QString& filePath, const QString& layerName, int layerIndex )
+{
+  if ( !layerName.isNull() )
+    return QString( "%1|layername=%2" ).arg( filePath ).arg( layerName );
+  return QString( "%1|layerid=%2" ).arg( filePath ).arg( layerIndex );
+}
@@ -0,0 +1,70 @@
+/***************************************************************************
+    qgsogrconnpool.h
+    ---------------------
+    begin                : April 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSOGRCONNPOOL_H
+#define QGSOGRCONNPOOL_H
+
+#include "qgsconnectionpool.h"
+
+#include <ogr_api.h>
+
+
+/** Data source opened read-only for a feature iterator, together with the pool key it was opened for */
+struct QgsOgrConn
+{
+  QString key;
+  OGRDataSourceH ds;
+};
+
+inline QString qgsConnectionPool_ConnectionToName( QgsOgrConn* c )
+{
+  return c->key;
+}
+
+void qgsConnectionPool_ConnectionCreate( QString connInfo, QgsOgrConn*& c );
+
+void qgsConnectionPool_ConnectionDestroy( QgsOgrConn* c );
+
+
+class QgsOgrConnPoolGroup : public QObject, public QgsConnectionPoolGroup<QgsOgrConn*>
+{
+    Q_OBJECT
+
+  public:
+    QgsOgrConnPoolGroup( QString name ) : QgsConnectionPoolGroup<QgsOgrConn*>( name ) { initTimer( this ); }
+
+  protected slots:
+    void handleConnectionExpired() { onConnectionExpired(); }
+    void startExpirationTimer() { expirationTimer->start(); }
+    void stopExpirationTimer() { expirationTimer->stop(); }
+
+  protected:
+    Q_DISABLE_COPY( QgsOgrConnPoolGroup )
+
+};
+
+/** OGR data source pool - singleton. Keeps data sources of files open for feature iterators */
+class QgsOgrConnPool : public QgsConnectionPool<QgsOgrConn*, QgsOgrConnPoolGroup>
+{
+  public:
+    static QgsOgrConnPool* instance();
+
+    /** Key of the data sources of a layer. Every layer of a file has its own data
+     * sources, so layers of the same file don't share the connection limit */
+    static QString connectionKey( const QString& filePath, const QString& layerName, int layerIndex );
+
+};
+
+
+#endif // QGSOGRCONNPOOL_H
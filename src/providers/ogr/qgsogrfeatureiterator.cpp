@@ -14,6 +14,7 @@
  ***************************************************************************/
 #include "qgsogrfeatureiterator.h"
 
+#include "qgsogrconnpool.h"
 #include "qgsogrprovider.h"
 #include "qgsogrgeometrysimplifier.h"
 
@@ -35,6 +36,8 @@
 
 QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource( source, ownSource, request )
+    , mConn( 0 )
+    , mConnPooled( false )
     , ogrDataSource( 0 )
     , ogrLayer( 0 )
     , mSubsetStringSet( false )
@@ -42,7 +45,23 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool
 {
   mFeatureFetched = false;
 
-  ogrDataSource = OGROpen( TO8F( mSource->mFilePath ), false, NULL );
+  // don't block when all pooled data sources are in use: the same thread may hold them
+  // in other open iterators of the layer
+  QString connKey = QgsOgrConnPool::connectionKey( mSource->mFilePath, mSource->mLayerName, mSource->mLayerIndex );
+  mConn = QgsOgrConnPool::instance()->tryAcquireConnection( connKey );
+  mConnPooled = mConn != 0;
+  if ( !mConn )
+  {
+    qgsConnectionPool_ConnectionCreate( connKey, mConn );
+  }
+  if ( !mConn )
+  {
+    QgsMessageLog::logMessage( QObject::tr( "Could not open %1" ).arg( mSource->mFilePath ), QObject::tr( "OGR" ) );
+    close();
+    return;
+  }
+
+  ogrDataSource = mConn->ds;
 
   if ( mSource->mLayerName.isNull() )
   {
@@ -214,9 +233,17 @@ bool QgsOgrFeatureIterator::close()
     OGR_DS_ReleaseResultSet( ogrDataSource, ogrLayer );
   }
 
-  OGR_DS_Destroy( ogrDataSource );
+  if ( mConn && mConnPooled )
+  {
+    QgsOgrConnPool::instance()->releaseConnection( mConn );
+  }
+  else if ( mConn )
+  {
+    qgsConnectionPool_ConnectionDestroy( mConn );
+  }
 
   mClosed = true;
+  mConn = 0;
   ogrDataSource = 0;
   return true;
 }
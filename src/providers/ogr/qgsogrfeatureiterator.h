@@ -21,6 +21,7 @@
 
 class QgsOgrFeatureIterator;
 class QgsOgrProvider;
+struct QgsOgrConn;
 class QgsOgrAbstractGeometrySimplifier;
 
 class QgsOgrFeatureSource : public QgsAbstractFeatureSource
@@ -70,6 +71,10 @@ class QgsOgrFeatureIterator : public QgsAbstractFeatureIteratorFromSource<QgsOgr
 
     bool mFeatureFetched;
 
+    //! data source borrowed from the connection pool or opened for this iterator
+    QgsOgrConn* mConn;
+    //! whether mConn goes back to the pool
+    bool mConnPooled;
     OGRDataSourceH ogrDataSource;
     OGRLayerH ogrLayer;
 
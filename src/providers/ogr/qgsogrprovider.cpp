@@ -16,6 +16,7 @@ email                : sherman at mrcc.com
  ***************************************************************************/
 
 #include "qgsogrprovider.h"
+#include "qgsogrconnpool.h"
 #include "qgsogrfeatureiterator.h"
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
@@ -436,6 +437,9 @@ QgsOgrProvider::~QgsOgrProvider()
   OGR_DS_Destroy( ogrDataSource );
   ogrDataSource = 0;
 
+  // the pooled data sources may have been opened before the last changes were written
+  invalidateConnections();
+
   if ( extent_ )
   {
     free( extent_ );
@@ -505,11 +509,11 @@ bool QgsOgrProvider::setSubsetString( QString theSQL, bool updateFeatureCount )
 
   OGR_L_ResetReading( ogrLayer );
 
-  // getting the total number of features in the layer
-  // TODO: This can be expensive, do we really need it!
+  // the total number of features in the layer is counted when it is asked for,
+  // for some drivers this is a scan of the whole layer
   if ( updateFeatureCount )
   {
-    recalculateFeatureCount();
+    featuresCounted = -1;
   }
 
   // check the validity of the layer
@@ -910,6 +914,10 @@ QGis::WkbType QgsOgrProvider::geometryType() const
  */
 long QgsOgrProvider::featureCount() const
 {
+  if ( featuresCounted < 0 )
+  {
+    recalculateFeatureCount();
+  }
   return featuresCounted;
 }
 
@@ -1057,7 +1065,7 @@ bool QgsOgrProvider::addFeatures( QgsFeatureList & flist )
     returnvalue = false;
   }
 
-  recalculateFeatureCount();
+  featuresCounted = -1;
 
   if ( returnvalue )
     clearMinMaxCache();
@@ -1108,6 +1116,7 @@ bool QgsOgrProvider::addAttributes( const QList<QgsField> &attributes )
     OGR_Fld_Destroy( fielddefn );
   }
   loadFields();
+  invalidateConnections();
   return returnvalue;
 }
 
@@ -1127,6 +1136,7 @@ bool QgsOgrProvider::deleteAttributes( const QgsAttributeIds &attributes )
     }
   }
   loadFields();
+  invalidateConnections();
   return res;
 #else
   Q_UNUSED( attributes );
@@ -1238,6 +1248,7 @@ bool QgsOgrProvider::changeAttributeValues( const QgsChangedAttributesMap & attr
   {
     pushError( tr( "OGR error syncing to disk: %1" ).arg( CPLGetLastErrorMsg() ) );
   }
+  invalidateConnections();
   return true;
 }
 
@@ -1316,6 +1327,7 @@ bool QgsOgrProvider::createSpatialIndex()
     QByteArray sql = "CREATE SPATIAL INDEX ON " + quotedIdentifier( layerName );  // quote the layer name so spaces are handled
     QgsDebugMsg( QString( "SQL: %1" ).arg( FROM8( sql ) ) );
     OGR_DS_ExecuteSQL( ogrDataSource, sql.constData(), OGR_L_GetSpatialFilter( ogrOrigLayer ), "" );
+    invalidateConnections();
   }
 
   QFileInfo fi( mFilePath );     // to get the base name
@@ -1331,6 +1343,7 @@ bool QgsOgrProvider::createAttributeIndex( int field )
   OGR_DS_ExecuteSQL( ogrDataSource, dropSql.constData(), OGR_L_GetSpatialFilter( ogrOrigLayer ), "SQL" );
   QByteArray createSql = "CREATE INDEX ON " + quotedLayerName + " USING " + mEncoding->fromUnicode( fields()[field].name() );
   OGR_DS_ExecuteSQL( ogrDataSource, createSql.constData(), OGR_L_GetSpatialFilter( ogrOrigLayer ), "SQL" );
+  invalidateConnections();
 
   QFileInfo fi( mFilePath );     // to get the base name
   //find out, if the .idm file is there
@@ -1338,6 +1351,11 @@ bool QgsOgrProvider::createAttributeIndex( int field )
   return indexfile.exists();
 }
 
+void QgsOgrProvider::invalidateConnections()
+{
+  QgsOgrConnPool::instance()->invalidateConnections( QgsOgrConnPool::connectionKey( mFilePath, mLayerName, mLayerIndex ) );
+}
+
 bool QgsOgrProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   QgsCPLErrorHandler handler;
@@ -1360,7 +1378,7 @@ bool QgsOgrProvider::deleteFeatures( const QgsFeatureIds & id )
     returnvalue = false;
   }
 
-  recalculateFeatureCount();
+  featuresCounted = -1;
 
   clearMinMaxCache();
 
@@ -1944,6 +1962,24 @@ QGISEXTERN bool isProvider()
   return true;
 }
 
+/**
+ * The provider can be created in a thread of the pool when a project is read,
+ * see QgsProviderRegistry::prepareProviders()
+ */
+QGISEXTERN bool supportsThreadedCreation()
+{
+  return true;
+}
+
+/**
+ * Registers the drivers on the thread which calls prepareProviders(), the
+ * providers created in the pool find them registered
+ */
+QGISEXTERN void prepareThreadedCreation()
+{
+  QgsApplication::registerOgrDrivers();
+}
+
 /**Creates an empty data source
 @param uri location to store the file(s)
 @param format data format (e.g. "ESRI Shapefile"
@@ -2383,6 +2419,8 @@ bool QgsOgrProvider::syncToDisc()
     pushError( tr( "OGR error syncing to disk: %1" ).arg( CPLGetLastErrorMsg() ) );
   }
 
+  invalidateConnections();
+
   //for shapefiles: is there already a spatial index?
   if ( !mFilePath.isEmpty() )
   {
@@ -2407,7 +2445,7 @@ bool QgsOgrProvider::syncToDisc()
   return true;
 }
 
-void QgsOgrProvider::recalculateFeatureCount()
+void QgsOgrProvider::recalculateFeatureCount() const
 {
   OGRGeometryH filter = OGR_L_GetSpatialFilter( ogrLayer );
   if ( filter )
@@ -2426,7 +2464,7 @@ void QgsOgrProvider::recalculateFeatureCount()
   {
     featuresCounted = 0;
     OGR_L_ResetReading( ogrLayer );
-    setRelevantFields( ogrLayer, true, QgsAttributeList() );
+    QgsOgrUtils::setRelevantFields( ogrLayer, mAttributeFields.count(), true, QgsAttributeList() );
     OGR_L_ResetReading( ogrLayer );
     OGRFeatureH fet;
     while (( fet = OGR_L_GetNextFeature( ogrLayer ) ) )
@@ -269,7 +269,7 @@ class QgsOgrProvider : public QgsVectorDataProvider
     void loadFields();
 
     /** find out the number of features of the whole layer */
-    void recalculateFeatureCount();
+    void recalculateFeatureCount() const;
 
     /** tell OGR, which fields to fetch in nextFeature/featureAtId (ie. which not to ignore) */
     void setRelevantFields( OGRLayerH ogrLayer, bool fetchGeometry, const QgsAttributeList& fetchAttributes );
@@ -324,7 +324,8 @@ class QgsOgrProvider : public QgsVectorDataProvider
     //! Flag to indicate that spatial intersect should be used in selecting features
     bool mUseIntersect;
     int geomType;
-    long featuresCounted;
+    //! number of features, -1 until featureCount() is called
+    mutable long featuresCounted;
 
     //! There are deleted feature - REPACK before creating a spatialindex
     bool mDeletedFeatures;
@@ -339,6 +340,9 @@ class QgsOgrProvider : public QgsVectorDataProvider
     /**Calls OGR_L_SyncToDisk and recreates the spatial index if present*/
     bool syncToDisc();
 
+    /**Closes the pooled data sources of the layer, iterators reopen the file to see the changes*/
+    void invalidateConnections();
+
     OGRLayerH setSubsetString( OGRLayerH layer, OGRDataSourceH ds );
 
     friend class QgsOgrFeatureSource;
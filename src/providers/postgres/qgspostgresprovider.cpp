@@ -25,6 +25,7 @@
 #include <qgscoordinatereferencesystem.h>
 
 #include <QMessageBox>
+#include <QThread>
 
 #include "qgsvectorlayerimport.h"
 #include "qgsprovidercountcalcevent.h"
@@ -103,7 +104,10 @@ QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
     return;
   }
 
-  mConnectionRO = QgsPostgresConn::connectDb( mUri.connectionInfo(), true );
+  // the shared connections are only used on the main thread, a provider prepared
+  // in the thread pool opens its own one
+  bool shared = !QCoreApplication::instance() || QThread::currentThread() == QCoreApplication::instance()->thread();
+  mConnectionRO = QgsPostgresConn::connectDb( mUri.connectionInfo(), true, shared );
   if ( !mConnectionRO )
   {
     return;
@@ -3179,6 +3183,15 @@ QGISEXTERN bool isProvider()
   return true;
 }
 
+/**
+ * The provider can be created in a thread of the pool when a project is read,
+ * see QgsProviderRegistry::prepareProviders()
+ */
+QGISEXTERN bool supportsThreadedCreation()
+{
+  return true;
+}
+
 QGISEXTERN QgsPgSourceSelect *selectWidget( QWidget *parent, Qt::WindowFlags fl )
 {
   return new QgsPgSourceSelect( parent, fl );
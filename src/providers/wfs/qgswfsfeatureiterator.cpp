@@ -154,6 +154,10 @@ QgsWFSFeatureSource::QgsWFSFeatureSource( const QgsWFSProvider* p )
     , mFeatures( p->mFeatures )
     , mSpatialIndex( p->mSpatialIndex ? new QgsSpatialIndex( *p->mSpatialIndex ) : 0 )  // just shallow copy
 {
+  if ( p->dataSourceUri().contains( "BBOX=" ) )
+  {
+    mProvider = const_cast<QgsWFSProvider*>( p );
+  }
 }
 
 QgsWFSFeatureSource::~QgsWFSFeatureSource()
@@ -163,5 +167,14 @@ QgsWFSFeatureSource::~QgsWFSFeatureSource()
 
 QgsFeatureIterator QgsWFSFeatureSource::getFeatures( const QgsFeatureRequest& request )
 {
+  if ( mProvider && !( request.flags() & QgsFeatureRequest::NoGeometry ) && !request.filterRect().isEmpty() )
+  {
+    //the source may be used from a render thread. Missing tiles are loaded in the provider's thread,
+    //the layer is repainted with them as they arrive
+    const QgsRectangle& rect = request.filterRect();
+    QMetaObject::invokeMethod( mProvider, "loadExtent", Qt::QueuedConnection,
+                               Q_ARG( double, rect.xMinimum() ), Q_ARG( double, rect.yMinimum() ),
+                               Q_ARG( double, rect.xMaximum() ), Q_ARG( double, rect.yMaximum() ) );
+  }
   return QgsFeatureIterator( new QgsWFSFeatureIterator( this, false, request ) );
 }
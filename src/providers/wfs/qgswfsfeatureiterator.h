@@ -17,6 +17,8 @@
 
 #include "qgsfeatureiterator.h"
 
+#include <QPointer>
+
 class QgsWFSProvider;
 class QgsSpatialIndex;
 typedef QMap<QgsFeatureId, QgsFeature*> QgsFeaturePtrMap;
@@ -35,6 +37,8 @@ class QgsWFSFeatureSource : public QgsAbstractFeatureSource
     QgsFields mFields;
     QgsFeaturePtrMap mFeatures;
     QgsSpatialIndex* mSpatialIndex;
+    /**Provider to ask for missing tiles if it fetches features on demand (GetRenderedOnly), else 0*/
+    QPointer<QgsWFSProvider> mProvider;
 
     friend class QgsWFSFeatureIterator;
 };
@@ -16,6 +16,10 @@
  ***************************************************************************/
 
 #define WFS_THRESHOLD 200
+//GetRenderedOnly: levels of larger tiles searched for a loaded tile containing a requested one
+#define WFS_MAX_TILE_LEVELS 24
+//GetRenderedOnly: how often a tile with too many features for a single request is split
+#define WFS_MAX_TILE_DEPTH 4
 
 #include "qgis.h"
 #include "qgsapplication.h"
@@ -34,6 +38,7 @@
 #include "qgsnetworkaccessmanager.h"
 #include "qgsogcutils.h"
 
+#include <QCryptographicHash>
 #include <QDomDocument>
 #include <QMessageBox>
 #include <QDomNodeList>
@@ -43,7 +48,9 @@
 #include <QUrl>
 #include <QWidget>
 #include <QPair>
+#include <QSettings>
 #include <cfloat>
+#include <cmath>
 
 static const QString TEXT_PROVIDER_KEY = "WFS";
 static const QString TEXT_PROVIDER_DESCRIPTION = "WFS data provider";
@@ -53,6 +60,13 @@ static const QString GML_NAMESPACE = "http://www.opengis.net/gml";
 static const QString OGC_NAMESPACE = "http://www.opengis.net/ogc";
 static const QString OWS_NAMESPACE = "http://www.opengis.net/ows";
 
+//GetRenderedOnly: rectangle of the tile in column x and row y of a level
+static QgsRectangle wfsTileRect( int level, int x, int y )
+{
+  double tileSize = ldexp( 1.0, level );
+  return QgsRectangle( x * tileSize, y * tileSize, ( x + 1 ) * tileSize, ( y + 1 ) * tileSize );
+}
+
 QgsWFSProvider::QgsWFSProvider( const QString& uri )
     : QgsVectorDataProvider( uri )
     , mNetworkRequestFinished( true )
@@ -65,8 +79,14 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
     , mLayer( 0 )
     , mGetRenderedOnly( false )
     , mInitGro( false )
+    , mNextTileSerial( 0 )
 {
   mSpatialIndex = 0;
+
+  QSettings settings;
+  mMaxConcurrentRequests = qMax( 1, settings.value( "/qgis/wfs/maxConcurrentRequests", 4 ).toInt() );
+  mTilePageSize = qMax( 1, settings.value( "/qgis/wfs/featuresPerTileRequest", 1000 ).toInt() );
+
   if ( uri.isEmpty() )
   {
     mValid = false;
@@ -128,6 +148,15 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
 
 QgsWFSProvider::~QgsWFSProvider()
 {
+  QList<QNetworkReply*> replies = mRunningTileRequests.keys();
+  mRunningTileRequests.clear();
+  foreach ( QNetworkReply* reply, replies )
+  {
+    disconnect( reply, 0, this, 0 );
+    reply->abort();
+    reply->deleteLater();
+  }
+
   deleteData();
   delete mSpatialIndex;
 }
@@ -153,6 +182,11 @@ void QgsWFSProvider::deleteData()
     delete mFeatures[i];
   }
   mFeatures.clear();
+  mWfsIdToFid.clear();
+  mAnonymousFeatureKeys.clear();
+  mLoadedTiles.clear();
+  mPendingTiles.clear();
+  mTileQueue.clear();
 }
 
 
@@ -198,70 +232,345 @@ QgsFeatureIterator QgsWFSProvider::getFeatures( const QgsFeatureRequest& request
     QgsRectangle rect = request.filterRect();
     if ( !rect.isEmpty() )
     {
-      QString dsURI = dataSourceUri();
-      //first time through, initialize GetRenderedOnly args
-      //ctor cannot initialize because layer object not available then
-      if ( ! mInitGro )
-      { //did user check "Cache Features" in WFS layer source selection?
-        if ( dsURI.contains( "BBOX=" ) )
-        { //no: initialize incremental getFeature
-          if ( initGetRenderedOnly( rect ) )
+      loadExtent( rect.xMinimum(), rect.yMinimum(), rect.xMaximum(), rect.yMaximum() );
+    }
+  }
+  return QgsFeatureIterator( new QgsWFSFeatureIterator( new QgsWFSFeatureSource( this ), true, request ) );
+}
+
+void QgsWFSProvider::loadExtent( double xMin, double yMin, double xMax, double yMax )
+{
+  QgsRectangle rect( xMin, yMin, xMax, yMax );
+  if ( rect.isEmpty() )
+  {
+    return;
+  }
+
+  //first time through, initialize GetRenderedOnly args
+  //ctor cannot initialize because layer object not available then
+  if ( ! mInitGro )
+  { //did user check "Cache Features" in WFS layer source selection?
+    if ( dataSourceUri().contains( "BBOX=" ) )
+    { //no: initialize incremental getFeature
+      if ( initGetRenderedOnly( rect ) )
+      {
+        mGetRenderedOnly = true;
+      }
+      else
+      { //initialization failed;
+        QgsDebugMsg( QString( "GetRenderedOnly initialization failed; incorrect operation may occur\n%1" )
+                     .arg( dataSourceUri() ) );
+        QMessageBox( QMessageBox::Warning, "Non-Cached layer initialization failed!",
+                     QString( "Incorrect operation may occur:\n%1" ).arg( dataSourceUri() ) );
+      }
+    }
+    mInitGro = true;
+  }
+
+  if ( !mGetRenderedOnly )
+  { //"Cache Features" was selected for this layer, everything is already there
+    return;
+  }
+
+  //the tile level is chosen such that the extent is covered by a few tiles. Tiles of other
+  //levels which are already loaded stay valid, a tile is not requested again if a larger
+  //tile containing it has been loaded
+  int level = ( int ) ceil( log( qMax( rect.width(), rect.height() ) / 2.0 ) / log( 2.0 ) );
+  double tileSize = ldexp( 1.0, level );
+
+  //requests for tiles no longer visible are dropped as long as they are not sent
+  QList<TileRequest>::iterator queueIt = mTileQueue.begin();
+  while ( queueIt != mTileQueue.end() )
+  {
+    if ( !wfsTileRect( queueIt->tileKey.level, queueIt->tileKey.x, queueIt->tileKey.y ).intersects( rect ) )
+    {
+      //the tile is incomplete without this request and gets requested again when visible
+      QHash<TileKey, TileLoad>::iterator loadIt = mPendingTiles.find( queueIt->tileKey );
+      if ( loadIt != mPendingTiles.end() && loadIt->serial == queueIt->serial )
+      {
+        mPendingTiles.erase( loadIt );
+      }
+      queueIt = mTileQueue.erase( queueIt );
+    }
+    else
+    {
+      ++queueIt;
+    }
+  }
+
+  int xMinIdx = ( int ) floor( rect.xMinimum() / tileSize );
+  int xMaxIdx = ( int ) floor( rect.xMaximum() / tileSize );
+  int yMinIdx = ( int ) floor( rect.yMinimum() / tileSize );
+  int yMaxIdx = ( int ) floor( rect.yMaximum() / tileSize );
+  for ( int y = yMinIdx; y <= yMaxIdx; ++y )
+  {
+    for ( int x = xMinIdx; x <= xMaxIdx; ++x )
+    {
+      TileKey key;
+      key.level = level;
+      key.x = x;
+      key.y = y;
+      if ( tileCovered( key ) )
+      {
+        continue;
+      }
+
+      TileLoad load;
+      load.serial = mNextTileSerial++;
+      load.pendingRequests = 1;
+      mPendingTiles.insert( key, load );
+
+      TileRequest tile;
+      tile.rect = wfsTileRect( level, x, y );
+      tile.tileKey = key;
+      tile.serial = load.serial;
+      tile.depth = 0;
+      tile.maxFeatures = pagedMaxFeatures();
+      mTileQueue.append( tile );
+    }
+  }
+
+  QgsDebugMsg( QString( "Layer %1 GetRenderedOnly: %2 tile requests queued, %3 running" )
+               .arg( mLayer->name() ).arg( mTileQueue.size() ).arg( mRunningTileRequests.size() ) );
+  startTileRequests();
+}
+
+bool QgsWFSProvider::tileCovered( const TileKey& key ) const
+{
+  TileKey parent = key;
+  for ( int i = 0; i <= WFS_MAX_TILE_LEVELS; ++i )
+  {
+    if ( mLoadedTiles.contains( parent ) || mPendingTiles.contains( parent ) )
+    {
+      return true;
+    }
+    //the tile of the next level containing this one
+    ++parent.level;
+    parent.x = ( int ) floor( parent.x / 2.0 );
+    parent.y = ( int ) floor( parent.y / 2.0 );
+  }
+  return false;
+}
+
+int QgsWFSProvider::userMaxFeatures() const
+{
+  return parameterFromUrl( "MAXFEATURES" ).toInt();
+}
+
+int QgsWFSProvider::pagedMaxFeatures() const
+{
+  int userMax = userMaxFeatures();
+  return userMax > 0 ? qMin( userMax, mTilePageSize ) : mTilePageSize;
+}
+
+void QgsWFSProvider::startTileRequests()
+{
+  while ( mRunningTileRequests.size() < mMaxConcurrentRequests && !mTileQueue.isEmpty() )
+  {
+    TileRequest tile = mTileQueue.takeFirst();
+
+    QUrl getFeatureUrl( dataSourceUri() );
+    getFeatureUrl.removeQueryItem( "username" );
+    getFeatureUrl.removeQueryItem( "password" );
+    getFeatureUrl.removeQueryItem( "BBOX" );
+    getFeatureUrl.removeQueryItem( "MAXFEATURES" );
+    //TODO: BBOX may not be combined with FILTER. WFS spec v. 1.1.0, sec. 14.7.3 ff.
+    //      if a FILTER is present, the BBOX must be merged into it, capabilities permitting.
+    //      Else one criterion must be abandoned and the user warned.  [WBC 111221]
+    getFeatureUrl.addQueryItem( "BBOX", QString( "%1,%2,%3,%4" )
+                                .arg( qgsDoubleToString( tile.rect.xMinimum() ) )
+                                .arg( qgsDoubleToString( tile.rect.yMinimum() ) )
+                                .arg( qgsDoubleToString( tile.rect.xMaximum() ) )
+                                .arg( qgsDoubleToString( tile.rect.yMaximum() ) ) );
+    if ( tile.maxFeatures > 0 )
+    {
+      getFeatureUrl.addQueryItem( "MAXFEATURES", QString::number( tile.maxFeatures ) );
+    }
+
+    QNetworkRequest request( getFeatureUrl );
+    mAuth.setAuthorization( request );
+    QNetworkReply* reply = QgsNetworkAccessManager::instance()->get( request );
+    connect( reply, SIGNAL( finished() ), this, SLOT( tileRequestFinished() ) );
+    mRunningTileRequests.insert( reply, tile );
+  }
+
+  if ( !mRunningTileRequests.isEmpty() )
+  {
+    emit dataReadProgressMessage( tr( "%n WFS tile request(s) pending", "pending requests", mRunningTileRequests.size() + mTileQueue.size() ) );
+  }
+}
+
+void QgsWFSProvider::tileRequestFinished()
+{
+  QNetworkReply* reply = qobject_cast<QNetworkReply*>( sender() );
+  if ( !reply || !mRunningTileRequests.contains( reply ) )
+  {
+    return;
+  }
+
+  TileRequest tile = mRunningTileRequests.take( reply );
+  reply->deleteLater();
+
+  bool success = reply->error() == QNetworkReply::NoError;
+  int nReceived = 0;
+  if ( success )
+  {
+    QgsGml dataReader( parameterFromUrl( "typename" ), mGeometryAttribute, mFields );
+    QGis::WkbType wkbType = mWKBType;
+    dataReader.getFeatures( reply->readAll(), &wkbType );
+    QMap<QgsFeatureId, QgsFeature* > features = dataReader.featuresMap();
+    nReceived = features.size();
+    if ( mergeFeatures( features, dataReader.idsMap() ) > 0 )
+    {
+      //render what we have so far
+      emit dataChanged();
+      if ( mLayer )
+      {
+        mLayer->updateExtents();
+      }
+    }
+  }
+  else
+  {
+    QgsMessageLog::logMessage( tr( "WFS tile request failed with error: %1" ).arg( reply->errorString() ), tr( "WFS" ) );
+  }
+
+  //requests belonging to a dropped or superseded tile load only contribute their features
+  QHash<TileKey, TileLoad>::iterator loadIt = mPendingTiles.find( tile.tileKey );
+  if ( loadIt != mPendingTiles.end() && loadIt->serial == tile.serial )
+  {
+    if ( !success )
+    { //not marked as loaded, the tile is requested again with the next extent containing it
+      mPendingTiles.erase( loadIt );
+    }
+    else
+    {
+      if ( tile.maxFeatures > 0 && nReceived >= tile.maxFeatures )
+      { //the server probably truncated the response
+        int userMax = userMaxFeatures();
+        if ( tile.depth < WFS_MAX_TILE_DEPTH && tile.maxFeatures == pagedMaxFeatures() )
+        { //page through the tile by requesting its quarters
+          double halfWidth = tile.rect.width() / 2.0;
+          double halfHeight = tile.rect.height() / 2.0;
+          for ( int i = 0; i < 4; ++i )
           {
-            mGetRenderedOnly = true;
-          }
-          else
-          { //initialization failed;
-            QgsDebugMsg( QString( "GetRenderedOnly initialization failed; incorrect operation may occur\n%1" )
-                         .arg( dataSourceUri() ) );
-            QMessageBox( QMessageBox::Warning, "Non-Cached layer initialization failed!",
-                         QString( "Incorrect operation may occur:\n%1" ).arg( dataSourceUri() ) );
+            TileRequest subTile = tile;
+            double x = tile.rect.xMinimum() + ( i % 2 ) * halfWidth;
+            double y = tile.rect.yMinimum() + ( i / 2 ) * halfHeight;
+            subTile.rect = QgsRectangle( x, y, x + halfWidth, y + halfHeight );
+            subTile.depth = tile.depth + 1;
+            mTileQueue.prepend( subTile );
           }
+          loadIt->pendingRequests += 4;
         }
-        mInitGro = true;
-      }
-
-      if ( mGetRenderedOnly )
-      { //"Cache Features" was not selected for this layer
-        //has rendered extent expanded beyond last-retrieved WFS extent?
-        //NB: "intersect" instead of "contains" tolerates rounding errors;
-        //    avoids unnecessary second fetch on zoom-in/zoom-out sequences
-        QgsRectangle olap( rect );
-        olap = olap.intersect( &mGetExtent );
-        if ( qgsDoubleNear( rect.width(), olap.width() ) && qgsDoubleNear( rect.height(), olap.height() ) )
-        { //difference between canvas and layer extents is within rounding error: do not re-fetch
-          QgsDebugMsg( QString( "Layer %1 GetRenderedOnly: no fetch required" ).arg( mLayer->name() ) );
+        else if ( tile.maxFeatures != userMax )
+        { //the features are too dense to be paged by splitting the tile, request them at once
+          QgsMessageLog::logMessage( tr( "WFS tile %1 still returns %2 features after %3 subdivisions, requesting it without paging" )
+                                     .arg( tile.rect.toString() ).arg( nReceived ).arg( tile.depth ), tr( "WFS" ) );
+          TileRequest fullTile = tile;
+          fullTile.maxFeatures = userMax;
+          mTileQueue.prepend( fullTile );
+          loadIt->pendingRequests += 1;
         }
         else
-        { //combined old and new extents might speed up local panning & zooming
-          mGetExtent.combineExtentWith( &rect );
-          //but see if the combination is useless or too big
-          double pArea = mGetExtent.width() * mGetExtent.height();
-          double cArea = rect.width() * rect.height();
-          if ( olap.isEmpty() || pArea > ( cArea * 4.0 ) )
-          { //new canvas extent does not overlap or combining old and new extents would
-            //fetch > 4 times the area to be rendered; get only what will be rendered
-            mGetExtent = rect;
-          }
-          QgsDebugMsg( QString( "Layer %1 GetRenderedOnly: fetching extent %2" )
-                       .arg( mLayer->name(), mGetExtent.asWktCoordinates() ) );
-          dsURI = dsURI.replace( QRegExp( "BBOX=[^&]*" ),
-                                 QString( "BBOX=%1,%2,%3,%4" )
-                                 .arg( qgsDoubleToString( mGetExtent.xMinimum() ) )
-                                 .arg( qgsDoubleToString( mGetExtent.yMinimum() ) )
-                                 .arg( qgsDoubleToString( mGetExtent.xMaximum() ) )
-                                 .arg( qgsDoubleToString( mGetExtent.yMaximum() ) ) );
-          //TODO: BBOX may not be combined with FILTER. WFS spec v. 1.1.0, sec. 14.7.3 ff.
-          //      if a FILTER is present, the BBOX must be merged into it, capabilities permitting.
-          //      Else one criterion must be abandoned and the user warned.  [WBC 111221]
-          setDataSourceUri( dsURI );
-          reloadData();
-          mLayer->updateExtents();
+        { //the data source asks for no more features
+          QgsMessageLog::logMessage( tr( "WFS tile %1 is limited to MAXFEATURES=%2 of the data source" )
+                                     .arg( tile.rect.toString() ).arg( userMax ), tr( "WFS" ) );
         }
       }
+
+      if ( --loadIt->pendingRequests == 0 )
+      {
+        mPendingTiles.erase( loadIt );
+        mLoadedTiles.insert( tile.tileKey );
+      }
     }
+  }
 
+  startTileRequests();
+}
+
+//GetRenderedOnly: checksum of the geometry and the attributes of a feature without WFS id
+static QByteArray anonymousFeatureKey( const QgsFeature& feature )
+{
+  QCryptographicHash hash( QCryptographicHash::Md5 );
+  const QgsGeometry* geometry = feature.geometry();
+  if ( geometry && geometry->asWkb() )
+  {
+    hash.addData( reinterpret_cast<const char*>( geometry->asWkb() ), geometry->wkbSize() );
   }
-  return QgsFeatureIterator( new QgsWFSFeatureIterator( new QgsWFSFeatureSource( this ), true, request ) );
+  foreach ( const QVariant& value, feature.attributes() )
+  {
+    //0xff does not occur in utf8 text and marks NULL
+    hash.addData( value.isNull() ? QByteArray( 1, '\xff' ) : value.toString().toUtf8() );
+    hash.addData( QByteArray( 1, '\0' ) );
+  }
+  return hash.result();
+}
+
+int QgsWFSProvider::mergeFeatures( const QMap<QgsFeatureId, QgsFeature* >& features, const QMap<QgsFeatureId, QString >& idMap )
+{
+  if ( !mSpatialIndex )
+  {
+    mSpatialIndex = new QgsSpatialIndex();
+  }
+
+  QgsFeatureId newId = findNewKey();
+  int nAdded = 0;
+  //features without id are only compared with the ones of earlier responses,
+  //identical features within one response are distinct features of the layer
+  QSet<QByteArray> anonymousKeys;
+  QMap<QgsFeatureId, QgsFeature* >::const_iterator featureIt = features.constBegin();
+  for ( ; featureIt != features.constEnd(); ++featureIt )
+  {
+    QgsFeature* f = featureIt.value();
+    QString wfsId = idMap.value( featureIt.key() );
+    if ( !wfsId.isEmpty() && mWfsIdToFid.contains( wfsId ) )
+    { //already received with another tile
+      delete f;
+      continue;
+    }
+    if ( wfsId.isEmpty() )
+    {
+      QByteArray key = anonymousFeatureKey( *f );
+      if ( mAnonymousFeatureKeys.contains( key ) )
+      {
+        delete f;
+        continue;
+      }
+      anonymousKeys.insert( key );
+    }
+
+    f->setFeatureId( newId );
+    mFeatures.insert( newId, f );
+    if ( !wfsId.isEmpty() )
+    {
+      mIdMap.insert( newId, wfsId );
+      mWfsIdToFid.insert( wfsId, newId );
+    }
+
+    if ( mWKBType != QGis::WKBNoGeometry && f->geometry() )
+    {
+      mSpatialIndex->insertFeature( *f );
+      QgsRectangle bbox = f->geometry()->boundingBox();
+      if ( mFeatures.size() == 1 )
+      {
+        mExtent = bbox;
+      }
+      else
+      {
+        mExtent.combineExtentWith( &bbox );
+      }
+    }
+    ++newId;
+    ++nAdded;
+  }
+
+  mAnonymousFeatureKeys.unite( anonymousKeys );
+
+  mFeatureCount = mFeatures.size();
+  QgsDebugMsg( QString( "%1 of %2 features added, feature count is %3" ).arg( nAdded ).arg( features.size() ).arg( mFeatureCount ) );
+  return nAdded;
 }
 
 int QgsWFSProvider::getFeature( const QString& uri )
@@ -357,6 +666,7 @@ bool QgsWFSProvider::addFeatures( QgsFeatureList &flist )
         featureIt->setFeatureId( newId );
         mFeatures.insert( newId, new QgsFeature( *featureIt ) );
         mIdMap.insert( newId, *idIt );
+        mWfsIdToFid.insert( *idIt, newId );
         mSpatialIndex->insertFeature( *featureIt );
         mFeatureCount = mFeatures.size();
       }
@@ -433,6 +743,7 @@ bool QgsWFSProvider::deleteFeatures( const QgsFeatureIds &id )
         delete fIt.value();
         mFeatures.remove( *idIt );
       }
+      mWfsIdToFid.remove( mIdMap.take( *idIt ) );
     }
     return true;
   }
@@ -696,6 +1007,10 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
   }
   mFeatures = dataReader.featuresMap();
   mIdMap = dataReader.idsMap();
+  for ( QMap<QgsFeatureId, QString>::const_iterator idIt = mIdMap.constBegin(); idIt != mIdMap.constEnd(); ++idIt )
+  {
+    mWfsIdToFid.insert( idIt.value(), idIt.key() );
+  }
 
   QgsDebugMsg( QString( "feature count after request is: %1" ).arg( mFeatures.size() ) );
   QgsDebugMsg( QString( "mExtent after request is: %1" ).arg( mExtent.toString() ) );
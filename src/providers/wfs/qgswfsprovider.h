@@ -28,9 +28,11 @@
 #include "qgswfsfeatureiterator.h"
 
 #include <QNetworkRequest>
+#include <QSet>
 
 class QgsRectangle;
 class QgsSpatialIndex;
+class QNetworkReply;
 
 // TODO: merge with QgsWmsAuthorization?
 struct QgsWFSAuthorization
@@ -150,6 +152,14 @@ class QgsWFSProvider: public QgsVectorDataProvider
     /**Sets mNetworkRequestFinished flag to true*/
     void networkRequestFinished();
 
+    /**GetRenderedOnly: makes sure the features of all tiles covering the given extent
+      are loaded. Missing tiles are requested asynchronously, dataChanged() is emitted
+      whenever a tile has been merged into the feature store*/
+    void loadExtent( double xMin, double yMin, double xMax, double yMax );
+
+    /**GetRenderedOnly: merges the features of a finished tile request and starts the next queued requests*/
+    void tileRequestFinished();
+
   private:
     bool mNetworkRequestFinished;
     friend class QgsWFSFeatureSource;
@@ -197,8 +207,54 @@ class QgsWFSProvider: public QgsVectorDataProvider
     bool mGetRenderedOnly;
     /**GetRenderedOnly initializaiton flat*/
     bool mInitGro;
-    /**if GetRenderedOnly, extent specified in WFS getFeatures; else empty (no constraint)*/
-    QgsRectangle mGetExtent;
+    /**GetRenderedOnly: tiles are addressed by their column and row in a grid anchored at the origin.
+      The tiles of a level have a side length of 2^level layer units*/
+    struct TileKey
+    {
+      int level;
+      int x;
+      int y;
+      bool operator==( const TileKey& other ) const { return level == other.level && x == other.x && y == other.y; }
+      friend uint qHash( const TileKey& key ) { return qHash( key.level ) ^ ( qHash( key.x ) * 31 ) ^ ( qHash( key.y ) * 1031 ); }
+    };
+    /**GetRenderedOnly: a GetFeature request for a tile or for a quarter of a tile which
+      returned as many features as were requested*/
+    struct TileRequest
+    {
+      QgsRectangle rect;
+      /**Key of the top level tile the request belongs to*/
+      TileKey tileKey;
+      /**Serial of the top level tile load the request belongs to*/
+      int serial;
+      /**Subdivision level below the top level tile*/
+      int depth;
+      /**MAXFEATURES sent with the request, 0 if the request has no limit*/
+      int maxFeatures;
+    };
+    /**GetRenderedOnly: bookkeeping for a top level tile being loaded*/
+    struct TileLoad
+    {
+      int serial;
+      int pendingRequests;
+    };
+    /**GetRenderedOnly: tiles whose features are completely in the feature store*/
+    QSet<TileKey> mLoadedTiles;
+    /**GetRenderedOnly: tiles with queued or running requests*/
+    QHash<TileKey, TileLoad> mPendingTiles;
+    /**GetRenderedOnly: requests waiting for a free network slot*/
+    QList<TileRequest> mTileQueue;
+    /**GetRenderedOnly: requests currently sent to the server*/
+    QHash<QNetworkReply*, TileRequest> mRunningTileRequests;
+    /**GetRenderedOnly: serial given to the next top level tile load*/
+    int mNextTileSerial;
+    /**Maximum number of concurrent GetFeature requests*/
+    int mMaxConcurrentRequests;
+    /**Maximum number of features requested per tile. A tile returning that many features is split in four*/
+    int mTilePageSize;
+    /**Reverse of mIdMap, used to skip features received twice (e.g. from neighbouring tiles)*/
+    QHash<QString, QgsFeatureId> mWfsIdToFid;
+    /**Checksums of the geometry and attributes of features without WFS id, used to skip them when received twice*/
+    QSet<QByteArray> mAnonymousFeatureKeys;
 
     //encoding specific methods of getFeature
     int getFeatureGET( const QString& uri, const QString& geometryAttribute );
@@ -260,6 +316,19 @@ class QgsWFSProvider: public QgsVectorDataProvider
     void handleException( const QDomDocument& serverResponse );
     /**Initializes "Cache Features" inactive processing*/
     bool initGetRenderedOnly( const QgsRectangle &rect );
+    /**GetRenderedOnly: sends queued tile requests as long as there are free network slots*/
+    void startTileRequests();
+    /**GetRenderedOnly: true if the tile or a larger tile containing it is loaded or being loaded*/
+    bool tileCovered( const TileKey& key ) const;
+    /**GetRenderedOnly: MAXFEATURES of the data source uri, 0 if there is none*/
+    int userMaxFeatures() const;
+    /**GetRenderedOnly: MAXFEATURES of the tile requests, the page size unless the data source asks for less*/
+    int pagedMaxFeatures() const;
+    /**Adds features received from the server to the feature store, skipping features
+      which are already there. Features without WFS id are recognized by their geometry
+      and attributes. Takes ownership of the features.
+      @return number of features added*/
+    int mergeFeatures( const QMap<QgsFeatureId, QgsFeature* >& features, const QMap<QgsFeatureId, QString >& idMap );
     /**Converts DescribeFeatureType schema geometry property type to WKBType*/
     QGis::WkbType geomTypeFromPropertyType( QString attName, QString propType );
 
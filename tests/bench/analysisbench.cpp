@@ -0,0 +1,170 @@
+/***************************************************************************
+                 analysisbench.cpp  - Benchmark of the vector analysis tools
+                             -------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QTime>
+
+#include <cmath>
+#include <iostream>
+
+#include "qgsapplication.h"
+#include "qgsgeometry.h"
+#include "qgsgeometryanalyzer.h"
+#include "qgsoverlayanalyzer.h"
+#include "qgsproviderregistry.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorfilewriter.h"
+#include "qgsvectorlayer.h"
+
+/** print usage text
+ */
+void usage( std::string const & appName )
+{
+  std::cerr << "QGIS Analysis Benchmark\n"
+            << "Times the vector analysis tools on random polygons with one and with several threads\n"
+            << "Usage: " << appName <<  " [options]\n"
+            << "  options:\n"
+            << "\t[--features count]\tnumber of random polygons, default 10000\n"
+            << "\t[--threads count]\tnumber of threads of the parallel runs, default number of cores\n"
+            << "\t[--prefix path]\tpath to a different build of qgis, may be used to test old versions\n"
+            << "\t[--help]\t\tthis text\n";
+}
+
+/** memory layer with overlapping random polygons of up to 32 vertices
+ */
+static QgsVectorLayer* createPolygonLayer( int featureCount, const QString& name )
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( "Polygon?crs=epsg:3857&field=id:integer&field=class:integer", name, "memory" );
+
+  // the polygons cover a square with about 10 polygons on top of each other
+  double size = sqrt(( double ) featureCount ) * 100.0;
+  QgsFeatureList features;
+  for ( int i = 0; i < featureCount; ++i )
+  {
+    QgsPoint center( size * qrand() / RAND_MAX, size * qrand() / RAND_MAX );
+    QgsGeometry* point = QgsGeometry::fromPoint( center );
+
+    QgsFeature feature;
+    feature.setGeometry( point->buffer( 50.0 + 150.0 * qrand() / RAND_MAX, 1 + qrand() % 8 ) );
+    QgsAttributes attributes( 2 );
+    attributes[0] = i;
+    attributes[1] = qrand() % 10;
+    feature.setAttributes( attributes );
+    features << feature;
+    delete point;
+  }
+  layer->dataProvider()->addFeatures( features );
+  layer->updateExtents();
+  return layer;
+}
+
+int main( int argc, char *argv[] )
+{
+  QgsApplication myApp( argc, argv, false );
+
+  int featureCount = 10000;
+  int threads = QThread::idealThreadCount();
+  QString myPrefixPath;
+
+  QStringList args = QCoreApplication::arguments();
+  for ( int i = 1; i < args.size(); ++i )
+  {
+    if ( args[i] == "--features" && i + 1 < args.size() )
+    {
+      featureCount = args[++i].toInt();
+    }
+    else if ( args[i] == "--threads" && i + 1 < args.size() )
+    {
+      threads = args[++i].toInt();
+    }
+    else if ( args[i] == "--prefix" && i + 1 < args.size() )
+    {
+      myPrefixPath = args[++i];
+    }
+    else
+    {
+      usage( args[0].toStdString() );
+      return args[i] == "--help" ? 0 : 2;
+    }
+  }
+
+  if ( myPrefixPath.isEmpty() )
+  {
+    QDir dir( QCoreApplication::applicationDirPath() );
+    dir.cdUp();
+    myPrefixPath = dir.absolutePath();
+  }
+  QgsApplication::setPrefixPath( myPrefixPath, true );
+  QgsApplication::initQgis();
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+
+  qsrand( 1 );
+  QgsVectorLayer* layerA = createPolygonLayer( featureCount, "a" );
+  QgsVectorLayer* layerB = createPolygonLayer( featureCount, "b" );
+
+  QString output = QDir::tempPath() + QDir::separator() + "qgis_analysis_bench.shp";
+  QgsGeometryAnalyzer geometryAnalyzer;
+  QgsOverlayAnalyzer overlayAnalyzer;
+
+  QStringList operations;
+  operations << "simplify" << "centroids" << "buffer" << "buffer dissolve" << "dissolve" << "dissolve field" << "convex hull" << "intersection";
+
+  std::cout << "features: " << featureCount << std::endl;
+  std::cout << "operation\t1 thread [s]\t" << threads << " threads [s]" << std::endl;
+
+  foreach ( QString operation, operations )
+  {
+    std::cout << operation.toStdString();
+    QList<int> threadCounts;
+    threadCounts << 1 << threads;
+    foreach ( int threadCount, threadCounts )
+    {
+      QThreadPool::globalInstance()->setMaxThreadCount( threadCount );
+      QgsVectorFileWriter::deleteShapeFile( output );
+
+      QTime time;
+      time.start();
+      if ( operation == "simplify" )
+        geometryAnalyzer.simplify( layerA, output, 10.0 );
+      else if ( operation == "centroids" )
+        geometryAnalyzer.centroids( layerA, output );
+      else if ( operation == "buffer" )
+        geometryAnalyzer.buffer( layerA, output, 10.0 );
+      else if ( operation == "buffer dissolve" )
+        geometryAnalyzer.buffer( layerA, output, 10.0, false, true );
+      else if ( operation == "dissolve" )
+        geometryAnalyzer.dissolve( layerA, output );
+      else if ( operation == "dissolve field" )
+        geometryAnalyzer.dissolve( layerA, output, false, 1 );
+      else if ( operation == "convex hull" )
+        geometryAnalyzer.convexHull( layerA, output, false, 1 );
+      else if ( operation == "intersection" )
+        overlayAnalyzer.intersection( layerA, layerB, output );
+
+      std::cout << "\t" << time.elapsed() / 1000.0;
+    }
+    std::cout << std::endl;
+  }
+
+  QgsVectorFileWriter::deleteShapeFile( output );
+  delete layerA;
+  delete layerB;
+  return 0;
+}
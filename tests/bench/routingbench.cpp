@@ -0,0 +1,206 @@
+/***************************************************************************
+                 routingbench.cpp  - Benchmark of the network analysis routing
+                             -------------------
+    begin                : May 2014
+    copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QThread>
+#include <QTime>
+
+#include <cmath>
+#include <iostream>
+
+#include "qgsgraph.h"
+#include "qgsgraphanalyzer.h"
+#include "qgscontractionhierarchy.h"
+#include "qgsroutinggraph.h"
+
+/** print usage text
+ */
+void usage( std::string const & appName )
+{
+  std::cerr << "QGIS Routing Benchmark\n"
+            << "Times shortest path queries and preprocessing on a synthetic grid network\n"
+            << "Usage: " << appName <<  " [options]\n"
+            << "  options:\n"
+            << "\t[--size count]\tnumber of vertices in each row and column of the grid, default 300\n"
+            << "\t[--queries count]\tnumber of point to point queries, default 100\n"
+            << "\t[--matrix count]\tnumber of start and end vertices of the cost matrix, default 100\n"
+            << "\t[--threads count]\tnumber of threads of the cost matrix, default number of cores\n"
+            << "\t[--help]\t\tthis text\n";
+}
+
+/** grid of streets with random speeds, about every tenth arc is one way
+ */
+static QgsGraph* createGridGraph( int size )
+{
+  QgsGraph* graph = new QgsGraph();
+  for ( int y = 0; y < size; ++y )
+  {
+    for ( int x = 0; x < size; ++x )
+    {
+      graph->addVertex( QgsPoint( x * 100.0, y * 100.0 ) );
+    }
+  }
+
+  for ( int y = 0; y < size; ++y )
+  {
+    for ( int x = 0; x < size; ++x )
+    {
+      int vertex = y * size + x;
+      QList<int> neighbours;
+      if ( x + 1 < size )
+        neighbours << vertex + 1;
+      if ( y + 1 < size )
+        neighbours << vertex + size;
+      foreach ( int neighbour, neighbours )
+      {
+        QVector<QVariant> properties( 1 );
+        properties[0] = 100.0 * ( 1.0 + 2.0 * qrand() / RAND_MAX );
+        graph->addArc( vertex, neighbour, properties );
+        if ( qrand() % 10 != 0 )
+        {
+          properties[0] = 100.0 * ( 1.0 + 2.0 * qrand() / RAND_MAX );
+          graph->addArc( neighbour, vertex, properties );
+        }
+      }
+    }
+  }
+  return graph;
+}
+
+int main( int argc, char *argv[] )
+{
+  QCoreApplication myApp( argc, argv );
+
+  int size = 300;
+  int queries = 100;
+  int matrixSize = 100;
+  int threads = QThread::idealThreadCount();
+
+  QStringList args = QCoreApplication::arguments();
+  for ( int i = 1; i < args.size(); ++i )
+  {
+    if ( args[i] == "--size" && i + 1 < args.size() )
+    {
+      size = args[++i].toInt();
+    }
+    else if ( args[i] == "--queries" && i + 1 < args.size() )
+    {
+      queries = args[++i].toInt();
+    }
+    else if ( args[i] == "--matrix" && i + 1 < args.size() )
+    {
+      matrixSize = args[++i].toInt();
+    }
+    else if ( args[i] == "--threads" && i + 1 < args.size() )
+    {
+      threads = args[++i].toInt();
+    }
+    else
+    {
+      usage( args[0].toStdString() );
+      return args[i] == "--help" ? 0 : 2;
+    }
+  }
+
+  qsrand( 1 );
+  QTime time;
+  time.start();
+  QgsGraph* source = createGridGraph( size );
+  std::cout << "vertices: " << source->vertexCount() << ", arcs: " << source->arcCount() << std::endl;
+  std::cout << "create graph [s]\t" << time.elapsed() / 1000.0 << std::endl;
+
+  time.start();
+  QgsRoutingGraph graph( source, 0 );
+  std::cout << "create routing graph [s]\t" << time.elapsed() / 1000.0 << std::endl;
+
+  QVector<int> startVertices;
+  QVector<int> endVertices;
+  for ( int i = 0; i < qMax( queries, matrixSize ); ++i )
+  {
+    startVertices << qrand() % source->vertexCount();
+    endVertices << qrand() % source->vertexCount();
+  }
+
+  // one to all searches
+  int trees = qMax( 1, queries / 10 );
+  time.start();
+  for ( int i = 0; i < trees; ++i )
+  {
+    QVector<double> cost;
+    QgsGraphAnalyzer::dijkstra( source, startVertices[i], 0, 0, &cost );
+  }
+  std::cout << trees << " x QgsGraphAnalyzer::dijkstra [s]\t" << time.elapsed() / 1000.0 << std::endl;
+
+  time.start();
+  for ( int i = 0; i < trees; ++i )
+  {
+    QVector<double> cost;
+    graph.dijkstra( startVertices[i], cost );
+  }
+  std::cout << trees << " x QgsRoutingGraph::dijkstra [s]\t" << time.elapsed() / 1000.0 << std::endl;
+
+  // point to point queries, the sum of the costs has to be the same for all algorithms
+  QList<QgsRoutingGraph::Algorithm> algorithms;
+  algorithms << QgsRoutingGraph::Dijkstra << QgsRoutingGraph::Bidirectional << QgsRoutingGraph::AStar;
+  QStringList names;
+  names << "dijkstra" << "bidirectional" << "A*";
+  for ( int a = 0; a < algorithms.size(); ++a )
+  {
+    double total = 0;
+    time.start();
+    for ( int i = 0; i < queries; ++i )
+    {
+      QVector<int> arcs;
+      double cost = graph.shortestPath( startVertices[i], endVertices[i], algorithms[a], &arcs );
+      if ( !std::isinf( cost ) )
+        total += cost;
+    }
+    std::cout << queries << " x " << names[a].toStdString() << " [s]\t" << time.elapsed() / 1000.0 << "\t(total cost " << total << ")" << std::endl;
+  }
+
+  // contraction hierarchy, the total cost has to be the same as above
+  time.start();
+  QgsContractionHierarchy hierarchy( source, 0 );
+  std::cout << "create contraction hierarchy [s]\t" << time.elapsed() / 1000.0 << "\t(" << hierarchy.shortcutCount() << " shortcuts)" << std::endl;
+
+  double total = 0;
+  time.start();
+  for ( int i = 0; i < queries; ++i )
+  {
+    QVector<int> arcs;
+    double cost = hierarchy.shortestPath( startVertices[i], endVertices[i], &arcs );
+    if ( !std::isinf( cost ) )
+      total += cost;
+  }
+  std::cout << queries << " x contraction hierarchy [s]\t" << time.elapsed() / 1000.0 << "\t(total cost " << total << ")" << std::endl;
+
+  // many to many
+  QVector<int> matrixStart = startVertices.mid( 0, matrixSize );
+  QVector<int> matrixEnd = endVertices.mid( 0, matrixSize );
+  QList<int> threadCounts;
+  threadCounts << 1 << threads;
+  foreach ( int threadCount, threadCounts )
+  {
+    graph.setMaxThreads( threadCount );
+    time.start();
+    graph.costMatrix( matrixStart, matrixEnd );
+    std::cout << matrixSize << " x " << matrixSize << " cost matrix, " << threadCount << " threads [s]\t" << time.elapsed() / 1000.0 << std::endl;
+  }
+
+  delete source;
+  return 0;
+}
@@ -0,0 +1,215 @@
+/***************************************************************************
+     testqgscontractionhierarchy.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+
+#include <cmath>
+#include <limits>
+
+#include "qgsgraph.h"
+#include "qgsgraphanalyzer.h"
+#include "qgscontractionhierarchy.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the contraction hierarchy
+ */
+class TestQgsContractionHierarchy: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void testShortestPath();
+    void testPointsOnArcs();
+    void testWriteToFile();
+
+  private:
+    void addArc( int from, int to, double factor );
+
+    QgsGraph* mGraph;
+};
+
+//! number of vertices in each row and column of the grid
+static const int GRID_SIZE = 30;
+
+void TestQgsContractionHierarchy::addArc( int from, int to, double factor )
+{
+  QgsPoint p1 = mGraph->vertex( from ).point();
+  QgsPoint p2 = mGraph->vertex( to ).point();
+  QVector<QVariant> properties;
+  properties << sqrt( p1.sqrDist( p2 ) ) * factor;
+  mGraph->addArc( from, to, properties );
+}
+
+void TestQgsContractionHierarchy::initTestCase()
+{
+  // a grid with arcs of different speed, some streets are one way
+  mGraph = new QgsGraph();
+  for ( int y = 0; y < GRID_SIZE; ++y )
+  {
+    for ( int x = 0; x < GRID_SIZE; ++x )
+    {
+      mGraph->addVertex( QgsPoint( x * 10, y * 10 ) );
+    }
+  }
+  for ( int y = 0; y < GRID_SIZE; ++y )
+  {
+    for ( int x = 0; x < GRID_SIZE; ++x )
+    {
+      int vertex = y * GRID_SIZE + x;
+      if ( x + 1 < GRID_SIZE )
+      {
+        addArc( vertex, vertex + 1, 1 + ( vertex * 7 ) % 5 );
+        if ( vertex % 4 != 0 )
+          addArc( vertex + 1, vertex, 1 + ( vertex * 3 ) % 4 );
+      }
+      if ( y + 1 < GRID_SIZE )
+      {
+        addArc( vertex, vertex + GRID_SIZE, 1 + ( vertex * 11 ) % 3 );
+        if ( vertex % 5 != 0 )
+          addArc( vertex + GRID_SIZE, vertex, 1 + ( vertex * 13 ) % 6 );
+      }
+    }
+  }
+  // parallel arcs, a loop and a vertex without arcs
+  addArc( 1, 2, 0.5 );
+  addArc( 7, 7, 1 );
+  mGraph->addVertex( QgsPoint( -5, -5 ) );
+}
+
+void TestQgsContractionHierarchy::cleanupTestCase()
+{
+  delete mGraph;
+}
+
+void TestQgsContractionHierarchy::testShortestPath()
+{
+  QgsContractionHierarchy hierarchy( mGraph, 0 );
+  QCOMPARE( hierarchy.vertexCount(), mGraph->vertexCount() );
+
+  for ( int start = 1; start < mGraph->vertexCount(); start += 71 )
+  {
+    QVector<double> expectedCost;
+    QgsGraphAnalyzer::dijkstra( mGraph, start, 0, 0, &expectedCost );
+
+    for ( int end = 0; end < mGraph->vertexCount(); end += 17 )
+    {
+      QVector<int> arcs;
+      double cost = hierarchy.shortestPath( start, end, &arcs );
+      QVERIFY( qAbs( cost - expectedCost[end] ) < 1e-9 || cost == expectedCost[end] );
+      QCOMPARE( hierarchy.distance( start, end ), cost );
+
+      // the shortcuts are unpacked to a path of the source graph
+      int vertex = start;
+      double pathCost = 0;
+      foreach ( int arc, arcs )
+      {
+        QCOMPARE( mGraph->arc( arc ).outVertex(), vertex );
+        vertex = mGraph->arc( arc ).inVertex();
+        pathCost += mGraph->arc( arc ).property( 0 ).toDouble();
+      }
+      if ( !std::isinf( cost ) )
+      {
+        QCOMPARE( vertex, end );
+        QVERIFY( qAbs( pathCost - cost ) < 1e-9 );
+      }
+      else
+      {
+        QVERIFY( arcs.isEmpty() );
+      }
+    }
+  }
+
+  int isolated = mGraph->vertexCount() - 1;
+  QVERIFY( std::isinf( hierarchy.distance( 0, isolated ) ) );
+  QCOMPARE( hierarchy.distance( isolated, isolated ), 0.0 );
+}
+
+void TestQgsContractionHierarchy::testPointsOnArcs()
+{
+  QgsContractionHierarchy hierarchy( mGraph, 0 );
+
+  // the best combination of the start and end vertices with their costs
+  QVector<int> startVertices;
+  QVector<double> startCosts;
+  startVertices << 40 << 41 << 300;
+  startCosts << 25 << 3 << 0;
+  QVector<int> endVertices;
+  QVector<double> endCosts;
+  endVertices << 850 << 880;
+  endCosts << 7 << 1;
+
+  double expected = std::numeric_limits<double>::infinity();
+  int expectedStart = -1;
+  for ( int i = 0; i < startVertices.size(); ++i )
+  {
+    QVector<double> cost;
+    QgsGraphAnalyzer::dijkstra( mGraph, startVertices[i], 0, 0, &cost );
+    for ( int j = 0; j < endVertices.size(); ++j )
+    {
+      if ( startCosts[i] + cost[endVertices[j]] + endCosts[j] < expected )
+      {
+        expected = startCosts[i] + cost[endVertices[j]] + endCosts[j];
+        expectedStart = i;
+      }
+    }
+  }
+
+  QVector<int> arcs;
+  int start = -1;
+  double cost = hierarchy.shortestPath( startVertices, startCosts, endVertices, endCosts, &arcs, &start );
+  QVERIFY( qAbs( cost - expected ) < 1e-9 );
+  QCOMPARE( start, expectedStart );
+  QVERIFY( !arcs.isEmpty() );
+  QCOMPARE( mGraph->arc( arcs.first() ).outVertex(), startVertices[start] );
+  QVERIFY( endVertices.contains( mGraph->arc( arcs.last() ).inVertex() ) );
+}
+
+void TestQgsContractionHierarchy::testWriteToFile()
+{
+  QgsContractionHierarchy hierarchy( mGraph, 0 );
+  QVERIFY( hierarchy.shortcutCount() > 0 );
+
+  QString fileName = QDir::tempPath() + QDir::separator() + "qgis_hierarchy_test.bin";
+  QVERIFY( hierarchy.writeToFile( fileName ) );
+
+  QgsContractionHierarchy loaded;
+  QCOMPARE( loaded.vertexCount(), 0 );
+  QVERIFY( loaded.readFromFile( fileName ) );
+  QCOMPARE( loaded.vertexCount(), hierarchy.vertexCount() );
+  QCOMPARE( loaded.shortcutCount(), hierarchy.shortcutCount() );
+  for ( int start = 0; start < mGraph->vertexCount(); start += 97 )
+  {
+    for ( int end = 5; end < mGraph->vertexCount(); end += 89 )
+    {
+      QVector<int> arcs;
+      QVector<int> loadedArcs;
+      QCOMPARE( loaded.shortestPath( start, end, &loadedArcs ), hierarchy.shortestPath( start, end, &arcs ) );
+      QCOMPARE( loadedArcs, arcs );
+    }
+  }
+
+  // a graph file is not a hierarchy
+  QVERIFY( mGraph->writeToFile( fileName ) );
+  QVERIFY( !loaded.readFromFile( fileName ) );
+  QCOMPARE( loaded.vertexCount(), hierarchy.vertexCount() );
+  QFile::remove( fileName );
+}
+
+QTEST_MAIN( TestQgsContractionHierarchy )
+#include "moc_testqgscontractionhierarchy.cxx"
@@ -0,0 +1,195 @@
+/***************************************************************************
+     testqgsidwinterpolator.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+
+#include "qgsapplication.h"
+#include "qgsgeometry.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "qgsgridfilewriter.h"
+#include "qgsidwinterpolator.h"
+
+#include "gdal.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the IDW interpolator and the grid file writer
+ */
+class TestQgsIDWInterpolator: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void testNeighbours();
+    void testSearchRadius();
+    void testGridFileWriter();
+
+  private:
+    QList<QgsInterpolator::LayerData> layerData() const;
+    QVector<float> readRaster( const QString& fileName, int& columns, int& rows );
+
+    QgsVectorLayer* mPointLayer;
+    QString mTempPath;
+};
+
+void TestQgsIDWInterpolator::initTestCase()
+{
+  // we need the memory provider
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mTempPath = QDir::tempPath() + QDir::separator();
+
+  mPointLayer = new QgsVectorLayer( "Point?crs=epsg:3857&field=value:double", "points", "memory" );
+  // 400 points on different positions
+  QgsFeatureList features;
+  for ( int i = 0; i < 400; ++i )
+  {
+    QgsFeature f;
+    f.initAttributes( 1 );
+    f.setAttribute( 0, ( i * 7 ) % 13 );
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint(( i * 37 ) % 100 + 0.25, ( i * 53 ) % 80 + 0.75 ) ) );
+    features << f;
+  }
+  mPointLayer->dataProvider()->addFeatures( features );
+  mPointLayer->updateExtents();
+}
+
+void TestQgsIDWInterpolator::cleanupTestCase()
+{
+  delete mPointLayer;
+}
+
+QList<QgsInterpolator::LayerData> TestQgsIDWInterpolator::layerData() const
+{
+  QgsInterpolator::LayerData ld;
+  ld.vectorLayer = mPointLayer;
+  ld.zCoordInterpolation = false;
+  ld.interpolationAttribute = 0;
+  ld.mInputType = QgsInterpolator::POINTS;
+  return QList<QgsInterpolator::LayerData>() << ld;
+}
+
+QVector<float> TestQgsIDWInterpolator::readRaster( const QString& fileName, int& columns, int& rows )
+{
+  QVector<float> values;
+  GDALDatasetH dataset = GDALOpen( fileName.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+    return values;
+
+  columns = GDALGetRasterXSize( dataset );
+  rows = GDALGetRasterYSize( dataset );
+  values.resize( columns * rows );
+  GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, columns, rows, values.data(), columns, rows, GDT_Float32, 0, 0 );
+  GDALClose( dataset );
+  return values;
+}
+
+void TestQgsIDWInterpolator::testNeighbours()
+{
+  QgsIDWInterpolator allPoints( layerData() );
+  QgsIDWInterpolator indexedPoints( layerData() );
+  indexedPoints.setMaxNeighbours( 100000 );
+  QgsIDWInterpolator nearestPoint( layerData() );
+  nearestPoint.setMaxNeighbours( 1 );
+
+  for ( int i = 0; i < 50; ++i )
+  {
+    double x = -10 + i * 2.5;
+    double y = ( i * 17 ) % 90;
+    double all, indexed, nearest;
+    QCOMPARE( allPoints.interpolatePoint( x, y, all ), 0 );
+    QCOMPARE( indexedPoints.interpolatePoint( x, y, indexed ), 0 );
+    QVERIFY( qAbs( all - indexed ) < 1e-9 );
+
+    // a single neighbour gives the value of one of the base points
+    QCOMPARE( nearestPoint.interpolatePoint( x, y, nearest ), 0 );
+    QCOMPARE( nearest, qRound( nearest ) * 1.0 );
+  }
+
+  // the value at a base point is the value of the point
+  double value;
+  QCOMPARE( nearestPoint.interpolatePoint( 37.25, 53.75, value ), 0 );
+  QCOMPARE( value, 7.0 );
+}
+
+void TestQgsIDWInterpolator::testSearchRadius()
+{
+  QgsIDWInterpolator interpolator( layerData() );
+  interpolator.setSearchRadius( 2.0 );
+
+  // next to the base point 37.25, 53.75
+  double value;
+  QCOMPARE( interpolator.interpolatePoint( 38.25, 53.75, value ), 0 );
+  QVERIFY( value >= 0 && value <= 12 );
+
+  // no point within the radius
+  QCOMPARE( interpolator.interpolatePoint( 200, 40, value ), 1 );
+
+  interpolator.setMaxNeighbours( 3 );
+  QCOMPARE( interpolator.interpolatePoint( 38.25, 53.75, value ), 0 );
+  QCOMPARE( interpolator.interpolatePoint( -50, -50, value ), 1 );
+}
+
+void TestQgsIDWInterpolator::testGridFileWriter()
+{
+  QgsIDWInterpolator interpolator( layerData() );
+  interpolator.setMaxNeighbours( 12 );
+  interpolator.setSearchRadius( 20 );
+
+  QgsRectangle extent( -20, -20, 120, 100 );
+  QString asciiFile = mTempPath + "idw.asc";
+  QgsGridFileWriter asciiWriter( &interpolator, asciiFile, extent, 140, 120, 1, 1 );
+  asciiWriter.setMaxThreads( 1 );
+  QCOMPARE( asciiWriter.writeFile(), 0 );
+
+  QString tiffFile = mTempPath + "idw.tif";
+  QgsGridFileWriter tiffWriter( &interpolator, tiffFile, extent, 140, 120, 1, 1 );
+  tiffWriter.setOutputFormat( "GTiff" );
+  tiffWriter.setMaxThreads( 4 );
+  QCOMPARE( tiffWriter.writeFile(), 0 );
+
+  int columns1 = 0, rows1 = 0, columns2 = 0, rows2 = 0;
+  QVector<float> values1 = readRaster( asciiFile, columns1, rows1 );
+  QVector<float> values2 = readRaster( tiffFile, columns2, rows2 );
+  QCOMPARE( columns1, 140 );
+  QCOMPARE( rows1, 120 );
+  QCOMPARE( columns2, 140 );
+  QCOMPARE( rows2, 120 );
+
+  int noData = 0;
+  for ( int i = 0; i < values1.size(); ++i )
+  {
+    QVERIFY( qAbs( values1[i] - values2[i] ) <= 1e-4 * qMax( 1.0f, qAbs( values1[i] ) ) );
+    if ( values1[i] == -9999 )
+    {
+      ++noData;
+    }
+  }
+  // the corners are out of the search radius
+  QVERIFY( noData > 0 );
+  QCOMPARE( values2[0], -9999.0f );
+
+  QFile::remove( tiffFile );
+  QFile::remove( asciiFile );
+  QFile::remove( mTempPath + "idw.prj" );
+}
+
+QTEST_MAIN( TestQgsIDWInterpolator )
+#include "moc_testqgsidwinterpolator.cxx"
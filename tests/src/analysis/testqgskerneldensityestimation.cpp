@@ -0,0 +1,170 @@
+/***************************************************************************
+     testqgskerneldensityestimation.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+
+#include "qgsapplication.h"
+#include "qgsgeometry.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "qgskerneldensityestimation.h"
+
+#include "gdal.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the kernel density estimation class
+ */
+class TestQgsKernelDensityEstimation: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase() {};
+    void init() {};
+    void cleanup() {};
+
+    void testSinglePoint();
+    void testBandsAndThreads();
+
+  private:
+    QgsVectorLayer* createLayer( const QList<QgsPoint>& points );
+    QVector<float> readRaster( const QString& fileName, int& columns, int& rows );
+
+    QString mTempPath;
+};
+
+void TestQgsKernelDensityEstimation::initTestCase()
+{
+  // we need the memory provider
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mTempPath = QDir::tempPath() + QDir::separator();
+}
+
+QgsVectorLayer* TestQgsKernelDensityEstimation::createLayer( const QList<QgsPoint>& points )
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( "Point?field=radius:double&field=weight:double", "points", "memory" );
+
+  QgsFeatureList features;
+  for ( int i = 0; i < points.size(); ++i )
+  {
+    QgsFeature f;
+    f.initAttributes( 2 );
+    f.setAttribute( 0, 2 + i % 5 );
+    f.setAttribute( 1, 1 + i % 3 );
+    f.setGeometry( QgsGeometry::fromPoint( points.at( i ) ) );
+    features << f;
+  }
+  layer->dataProvider()->addFeatures( features );
+  layer->updateExtents();
+  return layer;
+}
+
+QVector<float> TestQgsKernelDensityEstimation::readRaster( const QString& fileName, int& columns, int& rows )
+{
+  QVector<float> values;
+  GDALDatasetH dataset = GDALOpen( fileName.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+    return values;
+
+  columns = GDALGetRasterXSize( dataset );
+  rows = GDALGetRasterYSize( dataset );
+  values.resize( columns * rows );
+  GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, columns, rows, values.data(), columns, rows, GDT_Float32, 0, 0 );
+  GDALClose( dataset );
+  return values;
+}
+
+void TestQgsKernelDensityEstimation::testSinglePoint()
+{
+  QList<QgsPoint> points;
+  points << QgsPoint( 10.5, 10.5 ) << QgsPoint( 0.5, 0.5 );
+  QgsVectorLayer* layer = createLayer( points );
+
+  QString fileName = mTempPath + "kde_single.tif";
+  QgsKernelDensityEstimation kde( layer, fileName, "GTiff" );
+  kde.setExtent( QgsRectangle( 0, 0, 20, 20 ) );
+  kde.setCellSize( 1 );
+  kde.setRasterSize( 21, 21 );
+  kde.setRadius( 5 );
+  QCOMPARE( kde.run( NULL ), QgsKernelDensityEstimation::Success );
+
+  int columns = 0, rows = 0;
+  QVector<float> values = readRaster( fileName, columns, rows );
+  QCOMPARE( columns, 21 );
+  QCOMPARE( rows, 21 );
+
+  double center = QgsKernelDensityEstimation::kernelValue( QgsKernelDensityEstimation::Quartic, 0, 5, 0 );
+  double near = QgsKernelDensityEstimation::kernelValue( QgsKernelDensityEstimation::Quartic, 3, 5, 0 );
+  QVERIFY( qAbs( values[10 * columns + 10] - center ) < 1e-6 );
+  QVERIFY( qAbs( values[13 * columns + 10] - near ) < 1e-6 );
+  QVERIFY( qAbs( values[10 * columns + 7] - near ) < 1e-6 );
+  // on the radius the kernel is zero, outside of it there is no data
+  QCOMPARE( values[15 * columns + 10], 0.0f );
+  QCOMPARE( values[15 * columns + 11], -9999.0f );
+
+  // points near the border are clipped, not dropped
+  QVERIFY( qAbs( values[0] - center ) < 1e-6 );
+
+  delete layer;
+}
+
+void TestQgsKernelDensityEstimation::testBandsAndThreads()
+{
+  QList<QgsPoint> points;
+  for ( int i = 0; i < 5000; ++i )
+  {
+    points << QgsPoint(( i * 37 ) % 100 + 0.25, ( i * 53 ) % 80 + 0.75 );
+  }
+  QgsVectorLayer* layer = createLayer( points );
+
+  QString fileName1 = mTempPath + "kde_single_band.tif";
+  QgsKernelDensityEstimation kde1( layer, fileName1, "GTiff" );
+  kde1.setCellSize( 0.5 );
+  kde1.setRadiusField( 0 );
+  kde1.setWeightField( 1 );
+  kde1.setKernelShape( QgsKernelDensityEstimation::Epanechnikov );
+  kde1.setMaxThreads( 1 );
+  QCOMPARE( kde1.run( NULL ), QgsKernelDensityEstimation::Success );
+
+  // a few rows per band and several partial grids
+  QString fileName2 = mTempPath + "kde_multi_band.tif";
+  QgsKernelDensityEstimation kde2( layer, fileName2, "GTiff" );
+  kde2.setCellSize( 0.5 );
+  kde2.setRadiusField( 0 );
+  kde2.setWeightField( 1 );
+  kde2.setKernelShape( QgsKernelDensityEstimation::Epanechnikov );
+  kde2.setMaxThreads( 4 );
+  kde2.setMaximumMemory( 4 * 200 * 4 * 7 );
+  QCOMPARE( kde2.run( NULL ), QgsKernelDensityEstimation::Success );
+
+  int columns1 = 0, rows1 = 0, columns2 = 0, rows2 = 0;
+  QVector<float> values1 = readRaster( fileName1, columns1, rows1 );
+  QVector<float> values2 = readRaster( fileName2, columns2, rows2 );
+  QCOMPARE( columns1, columns2 );
+  QCOMPARE( rows1, rows2 );
+  QCOMPARE( values1.size(), values2.size() );
+
+  for ( int i = 0; i < values1.size(); ++i )
+  {
+    QVERIFY( qAbs( values1[i] - values2[i] ) <= 1e-4 * qMax( 1.0f, qAbs( values1[i] ) ) );
+  }
+
+  delete layer;
+}
+
+QTEST_MAIN( TestQgsKernelDensityEstimation )
+#include "moc_testqgskerneldensityestimation.cxx"
@@ -0,0 +1,191 @@
+/***************************************************************************
+     testqgslinevectorlayerdirector.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+
+#include "qgsapplication.h"
+#include "qgsgeometry.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "qgsdistancearcproperter.h"
+#include "qgsgraph.h"
+#include "qgsgraphanalyzer.h"
+#include "qgsgraphbuilder.h"
+#include "qgslinevectorlayerdirector.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for building graphs from line layers
+ */
+class TestQgsLineVectorLayerDirector: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void testSnapping();
+    void testTiedPoints();
+    void testWriteToFile();
+
+  private:
+    QgsGraph* makeGraph( double tolerance, const QVector<QgsPoint>& additionalPoints, QVector<QgsPoint>& tiedPoints );
+    void addLine( QgsFeatureList& features, const QString& direction, const QgsMultiPolyline& lines );
+
+    QgsVectorLayer* mLineLayer;
+};
+
+void TestQgsLineVectorLayerDirector::addLine( QgsFeatureList& features, const QString& direction, const QgsMultiPolyline& lines )
+{
+  QgsFeature f;
+  f.initAttributes( 1 );
+  f.setAttribute( 0, direction );
+  if ( lines.size() == 1 )
+    f.setGeometry( QgsGeometry::fromPolyline( lines.first() ) );
+  else
+    f.setGeometry( QgsGeometry::fromMultiPolyline( lines ) );
+  features << f;
+}
+
+void TestQgsLineVectorLayerDirector::initTestCase()
+{
+  // we need the memory provider
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  // a square of roads, the start of the one way road on the right is a bit off its corner
+  mLineLayer = new QgsVectorLayer( "MultiLineString?crs=epsg:3857&field=direction:string", "roads", "memory" );
+  QgsFeatureList features;
+  QgsPolyline bottom;
+  bottom << QgsPoint( 0, 0 ) << QgsPoint( 10, 0 ) << QgsPoint( 20, 0 );
+  addLine( features, "both", QgsMultiPolyline() << bottom );
+  QgsPolyline right;
+  right << QgsPoint( 20, 0.0004 ) << QgsPoint( 20, 10 );
+  addLine( features, "forward", QgsMultiPolyline() << right );
+  QgsPolyline left;
+  left << QgsPoint( 0, 0 ) << QgsPoint( 0, 10 );
+  addLine( features, "backward", QgsMultiPolyline() << left );
+  QgsPolyline top1, top2;
+  top1 << QgsPoint( 20, 10 ) << QgsPoint( 10, 10 );
+  top2 << QgsPoint( 10, 10 ) << QgsPoint( 0, 10 );
+  addLine( features, QString(), QgsMultiPolyline() << top1 << top2 );
+  mLineLayer->dataProvider()->addFeatures( features );
+  mLineLayer->updateExtents();
+}
+
+void TestQgsLineVectorLayerDirector::cleanupTestCase()
+{
+  delete mLineLayer;
+}
+
+QgsGraph* TestQgsLineVectorLayerDirector::makeGraph( double tolerance, const QVector<QgsPoint>& additionalPoints, QVector<QgsPoint>& tiedPoints )
+{
+  QgsLineVectorLayerDirector director( mLineLayer, 0, "forward", "backward", "both", 3 );
+  QgsDistanceArcProperter properter;
+  director.addProperter( &properter );
+  QgsGraphBuilder builder( mLineLayer->crs(), false, tolerance );
+  director.makeGraph( &builder, additionalPoints, tiedPoints );
+  return builder.graph();
+}
+
+void TestQgsLineVectorLayerDirector::testSnapping()
+{
+  QVector<QgsPoint> tiedPoints;
+  QgsGraph* graph = makeGraph( 0.001, QVector<QgsPoint>(), tiedPoints );
+  QVERIFY( tiedPoints.isEmpty() );
+  QCOMPARE( graph->vertexCount(), 6 );
+  QCOMPARE( graph->arcCount(), 10 );
+  QVERIFY( graph->findVertex( QgsPoint( 20, 0.0004 ) ) == -1 );
+  delete graph;
+
+  // without tolerance only equal points are merged
+  graph = makeGraph( 0.0, QVector<QgsPoint>(), tiedPoints );
+  QCOMPARE( graph->vertexCount(), 7 );
+  QCOMPARE( graph->arcCount(), 10 );
+  QVERIFY( graph->findVertex( QgsPoint( 20, 0.0004 ) ) != -1 );
+  delete graph;
+}
+
+void TestQgsLineVectorLayerDirector::testTiedPoints()
+{
+  QVector<QgsPoint> additionalPoints;
+  additionalPoints << QgsPoint( 5, 1 ) << QgsPoint( 25, 5 ) << QgsPoint( 9.9995, 10.5 );
+  QVector<QgsPoint> tiedPoints;
+  QgsGraph* graph = makeGraph( 0.001, additionalPoints, tiedPoints );
+
+  // the last point is snapped to the vertex of the multi line
+  QCOMPARE( tiedPoints.size(), 3 );
+  QCOMPARE( tiedPoints[0], QgsPoint( 5, 0 ) );
+  QVERIFY( tiedPoints[1].sqrDist( 20, 5 ) < 1e-12 );
+  QCOMPARE( tiedPoints[2], QgsPoint( 10, 10 ) );
+  QCOMPARE( graph->vertexCount(), 8 );
+  QCOMPARE( graph->arcCount(), 13 );
+
+  // the one way roads are used in their direction
+  int start = graph->findVertex( tiedPoints[0] );
+  int end = graph->findVertex( QgsPoint( 20, 10 ) );
+  QVERIFY( start != -1 && end != -1 );
+  QVector<double> cost;
+  QgsGraphAnalyzer::dijkstra( graph, start, 0, 0, &cost );
+  QVERIFY( qAbs( cost[end] - 25 ) < 1e-9 );
+  QgsGraphAnalyzer::dijkstra( graph, end, 0, 0, &cost );
+  QVERIFY( qAbs( cost[start] - 35 ) < 1e-9 );
+  delete graph;
+}
+
+void TestQgsLineVectorLayerDirector::testWriteToFile()
+{
+  QVector<QgsPoint> additionalPoints;
+  additionalPoints << QgsPoint( 5, 1 );
+  QVector<QgsPoint> tiedPoints;
+  QgsGraph* graph = makeGraph( 0.001, additionalPoints, tiedPoints );
+
+  QString fileName = QDir::tempPath() + QDir::separator() + "qgis_graph_test.bin";
+  QVERIFY( graph->writeToFile( fileName ) );
+
+  QgsGraph loaded;
+  QVERIFY( loaded.readFromFile( fileName ) );
+  QCOMPARE( loaded.vertexCount(), graph->vertexCount() );
+  QCOMPARE( loaded.arcCount(), graph->arcCount() );
+  for ( int i = 0; i < graph->vertexCount(); ++i )
+  {
+    QCOMPARE( loaded.vertex( i ).point(), graph->vertex( i ).point() );
+    QCOMPARE( loaded.vertex( i ).outArc(), graph->vertex( i ).outArc() );
+    QCOMPARE( loaded.vertex( i ).inArc(), graph->vertex( i ).inArc() );
+  }
+  for ( int i = 0; i < graph->arcCount(); ++i )
+  {
+    QCOMPARE( loaded.arc( i ).outVertex(), graph->arc( i ).outVertex() );
+    QCOMPARE( loaded.arc( i ).inVertex(), graph->arc( i ).inVertex() );
+    QCOMPARE( loaded.arc( i ).properties(), graph->arc( i ).properties() );
+  }
+  QFile::remove( fileName );
+
+  // other files are rejected and leave the graph unchanged
+  QVERIFY( !loaded.readFromFile( fileName ) );
+  QFile file( fileName );
+  QVERIFY( file.open( QIODevice::WriteOnly ) );
+  file.write( "not a graph" );
+  file.close();
+  QVERIFY( !loaded.readFromFile( fileName ) );
+  QCOMPARE( loaded.vertexCount(), graph->vertexCount() );
+  QFile::remove( fileName );
+
+  delete graph;
+}
+
+QTEST_MAIN( TestQgsLineVectorLayerDirector )
+#include "moc_testqgslinevectorlayerdirector.cxx"
@@ -0,0 +1,199 @@
+/***************************************************************************
+     testqgsroutinggraph.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include <cmath>
+
+#include "qgsgraph.h"
+#include "qgsgraphanalyzer.h"
+#include "qgsroutinggraph.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the routing graph
+ */
+class TestQgsRoutingGraph: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void testDijkstra();
+    void testShortestPath();
+    void testCostMatrix();
+
+  private:
+    void addArc( int from, int to, double factor );
+
+    QgsGraph* mGraph;
+};
+
+//! number of vertices in each row and column of the grid
+static const int GRID_SIZE = 30;
+
+void TestQgsRoutingGraph::addArc( int from, int to, double factor )
+{
+  QgsPoint p1 = mGraph->vertex( from ).point();
+  QgsPoint p2 = mGraph->vertex( to ).point();
+  QVector<QVariant> properties;
+  properties << sqrt( p1.sqrDist( p2 ) ) * factor;
+  mGraph->addArc( from, to, properties );
+}
+
+void TestQgsRoutingGraph::initTestCase()
+{
+  // a grid with arcs of different speed, some streets are one way
+  mGraph = new QgsGraph();
+  for ( int y = 0; y < GRID_SIZE; ++y )
+  {
+    for ( int x = 0; x < GRID_SIZE; ++x )
+    {
+      mGraph->addVertex( QgsPoint( x * 10, y * 10 ) );
+    }
+  }
+  for ( int y = 0; y < GRID_SIZE; ++y )
+  {
+    for ( int x = 0; x < GRID_SIZE; ++x )
+    {
+      int vertex = y * GRID_SIZE + x;
+      if ( x + 1 < GRID_SIZE )
+      {
+        addArc( vertex, vertex + 1, 1 + ( vertex * 7 ) % 5 );
+        if ( vertex % 4 != 0 )
+          addArc( vertex + 1, vertex, 1 + ( vertex * 3 ) % 4 );
+      }
+      if ( y + 1 < GRID_SIZE )
+      {
+        addArc( vertex, vertex + GRID_SIZE, 1 + ( vertex * 11 ) % 3 );
+        if ( vertex % 5 != 0 )
+          addArc( vertex + GRID_SIZE, vertex, 1 + ( vertex * 13 ) % 6 );
+      }
+    }
+  }
+  // a vertex without arcs
+  mGraph->addVertex( QgsPoint( -5, -5 ) );
+}
+
+void TestQgsRoutingGraph::cleanupTestCase()
+{
+  delete mGraph;
+}
+
+void TestQgsRoutingGraph::testDijkstra()
+{
+  QgsRoutingGraph graph( mGraph, 0 );
+  QCOMPARE( graph.vertexCount(), mGraph->vertexCount() );
+  QCOMPARE( graph.arcCount(), mGraph->arcCount() );
+  QCOMPARE( graph.vertexPoint( GRID_SIZE + 2 ), QgsPoint( 20, 10 ) );
+
+  for ( int start = 0; start < GRID_SIZE * GRID_SIZE; start += 97 )
+  {
+    QVector<int> expectedTree;
+    QVector<double> expectedCost;
+    QgsGraphAnalyzer::dijkstra( mGraph, start, 0, &expectedTree, &expectedCost );
+
+    QVector<int> tree;
+    QVector<double> cost;
+    graph.dijkstra( start, cost, &tree );
+    QCOMPARE( cost.size(), expectedCost.size() );
+    for ( int i = 0; i < cost.size(); ++i )
+    {
+      QVERIFY( qAbs( cost[i] - expectedCost[i] ) < 1e-9 || cost[i] == expectedCost[i] );
+      QCOMPARE( tree[i] == -1, expectedTree[i] == -1 );
+    }
+    QVERIFY( std::isinf( cost.last() ) );
+  }
+}
+
+void TestQgsRoutingGraph::testShortestPath()
+{
+  QgsRoutingGraph graph( mGraph, 0 );
+  QList<QgsRoutingGraph::Algorithm> algorithms;
+  algorithms << QgsRoutingGraph::Dijkstra << QgsRoutingGraph::Bidirectional << QgsRoutingGraph::AStar;
+
+  for ( int start = 3; start < GRID_SIZE * GRID_SIZE; start += 89 )
+  {
+    QVector<double> expectedCost;
+    QgsGraphAnalyzer::dijkstra( mGraph, start, 0, 0, &expectedCost );
+
+    for ( int end = 0; end < mGraph->vertexCount(); end += 41 )
+    {
+      foreach ( QgsRoutingGraph::Algorithm algorithm, algorithms )
+      {
+        QVector<int> arcs;
+        double cost = graph.shortestPath( start, end, algorithm, &arcs );
+        QVERIFY( qAbs( cost - expectedCost[end] ) < 1e-9 || cost == expectedCost[end] );
+
+        // the arcs are a path from the start to the end with the cost
+        int vertex = start;
+        double pathCost = 0;
+        foreach ( int arc, arcs )
+        {
+          QCOMPARE( mGraph->arc( arc ).outVertex(), vertex );
+          vertex = mGraph->arc( arc ).inVertex();
+          pathCost += mGraph->arc( arc ).property( 0 ).toDouble();
+        }
+        if ( !std::isinf( cost ) )
+        {
+          QCOMPARE( vertex, end );
+          QVERIFY( qAbs( pathCost - cost ) < 1e-9 );
+        }
+        else
+        {
+          QVERIFY( arcs.isEmpty() );
+        }
+      }
+    }
+  }
+
+  // the vertex without arcs can't be reached
+  int isolated = mGraph->vertexCount() - 1;
+  QVERIFY( std::isinf( graph.shortestPath( 0, isolated ) ) );
+  QCOMPARE( graph.shortestPath( isolated, isolated ), 0.0 );
+}
+
+void TestQgsRoutingGraph::testCostMatrix()
+{
+  QgsRoutingGraph graph( mGraph, 0 );
+  QVector<int> startVertices;
+  QVector<int> endVertices;
+  for ( int i = 0; i < GRID_SIZE * GRID_SIZE; i += 53 )
+    startVertices << i;
+  for ( int i = 7; i < mGraph->vertexCount(); i += 61 )
+    endVertices << i;
+  endVertices << mGraph->vertexCount() - 1 << endVertices.first();
+
+  graph.setMaxThreads( 1 );
+  QVector<double> matrix = graph.costMatrix( startVertices, endVertices );
+  graph.setMaxThreads( 4 );
+  QVector<double> parallelMatrix = graph.costMatrix( startVertices, endVertices );
+  QCOMPARE( matrix.size(), startVertices.size() * endVertices.size() );
+  QCOMPARE( parallelMatrix, matrix );
+
+  for ( int i = 0; i < startVertices.size(); ++i )
+  {
+    QVector<double> cost;
+    graph.dijkstra( startVertices[i], cost );
+    for ( int j = 0; j < endVertices.size(); ++j )
+    {
+      QCOMPARE( matrix[i * endVertices.size() + j], cost[endVertices[j]] );
+    }
+  }
+}
+
+QTEST_MAIN( TestQgsRoutingGraph )
+#include "moc_testqgsroutinggraph.cxx"
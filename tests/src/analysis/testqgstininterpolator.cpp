@@ -0,0 +1,147 @@
+/***************************************************************************
+     testqgstininterpolator.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include "qgsapplication.h"
+#include "qgsgeometry.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+#include "qgstininterpolator.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the TIN interpolator
+ */
+class TestQgsTINInterpolator: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void testPlane();
+    void testMultiPoints();
+
+  private:
+    QList<QgsInterpolator::LayerData> layerData( QgsVectorLayer* layer ) const;
+
+    QgsVectorLayer* mPointLayer;
+};
+
+//! the base points are on the plane z = 2x + 3y + 1
+static double planeValue( double x, double y )
+{
+  return 2 * x + 3 * y + 1;
+}
+
+void TestQgsTINInterpolator::initTestCase()
+{
+  // we need the memory provider
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  // a grid of points with the corners first and the others in a scattered order
+  mPointLayer = new QgsVectorLayer( "Point?field=value:double", "points", "memory" );
+  QgsFeatureList features;
+  QList<QgsPoint> points;
+  points << QgsPoint( 0, 0 ) << QgsPoint( 100, 0 ) << QgsPoint( 100, 100 ) << QgsPoint( 0, 100 );
+  for ( int i = 0; i < 2000; ++i )
+  {
+    points << QgsPoint(( i * 37 ) % 97 + 1.5, ( i * 53 ) % 89 + 2.25 );
+  }
+  foreach ( QgsPoint point, points )
+  {
+    QgsFeature f;
+    f.initAttributes( 1 );
+    f.setAttribute( 0, planeValue( point.x(), point.y() ) );
+    f.setGeometry( QgsGeometry::fromPoint( point ) );
+    features << f;
+  }
+  mPointLayer->dataProvider()->addFeatures( features );
+  mPointLayer->updateExtents();
+}
+
+void TestQgsTINInterpolator::cleanupTestCase()
+{
+  delete mPointLayer;
+}
+
+QList<QgsInterpolator::LayerData> TestQgsTINInterpolator::layerData( QgsVectorLayer* layer ) const
+{
+  QgsInterpolator::LayerData ld;
+  ld.vectorLayer = layer;
+  ld.zCoordInterpolation = false;
+  ld.interpolationAttribute = 0;
+  ld.mInputType = QgsInterpolator::POINTS;
+  return QList<QgsInterpolator::LayerData>() << ld;
+}
+
+void TestQgsTINInterpolator::testPlane()
+{
+  QgsTINInterpolator interpolator( layerData( mPointLayer ) );
+
+  // the cells of a raster, row by row, reproduce the plane
+  for ( int row = 0; row < 60; ++row )
+  {
+    double y = 99.5 - row * 1.65;
+    for ( int column = 0; column < 60; ++column )
+    {
+      double x = 0.5 + column * 1.65;
+      double value;
+      QCOMPARE( interpolator.interpolatePoint( x, y, value ), 0 );
+      QVERIFY( qAbs( value - planeValue( x, y ) ) < 1e-6 );
+    }
+  }
+
+  // points in any order
+  double value;
+  QCOMPARE( interpolator.interpolatePoint( 10.3, 88.1, value ), 0 );
+  QVERIFY( qAbs( value - planeValue( 10.3, 88.1 ) ) < 1e-6 );
+  QCOMPARE( interpolator.interpolatePoint( 90.7, 3.9, value ), 0 );
+  QVERIFY( qAbs( value - planeValue( 90.7, 3.9 ) ) < 1e-6 );
+
+  // outside of the convex hull
+  QVERIFY( interpolator.interpolatePoint( 150, 50, value ) != 0 );
+  QCOMPARE( interpolator.interpolatePoint( 50.2, 50.1, value ), 0 );
+  QVERIFY( qAbs( value - planeValue( 50.2, 50.1 ) ) < 1e-6 );
+}
+
+void TestQgsTINInterpolator::testMultiPoints()
+{
+  // the vertices of multipoints are used as well
+  QgsVectorLayer layer( "MultiPoint?field=value:double", "multipoints", "memory" );
+  QgsFeatureList features;
+  for ( int i = 0; i < 4; ++i )
+  {
+    QgsMultiPoint multiPoint;
+    multiPoint << QgsPoint( i * 10, 0 ) << QgsPoint( i * 10, 10 ) << QgsPoint( i * 10 + 5, 5 );
+    QgsFeature f;
+    f.initAttributes( 1 );
+    f.setAttribute( 0, 7.5 );
+    f.setGeometry( QgsGeometry::fromMultiPoint( multiPoint ) );
+    features << f;
+  }
+  layer.dataProvider()->addFeatures( features );
+  layer.updateExtents();
+
+  QgsTINInterpolator interpolator( layerData( &layer ) );
+  double value;
+  QCOMPARE( interpolator.interpolatePoint( 12, 6, value ), 0 );
+  QCOMPARE( value, 7.5 );
+}
+
+QTEST_MAIN( TestQgsTINInterpolator )
+#include "moc_testqgstininterpolator.cxx"
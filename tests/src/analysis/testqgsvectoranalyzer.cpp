@@ -16,6 +16,7 @@ Email                : sherman at mrcc dot com
 
 //header for class being tested
 #include <qgsgeometryanalyzer.h>
+#include <qgsoverlayanalyzer.h>
 #include <qgsapplication.h>
 #include <qgsproviderregistry.h>
 
@@ -36,6 +37,10 @@ class TestQgsVectorAnalyzer: public QObject
     void simplifyGeometry( );
     void polygonCentroids( );
     void layerExtent( );
+    void dissolve( );
+    void bufferDissolve( );
+    void convexHull( );
+    void intersection( );
   private:
     QgsGeometryAnalyzer mAnalyzer;
     QgsVectorLayer * mpLineLayer;
@@ -129,5 +134,89 @@ void TestQgsVectorAnalyzer::layerExtent( )
   QVERIFY( mAnalyzer.extent( mpPointLayer, myFileName ) );
 }
 
+void TestQgsVectorAnalyzer::dissolve( )
+{
+  QString myTmpDir = QDir::tempPath() + QDir::separator() ;
+  QString myFileName = myTmpDir +  "dissolve_layer.shp";
+  QVERIFY( mAnalyzer.dissolve( mpPolyLayer, myFileName ) );
+
+  // same area as adding the polygons one by one to a growing geometry
+  QgsGeometry* expected = 0;
+  QgsFeature f;
+  QgsFeatureIterator fit = mpPolyLayer->getFeatures();
+  while ( fit.nextFeature( f ) )
+  {
+    if ( !expected )
+    {
+      expected = new QgsGeometry( *f.geometry() );
+      continue;
+    }
+    QgsGeometry* combined = expected->combine( f.geometry() );
+    delete expected;
+    expected = combined;
+  }
+  QVERIFY( expected );
+
+  QgsVectorLayer layer( myFileName, "dissolve", "ogr" );
+  QVERIFY( layer.isValid() );
+  QCOMPARE( layer.featureCount(), ( long ) 1 );
+  QVERIFY( layer.getFeatures().nextFeature( f ) );
+  QVERIFY( qAbs( f.geometry()->area() - expected->area() ) < 0.000001 * expected->area() );
+  delete expected;
+}
+
+void TestQgsVectorAnalyzer::bufferDissolve( )
+{
+  QString myTmpDir = QDir::tempPath() + QDir::separator() ;
+  QString myFileName = myTmpDir +  "buffer_layer.shp";
+  QVERIFY( mAnalyzer.buffer( mpPointLayer, myFileName, 1.0 ) );
+  QgsVectorLayer bufferLayer( myFileName, "buffer", "ogr" );
+  QVERIFY( bufferLayer.isValid() );
+  QCOMPARE( bufferLayer.featureCount(), mpPointLayer->featureCount() );
+
+  myFileName = myTmpDir +  "buffer_dissolve_layer.shp";
+  QVERIFY( mAnalyzer.buffer( mpPointLayer, myFileName, 1.0, false, true ) );
+  QgsVectorLayer dissolveLayer( myFileName, "buffer_dissolve", "ogr" );
+  QVERIFY( dissolveLayer.isValid() );
+  QCOMPARE( dissolveLayer.featureCount(), ( long ) 1 );
+}
+
+void TestQgsVectorAnalyzer::convexHull( )
+{
+  QString myTmpDir = QDir::tempPath() + QDir::separator() ;
+  QString myFileName = myTmpDir +  "convexhull_layer.shp";
+  QVERIFY( mAnalyzer.convexHull( mpPointLayer, myFileName ) );
+
+  QgsVectorLayer layer( myFileName, "hull", "ogr" );
+  QVERIFY( layer.isValid() );
+  QCOMPARE( layer.featureCount(), ( long ) 1 );
+
+  // the hull contains all points
+  QgsFeature hull;
+  QVERIFY( layer.getFeatures().nextFeature( hull ) );
+  QgsGeometry* buffered = hull.geometry()->buffer( 0.000001, 5 );
+  QgsFeature f;
+  QgsFeatureIterator fit = mpPointLayer->getFeatures();
+  while ( fit.nextFeature( f ) )
+  {
+    QVERIFY( buffered->contains( f.geometry() ) );
+  }
+  delete buffered;
+}
+
+void TestQgsVectorAnalyzer::intersection( )
+{
+  QString myTmpDir = QDir::tempPath() + QDir::separator() ;
+  QString myFileName = myTmpDir +  "intersection_layer.shp";
+  QgsOverlayAnalyzer analyzer;
+  QVERIFY( analyzer.intersection( mpPolyLayer, mpPolyLayer, myFileName ) );
+
+  // each polygon intersects at least itself
+  QgsVectorLayer layer( myFileName, "intersection", "ogr" );
+  QVERIFY( layer.isValid() );
+  QVERIFY( layer.featureCount() >= mpPolyLayer->featureCount() );
+  QCOMPARE( layer.pendingFields().count(), 2 * mpPolyLayer->pendingFields().count() );
+}
+
 QTEST_MAIN( TestQgsVectorAnalyzer )
 #include "moc_testqgsvectoranalyzer.cxx"
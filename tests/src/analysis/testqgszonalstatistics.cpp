@@ -33,6 +33,7 @@ class TestQgsZonalStatistics: public QObject
     void cleanup() {};
 
     void testStatistics();
+    void testAllStatistics();
 
   private:
     QgsVectorLayer* mVectorLayer;
@@ -116,5 +117,40 @@ void TestQgsZonalStatistics::testStatistics()
   QCOMPARE( f.attribute( "myqgis2_me" ).toDouble(), 0.833333333333333 );
 }
 
+void TestQgsZonalStatistics::testAllStatistics()
+{
+  // single threaded and parallel calculation give the same results
+  for ( int threads = 1; threads <= 2; ++threads )
+  {
+    QString prefix = QString( "a%1_" ).arg( threads );
+    QgsZonalStatistics zs( mVectorLayer, mRasterPath, prefix, 1 );
+    zs.setStatistics( QgsZonalStatistics::All );
+    zs.setMaxThreads( threads );
+    QCOMPARE( zs.calculateStatistics( NULL ), 0 );
+
+    QgsFeature f;
+    QgsFeatureRequest request;
+    request.setFilterFid( 0 );
+    QVERIFY( mVectorLayer->getFeatures( request ).nextFeature( f ) );
+    QCOMPARE( f.attribute( prefix + "count" ).toDouble(), 12.0 );
+    QCOMPARE( f.attribute( prefix + "min" ).toDouble(), 0.0 );
+    QCOMPARE( f.attribute( prefix + "max" ).toDouble(), 1.0 );
+    QCOMPARE( f.attribute( prefix + "majorit" ).toDouble(), 1.0 );
+    QVERIFY( qAbs( f.attribute( prefix + "stdev" ).toDouble() - 0.471404520791032 ) < 0.000001 );
+
+    request.setFilterFid( 1 );
+    QVERIFY( mVectorLayer->getFeatures( request ).nextFeature( f ) );
+    QCOMPARE( f.attribute( prefix + "sum" ).toDouble(), 5.0 );
+    QCOMPARE( f.attribute( prefix + "majorit" ).toDouble(), 1.0 );
+    QVERIFY( qAbs( f.attribute( prefix + "stdev" ).toDouble() - 0.496903994999953 ) < 0.000001 );
+
+    request.setFilterFid( 2 );
+    QVERIFY( mVectorLayer->getFeatures( request ).nextFeature( f ) );
+    QCOMPARE( f.attribute( prefix + "count" ).toDouble(), 6.0 );
+    QCOMPARE( f.attribute( prefix + "min" ).toDouble(), 0.0 );
+    QVERIFY( qAbs( f.attribute( prefix + "stdev" ).toDouble() - 0.372677996249965 ) < 0.000001 );
+  }
+}
+
 QTEST_MAIN( TestQgsZonalStatistics )
 #include "moc_testqgszonalstatistics.cxx"
@@ -59,6 +59,10 @@ class TestQgsAtlasComposition: public QObject
     void sorting_render();
     // test rendering with feature filtering
     void filtering_render();
+    // test rendering with maps rendered in advance
+    void prerender_render();
+    // test that prerendered maps look like maps rendered page by page
+    void prerender_serial();
     // test render signals
     void test_signals();
   private:
@@ -371,6 +375,100 @@ void TestQgsAtlasComposition::filtering_render()
   mAtlas->endRender();
 }
 
+void TestQgsAtlasComposition::prerender_render()
+{
+  mAtlasMap->setNewExtent( QgsRectangle( 209838.166, 6528781.020, 610491.166, 6920530.620 ) );
+  mAtlasMap->setAtlasDriven( true );
+  mAtlasMap->setAtlasFixedScale( true );
+  mAtlas->setHideCoverage( false );
+  mAtlas->setSortFeatures( false );
+  mAtlas->setFilterFeatures( false );
+
+  mAtlas->beginRender();
+  QVERIFY( mAtlasMap->reuseRenderedImages() );
+  QVERIFY( !mAtlasMap->layersUseAtlasVariables() );
+
+  // the pages must look the same as if the maps were rendered page by page
+  mAtlas->prerenderFeatures( 0, 1 );
+  for ( int fit = 0; fit < 2; ++fit )
+  {
+    mAtlas->prepareForFeature( fit );
+    mLabel1->adjustSizeToText();
+
+    QgsCompositionChecker checker( QString( "atlas_fixedscale%1" ).arg((( int )fit ) + 1 ), mComposition );
+    QVERIFY( checker.testComposition( mReport, 0, 200 ) );
+  }
+  mAtlas->endRender();
+  QVERIFY( !mAtlasMap->reuseRenderedImages() );
+
+  mAtlasMap->setAtlasDriven( false );
+  mAtlasMap->setAtlasFixedScale( false );
+}
+
+//! number of pixels which differ by more than a small tolerance
+static int differentPixels( const QImage& image1, const QImage& image2 )
+{
+  if ( image1.size() != image2.size() )
+  {
+    return image1.width() * image1.height();
+  }
+
+  int count = 0;
+  for ( int y = 0; y < image1.height(); ++y )
+  {
+    for ( int x = 0; x < image1.width(); ++x )
+    {
+      QRgb p1 = image1.pixel( x, y );
+      QRgb p2 = image2.pixel( x, y );
+      if ( qAbs( qRed( p1 ) - qRed( p2 ) ) > 8 || qAbs( qGreen( p1 ) - qGreen( p2 ) ) > 8
+           || qAbs( qBlue( p1 ) - qBlue( p2 ) ) > 8 || qAbs( qAlpha( p1 ) - qAlpha( p2 ) ) > 8 )
+      {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+void TestQgsAtlasComposition::prerender_serial()
+{
+  mAtlasMap->setNewExtent( QgsRectangle( 209838.166, 6528781.020, 610491.166, 6920530.620 ) );
+  mAtlasMap->setAtlasDriven( true );
+  mAtlasMap->setAtlasFixedScale( true );
+  mAtlas->setHideCoverage( false );
+  mAtlas->setSortFeatures( false );
+  mAtlas->setFilterFeatures( false );
+
+  mAtlas->beginRender();
+
+  // the maps rendered page by page
+  mAtlasMap->setReuseRenderedImages( false );
+  QList<QImage> serialPages;
+  for ( int fit = 0; fit < 2; ++fit )
+  {
+    mAtlas->prepareForFeature( fit );
+    mLabel1->adjustSizeToText();
+    serialPages << mComposition->printPageAsRaster( 0 );
+  }
+
+  // the same pages with the maps rendered in advance
+  mAtlasMap->setReuseRenderedImages( true );
+  mAtlas->prerenderFeatures( 0, 1 );
+  QCOMPARE( mAtlasMap->prerenderedImageCount(), 2 );
+  for ( int fit = 0; fit < 2; ++fit )
+  {
+    mAtlas->prepareForFeature( fit );
+    mLabel1->adjustSizeToText();
+    QImage page = mComposition->printPageAsRaster( 0 );
+    QCOMPARE( mAtlasMap->prerenderedImageCount(), 1 - fit );
+    QVERIFY( differentPixels( page, serialPages.at( fit ) ) < 200 );
+  }
+  mAtlas->endRender();
+
+  mAtlasMap->setAtlasDriven( false );
+  mAtlasMap->setAtlasFixedScale( false );
+}
+
 void TestQgsAtlasComposition::test_signals()
 {
   mAtlasMap->setNewExtent( QgsRectangle( 209838.166, 6528781.020, 610491.166, 6920530.620 ) );
@@ -44,6 +44,7 @@ class TestQgsComposerMap: public QObject
     void zebraStyle(); //test zebra map border style
     void overviewMapCenter(); //test if centering of overview map frame works
     void worldFileGeneration(); // test world file generation
+    void previewRendering(); // test background rendering of the preview
 
   private:
     QgsComposition* mComposition;
@@ -272,5 +273,31 @@ void TestQgsComposerMap::worldFileGeneration()
   QVERIFY( fabs( f - 3.34241e+06 ) < 1e+03 );
 }
 
+void TestQgsComposerMap::previewRendering()
+{
+  QgsComposerMap* previewMap = new QgsComposerMap( mComposition, 20, 20, 200, 100 );
+  mComposition->addComposerMap( previewMap );
+  previewMap->setNewExtent( QgsRectangle( 781662.375, 3339523.125, 793062.375, 3345223.125 ) );
+  previewMap->setPreviewMode( QgsComposerMap::Cache );
+
+  previewMap->cache();
+  QVERIFY( previewMap->isRenderingPreview() );
+
+  // a new extent cancels the running job
+  previewMap->setNewExtent( QgsRectangle( 781662.375, 3339523.125, 787362.375, 3342373.125 ) );
+  previewMap->cache();
+  QVERIFY( previewMap->isRenderingPreview() );
+
+  previewMap->waitForPreview();
+  QVERIFY( !previewMap->isRenderingPreview() );
+
+  // rendering the same extent again takes the layers from the cache
+  previewMap->cache();
+  previewMap->waitForPreview();
+  QVERIFY( !previewMap->isRenderingPreview() );
+
+  mComposition->removeComposerItem( previewMap );
+}
+
 QTEST_MAIN( TestQgsComposerMap )
 #include "moc_testqgscomposermap.cxx"
@@ -45,6 +45,7 @@ class TestQgsCoordinateReferenceSystem: public QObject
     void createFromESRIWkt();
     void createFromSrsId();
     void createFromProj4();
+    void repeatedLookups();
     void isValid();
     void validate();
     void equality();
@@ -280,6 +281,33 @@ void TestQgsCoordinateReferenceSystem::createFromProj4()
   QVERIFY( myCrs.createFromProj4( GEOPROJ4 ) );
   debugPrint( myCrs );
 }
+void TestQgsCoordinateReferenceSystem::repeatedLookups()
+{
+  // the second time the definitions come from the catalogue of srs.db
+  for ( int i = 0; i < 2; ++i )
+  {
+    QgsCoordinateReferenceSystem mySrsIdCrs;
+    QVERIFY( mySrsIdCrs.createFromSrsId( GEOCRS_ID ) );
+    QgsCoordinateReferenceSystem mySridCrs;
+    QVERIFY( mySridCrs.createFromSrid( GEOSRID ) );
+    QgsCoordinateReferenceSystem myAuthIdCrs;
+    QVERIFY( myAuthIdCrs.createFromOgcWmsCrs( GEO_EPSG_CRS_AUTHID ) );
+    QgsCoordinateReferenceSystem myProj4Crs;
+    QVERIFY( myProj4Crs.createFromProj4( GEOPROJ4 ) );
+
+    QCOMPARE( mySrsIdCrs.srsid(), GEOCRS_ID );
+    QCOMPARE( mySrsIdCrs.authid(), GEO_EPSG_CRS_AUTHID );
+    QCOMPARE( mySridCrs.srsid(), GEOCRS_ID );
+    QCOMPARE( myAuthIdCrs.srsid(), GEOCRS_ID );
+    QCOMPARE( myProj4Crs.srsid(), GEOCRS_ID );
+    QCOMPARE( myProj4Crs.toProj4(), mySrsIdCrs.toProj4() );
+    QVERIFY( mySrsIdCrs.geographicFlag() );
+    QCOMPARE( mySrsIdCrs.mapUnits(), QGis::Degrees );
+  }
+
+  QgsCoordinateReferenceSystem myCrs;
+  QVERIFY( !myCrs.createFromOgcWmsCrs( "EPSG:1" ) );
+}
 void TestQgsCoordinateReferenceSystem::isValid()
 {
   QgsCoordinateReferenceSystem myCrs;
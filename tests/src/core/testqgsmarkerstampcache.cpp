@@ -0,0 +1,163 @@
+/***************************************************************************
+     testqgsmarkerstampcache.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest>
+#include <QObject>
+#include <QImage>
+#include <QPainter>
+
+#include <qgsapplication.h>
+#include <qgsmarkerstampcache.h>
+#include <qgsrendercontext.h>
+#include <qgssymbolv2.h>
+
+/** \ingroup UnitTests
+ * This is a unit test for the cache of rasterised markers
+ */
+class TestQgsMarkerStampCache: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase() {};
+    void init();
+    void cleanup() {};
+
+    void testStamps();
+    void testMaximumSize();
+    void testRenderedMarkers();
+
+  private:
+    QImage renderMarkers( bool forceVectorOutput, bool selected );
+};
+
+void TestQgsMarkerStampCache::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+}
+
+void TestQgsMarkerStampCache::init()
+{
+  QgsMarkerStampCache::instance()->clear();
+  QgsMarkerStampCache::instance()->setMaximumSize( 32 * 1024 * 1024 );
+}
+
+void TestQgsMarkerStampCache::testStamps()
+{
+  QgsMarkerStampCache* cache = QgsMarkerStampCache::instance();
+
+  QImage image( 10, 10, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+  cache->insertStamp( "circle", 1, QgsMarkerStamp( image, QPointF( 5, 5 ) ) );
+  QCOMPARE( cache->size(), image.byteCount() );
+
+  QgsMarkerStamp stamp;
+  QVERIFY( cache->stamp( "circle", 1, stamp ) );
+  QCOMPARE( stamp.image.size(), QSize( 10, 10 ) );
+  QCOMPARE( stamp.anchor, QPointF( 5, 5 ) );
+
+  QVERIFY( !cache->stamp( "circle", 2, stamp ) );
+  QVERIFY( !cache->stamp( "square", 1, stamp ) );
+
+  cache->clear();
+  QVERIFY( !cache->stamp( "circle", 1, stamp ) );
+  QCOMPARE( cache->size(), 0 );
+}
+
+void TestQgsMarkerStampCache::testMaximumSize()
+{
+  QgsMarkerStampCache* cache = QgsMarkerStampCache::instance();
+
+  QImage image( 16, 16, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+  cache->setMaximumSize( 3 * image.byteCount() );
+
+  for ( int i = 0; i < 10; ++i )
+  {
+    cache->insertStamp( "square", i, QgsMarkerStamp( image, QPointF( 8, 8 ) ) );
+    QVERIFY( cache->size() <= cache->maximumSize() );
+  }
+
+  // the least recently used stamps are dropped
+  QgsMarkerStamp stamp;
+  QVERIFY( !cache->stamp( "square", 0, stamp ) );
+  QVERIFY( cache->stamp( "square", 9, stamp ) );
+}
+
+QImage TestQgsMarkerStampCache::renderMarkers( bool forceVectorOutput, bool selected )
+{
+  QImage image( 200, 200, QImage::Format_ARGB32_Premultiplied );
+  image.fill( 0 );
+
+  QPainter p( &image );
+  p.setRenderHint( QPainter::Antialiasing );
+
+  QgsRenderContext context;
+  context.setPainter( &p );
+  context.setForceVectorOutput( forceVectorOutput );
+
+  QgsStringMap props;
+  props["name"] = "star";
+  props["color"] = "255,0,0,255";
+  props["color_border"] = "0,0,0,255";
+  props["size"] = "7.3";
+  props["angle"] = "17";
+  QgsMarkerSymbolV2* symbol = QgsMarkerSymbolV2::createSimple( props );
+
+  symbol->startRender( context );
+  for ( int i = 0; i < 100; ++i )
+  {
+    // many subpixel positions, each stamp is reused a few times
+    QPointF point( 10 + ( i % 10 ) * 18.37, 10 + ( i / 10 ) * 18.61 );
+    symbol->renderPoint( point, 0, context, -1, selected );
+  }
+  symbol->stopRender( context );
+  p.end();
+
+  delete symbol;
+  return image;
+}
+
+void TestQgsMarkerStampCache::testRenderedMarkers()
+{
+  for ( int selected = 0; selected < 2; ++selected )
+  {
+    QgsMarkerStampCache::instance()->clear();
+    QImage vectorImage = renderMarkers( true, selected );
+    QCOMPARE( QgsMarkerStampCache::instance()->size(), 0 );
+
+    QImage stampImage = renderMarkers( false, selected );
+    QVERIFY( QgsMarkerStampCache::instance()->size() > 0 );
+
+    // stamps quantize size, rotation and position, only antialiased edges may differ
+    int maxDiff = 0;
+    for ( int y = 0; y < vectorImage.height(); ++y )
+    {
+      for ( int x = 0; x < vectorImage.width(); ++x )
+      {
+        QRgb a = vectorImage.pixel( x, y );
+        QRgb b = stampImage.pixel( x, y );
+        maxDiff = qMax( maxDiff, qAbs( qRed( a ) - qRed( b ) ) );
+        maxDiff = qMax( maxDiff, qAbs( qGreen( a ) - qGreen( b ) ) );
+        maxDiff = qMax( maxDiff, qAbs( qBlue( a ) - qBlue( b ) ) );
+        maxDiff = qMax( maxDiff, qAbs( qAlpha( a ) - qAlpha( b ) ) );
+      }
+    }
+    QVERIFY2( maxDiff < 128, QString( "maximum difference %1" ).arg( maxDiff ).toLocal8Bit().constData() );
+  }
+}
+
+QTEST_MAIN( TestQgsMarkerStampCache )
+#include "moc_testqgsmarkerstampcache.cxx"
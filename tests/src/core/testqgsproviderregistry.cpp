@@ -0,0 +1,120 @@
+/***************************************************************************
+     testqgsproviderregistry.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QDir>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QThread>
+
+#include <qgsapplication.h>
+#include <qgsdataprovider.h>
+#include <qgsproviderregistry.h>
+
+/**
+ * Tests the providers created in the thread pool by prepareProviders()
+ */
+class TestQgsProviderRegistry : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::initQgis();
+
+      QString dataDir = QString( TEST_DATA_DIR ) + QDir::separator();
+      mPoints = dataDir + "points.shp";
+      mLines = dataDir + "lines.shp";
+    }
+
+    void cleanupTestCase()
+    {
+      QgsApplication::exitQgis();
+    }
+
+    void preparedProviders()
+    {
+      QgsProviderRegistry* registry = QgsProviderRegistry::instance();
+
+      QList< QPair<QString, QString> > dataSources;
+      dataSources << qMakePair( QString( "ogr" ), mPoints )
+      << qMakePair( QString( "ogr" ), mLines )
+      << qMakePair( QString( "ogr" ), mPoints )
+      << qMakePair( QString( "memory" ), QString( "Point" ) );
+      registry->prepareProviders( dataSources );
+
+      // the memory provider is created when asked for
+      QCOMPARE( registry->preparedProviderCount(), 3 );
+
+      // handed out in the order of the data sources, independent of other sources
+      QgsDataProvider* points1 = registry->provider( "ogr", mPoints );
+      QVERIFY( points1 );
+      QVERIFY( points1->isValid() );
+      QCOMPARE( points1->thread(), QThread::currentThread() );
+      QCOMPARE( registry->preparedProviderCount(), 2 );
+
+      QgsDataProvider* points2 = registry->provider( "ogr", mPoints );
+      QVERIFY( points2 );
+      QVERIFY( points2 != points1 );
+      QVERIFY( points2->isValid() );
+      QCOMPARE( points2->thread(), QThread::currentThread() );
+      QCOMPARE( registry->preparedProviderCount(), 1 );
+
+      // no prepared one left for this source, a new provider is created
+      QgsDataProvider* points3 = registry->provider( "ogr", mPoints );
+      QVERIFY( points3 );
+      QVERIFY( points3->isValid() );
+      QCOMPARE( registry->preparedProviderCount(), 1 );
+
+      // the lines were not asked for
+      registry->clearPreparedProviders();
+      QCOMPARE( registry->preparedProviderCount(), 0 );
+
+      delete points1;
+      delete points2;
+      delete points3;
+    }
+
+    void clearBeforeFinished()
+    {
+      QgsProviderRegistry* registry = QgsProviderRegistry::instance();
+
+      QList< QPair<QString, QString> > dataSources;
+      for ( int i = 0; i < 20; ++i )
+      {
+        dataSources << qMakePair( QString( "ogr" ), i % 2 ? mPoints : mLines );
+      }
+      registry->prepareProviders( dataSources );
+      QCOMPARE( registry->preparedProviderCount(), 20 );
+
+      // waits for the providers which are still being created and deletes them
+      registry->clearPreparedProviders();
+      QCOMPARE( registry->preparedProviderCount(), 0 );
+
+      QgsDataProvider* lines = registry->provider( "ogr", mLines );
+      QVERIFY( lines );
+      QVERIFY( lines->isValid() );
+      delete lines;
+    }
+
+  private:
+    QString mPoints;
+    QString mLines;
+};
+
+QTEST_MAIN( TestQgsProviderRegistry )
+#include "moc_testqgsproviderregistry.cxx"
@@ -21,15 +21,18 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QDesktopServices>
+#include <QSettings>
 
 #include <iostream>
 //qgis includes...
 #include <qgsmaprenderer.h>
+#include <qgsmaprendererjob.h>
 #include <qgsmaplayer.h>
 #include <qgsvectorlayer.h>
 #include <qgsapplication.h>
 #include <qgsproviderregistry.h>
 #include <qgsmaplayerregistry.h>
+#include <qgsrendererv2.h>
 //qgis test includes
 #include "qgsrenderchecker.h"
 
@@ -46,6 +49,7 @@ class TestQgsRenderers: public QObject
     void cleanup() {};// will be called after every testfunction.
 
     void singleSymbol();
+    void symbolLevels();
 //    void uniqueValue();
 //    void graduatedSymbol();
 //    void continuousSymbol();
@@ -138,6 +142,43 @@ void TestQgsRenderers::singleSymbol()
   QVERIFY( imageCheck( "single" ) );
 }
 
+static QImage _renderImage( const QgsMapSettings& settings )
+{
+  QgsMapRendererSequentialJob job( settings );
+  job.start();
+  job.waitForFinished();
+  return job.renderedImage();
+}
+
+void TestQgsRenderers::symbolLevels()
+{
+  QVERIFY( setQml( "single" ) );
+
+  QgsMapSettings mapSettings;
+  mapSettings.setLayers( QStringList() << mpPolysLayer->id() );
+  mapSettings.setExtent( mpPolysLayer->extent() );
+  mapSettings.setOutputSize( QSize( 256, 256 ) );
+
+  QImage plainImage = _renderImage( mapSettings );
+
+  // with a single symbol layer symbol levels give the same image, whether
+  // the features are kept in memory or fetched again for each level
+  QgsFeatureRendererV2* renderer = static_cast<QgsVectorLayer*>( mpPolysLayer )->rendererV2();
+  renderer->setUsingSymbolLevels( true );
+
+  QSettings settings;
+  settings.setValue( "/qgis/symbol_levels_memory", 64 );
+  QImage levelsImage = _renderImage( mapSettings );
+  settings.setValue( "/qgis/symbol_levels_memory", 0 );
+  QImage refetchedImage = _renderImage( mapSettings );
+  settings.remove( "/qgis/symbol_levels_memory" );
+
+  renderer->setUsingSymbolLevels( false );
+
+  QVERIFY( levelsImage == plainImage );
+  QVERIFY( refetchedImage == plainImage );
+}
+
 // TODO: update tests and enable
 /*
 void TestQgsRenderers::uniqueValue()
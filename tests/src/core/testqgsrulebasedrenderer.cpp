@@ -104,6 +104,64 @@ class TestQgsRuleBasedRenderer: public QObject
       delete layer;
     }
 
+    void test_childIndex()
+    {
+      // enough rules for the renderer to look up the children by attribute values
+      QgsVectorLayer* layer = new QgsVectorLayer( "point?field=cls:string&field=val:double&field=code:int", "x", "memory" );
+      QgsFields fields = layer->pendingFields();
+
+      RRule* rootRule = new RRule( NULL );
+      QStringList classes;
+      classes << "road" << "track" << "path" << "river" << "5" << "07";
+      foreach ( QString cls, classes )
+        rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, QString( "\"cls\" = '%1'" ).arg( cls ) ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "'river' = cls and val > 50" ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "code IN (1, 2, '3', NULL)" ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "val >= 0 and val < 10" ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "val >= 10 and val <= 20" ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "15 < val" ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "cls LIKE 'r%'" ) );
+      rootRule->appendChild( new RRule( QgsSymbolV2::defaultSymbol( QGis::Point ), 0, 0, "", "", "", true ) );
+      QgsRuleBasedRendererV2 r( rootRule );
+
+      QgsRenderContext ctx;
+      r.startRender( ctx, fields );
+
+      QList<QVariant> clsValues, valValues, codeValues;
+      clsValues << "road" << "river" << "5" << "5.0" << "7" << "07" << "other" << QVariant();
+      valValues << -1.0 << 0.0 << 5.0 << 10.0 << 15.0 << 20.0 << 20.5 << 60.0 << QVariant();
+      codeValues << 1 << 3 << 4 << QVariant();
+
+      foreach ( QVariant cls, clsValues )
+      {
+        foreach ( QVariant val, valValues )
+        {
+          foreach ( QVariant code, codeValues )
+          {
+            QgsFeature f;
+            f.initAttributes( 3 );
+            f.setAttribute( 0, cls );
+            f.setAttribute( 1, val );
+            f.setAttribute( 2, code );
+
+            // evaluate every filter for the expected rules
+            QgsRuleBasedRendererV2::RuleList expected;
+            foreach ( RRule* rule, rootRule->children() )
+            {
+              if ( rule->isFilterOK( f ) )
+                expected << rule;
+            }
+
+            QgsRuleBasedRendererV2::RuleList rules = rootRule->rulesForFeature( f );
+            QCOMPARE( rules, expected );
+          }
+        }
+      }
+
+      r.stopRender( ctx );
+      delete layer;
+    }
+
   private:
     void xml2domElement( QString testFile, QDomDocument& doc )
     {
@@ -0,0 +1,163 @@
+/***************************************************************************
+     testqgssvgcache.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest>
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QtConcurrentMap>
+
+#include <qgsapplication.h>
+#include <qgssvgcache.h>
+
+/** \ingroup UnitTests
+ * This is a unit test for the svg cache
+ */
+class TestQgsSvgCache: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup() {};
+
+    void testParams();
+    void testHitsAndMisses();
+    void testLargeImage();
+    void testThreads();
+
+  private:
+    QString mSvgFile;
+};
+
+void TestQgsSvgCache::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mSvgFile = QDir::tempPath() + QDir::separator() + "qgssvgcachetest.svg";
+  QFile file( mSvgFile );
+  QVERIFY( file.open( QIODevice::WriteOnly ) );
+  file.write( "<svg xmlns='http://www.w3.org/2000/svg' width='10' height='10' viewBox='0 0 10 10'>"
+              "<rect x='0' y='0' width='10' height='10' fill='param(fill) #000' stroke='param(outline) #000' stroke-width='param(outline-width) 1'/>"
+              "</svg>" );
+  file.close();
+}
+
+void TestQgsSvgCache::cleanupTestCase()
+{
+  QFile::remove( mSvgFile );
+}
+
+void TestQgsSvgCache::init()
+{
+  QgsSvgCache::instance()->clear();
+}
+
+void TestQgsSvgCache::testParams()
+{
+  QgsSvgCache* cache = QgsSvgCache::instance();
+
+  bool fitsInCache = false;
+  QImage red = cache->svgAsImage( mSvgFile, 20, Qt::red, Qt::red, 0.5, 1.0, 1.0, fitsInCache );
+  QVERIFY( fitsInCache );
+  QCOMPARE( red.size(), QSize( 20, 20 ) );
+  QCOMPARE( QColor( red.pixel( 10, 10 ) ), QColor( Qt::red ) );
+
+  // same file with other colors is substituted on the parsed document
+  QImage blue = cache->svgAsImage( mSvgFile, 20, Qt::blue, Qt::blue, 0.5, 1.0, 1.0, fitsInCache );
+  QCOMPARE( QColor( blue.pixel( 10, 10 ) ), QColor( Qt::blue ) );
+  QCOMPARE( QColor( red.pixel( 10, 10 ) ), QColor( Qt::red ) );
+}
+
+void TestQgsSvgCache::testHitsAndMisses()
+{
+  QgsSvgCache* cache = QgsSvgCache::instance();
+
+  bool fitsInCache = false;
+  cache->svgAsImage( mSvgFile, 20, Qt::red, Qt::black, 1, 1.0, 1.0, fitsInCache );
+  QCOMPARE( cache->misses(), 1 );
+  QCOMPARE( cache->hits(), 0 );
+
+  QImage image = cache->svgAsImage( mSvgFile, 20, Qt::red, Qt::black, 1, 1.0, 1.0, fitsInCache );
+  QCOMPARE( cache->misses(), 1 );
+  QCOMPARE( cache->hits(), 1 );
+  QCOMPARE( image.size(), QSize( 20, 20 ) );
+
+  // a new size is a miss, but does not need to read the file again
+  image = cache->svgAsImage( mSvgFile, 30, Qt::red, Qt::black, 1, 1.0, 1.0, fitsInCache );
+  QCOMPARE( cache->misses(), 2 );
+  QCOMPARE( image.size(), QSize( 30, 30 ) );
+
+  cache->svgAsPicture( mSvgFile, 30, Qt::red, Qt::black, 1, 1.0, 1.0 );
+  QCOMPARE( cache->misses(), 3 );
+  cache->svgAsPicture( mSvgFile, 30, Qt::red, Qt::black, 1, 1.0, 1.0 );
+  QCOMPARE( cache->hits(), 2 );
+
+  QVERIFY( cache->totalSize() > 0 );
+  QCOMPARE( cache->evictions(), 0 );
+}
+
+void TestQgsSvgCache::testLargeImage()
+{
+  QgsSvgCache* cache = QgsSvgCache::instance();
+
+  bool fitsInCache = true;
+  QImage image = cache->svgAsImage( mSvgFile, 2000, Qt::red, Qt::black, 1, 1.0, 1.0, fitsInCache );
+  QVERIFY( !fitsInCache );
+  QVERIFY( image.isNull() );
+
+  // the picture rendered instead is used for the next request
+  QPicture picture = cache->svgAsPicture( mSvgFile, 2000, Qt::red, Qt::black, 1, 1.0, 1.0 );
+  QVERIFY( picture.width() > 1 );
+  QCOMPARE( cache->hits(), 1 );
+
+  // filling the cache with many sizes removes old entries
+  for ( int size = 100; size < 400; ++size )
+  {
+    cache->svgAsImage( mSvgFile, size, Qt::red, Qt::black, 1, 1.0, 1.0, fitsInCache );
+    QVERIFY( fitsInCache );
+  }
+  QVERIFY( cache->evictions() > 0 );
+}
+
+static void _renderSvg( int& size )
+{
+  bool fitsInCache;
+  QImage image = QgsSvgCache::instance()->svgAsImage( QDir::tempPath() + QDir::separator() + "qgssvgcachetest.svg", 10 + size % 50,
+                 size % 2 ? Qt::red : Qt::green, Qt::black, 1, 1.0, 1.0, fitsInCache );
+  size = image.width();
+}
+
+void TestQgsSvgCache::testThreads()
+{
+  QList<int> sizes;
+  for ( int i = 0; i < 2000; ++i )
+  {
+    sizes << i;
+  }
+
+  QtConcurrent::map( sizes, _renderSvg ).waitForFinished();
+
+  for ( int i = 0; i < sizes.count(); ++i )
+  {
+    QCOMPARE( sizes.at( i ), 10 + i % 50 );
+  }
+  QCOMPARE( QgsSvgCache::instance()->hits() + QgsSvgCache::instance()->misses(), 2000 );
+}
+
+QTEST_MAIN( TestQgsSvgCache )
+#include "moc_testqgssvgcache.cxx"
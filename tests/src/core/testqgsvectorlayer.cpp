@@ -21,6 +21,7 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QDesktopServices>
+#include <QSignalSpy>
 
 #include <iostream>
 //qgis includes...
@@ -29,6 +30,7 @@
 #include <qgsvectordataprovider.h>
 #include <qgsvectorlayer.h>
 #include <qgsapplication.h>
+#include <qgsgeometrycache.h>
 #include <qgsproviderregistry.h>
 #include <qgsmaplayerregistry.h>
 #include <qgssymbolv2.h>
@@ -80,6 +82,22 @@ class TestQgsVectorLayer: public QObject
     QString mTestDataDir;
     QString mReport;
 
+    //! snapping results as sorted text, to compare results found in different ways
+    QStringList snappingResults( QgsVectorLayer* layer, const QgsPoint& point, double tolerance, QgsSnapper::SnappingType snapTo )
+    {
+      QMultiMap<double, QgsSnappingResult> results;
+      layer->snapWithContext( point, tolerance, results, snapTo );
+      QStringList list;
+      for ( QMultiMap<double, QgsSnappingResult>::const_iterator it = results.constBegin(); it != results.constEnd(); ++it )
+      {
+        list << QString( "%1 %2 %3 %4 %5 %6" ).arg( it.key(), 0, 'f', 6 ).arg( it.value().snappedAtGeometry )
+        .arg( it.value().snappedVertexNr ).arg( it.value().beforeVertexNr ).arg( it.value().afterVertexNr )
+        .arg( it.value().snappedVertex.toString( 6 ) );
+      }
+      list.sort();
+      return list;
+    }
+
   private slots:
 
 
@@ -289,7 +307,29 @@ class TestQgsVectorLayer: public QObject
     };
     void QgsVectorLayerfeatureCount()
     {
+      QgsVectorLayer* vLayer = static_cast< QgsVectorLayer * >( mpLinesLayer );
+      QVERIFY( vLayer->featureCount() > 0 );
+
+      vLayer->setRendererV2( new QgsSingleSymbolRendererV2( QgsSymbolV2::defaultSymbol( QGis::Line ) ) );
+      QgsSymbolV2* symbol = vLayer->rendererV2()->legendSymbolItems().first().second;
+      QCOMPARE( vLayer->featureCount( symbol ), -1L );
 
+      // the counts are not available until the counting thread has finished
+      QSignalSpy spy( vLayer, SIGNAL( symbolFeatureCountMapChanged() ) );
+      vLayer->countSymbolFeaturesInBackground();
+      for ( int i = 0; i < 100 && spy.isEmpty(); ++i )
+      {
+        QTest::qWait( 50 );
+      }
+      QCOMPARE( spy.count(), 1 );
+      QCOMPARE( vLayer->featureCount( symbol ), vLayer->featureCount() );
+
+      // a new renderer has to be counted again
+      vLayer->setRendererV2( new QgsSingleSymbolRendererV2( QgsSymbolV2::defaultSymbol( QGis::Line ) ) );
+      symbol = vLayer->rendererV2()->legendSymbolItems().first().second;
+      QCOMPARE( vLayer->featureCount( symbol ), -1L );
+      QVERIFY( vLayer->countSymbolFeatures( false ) );
+      QCOMPARE( vLayer->featureCount( symbol ), vLayer->featureCount() );
     };
     void QgsVectorLayerupdateFeatureCount()
     {
@@ -493,7 +533,64 @@ class TestQgsVectorLayer: public QObject
     };
     void QgsVectorLayersnapWithContext()
     {
-
+      QList<QgsSnapper::SnappingType> snapTypes;
+      snapTypes << QgsSnapper::SnapToVertex << QgsSnapper::SnapToSegment << QgsSnapper::SnapToVertexAndSegment;
+      QList<QgsMapLayer *> layers;
+      layers << mpPointsLayer << mpLinesLayer << mpPolysLayer;
+      foreach ( QgsMapLayer* mapLayer, layers )
+      {
+        QgsVectorLayer* layer = qobject_cast<QgsVectorLayer *>( mapLayer );
+        QgsRectangle extent = layer->extent();
+        double tolerance = extent.width() / 20;
+
+        // snapping to the cached geometries uses the segment index,
+        // it has to give the same results as snapping to the provider features
+        layer->cache()->deleteCachedGeometries();
+        QgsGeometryMap geometries;
+        QgsFeature f;
+        QgsFeatureIterator fit = layer->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QgsAttributeList() ) );
+        while ( fit.nextFeature( f ) )
+        {
+          geometries.insert( f.id(), *f.geometry() );
+        }
+        QVERIFY( !geometries.isEmpty() );
+
+        for ( int i = 0; i <= 10; ++i )
+        {
+          for ( int j = 0; j <= 10; ++j )
+          {
+            QgsPoint point( extent.xMinimum() + extent.width() * i / 10, extent.yMinimum() + extent.height() * j / 10 );
+            foreach ( QgsSnapper::SnappingType snapTo, snapTypes )
+            {
+              layer->cache()->deleteCachedGeometries();
+              QStringList expected = snappingResults( layer, point, tolerance, snapTo );
+
+              for ( QgsGeometryMap::const_iterator it = geometries.constBegin(); it != geometries.constEnd(); ++it )
+                layer->cache()->cacheGeometry( it.key(), it.value() );
+              QgsRectangle cachedRect = extent;
+              cachedRect.scale( 2 );
+              layer->cache()->setCachedGeometriesRect( cachedRect );
+              QCOMPARE( snappingResults( layer, point, tolerance, snapTo ), expected );
+            }
+          }
+        }
+
+        // the index follows changed and removed geometries
+        QgsFeatureId fid = geometries.constBegin().key();
+        QgsGeometry moved = geometries.constBegin().value();
+        moved.translate( extent.width() * 2, extent.height() * 2 );
+        QgsRectangle cachedRect = extent;
+        cachedRect.scale( 10 );
+        layer->cache()->setCachedGeometriesRect( cachedRect );
+        layer->cache()->cacheGeometry( fid, moved );
+        QgsPoint movedVertex = moved.vertexAt( 0 );
+        QStringList results = snappingResults( layer, movedVertex, tolerance, QgsSnapper::SnapToVertex );
+        QCOMPARE( results.size(), 1 );
+        QVERIFY( results.first().startsWith( QString( "%1 %2 0 " ).arg( 0.0, 0, 'f', 6 ).arg( fid ) ) );
+        layer->cache()->removeGeometry( fid );
+        QVERIFY( snappingResults( layer, movedVertex, tolerance, QgsSnapper::SnapToVertex ).isEmpty() );
+        layer->cache()->deleteCachedGeometries();
+      }
     };
     void QgsVectorLayersnapToGeometry()
     {
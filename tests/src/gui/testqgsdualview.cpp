@@ -33,6 +33,7 @@ class TestQgsDualView: public QObject
     void cleanup(); // will be called after every testfunction.
 
     void testSelectAll();
+    void testSort();
 
   private:
     QgsMapCanvas* mCanvas;
@@ -93,6 +94,25 @@ void TestQgsDualView::testSelectAll()
   QVERIFY( mPointsLayer->selectedFeatureCount() == 1 );
 }
 
+void TestQgsDualView::testSort()
+{
+  QgsAttributeTableModel* model = mDualView->masterModel();
+  QCOMPARE( model->rowCount(), ( int ) mPointsLayer->featureCount() );
+
+  int column = model->fieldCol( mPointsLayer->fieldNameIndex( "Heading" ) );
+  QVERIFY( column >= 0 );
+
+  mDualView->mFilterModel->sort( column, Qt::AscendingOrder );
+  QCOMPARE( mDualView->mFilterModel->rowCount(), model->rowCount() );
+
+  for ( int row = 1; row < mDualView->mFilterModel->rowCount(); ++row )
+  {
+    QVariant previous = mDualView->mFilterModel->index( row - 1, column ).data( QgsAttributeTableModel::SortRole );
+    QVariant current = mDualView->mFilterModel->index( row, column ).data( QgsAttributeTableModel::SortRole );
+    QVERIFY( previous.toLongLong() <= current.toLongLong() );
+  }
+}
+
 QTEST_MAIN( TestQgsDualView )
 #include "moc_testqgsdualview.cxx"
 
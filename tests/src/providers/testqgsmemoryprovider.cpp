@@ -0,0 +1,156 @@
+/***************************************************************************
+     testqgsmemoryprovider.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+
+#include <qgsapplication.h>
+#include <qgsfeatureiterator.h>
+#include <qgsfeaturerequest.h>
+#include <qgsgeometry.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+#if QT_VERSION < 0x40701
+// See http://hub.qgis.org/issues/4284
+Q_DECLARE_METATYPE( QVariant )
+#endif
+
+// number of features in the benchmark layers
+#define BENCHMARK_FEATURES 100000
+
+static QgsFeatureList _pointFeatures( int count )
+{
+  static const char* names[] = { "road", "river", "building", "forest" };
+
+  QgsFeatureList features;
+  for ( int i = 0; i < count; ++i )
+  {
+    QgsFeature f;
+    f.initAttributes( 3 );
+    f.setAttribute( 0, i );
+    f.setAttribute( 1, names[i % 4] );
+    f.setAttribute( 2, i * 0.5 );
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint( i % 1000, i / 1000 ) ) );
+    features << f;
+  }
+  return features;
+}
+
+/**
+ * Compares the default and the columnar storage of the memory provider.
+ * Run with -iterations or -callgrind for stable numbers.
+ */
+class TestQgsMemoryProvider : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+
+    void initTestCase()
+    {
+      // we need the memory provider
+      QgsApplication::init();
+      QgsApplication::initQgis();
+      mFeatures = _pointFeatures( BENCHMARK_FEATURES );
+    }
+
+    void cleanupTestCase()
+    {
+      QgsApplication::exitQgis();
+    }
+
+    void benchmarkLoad_data()
+    {
+      storageData();
+    }
+
+    void benchmarkLoad()
+    {
+      QFETCH( QString, uri );
+
+      QBENCHMARK
+      {
+        QgsVectorLayer layer( uri, "x", "memory" );
+        QgsFeatureList features = mFeatures;
+        layer.dataProvider()->addFeatures( features );
+      }
+    }
+
+    void benchmarkFilterRect_data()
+    {
+      storageData();
+    }
+
+    void benchmarkFilterRect()
+    {
+      QFETCH( QString, uri );
+
+      QgsVectorLayer layer( uri, "x", "memory" );
+      QgsFeatureList features = mFeatures;
+      QVERIFY( layer.dataProvider()->addFeatures( features ) );
+
+      int count = 0;
+      QBENCHMARK
+      {
+        count = 0;
+        QgsFeatureIterator it = layer.dataProvider()->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( 100, 10, 199.5, 19.5 ) ) );
+        QgsFeature f;
+        while ( it.nextFeature( f ) )
+          count++;
+      }
+      QCOMPARE( count, 1000 );
+    }
+
+    void benchmarkIterate_data()
+    {
+      storageData();
+    }
+
+    void benchmarkIterate()
+    {
+      QFETCH( QString, uri );
+
+      QgsVectorLayer layer( uri, "x", "memory" );
+      QgsFeatureList features = mFeatures;
+      QVERIFY( layer.dataProvider()->addFeatures( features ) );
+
+      double sum = 0;
+      QBENCHMARK
+      {
+        sum = 0;
+        QgsFeatureIterator it = layer.dataProvider()->getFeatures( QgsFeatureRequest().setFlags( QgsFeatureRequest::NoGeometry ).setSubsetOfAttributes( QgsAttributeList() << 2 ) );
+        QgsFeature f;
+        while ( it.nextFeature( f ) )
+          sum += f.attribute( 2 ).toDouble();
+      }
+      QCOMPARE( sum, 0.5 * BENCHMARK_FEATURES * ( BENCHMARK_FEATURES - 1 ) / 2 );
+    }
+
+  private:
+    void storageData()
+    {
+      QTest::addColumn<QString>( "uri" );
+
+      QString fields( "point?field=id:integer&field=name:string&field=value:double" );
+      QTest::newRow( "default" ) << fields;
+      QTest::newRow( "columnar" ) << fields + "&storage=columnar";
+    }
+
+    QgsFeatureList mFeatures;
+};
+
+QTEST_MAIN( TestQgsMemoryProvider )
+
+#include "moc_testqgsmemoryprovider.cxx"
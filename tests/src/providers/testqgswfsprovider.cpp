@@ -0,0 +1,246 @@
+/***************************************************************************
+     testqgswfsprovider.cpp
+     --------------------------------------
+    Date                 : May 2014
+    Copyright            : (C) 2014 by QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTime>
+#include <QUrl>
+
+#include <qgsapplication.h>
+#include <qgsfeatureiterator.h>
+#include <qgsfeaturerequest.h>
+#include <qgsmaplayerregistry.h>
+#include <qgsrectangle.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+//! features returned by one GetFeature request of the provider
+#define TEST_PAGE_SIZE 10
+//! features without WFS id, all at the same location so splitting tiles can't page them
+#define TEST_CLUSTER_SIZE 30
+
+/**
+ * Minimal WFS 1.0 server. Returns a grid of points with WFS ids at the integer
+ * coordinates of 0..9 x 0..9 and a cluster of points without id at 4,4.
+ * GetFeature honors BBOX (boundaries included) and MAXFEATURES.
+ */
+class TestWfsServer : public QTcpServer
+{
+    Q_OBJECT
+
+  public:
+    TestWfsServer() : mGetFeatureRequests( 0 )
+    {
+      connect( this, SIGNAL( newConnection() ), this, SLOT( acceptConnection() ) );
+    }
+
+    int getFeatureRequests() const { return mGetFeatureRequests; }
+
+    //! milliseconds since the last response was sent
+    int idleTime() const { return mLastResponse.isNull() ? 0 : mLastResponse.elapsed(); }
+
+  private slots:
+    void acceptConnection()
+    {
+      while ( hasPendingConnections() )
+      {
+        QTcpSocket* socket = nextPendingConnection();
+        connect( socket, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+        connect( socket, SIGNAL( disconnected() ), socket, SLOT( deleteLater() ) );
+      }
+    }
+
+    void readRequest()
+    {
+      QTcpSocket* socket = qobject_cast<QTcpSocket*>( sender() );
+      QByteArray& buffer = mBuffers[ socket ];
+      buffer += socket->readAll();
+      if ( !buffer.contains( "\r\n\r\n" ) )
+        return;
+
+      QUrl url = QUrl::fromEncoded( buffer.split( ' ' ).value( 1 ) );
+      mBuffers.remove( socket );
+
+      QString request = queryItem( url, "REQUEST" );
+      QByteArray body;
+      if ( request.compare( "DescribeFeatureType", Qt::CaseInsensitive ) == 0 )
+      {
+        // on one line: the provider looks at the column numbers of the first elements
+        body = "<?xml version=\"1.0\"?>"
+               "<xsd:schema xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" xmlns:gml=\"http://www.opengis.net/gml\" xmlns:qgs=\"http://qgis.org/test\" targetNamespace=\"http://qgis.org/test\">"
+               "<xsd:complexType name=\"pointsType\"><xsd:complexContent><xsd:extension base=\"gml:AbstractFeatureType\"><xsd:sequence>"
+               "<xsd:element name=\"geometry\" type=\"gml:PointPropertyType\"/>"
+               "<xsd:element name=\"id\" type=\"xsd:int\"/>"
+               "</xsd:sequence></xsd:extension></xsd:complexContent></xsd:complexType>"
+               "<xsd:element name=\"points\" type=\"qgs:pointsType\" substitutionGroup=\"gml:_Feature\"/>"
+               "</xsd:schema>";
+      }
+      else if ( request.compare( "GetFeature", Qt::CaseInsensitive ) == 0 )
+      {
+        ++mGetFeatureRequests;
+        body = getFeature( queryItem( url, "BBOX" ), queryItem( url, "MAXFEATURES" ).toInt() );
+      }
+      else
+      {
+        body = "<WFS_Capabilities version=\"1.0.0\" xmlns=\"http://www.opengis.net/wfs\"/>";
+      }
+
+      socket->write( "HTTP/1.0 200 OK\r\nContent-Type: text/xml\r\nConnection: close\r\n" );
+      socket->write( QString( "Content-Length: %1\r\n\r\n" ).arg( body.size() ).toAscii() );
+      socket->write( body );
+      socket->disconnectFromHost();
+      mLastResponse.start();
+    }
+
+  private:
+    static QString queryItem( const QUrl& url, const QString& key )
+    {
+      QList< QPair<QString, QString> > items = url.queryItems();
+      for ( int i = 0; i < items.size(); ++i )
+      {
+        if ( items[i].first.compare( key, Qt::CaseInsensitive ) == 0 )
+          return items[i].second;
+      }
+      return QString();
+    }
+
+    static QByteArray feature( const QString& fid, double x, double y, int id )
+    {
+      QString f = QString( "<gml:featureMember><qgs:points%1>"
+                           "<qgs:geometry><gml:Point><gml:coordinates>%2,%3</gml:coordinates></gml:Point></qgs:geometry>"
+                           "<qgs:id>%4</qgs:id></qgs:points></gml:featureMember>" )
+                  .arg( fid.isEmpty() ? QString() : QString( " fid=\"%1\"" ).arg( fid ) )
+                  .arg( x ).arg( y ).arg( id );
+      return f.toUtf8();
+    }
+
+    QByteArray getFeature( const QString& bbox, int maxFeatures )
+    {
+      QStringList coords = bbox.split( "," );
+      QgsRectangle rect( coords.value( 0 ).toDouble(), coords.value( 1 ).toDouble(),
+                         coords.value( 2 ).toDouble(), coords.value( 3 ).toDouble() );
+
+      QList<QByteArray> features;
+      for ( int i = 0; i < TEST_CLUSTER_SIZE; ++i )
+      {
+        if ( rect.contains( QgsPoint( 4, 4 ) ) )
+          features << feature( QString(), 4, 4, 1000 + i );
+      }
+      for ( int y = 0; y < 10; ++y )
+      {
+        for ( int x = 0; x < 10; ++x )
+        {
+          if ( rect.contains( QgsPoint( x, y ) ) )
+            features << feature( QString( "points.%1" ).arg( y * 10 + x ), x, y, y * 10 + x );
+        }
+      }
+      if ( maxFeatures > 0 )
+        features = features.mid( 0, maxFeatures );
+
+      QByteArray body = "<wfs:FeatureCollection xmlns:wfs=\"http://www.opengis.net/wfs\" xmlns:gml=\"http://www.opengis.net/gml\" xmlns:qgs=\"http://qgis.org/test\">";
+      foreach ( const QByteArray& f, features )
+        body += f;
+      body += "</wfs:FeatureCollection>";
+      return body;
+    }
+
+    QHash<QTcpSocket*, QByteArray> mBuffers;
+    int mGetFeatureRequests;
+    QTime mLastResponse;
+};
+
+/**
+ * Tests loading the features of the rendered extent in tiles
+ */
+class TestQgsWfsProvider : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+
+    void initTestCase()
+    {
+      // don't touch the settings of the user
+      QCoreApplication::setOrganizationName( "QGIS" );
+      QCoreApplication::setOrganizationDomain( "qgis.org" );
+      QCoreApplication::setApplicationName( "QGIS-TEST-WFS" );
+      QSettings().setValue( "/qgis/wfs/featuresPerTileRequest", TEST_PAGE_SIZE );
+
+      QgsApplication::init();
+      QgsApplication::initQgis();
+
+      QVERIFY( mServer.listen( QHostAddress::LocalHost ) );
+    }
+
+    void cleanupTestCase()
+    {
+      QgsApplication::exitQgis();
+    }
+
+    void pagedTiles()
+    {
+      QString uri = QString( "http://127.0.0.1:%1/wfs?SERVICE=WFS&VERSION=1.0.0&REQUEST=GetFeature&TYPENAME=qgs:points&SRSNAME=EPSG:4326&BBOX=0,0,10,10" )
+                    .arg( mServer.serverPort() );
+      QgsVectorLayer* layer = new QgsVectorLayer( uri, "points", "WFS" );
+      QVERIFY( layer->isValid() );
+      QgsMapLayerRegistry::instance()->addMapLayers( QList<QgsMapLayer*>() << layer );
+
+      QgsVectorDataProvider* provider = layer->dataProvider();
+      provider->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( 0, 0, 10, 10 ) ) );
+      waitForServer();
+
+      // nothing truncated by the page size is missing, nothing received twice is duplicated
+      QCOMPARE( provider->featureCount(), ( long )( 100 + TEST_CLUSTER_SIZE ) );
+      int idIndex = provider->fieldNameIndex( "id" );
+      QVERIFY( idIndex >= 0 );
+      QSet<int> ids;
+      QgsFeatureIterator it = provider->getFeatures( QgsFeatureRequest().setFlags( QgsFeatureRequest::NoGeometry ) );
+      QgsFeature f;
+      while ( it.nextFeature( f ) )
+      {
+        ids << f.attribute( idIndex ).toInt();
+      }
+      QCOMPARE( ids.size(), 100 + TEST_CLUSTER_SIZE );
+
+      // zooming in uses smaller tiles, they are covered by the loaded ones
+      int requests = mServer.getFeatureRequests();
+      provider->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( 1, 1, 2, 2 ) ) );
+      QTest::qWait( 1000 );
+      QCOMPARE( mServer.getFeatureRequests(), requests );
+
+      QgsMapLayerRegistry::instance()->removeMapLayers( QStringList() << layer->id() );
+    }
+
+  private:
+    //! processes events until the server did not respond for a while
+    void waitForServer()
+    {
+      QTime timeout;
+      timeout.start();
+      do
+      {
+        QTest::qWait( 100 );
+      }
+      while ( mServer.idleTime() < 1000 && timeout.elapsed() < 30000 );
+    }
+
+    TestWfsServer mServer;
+};
+
+QTEST_MAIN( TestQgsWfsProvider )
+#include "moc_testqgswfsprovider.cxx"
@@ -654,6 +654,47 @@ class TestQgsDelimitedTextProvider(TestCase):
         requests=None
         runTest(filename,requests,**params)
 
+    def test_038_persistent_index(self):
+        # Scan results saved to and reloaded from the index file
+        tmpdir = tempfile.mkdtemp()
+        filename = os.path.join(tmpdir,'testextw.txt')
+        with file(os.path.join(unitTestDataPath("delimitedtext"),'testextw.txt')) as f:
+            data = f.read()
+        with file(filename,'w') as f:
+            f.write(data)
+        def layerUrl( **params ):
+            url = QUrl.fromLocalFile(filename)
+            for k in params.keys():
+                url.addQueryItem(k,params[k])
+            return url.toString()
+        params={'delimiter': '|', 'type': 'csv', 'wktField': 'wkt', 'spatialIndex': 'Y', 'watchFile': 'N' }
+        expected = QgsVectorLayer(layerUrl(**params),'test','delimitedtext')
+        params['persistIndex']='Y'
+        created = QgsVectorLayer(layerUrl(**params),'test','delimitedtext')
+        assert os.path.exists(filename+'.dtidx'), "Index file not created"
+        loaded = QgsVectorLayer(layerUrl(**params),'test','delimitedtext')
+        requests=[
+            {},
+            {'extents': [10, 30, 30, 50]},
+            {'extents': [10, 30, 30, 50], 'exact': 1},
+            {'fid': 5},
+            {'fid': 3},
+        ]
+        for layer in (created,loaded):
+            assert layer.isValid(), "Layer not valid"
+            assert layer.featureCount() == expected.featureCount(), "Feature count {0} - expected {1}".format(layer.featureCount(),expected.featureCount())
+            assert layer.extent() == expected.extent(), "Extents differ"
+            for r in requests:
+                assert layerData(layer,r) == layerData(expected,r), "Features differ for request {0}".format(repr(r))
+        # Index no longer used once the file has changed
+        with file(filename,'a') as f:
+            f.write('100|New|LINESTRING(15 35, 16 36)\n')
+        changed = QgsVectorLayer(layerUrl(**params),'test','delimitedtext')
+        assert changed.featureCount() == expected.featureCount()+1, "Out of date index was used"
+        os.remove(filename+'.dtidx')
+        os.remove(filename)
+        os.rmdir(tmpdir)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -22,7 +22,8 @@ from qgis.core import (QGis,
                        QgsFeatureRequest,
                        QgsField,
                        QgsGeometry,
-                       QgsPoint
+                       QgsPoint,
+                       QgsRectangle
                       )
 
 from utilities import (getQgisTestApp,
@@ -138,5 +139,91 @@ class TestQgsMemoryProvider(TestCase):
         myProvider = myMemoryLayer.dataProvider()
         assert myProvider is not None
 
+    def testColumnarStorage(self):
+        """Test features stored in columns behave as with the default storage"""
+        layer = QgsVectorLayer(
+            ('Point?field=name:string&field=age:integer&'
+             'field=size:double&storage=columnar'),
+            'test',
+            'memory')
+        assert layer.isValid(), "Failed to create columnar memory layer"
+        provider = layer.dataProvider()
+        assert 'storage=columnar' in provider.dataSourceUri()
+
+        features = []
+        for i in range(10):
+            ft = QgsFeature()
+            ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(i, i)))
+            ft.setAttributes(["name%d" % (i % 3), i, None])
+            features.append(ft)
+        res, added = provider.addFeatures(features)
+        assert res, "Failed to add features"
+        assert provider.featureCount() == 10
+        ids = [f.id() for f in added]
+
+        f = provider.getFeatures(QgsFeatureRequest(ids[4])).next()
+        assert f['name'] == "name1", f['name']
+        assert f['age'] == 4, f['age']
+        assert f['size'] is None, f['size']
+        assert compareWkt(str(f.geometry().exportToWkt()), "POINT(4.0 4.0)")
+
+        provider.changeAttributeValues({ids[4]: {2: 1.5, 0: "changed"}})
+        provider.changeGeometryValues({ids[4]: QgsGeometry.fromPoint(QgsPoint(20, 20))})
+        provider.deleteFeatures([ids[0], ids[1]])
+        assert provider.featureCount() == 8
+
+        f = provider.getFeatures(QgsFeatureRequest(ids[4])).next()
+        assert f['name'] == "changed", f['name']
+        assert f['size'] == 1.5, f['size']
+        assert compareWkt(str(f.geometry().exportToWkt()), "POINT(20.0 20.0)")
+
+        request = QgsFeatureRequest().setFilterRect(QgsRectangle(0, 0, 5.5, 5.5))
+        found = sorted(f['age'] for f in provider.getFeatures(request))
+        assert found == [2, 3, 5], found
+
+        request = QgsFeatureRequest().setSubsetOfAttributes([1]).setFlags(QgsFeatureRequest.NoGeometry)
+        f = provider.getFeatures(request).next()
+        assert f['age'] == 2, f['age']
+        assert f['name'] is None, f['name']
+        assert f.geometry() is None
+
+        provider.addAttributes([QgsField("extra", QVariant.Int)])
+        provider.deleteAttributes([0])
+        f = provider.getFeatures(QgsFeatureRequest(ids[9])).next()
+        assert f.attributes() == [9, None, None], f.attributes()
+
+    def testColumnarStorageTypes(self):
+        """Test date/time and boolean values keep their type in columns"""
+        values = [QDateTime(QDate(2014, 5, 17), QTime(13, 45, 12, 345)),
+                  QTime(8, 5, 3, 21),
+                  QDate(2014, 5, 17),
+                  True]
+        results = []
+        for storage in ['', '&storage=columnar']:
+            layer = QgsVectorLayer('Point?field=name:string' + storage, 'test', 'memory')
+            assert layer.isValid(), "Failed to create memory layer"
+            provider = layer.dataProvider()
+            provider.addAttributes([QgsField("datetime", QVariant.DateTime),
+                                    QgsField("time", QVariant.Time),
+                                    QgsField("date", QVariant.Date),
+                                    QgsField("flag", QVariant.Bool)])
+            assert len(provider.fields()) == 5, len(provider.fields())
+
+            ft = QgsFeature()
+            ft.setAttributes(["a"] + values)
+            ft2 = QgsFeature()
+            ft2.setAttributes(["b", None, None, None, False])
+            res, added = provider.addFeatures([ft, ft2])
+            assert res, "Failed to add features"
+
+            f = provider.getFeatures(QgsFeatureRequest(added[0].id())).next()
+            assert f.attributes()[1:] == values, f.attributes()
+            f = provider.getFeatures(QgsFeatureRequest(added[1].id())).next()
+            assert f.attributes()[1:] == [None, None, None, False], f.attributes()
+            results.append(f.attributes())
+
+        assert results[0] == results[1], results
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -15,7 +15,7 @@ __revision__ = '$Format:%H$'
 import os
 import qgis
 
-from PyQt4.QtCore import QDir
+from PyQt4.QtCore import QDir, QVariant
 
 from qgis.core import (QgsVectorLayer,
                        QgsFeature,
@@ -59,5 +59,46 @@ class TestQgsVectorLayer(TestCase):
 
         writeShape(self.mMemoryLayer, 'writetest.shp')
 
+    def testWriteManyFeatures(self):
+        """Check that features written in several blocks keep their
+        attributes and geometries, including null values."""
+        myMemoryLayer = QgsVectorLayer(
+            ('Point?crs=epsg:4326&field=name:string(20)&'
+            'field=age:integer'),
+            'test',
+            'memory')
+        myProvider = myMemoryLayer.dataProvider()
+
+        myFeatures = []
+        for i in range(2500):
+            ft = QgsFeature()
+            if i % 3 != 0:
+                ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(i, -i)))
+            if i % 2 == 0:
+                ft.setAttributes(['name%d' % i, i])
+            else:
+                ft.setAttributes([QVariant(), QVariant()])
+            myFeatures.append(ft)
+        myResult, myFeatures = myProvider.addFeatures(myFeatures)
+        assert myResult == True
+
+        writeShape(myMemoryLayer, 'writemanytest.shp')
+
+        myFileName = os.path.join(str(QDir.tempPath()), 'writemanytest.shp')
+        myLayer = QgsVectorLayer(myFileName, 'test', 'ogr')
+        assert myLayer.isValid()
+        self.assertEqual(myLayer.featureCount(), 2500)
+
+        for i, ft in enumerate(myLayer.getFeatures()):
+            if i % 3 != 0:
+                self.assertEqual(ft.geometry().asPoint(), QgsPoint(i, -i))
+            else:
+                assert ft.geometry() is None or ft.geometry().isGeosEmpty()
+            if i % 2 == 0:
+                self.assertEqual(ft[0], 'name%d' % i)
+                self.assertEqual(ft[1], i)
+            else:
+                assert ft[0] is None or ft[0] == '' or ft[0].isNull()
+
 if __name__ == '__main__':
     unittest.main()
@@ -882,6 +882,41 @@ class TestQgsVectorLayer(TestCase):
         assert f2[2] == "foo"
         assert f2[3] == 321
 
+    def test_joinWithoutMemoryCache(self):
+
+        joinLayer = createJoinLayer()
+        QgsMapLayerRegistry.instance().addMapLayers([joinLayer])
+
+        layer = QgsVectorLayer("Point?field=fldtxt:string&field=fldint:integer",
+                               "addfeat", "memory")
+        pr = layer.dataProvider()
+        feats = []
+        for txt, val in [("a", 456), ("b", 999), ("c", 123)]:
+            f = QgsFeature()
+            f.setAttributes([txt, val])
+            f.setGeometry(QgsGeometry.fromPoint(QgsPoint(100,200)))
+            feats.append(f)
+        assert pr.addFeatures(feats)
+
+        join = QgsVectorJoinInfo()
+        join.targetFieldName = "fldint"
+        join.joinLayerId = joinLayer.id()
+        join.joinFieldName = "y"
+        join.memoryCache = False
+
+        layer.addJoin(join)
+
+        joined = {}
+        for f in layer.getFeatures():
+            attrs = f.attributes()
+            assert len(attrs) == 4
+            joined[attrs[0]] = (attrs[2], attrs[3])
+
+        assert joined["a"] == ("bar", 654)
+        assert joined["c"] == ("foo", 321)
+        # no matching feature in the join layer
+        assert joined["b"] == (None, None)
+
     def test_InvalidOperations(self):
         layer = createLayerWithOnePoint()
 